@@ -15,6 +15,7 @@
 #include "IRPrinter.h"
 #include "IRVisitor.h"
 #include "InlineReductions.h"
+#include "LoweringCache.h"
 #include "Param.h"
 #include "PurifyIndexMath.h"
 #include "Simplify.h"
@@ -1636,7 +1637,9 @@ private:
 
 }  // namespace
 
-Interval bounds_of_expr_in_scope(const Expr &expr, const Scope<Interval> &scope, const FuncValueBounds &fb, bool const_bound) {
+namespace {
+
+Interval bounds_of_expr_in_scope_uncached(const Expr &expr, const Scope<Interval> &scope, const FuncValueBounds &fb, bool const_bound) {
     //debug(3) << "computing bounds_of_expr_in_scope " << expr << "\n";
     Bounds b(&scope, fb, const_bound);
     expr.accept(&b);
@@ -1657,6 +1660,14 @@ Interval bounds_of_expr_in_scope(const Expr &expr, const Scope<Interval> &scope,
     return b.interval;
 }
 
+}  // namespace
+
+Interval bounds_of_expr_in_scope(const Expr &expr, const Scope<Interval> &scope, const FuncValueBounds &fb, bool const_bound) {
+    return cached_bounds_of_expr_in_scope(expr, scope, fb, const_bound, [&]() {
+        return bounds_of_expr_in_scope_uncached(expr, scope, fb, const_bound);
+    });
+}
+
 Region region_union(const Region &a, const Region &b) {
     internal_assert(a.size() == b.size()) << "Mismatched dimensionality in region union\n";
     Region result;
@@ -2693,8 +2704,10 @@ private:
 
 }  // namespace
 
-map<string, Box> boxes_touched(const Expr &e, Stmt s, bool consider_calls, bool consider_provides,
-                               const string &fn, const Scope<Interval> &scope, const FuncValueBounds &fb) {
+namespace {
+
+map<string, Box> boxes_touched_uncached(const Expr &e, Stmt s, bool consider_calls, bool consider_provides,
+                                        const string &fn, const Scope<Interval> &scope, const FuncValueBounds &fb) {
     if (!fn.empty() && s.defined()) {
         // Filter things down to the relevant sub-Stmts, so we don't spend a
         // long time reasoning about lets and ifs that don't surround an
@@ -2807,6 +2820,15 @@ map<string, Box> boxes_touched(const Expr &e, Stmt s, bool consider_calls, bool
     return calls.boxes;
 }
 
+}  // namespace
+
+map<string, Box> boxes_touched(const Expr &e, Stmt s, bool consider_calls, bool consider_provides,
+                               const string &fn, const Scope<Interval> &scope, const FuncValueBounds &fb) {
+    return cached_boxes_touched(e, s, consider_calls, consider_provides, fn, scope, fb, [&]() {
+        return boxes_touched_uncached(e, std::move(s), consider_calls, consider_provides, fn, scope, fb);
+    });
+}
+
 Box box_touched(const Expr &e, Stmt s, bool consider_calls, bool consider_provides,
                 const string &fn, const Scope<Interval> &scope, const FuncValueBounds &fb) {
     map<string, Box> boxes = boxes_touched(e, std::move(s), consider_calls, consider_provides, fn, scope, fb);
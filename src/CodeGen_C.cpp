@@ -2521,7 +2521,12 @@ void CodeGen_C::visit(const For *op) {
     string id_extent = print_expr(op->extent);
 
     if (op->for_type == ForType::Parallel) {
-        stream << get_indent() << "#pragma omp parallel for\n";
+        int grain = get_parallel_min_grain(op);
+        if (grain > 1) {
+            stream << get_indent() << "#pragma omp parallel for schedule(dynamic, " << grain << ")\n";
+        } else {
+            stream << get_indent() << "#pragma omp parallel for\n";
+        }
     } else {
         internal_assert(op->for_type == ForType::Serial)
             << "Can only emit serial or parallel for loops to C\n";
@@ -2730,6 +2735,12 @@ void CodeGen_C::visit(const Evaluate *op) {
     if (is_const(op->value)) {
         return;
     }
+    if (const Call *c = op->value.as<Call>()) {
+        if (c->is_intrinsic(Call::parallel_min_grain)) {
+            // Already handled by the enclosing parallel loop.
+            return;
+        }
+    }
     string id = print_expr(op->value);
     stream << get_indent() << "halide_unused(" << id << ");\n";
 }
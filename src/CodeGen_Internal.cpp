@@ -2,6 +2,7 @@
 #include "CSE.h"
 #include "Debug.h"
 #include "IRMutator.h"
+#include "IRVisitor.h"
 #include "IROperator.h"
 #include "IntegerDivisionTable.h"
 #include "LLVM_Headers.h"
@@ -200,6 +201,7 @@ bool function_takes_user_context(const std::string &name) {
         "halide_device_and_host_malloc",
         "halide_device_sync",
         "halide_do_par_for",
+        "halide_do_par_for_with_min_grain",
         "halide_do_loop_task",
         "halide_do_task",
         "halide_do_async_consumer",
@@ -632,6 +634,32 @@ Expr lower_mux(const Call *mux) {
     return equiv;
 }
 
+int get_parallel_min_grain(const For *op) {
+    // Look for the marker left by build_loop_nest, skipping over any
+    // inner loops, which may have markers of their own.
+    class FindMinGrain : public IRVisitor {
+        using IRVisitor::visit;
+
+        void visit(const For *op) override {
+        }
+
+        void visit(const Call *op) override {
+            if (op->is_intrinsic(Call::parallel_min_grain)) {
+                const int64_t *grain = as_const_int(op->args[0]);
+                internal_assert(grain) << "parallel_min_grain with non-constant argument\n";
+                result = std::max(result, (int)*grain);
+            } else {
+                IRVisitor::visit(op);
+            }
+        }
+
+    public:
+        int result = 0;
+    } finder;
+    op->body.accept(&finder);
+    return finder.result;
+}
+
 bool get_md_bool(llvm::Metadata *value, bool &result) {
     if (!value) {
         return false;
@@ -120,6 +120,10 @@ Expr lower_signed_shift_right(const Expr &a, const Expr &b);
 /** Reduce a mux intrinsic to a select tree */
 Expr lower_mux(const Call *mux);
 
+/** Get the minimum grain size Func::min_grain recorded in the body of
+ * a parallel loop, or zero if there isn't one. */
+int get_parallel_min_grain(const For *op);
+
 /** Given an llvm::Module, set llvm:TargetOptions, cpu and attr information */
 void get_target_options(const llvm::Module &module, llvm::TargetOptions &options, std::string &mcpu, std::string &mattrs);
 
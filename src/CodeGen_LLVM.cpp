@@ -545,6 +545,8 @@ void CodeGen_LLVM::init_codegen(const std::string &name, bool any_strict_float)
 }
 
 std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
+    auto time_start = std::chrono::high_resolution_clock::now();
+
     init_codegen(input.name(), input.any_strict_float());
 
     internal_assert(module && context && builder)
@@ -577,6 +579,18 @@ std::unique_ptr<llvm::Module> CodeGen_LLVM::compile(const Module &input) {
 
     debug(2) << module.get() << "\n";
 
+    auto *logger = get_compiler_logger();
+    if (logger) {
+        auto time_end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> diff = time_end - time_start;
+        int64_t ir_size = 0;
+        for (const auto &f : input.functions()) {
+            ir_size += count_ir_nodes(f.body);
+        }
+        logger->record_compilation_pass("codegen_llvm", diff.count(), ir_size,
+                                        module->getInstructionCount(), get_peak_memory_usage());
+    }
+
     return finish_codegen();
 }
 
@@ -687,8 +701,79 @@ void CodeGen_LLVM::end_func(const std::vector<LoweredArgument> &args) {
     current_function_args.clear();
 }
 
+namespace {
+
+// Find the branches of if-else chains outside of any loop (or task) in
+// which more than one branch contains a loop.
+class FindLazyBranches : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const For *op) override {
+    }
+
+    void visit(const Fork *op) override {
+    }
+
+    void visit(const Acquire *op) override {
+    }
+
+    static bool contains_loop(const Stmt &s) {
+        class ContainsLoop : public IRVisitor {
+            using IRVisitor::visit;
+            void visit(const For *op) override {
+                result = true;
+            }
+
+        public:
+            bool result = false;
+        } c;
+        s.accept(&c);
+        return c.result;
+    }
+
+    void visit(const IfThenElse *op) override {
+        vector<Stmt> branches;
+        const IfThenElse *next_if = op;
+        do {
+            branches.push_back(next_if->then_case);
+            const Stmt &else_case = next_if->else_case;
+            next_if = else_case.defined() ? else_case.as<IfThenElse>() : nullptr;
+            if (else_case.defined() && !next_if) {
+                branches.push_back(else_case);
+            }
+        } while (next_if);
+
+        vector<const IRNode *> with_loops;
+        for (const Stmt &b : branches) {
+            if (contains_loop(b)) {
+                with_loops.push_back(b.get());
+            }
+        }
+        if (with_loops.size() > 1) {
+            result.insert(with_loops.begin(), with_loops.end());
+        }
+        for (const Stmt &b : branches) {
+            b.accept(this);
+        }
+    }
+
+public:
+    std::set<const IRNode *> result;
+};
+
+}  // namespace
+
 void CodeGen_LLVM::compile_func(const LoweredFunc &f, const std::string &simple_name,
                                 const std::string &extern_name) {
+    // The JIT can defer compiling specializations until they first
+    // run, if they are in functions of their own.
+    lazy_branches.clear();
+    if (target.has_feature(Target::JIT) && get_env_variable("HL_JIT_LAZY") == "1") {
+        FindLazyBranches finder;
+        f.body.accept(&finder);
+        lazy_branches = std::move(finder.result);
+    }
+
     // Generate the function declaration and argument unpacking code.
     begin_func(f.linkage, simple_name, extern_name, f.args);
 
@@ -1127,6 +1212,7 @@ void CodeGen_LLVM::optimize_module() {
     debug(3) << "Optimizing module\n";
 
     auto time_start = std::chrono::high_resolution_clock::now();
+    const int64_t instructions_before = get_compiler_logger() ? module->getInstructionCount() : 0;
 
     if (debug::debug_level() >= 3) {
         module->print(dbgs(), nullptr, false, true);
@@ -1296,6 +1382,8 @@ void CodeGen_LLVM::optimize_module() {
         auto time_end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> diff = time_end - time_start;
         logger->record_compilation_time(CompilerLogger::Phase::LLVM, diff.count());
+        logger->record_compilation_pass("llvm_optimize", diff.count(), instructions_before,
+                                        module->getInstructionCount(), get_peak_memory_usage());
     }
 }
 
@@ -3175,6 +3263,9 @@ void CodeGen_LLVM::visit(const Call *op) {
         user_error << "Signed integer overflow occurred during constant-folding. Signed"
                       " integer overflow for int32 and int64 is undefined behavior in"
                       " Halide.\n";
+    } else if (op->is_intrinsic(Call::parallel_min_grain)) {
+        // Only a hint to do_parallel_tasks, which has already dealt with it.
+        value = ConstantInt::get(i32_t, 0);
     } else if (op->is_intrinsic(Call::undef)) {
         value = UndefValue::get(llvm_type_of(op->type));
     } else if (op->is_intrinsic(Call::size_of_halide_buffer_t)) {
@@ -3868,7 +3959,15 @@ void CodeGen_LLVM::do_parallel_tasks(const vector<ParallelTask> &tasks) {
         Value *extent = codegen(t.extent);
         Value *serial = codegen(cast(UInt(8), t.serial));
 
-        if (use_do_par_for) {
+        if (use_do_par_for && t.min_grain > 1) {
+            llvm::Function *do_par_for = module->getFunction("halide_do_par_for_with_min_grain");
+            internal_assert(do_par_for) << "Could not find halide_do_par_for_with_min_grain in initial module\n";
+            do_par_for->addParamAttr(4, Attribute::NoAlias);
+            Value *args[] = {get_user_context(), task_ptr, min, extent, closure_ptr,
+                             ConstantInt::get(i32_t, t.min_grain)};
+            debug(4) << "Creating call to do_par_for_with_min_grain\n";
+            result = builder->CreateCall(do_par_for, args);
+        } else if (use_do_par_for) {
             llvm::Function *do_par_for = module->getFunction("halide_do_par_for");
             internal_assert(do_par_for) << "Could not find halide_do_par_for in initial module\n";
             do_par_for->addParamAttr(4, Attribute::NoAlias);
@@ -3956,7 +4055,7 @@ void CodeGen_LLVM::get_parallel_tasks(const Stmt &s, vector<ParallelTask> &resul
         const Variable *v = acquire->semaphore.as<Variable>();
         internal_assert(v);
         add_suffix(prefix, "." + v->name);
-        ParallelTask t{s, {}, "", 0, 1, const_false(), task_debug_name(prefix)};
+        ParallelTask t{s, {}, "", 0, 1, const_false(), task_debug_name(prefix), 0};
         while (acquire) {
             t.semaphores.push_back({acquire->semaphore, acquire->count});
             t.body = acquire->body;
@@ -3965,7 +4064,7 @@ void CodeGen_LLVM::get_parallel_tasks(const Stmt &s, vector<ParallelTask> &resul
         result.push_back(t);
     } else if (loop && loop->for_type == ForType::Parallel) {
         add_suffix(prefix, ".par_for." + loop->name);
-        result.push_back(ParallelTask{loop->body, {}, loop->name, loop->min, loop->extent, const_false(), task_debug_name(prefix)});
+        result.push_back(ParallelTask{loop->body, {}, loop->name, loop->min, loop->extent, const_false(), task_debug_name(prefix), get_parallel_min_grain(loop)});
     } else if (loop &&
                loop->for_type == ForType::Serial &&
                acquire &&
@@ -3973,7 +4072,7 @@ void CodeGen_LLVM::get_parallel_tasks(const Stmt &s, vector<ParallelTask> &resul
         const Variable *v = acquire->semaphore.as<Variable>();
         internal_assert(v);
         add_suffix(prefix, ".for." + v->name);
-        ParallelTask t{loop->body, {}, loop->name, loop->min, loop->extent, const_true(), task_debug_name(prefix)};
+        ParallelTask t{loop->body, {}, loop->name, loop->min, loop->extent, const_true(), task_debug_name(prefix), 0};
         while (acquire) {
             t.semaphores.push_back({acquire->semaphore, acquire->count});
             t.body = acquire->body;
@@ -3982,7 +4081,7 @@ void CodeGen_LLVM::get_parallel_tasks(const Stmt &s, vector<ParallelTask> &resul
         result.push_back(t);
     } else {
         add_suffix(prefix, "." + std::to_string(result.size()));
-        result.push_back(ParallelTask{s, {}, "", 0, 1, const_false(), task_debug_name(prefix)});
+        result.push_back(ParallelTask{s, {}, "", 0, 1, const_false(), task_debug_name(prefix), 0});
     }
 }
 
@@ -4191,6 +4290,68 @@ void CodeGen_LLVM::visit(const Provide *op) {
     internal_error << "Provide encountered during codegen\n";
 }
 
+void CodeGen_LLVM::codegen_branch(const Stmt &s) {
+    if (!lazy_branches.count(s.get())) {
+        codegen(s);
+        return;
+    }
+
+    // As for a parallel task, pass everything the branch uses in a
+    // closure.
+    Closure closure;
+    s.accept(&closure);
+    StructType *closure_t = build_closure_type(closure, halide_buffer_t_type, context);
+    Value *closure_ptr = create_alloca_at_entry(closure_t, 1);
+    pack_closure(closure_t, closure_ptr, closure, symbol_table, halide_buffer_t_type, builder);
+    closure_ptr = builder->CreatePointerCast(closure_ptr, i8_t->getPointerTo());
+
+    llvm::Type *args_t[] = {i8_t->getPointerTo(), i8_t->getPointerTo()};
+    FunctionType *branch_t = FunctionType::get(i32_t, args_t, false);
+
+    // Make a new function that does the branch. The JIT recognizes it
+    // by its attribute, and it must not be inlined back into its
+    // caller.
+    llvm::Function *containing_function = function;
+    function = llvm::Function::Create(branch_t, llvm::Function::InternalLinkage,
+                                      containing_function->getName() + ".branch", module.get());
+    llvm::Function *branch_fn = function;
+    function->addParamAttr(1, Attribute::NoAlias);
+    set_function_attributes_for_target(function, target);
+    function->addFnAttr(Attribute::NoInline);
+    function->addFnAttr("halide-jit-lazy");
+
+    IRBuilderBase::InsertPoint call_site = builder->saveIP();
+    BasicBlock *block = BasicBlock::Create(*context, "entry", function);
+    builder->SetInsertPoint(block);
+
+    BasicBlock *parent_destructor_block = destructor_block;
+    destructor_block = nullptr;
+
+    Scope<Value *> saved_symbol_table;
+    symbol_table.swap(saved_symbol_table);
+
+    llvm::Function::arg_iterator iter = function->arg_begin();
+    sym_push("__user_context", iterator_to_pointer(iter));
+    ++iter;
+    iter->setName("closure");
+    Value *closure_handle = builder->CreatePointerCast(iterator_to_pointer(iter),
+                                                       closure_t->getPointerTo());
+    unpack_closure(closure, symbol_table, closure_t, closure_handle, builder);
+
+    codegen(s);
+    return_with_error_code(ConstantInt::get(i32_t, 0));
+
+    builder->restoreIP(call_site);
+    symbol_table.swap(saved_symbol_table);
+    function = containing_function;
+    destructor_block = parent_destructor_block;
+
+    Value *args[] = {get_user_context(), closure_ptr};
+    Value *result = builder->CreateCall(branch_fn, args);
+    Value *did_succeed = builder->CreateICmpEQ(result, ConstantInt::get(i32_t, 0));
+    create_assertion(did_succeed, Expr(), result);
+}
+
 void CodeGen_LLVM::visit(const IfThenElse *op) {
 
     // Gather the conditions and values in an if-else chain
@@ -4238,13 +4399,13 @@ void CodeGen_LLVM::visit(const IfThenElse *op) {
             BasicBlock *case_bb = BasicBlock::Create(*context, name, function);
             switch_inst->addCase(ConstantInt::get(IntegerType::get(*context, 32), rhs[i]), case_bb);
             builder->SetInsertPoint(case_bb);
-            codegen(blocks[i].second);
+            codegen_branch(blocks[i].second);
             builder->CreateBr(after_bb);
         }
 
         builder->SetInsertPoint(default_bb);
         if (final_else.defined()) {
-            codegen(final_else);
+            codegen_branch(final_else);
         }
         builder->CreateBr(after_bb);
 
@@ -4259,13 +4420,13 @@ void CodeGen_LLVM::visit(const IfThenElse *op) {
             BasicBlock *next_bb = BasicBlock::Create(*context, "next_bb", function);
             builder->CreateCondBr(codegen(p.first), then_bb, next_bb);
             builder->SetInsertPoint(then_bb);
-            codegen(p.second);
+            codegen_branch(p.second);
             builder->CreateBr(after_bb);
             builder->SetInsertPoint(next_bb);
         }
 
         if (final_else.defined()) {
-            codegen(final_else);
+            codegen_branch(final_else);
         }
         builder->CreateBr(after_bb);
 
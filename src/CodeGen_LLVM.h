@@ -34,6 +34,7 @@ class GlobalVariable;
 
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -288,12 +289,24 @@ protected:
         Expr min, extent;
         Expr serial;
         std::string name;
+        int min_grain;
     };
     int task_depth;
     void get_parallel_tasks(const Stmt &s, std::vector<ParallelTask> &tasks, std::pair<std::string, int> prefix);
     void do_parallel_tasks(const std::vector<ParallelTask> &tasks);
     void do_as_parallel_task(const Stmt &s);
 
+    /** When JIT compiling with HL_JIT_LAZY=1, the branches of if-else
+     * chains outside of any loop in which more than one branch
+     * contains a loop, such as those made by specialize(). Each is
+     * compiled to a function of its own, which the JIT defers
+     * compiling until it is first called. */
+    std::set<const IRNode *> lazy_branches;
+
+    /** Codegen a branch of an if-else chain, moving it into a function
+     * of its own if it's one of the lazy_branches. */
+    void codegen_branch(const Stmt &s);
+
     /** Return the the pipeline with the given error code. Will run
      * the destructor block. */
     void return_with_error_code(llvm::Value *error_code);
@@ -2,11 +2,13 @@
 
 #include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <set>
 #include <vector>
 
 #include "IRMutator.h"
+#include "IRVisitor.h"
 #include "Util.h"
 
 namespace Halide {
@@ -17,7 +19,10 @@ namespace {
 // TODO: for now we are just going to ignore potential issues with
 // static-initialization-order-fiasco, as CompilerLogger isn't currently used
 // from any static-initialization execution scope.
-std::unique_ptr<CompilerLogger> active_compiler_logger;
+//
+// Each thread has its own, so that compile_multitarget can log the
+// sub-targets it compiles in parallel separately.
+thread_local std::unique_ptr<CompilerLogger> active_compiler_logger;
 
 class ObfuscateNames : public IRMutator {
     using IRMutator::visit;
@@ -74,6 +79,24 @@ public:
     }
 };
 
+class CountIRNodes : public IRGraphVisitor {
+    using IRGraphVisitor::include;
+    using IRGraphVisitor::visit;
+
+    void include(const Expr &e) override {
+        count++;
+        IRGraphVisitor::include(e);
+    }
+
+    void include(const Stmt &s) override {
+        count++;
+        IRGraphVisitor::include(s);
+    }
+
+public:
+    int64_t count = 0;
+};
+
 }  // namespace
 
 std::unique_ptr<CompilerLogger> set_compiler_logger(std::unique_ptr<CompilerLogger> compiler_logger) {
@@ -86,6 +109,34 @@ CompilerLogger *get_compiler_logger() {
     return active_compiler_logger.get();
 }
 
+int64_t count_ir_nodes(const Stmt &s) {
+    if (!s.defined()) {
+        return 0;
+    }
+    CountIRNodes counter;
+    s.accept(&counter);
+    // The root isn't passed to include().
+    return counter.count + 1;
+}
+
+CompilerPassLogger::CompilerPassLogger()
+    : logger(get_compiler_logger()),
+      last_time(std::chrono::high_resolution_clock::now()) {
+}
+
+void CompilerPassLogger::record(const std::string &pass_name, const Stmt &s) {
+    if (!logger) {
+        return;
+    }
+    auto now = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> diff = now - last_time;
+    int64_t ir_size = count_ir_nodes(s);
+    logger->record_compilation_pass(pass_name, diff.count(), last_ir_size, ir_size, get_peak_memory_usage());
+    last_ir_size = ir_size;
+    // Don't charge the next pass for the time spent counting.
+    last_time = std::chrono::high_resolution_clock::now();
+}
+
 JSONCompilerLogger::JSONCompilerLogger(
     const std::string &generator_name,
     const std::string &function_name,
@@ -120,6 +171,12 @@ void JSONCompilerLogger::record_compilation_time(Phase phase, double duration) {
     compilation_time[phase] += duration;
 }
 
+void JSONCompilerLogger::record_compilation_pass(const std::string &pass_name, double duration,
+                                                 int64_t ir_size_before, int64_t ir_size_after,
+                                                 uint64_t peak_memory) {
+    compilation_passes.push_back({pass_name, duration, ir_size_before, ir_size_after, peak_memory});
+}
+
 void JSONCompilerLogger::obfuscate() {
     {
         std::map<std::string, std::vector<Expr>> n;
@@ -282,6 +339,24 @@ std::ostream &JSONCompilerLogger::emit_to_stream(std::ostream &o) {
         emit_key_value(o, indent, "compilation_time_llvm", compilation_time[Phase::LLVM]);
     }
 
+    if (!compilation_passes.empty()) {
+        emit_key(o, indent, "compilation_passes");
+        o << "[\n";
+        for (size_t i = 0; i < compilation_passes.size(); i++) {
+            const PassRecord &p = compilation_passes[i];
+            o << std::string(indent + 1, ' ') << "{ ";
+            emit_value(o, std::string("name")) << " : ";
+            emit_value(o, p.name) << ", ";
+            emit_value(o, std::string("time")) << " : " << p.duration << ", ";
+            emit_value(o, std::string("ir_size_before")) << " : " << p.ir_size_before << ", ";
+            emit_value(o, std::string("ir_size_after")) << " : " << p.ir_size_after << ", ";
+            emit_value(o, std::string("peak_memory")) << " : " << p.peak_memory << " }";
+            emit_eol(o, i + 1 < compilation_passes.size());
+        }
+        o << std::string(indent, ' ') << "]";
+        emit_eol(o);
+    }
+
     if (!matched_simplifier_rules.empty()) {
         emit_object_key_open(o, indent, "matched_simplifier_rules");
 
@@ -338,5 +413,77 @@ std::ostream &JSONCompilerLogger::emit_to_stream(std::ostream &o) {
     return o;
 }
 
+std::ostream &JSONCompilerLogger::emit_pass_summary_to_stream(std::ostream &o) {
+    if (compilation_passes.empty()) {
+        return o;
+    }
+
+    // Combine the runs of each pass, keeping the order of first appearance.
+    struct Summary {
+        int runs = 0;
+        double total = 0, max = 0;
+        int64_t ir_size_change = 0;
+        uint64_t peak_memory_growth = 0;
+    };
+    std::vector<std::string> names;
+    std::map<std::string, Summary> summaries;
+    double total = 0;
+    uint64_t last_peak_memory = 0;
+    for (const PassRecord &p : compilation_passes) {
+        if (!summaries.count(p.name)) {
+            names.push_back(p.name);
+        }
+        Summary &sum = summaries[p.name];
+        sum.runs++;
+        sum.total += p.duration;
+        sum.max = std::max(sum.max, p.duration);
+        sum.ir_size_change += p.ir_size_after - p.ir_size_before;
+        if (last_peak_memory && p.peak_memory > last_peak_memory) {
+            sum.peak_memory_growth += p.peak_memory - last_peak_memory;
+        }
+        last_peak_memory = std::max(last_peak_memory, p.peak_memory);
+        total += p.duration;
+    }
+    std::stable_sort(names.begin(), names.end(), [&](const std::string &a, const std::string &b) {
+        return summaries[a].total > summaries[b].total;
+    });
+
+    size_t name_width = 4;
+    for (const auto &n : names) {
+        name_width = std::max(name_width, n.size());
+    }
+
+    std::ios_base::fmtflags flags = o.flags();
+    std::streamsize precision = o.precision();
+    o << std::left << std::setw(name_width) << "pass" << std::right
+      << std::setw(6) << "runs"
+      << std::setw(12) << "total ms"
+      << std::setw(8) << "%"
+      << std::setw(12) << "max ms"
+      << std::setw(14) << "IR change"
+      << std::setw(14) << "peak mem +KB"
+      << "\n";
+    o << std::fixed;
+    for (const auto &n : names) {
+        const Summary &sum = summaries[n];
+        o << std::left << std::setw(name_width) << n << std::right
+          << std::setw(6) << sum.runs
+          << std::setw(12) << std::setprecision(3) << sum.total * 1000
+          << std::setw(8) << std::setprecision(1) << (total > 0 ? 100 * sum.total / total : 0.0)
+          << std::setw(12) << std::setprecision(3) << sum.max * 1000
+          << std::setw(14) << sum.ir_size_change
+          << std::setw(14) << sum.peak_memory_growth / 1024
+          << "\n";
+    }
+    o << std::left << std::setw(name_width) << "total" << std::right
+      << std::setw(6) << compilation_passes.size()
+      << std::setw(12) << std::setprecision(3) << total * 1000
+      << "\n";
+    o.flags(flags);
+    o.precision(precision);
+
+    return o;
+}
+
 }  // namespace Internal
 }  // namespace Halide
@@ -10,11 +10,13 @@
  * replaced by custom definitions if you have unusual logging needs.
  */
 
+#include <chrono>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "Expr.h"
 #include "Target.h"
@@ -53,23 +55,70 @@ public:
      */
     virtual void record_compilation_time(Phase phase, double duration) = 0;
 
+    /** Record one run of a pass of compilation: its wall time (in
+     * seconds), the size of the IR it was given and the size of the
+     * IR it produced (in IR nodes for Halide passes, and in
+     * instructions for LLVM passes), and the peak memory use of the
+     * process (in bytes) when it finished. The default implementation
+     * ignores it, so that existing loggers need not implement it.
+     */
+    virtual void record_compilation_pass(const std::string &pass_name, double duration,
+                                         int64_t ir_size_before, int64_t ir_size_after,
+                                         uint64_t peak_memory) {
+    }
+
+    /** Emit a human-readable summary of the recorded passes to the
+     * given stream. The default implementation emits nothing.
+     */
+    virtual std::ostream &emit_pass_summary_to_stream(std::ostream &o) {
+        return o;
+    }
+
     /**
      * Emit all the gathered data to the given stream. This may be called multiple times.
      */
     virtual std::ostream &emit_to_stream(std::ostream &o) = 0;
 };
 
-/** Set the active CompilerLogger object, replacing any existing one.
- * It is legal to pass in a nullptr (which means "don't do any compiler logging").
- * Returns the previous CompilerLogger (if any). */
+/** Set the active CompilerLogger object for the calling thread, replacing any
+ * existing one. It is legal to pass in a nullptr (which means "don't do any
+ * compiler logging"). Returns the previous CompilerLogger (if any).
+ *
+ * The logger is per-thread, and is not forwarded to other threads:
+ * compilation work done on another thread is only logged if a logger
+ * was set on that thread too. compile_multitarget sets one up in each
+ * of its worker threads from the CompilerLoggerFactory, so each
+ * sub-target is logged separately. Lowering doesn't run its loops in
+ * parallel while the calling thread has a logger, and parallel code
+ * generation records its totals on the calling thread, so everything
+ * else is logged by the thread that set the logger. */
 std::unique_ptr<CompilerLogger> set_compiler_logger(std::unique_ptr<CompilerLogger> compiler_logger);
 
-/** Return the currently active CompilerLogger object. If set_compiler_logger()
+/** Return the currently active CompilerLogger object of the calling thread. If set_compiler_logger()
  * has never been called, a nullptr implementation will be returned.
  * Do not save the pointer returned! It is intended to be used for immediate
  * calls only. */
 CompilerLogger *get_compiler_logger();
 
+/** Count the nodes in a Stmt, counting shared subtrees once. */
+int64_t count_ir_nodes(const Stmt &s);
+
+/** Records a sequence of passes over a Stmt with the active
+ * CompilerLogger. Each call to record() logs the pass that ran since
+ * the previous call (or since construction). Does nothing, and costs
+ * nothing beyond a clock read, if there is no active CompilerLogger. */
+class CompilerPassLogger {
+public:
+    CompilerPassLogger();
+
+    void record(const std::string &pass_name, const Stmt &s);
+
+private:
+    CompilerLogger *logger;
+    std::chrono::high_resolution_clock::time_point last_time;
+    int64_t last_ir_size = 0;
+};
+
 /** JSONCompilerLogger is a basic implementation of the CompilerLogger interface
  * that saves logged data, then logs it all in JSON format in emit_to_stream().
  */
@@ -90,8 +139,12 @@ public:
     void record_failed_to_prove(Expr failed_to_prove, Expr original_expr) override;
     void record_object_code_size(uint64_t bytes) override;
     void record_compilation_time(Phase phase, double duration) override;
+    void record_compilation_pass(const std::string &pass_name, double duration,
+                                 int64_t ir_size_before, int64_t ir_size_after,
+                                 uint64_t peak_memory) override;
 
     std::ostream &emit_to_stream(std::ostream &o) override;
+    std::ostream &emit_pass_summary_to_stream(std::ostream &o) override;
 
 protected:
     const std::string generator_name;
@@ -116,6 +169,16 @@ protected:
     // Map of the time take for each phase of compilation.
     std::map<Phase, double> compilation_time;
 
+    struct PassRecord {
+        std::string name;
+        double duration;
+        int64_t ir_size_before, ir_size_after;
+        uint64_t peak_memory;
+    };
+
+    // Every pass run, in the order they ran.
+    std::vector<PassRecord> compilation_passes;
+
     void obfuscate();
     void emit();
 };
@@ -1,4 +1,5 @@
 #include "Expr.h"
+#include "IRInterning.h"
 #include "IROperator.h"  // for lossless_cast()
 
 namespace Halide {
@@ -21,7 +22,7 @@ const IntImm *IntImm::make(Type t, int64_t value) {
     IntImm *node = new IntImm;
     node->type = t;
     node->value = value;
-    return node;
+    return (const IntImm *)intern_constant_node(node);
 }
 
 const UIntImm *UIntImm::make(Type t, uint64_t value) {
@@ -37,7 +38,7 @@ const UIntImm *UIntImm::make(Type t, uint64_t value) {
     UIntImm *node = new UIntImm;
     node->type = t;
     node->value = value;
-    return node;
+    return (const UIntImm *)intern_constant_node(node);
 }
 
 const FloatImm *FloatImm::make(Type t, double value) {
@@ -63,14 +64,14 @@ const FloatImm *FloatImm::make(Type t, double value) {
         internal_error << "FloatImm must be 16, 32, or 64-bit\n";
     }
 
-    return node;
+    return (const FloatImm *)intern_constant_node(node);
 }
 
 const StringImm *StringImm::make(const std::string &val) {
     StringImm *node = new StringImm;
     node->type = type_of<const char *>();
     node->value = val;
-    return node;
+    return (const StringImm *)intern_constant_node(node);
 }
 
 /** Check if for_type executes for loop iterations in parallel and unordered. */
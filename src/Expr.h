@@ -22,7 +22,7 @@ class IRMutator;
 class IRVisitor;
 
 /** All our IR node types get unique IDs for the purposes of RTTI */
-enum class IRNodeType {
+enum class IRNodeType : uint8_t {
     // Exprs, in order of strength. Code in IRMatch.h and the
     // simplifier relies on this order for canonicalization of
     // expressions, so you may need to update those modules if you
@@ -109,6 +109,13 @@ struct IRNode {
      * anyway, so this doesn't increase the memory footprint of an IR node.
      */
     IRNodeType node_type;
+
+    /** True for Expr nodes that were made while interning was enabled
+     * (see IRInterning.h) and whose children were all interned too. No
+     * other interned node is equal to it, so two interned nodes are
+     * equal if and only if they are the same node. Shares the padding
+     * after node_type. */
+    bool interned = false;
 };
 
 template<>
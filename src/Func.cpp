@@ -1467,6 +1467,31 @@ Stage &Stage::parallel(const VarOrRVar &var, const Expr &factor, TailStrategy ta
     return *this;
 }
 
+Stage &Stage::min_grain(const VarOrRVar &var, int grain) {
+    user_assert(grain >= 1)
+        << "In schedule for " << name()
+        << ", the min_grain of " << var.name()
+        << " must be at least one.\n";
+    bool found = false;
+    vector<Dim> &dims = definition.schedule().dims();
+    for (size_t i = 0; i < dims.size(); i++) {
+        if (var_name_match(dims[i].var, var.name())) {
+            found = true;
+            dims[i].min_grain = grain;
+        }
+    }
+
+    if (!found) {
+        user_error << "In schedule for " << name()
+                   << ", could not find dimension "
+                   << var.name()
+                   << " to set the min_grain of"
+                   << " in vars for function\n"
+                   << dump_argument_list();
+    }
+    return *this;
+}
+
 Stage &Stage::vectorize(const VarOrRVar &var, const Expr &factor, TailStrategy tail) {
     if (var.is_rvar) {
         RVar tmp;
@@ -2158,6 +2183,12 @@ Func &Func::parallel(const VarOrRVar &var, const Expr &factor, TailStrategy tail
     return *this;
 }
 
+Func &Func::min_grain(const VarOrRVar &var, int grain) {
+    invalidate_cache();
+    Stage(func, func.definition(), 0).min_grain(var, grain);
+    return *this;
+}
+
 Func &Func::vectorize(const VarOrRVar &var, const Expr &factor, TailStrategy tail) {
     invalidate_cache();
     Stage(func, func.definition(), 0).vectorize(var, factor, tail);
@@ -3247,4 +3278,8 @@ void Func::compile_jit(const Target &target) {
     pipeline().compile_jit(target);
 }
 
+Callable Func::compile_to_callable(const std::vector<Argument> &args, const Target &target) {
+    return pipeline().compile_to_callable(args, target);
+}
+
 }  // namespace Halide
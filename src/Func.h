@@ -348,6 +348,7 @@ public:
     Stage &vectorize(const VarOrRVar &var);
     Stage &unroll(const VarOrRVar &var);
     Stage &parallel(const VarOrRVar &var, const Expr &task_size, TailStrategy tail = TailStrategy::Auto);
+    Stage &min_grain(const VarOrRVar &var, int grain);
     Stage &vectorize(const VarOrRVar &var, const Expr &factor, TailStrategy tail = TailStrategy::Auto);
     Stage &unroll(const VarOrRVar &var, const Expr &factor, TailStrategy tail = TailStrategy::Auto);
     Stage &tile(const VarOrRVar &x, const VarOrRVar &y,
@@ -1019,6 +1020,11 @@ public:
      */
     void compile_jit(const Target &target = get_jit_target_from_environment());
 
+    /** JIT compile the function, and return a Callable that runs it
+     * with the given arguments. See Pipeline::compile_to_callable. */
+    Callable compile_to_callable(const std::vector<Argument> &args,
+                                 const Target &target = get_jit_target_from_environment());
+
     /** Set the error handler function that be called in the case of
      * runtime errors during halide pipelines. If you are compiling
      * statically, you can also just define your own function with
@@ -1493,6 +1499,15 @@ public:
      * manually. */
     Func &parallel(const VarOrRVar &var, const Expr &task_size, TailStrategy tail = TailStrategy::Auto);
 
+    /** Run at least grain consecutive iterations of the parallel loop
+     * over var as a single task, to amortize the cost of handing out
+     * tasks when each iteration does very little. Unlike splitting
+     * the loop, this doesn't change the loop nest, so it needs no
+     * tail strategy. The thread pool may still hand out larger chunks
+     * (see halide_set_par_for_chunking). Has no effect unless var is
+     * also marked parallel. */
+    Func &min_grain(const VarOrRVar &var, int grain);
+
     /** Mark a dimension to be computed all-at-once as a single
      * vector. The dimension should have constant extent -
      * e.g. because it is the inner dimension following a split by a
@@ -1466,6 +1466,11 @@ Pipeline GeneratorBase::get_pipeline() {
     return pipeline;
 }
 
+Pipeline GeneratorBase::configure_and_build_pipeline() {
+    call_configure();
+    return build_pipeline();
+}
+
 Module GeneratorBase::build_module(const std::string &function_name,
                                    const LinkageType linkage_type) {
     AutoSchedulerResults auto_schedule_results;
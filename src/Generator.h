@@ -3049,6 +3049,11 @@ public:
 
     void emit_cpp_stub(const std::string &stub_file_path);
 
+    // Call configure() and build() (or generate() and schedule()), and
+    // return the Pipeline without compiling it, for tools that schedule
+    // and compile the Pipeline themselves.
+    Pipeline configure_and_build_pipeline();
+
     // Call build() and produce a Module for the result.
     // If function_name is empty, generator_name() will be used for the function.
     Module build_module(const std::string &function_name = "",
@@ -0,0 +1,228 @@
+#include "HostMachineParams.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "Buffer.h"
+#include "Func.h"
+#include "IROperator.h"
+#include "Param.h"
+#include "Pipeline.h"
+#include "RDom.h"
+#include "Util.h"
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+// The defaults of MachineParams::generic().
+const int default_parallelism = 16;
+const uint64_t default_last_level_cache_size = 16 * 1024 * 1024;
+const float default_balance = 40;
+
+// Read the sizes of the data caches of cpu0 from sysfs.
+std::vector<uint64_t> read_cache_sizes() {
+    std::map<int, uint64_t> sizes;
+#ifdef __linux__
+    for (int i = 0;; i++) {
+        std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+        std::ifstream type_file(dir + "type"), level_file(dir + "level"), size_file(dir + "size");
+        std::string type, size;
+        int level = 0;
+        if (!(type_file >> type) || !(level_file >> level) || !(size_file >> size)) {
+            break;
+        }
+        if (type == "Instruction" || size.empty()) {
+            continue;
+        }
+        // e.g. "48K" or "32768K"
+        uint64_t bytes = std::strtoull(size.c_str(), nullptr, 10);
+        switch (size.back()) {
+        case 'K':
+            bytes <<= 10;
+            break;
+        case 'M':
+            bytes <<= 20;
+            break;
+        case 'G':
+            bytes <<= 30;
+            break;
+        }
+        sizes[level] = std::max(sizes[level], bytes);
+    }
+#endif
+    std::vector<uint64_t> result;
+    for (const auto &it : sizes) {
+        result.push_back(it.second);
+    }
+    return result;
+}
+
+int num_threads() {
+    // The same as the runtime's default for the thread pool.
+    std::string env = get_env_variable("HL_NUM_THREADS");
+    if (env.empty()) {
+        env = get_env_variable("HL_NUMTHREADS");
+    }
+    int n = env.empty() ? (int)std::thread::hardware_concurrency() : std::atoi(env.c_str());
+    return std::max(n, 1);
+}
+
+// The fastest of a few runs of f, in seconds.
+double best_time(const std::function<void()> &f) {
+    double best = std::numeric_limits<double>::max();
+    for (int i = 0; i < 3; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// Each task runs long dependent chains of multiply-adds on a few
+// vectors that stay in registers. There are enough independent chains
+// to hide the latency of a multiply-add on current CPUs.
+class ArithmeticBenchmark {
+    static constexpr int chain_length = 32;
+
+    Param<int> iterations;
+    Func f{"arithmetic_benchmark"};
+    int lanes;
+
+public:
+    explicit ArithmeticBenchmark(const Target &target) {
+        lanes = target.natural_vector_size<float>() * 8;
+        Var x("x"), task("task");
+        RDom r(0, iterations);
+        f(x, task) = cast<float>(x + task);
+        // Loop-invariant in x, so computed once per iteration.
+        Expr b = cast<float>(r) * 1e-9f;
+        Expr e = f(x, task);
+        for (int i = 0; i < chain_length; i++) {
+            e = e * 0.999f + b;
+        }
+        f(x, task) = e;
+
+        f.bound(x, 0, lanes).vectorize(x);
+        f.update().reorder(x, r, task).vectorize(x).parallel(task);
+        f.compile_jit(target);
+    }
+
+    // Returns the floating-point operations per second with a number
+    // of tasks, each doing the given number of iterations.
+    double flops(int tasks, int n) {
+        Buffer<float> out(lanes, tasks);
+        iterations.set(n);
+        double t = best_time([&]() { f.realize(out); });
+        return (double)tasks * lanes * n * chain_length * 2 / t;
+    }
+
+    // The number of iterations that takes one task long enough to
+    // time.
+    int calibrate() {
+        Buffer<float> out(lanes, 1);
+        int n = 256;
+        while (n < (1 << 24)) {
+            iterations.set(n);
+            if (best_time([&]() { f.realize(out); }) > 0.01) {
+                break;
+            }
+            n *= 2;
+        }
+        return n;
+    }
+};
+
+// Each task sums a contiguous part of a buffer much larger than the
+// caches, with vector loads.
+class MemoryBenchmark {
+    Buffer<float> data;
+    Param<int> chunk;
+    Func f{"memory_benchmark"};
+    int lanes;
+
+public:
+    MemoryBenchmark(const Target &target, int64_t bytes) {
+        lanes = target.natural_vector_size<float>() * 4;
+        data = Buffer<float>((int)(bytes / sizeof(float) / lanes * lanes));
+        data.fill(1.0f);
+
+        Var x("x"), task("task");
+        RDom r(0, chunk / lanes);
+        f(x, task) = 0.0f;
+        f(x, task) += data(task * chunk + r * lanes + x);
+
+        f.bound(x, 0, lanes).vectorize(x);
+        f.update().reorder(x, r, task).vectorize(x).parallel(task);
+        f.compile_jit(target);
+    }
+
+    // Returns the bytes per second read by a number of tasks that
+    // split the buffer between them.
+    double bandwidth(int tasks) {
+        const int n = data.width() / lanes / tasks * lanes;
+        Buffer<float> out(lanes, tasks);
+        chunk.set(n);
+        double t = best_time([&]() { f.realize(out); });
+        return (double)tasks * n * sizeof(float) / t;
+    }
+};
+
+}  // namespace
+
+HostMachineMeasurements measure_host_machine() {
+    HostMachineMeasurements m;
+    m.cache_sizes = read_cache_sizes();
+    m.threads = num_threads();
+
+    const Target target = get_jit_target_from_environment();
+
+    ArithmeticBenchmark arithmetic(target);
+    const int iterations = arithmetic.calibrate();
+    for (int tasks = 1;; tasks = std::min(tasks * 2, m.threads)) {
+        m.flops.emplace_back(tasks, arithmetic.flops(tasks, iterations));
+        if (tasks == m.threads) {
+            break;
+        }
+    }
+
+    // Several times the size of the largest cache, so that the caches
+    // don't help. (Within reason: on machines with huge caches, this
+    // measures the last level cache instead of memory.)
+    const uint64_t llc = m.cache_sizes.empty() ? default_last_level_cache_size : m.cache_sizes.back();
+    const int64_t bytes = std::min(std::max((int64_t)llc * 8, (int64_t)64 << 20), (int64_t)512 << 20);
+    MemoryBenchmark memory(target, bytes);
+    m.single_core_memory_bandwidth = memory.bandwidth(1);
+    m.total_memory_bandwidth = memory.bandwidth(m.threads);
+
+    return m;
+}
+
+MachineParams machine_params_from_measurements(const HostMachineMeasurements &m) {
+    MachineParams params(default_parallelism, default_last_level_cache_size, default_balance);
+    if (!m.flops.empty() && m.flops.front().second > 0) {
+        double speedup = m.flops.back().second / m.flops.front().second;
+        params.parallelism = std::max(1, std::min(m.threads, (int)std::lround(speedup)));
+    }
+    if (!m.cache_sizes.empty()) {
+        params.last_level_cache_size = m.cache_sizes.back();
+    }
+    if (!m.flops.empty() && m.single_core_memory_bandwidth > 0) {
+        double loads_per_second = m.single_core_memory_bandwidth / sizeof(float);
+        params.balance = std::max(1.0f, (float)std::round(m.flops.front().second / loads_per_second));
+    }
+    return params;
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,58 @@
+#ifndef HALIDE_HOST_MACHINE_PARAMS_H
+#define HALIDE_HOST_MACHINE_PARAMS_H
+
+/** \file
+ * Defines the microbenchmarks that MachineParams::host() uses to
+ * measure the machine it runs on.
+ */
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Halide {
+
+struct MachineParams;
+
+namespace Internal {
+
+/** What measure_host_machine() found out about the host. Rates are
+ * per second, and zero if they could not be measured. */
+struct HostMachineMeasurements {
+    /** The sizes in bytes of the data caches of one core, from level
+     * 1 up. The last one is usually shared by all the cores. Empty if
+     * the OS doesn't say. */
+    std::vector<uint64_t> cache_sizes;
+
+    /** The number of threads Halide's thread pool runs on. */
+    int threads = 0;
+
+    /** Floating-point operations per second over a parallel loop with
+     * each number of tasks tried, starting with one task. The
+     * arithmetic is vectorized for the host and never touches
+     * memory. */
+    std::vector<std::pair<int, double>> flops;
+
+    /** Bytes per second read from memory by one task, and by as many
+     * tasks as there are threads. The data is well out of cache. */
+    double single_core_memory_bandwidth = 0;
+    double total_memory_bandwidth = 0;
+};
+
+/** Run the microbenchmarks. Takes about a second. */
+HostMachineMeasurements measure_host_machine();
+
+/** The MachineParams that describe the measured machine:
+ * - parallelism is the speedup of arithmetic from using all the
+ *   threads, which counts cores but not hyperthreads.
+ * - last_level_cache_size is the size of the largest cache.
+ * - balance is how many floating-point operations one core can do in
+ *   the time it loads one float from memory.
+ * Anything that wasn't measured keeps the default value that
+ * MachineParams::generic() uses. */
+MachineParams machine_params_from_measurements(const HostMachineMeasurements &m);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -1,5 +1,6 @@
 #include "IR.h"
 
+#include "IRInterning.h"
 #include "IRMutator.h"
 #include "IRPrinter.h"
 #include "IRVisitor.h"
@@ -16,7 +17,7 @@ Expr Cast::make(Type t, Expr v) {
     Cast *node = new Cast;
     node->type = t;
     node->value = std::move(v);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Add::make(Expr a, Expr b) {
@@ -28,7 +29,7 @@ Expr Add::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Sub::make(Expr a, Expr b) {
@@ -40,7 +41,7 @@ Expr Sub::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Mul::make(Expr a, Expr b) {
@@ -52,7 +53,7 @@ Expr Mul::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Div::make(Expr a, Expr b) {
@@ -64,7 +65,7 @@ Expr Div::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Mod::make(Expr a, Expr b) {
@@ -76,7 +77,7 @@ Expr Mod::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Min::make(Expr a, Expr b) {
@@ -88,7 +89,7 @@ Expr Min::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Max::make(Expr a, Expr b) {
@@ -100,7 +101,7 @@ Expr Max::make(Expr a, Expr b) {
     node->type = a.type();
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr EQ::make(Expr a, Expr b) {
@@ -112,7 +113,7 @@ Expr EQ::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr NE::make(Expr a, Expr b) {
@@ -124,7 +125,7 @@ Expr NE::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr LT::make(Expr a, Expr b) {
@@ -136,7 +137,7 @@ Expr LT::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr LE::make(Expr a, Expr b) {
@@ -148,7 +149,7 @@ Expr LE::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr GT::make(Expr a, Expr b) {
@@ -160,7 +161,7 @@ Expr GT::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr GE::make(Expr a, Expr b) {
@@ -172,7 +173,7 @@ Expr GE::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr And::make(Expr a, Expr b) {
@@ -186,7 +187,7 @@ Expr And::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Or::make(Expr a, Expr b) {
@@ -200,7 +201,7 @@ Expr Or::make(Expr a, Expr b) {
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
     node->b = std::move(b);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Not::make(Expr a) {
@@ -210,7 +211,7 @@ Expr Not::make(Expr a) {
     Not *node = new Not;
     node->type = Bool(a.type().lanes());
     node->a = std::move(a);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Select::make(Expr condition, Expr true_value, Expr false_value) {
@@ -228,7 +229,7 @@ Expr Select::make(Expr condition, Expr true_value, Expr false_value) {
     node->condition = std::move(condition);
     node->true_value = std::move(true_value);
     node->false_value = std::move(false_value);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Load::make(Type type, const std::string &name, Expr index, Buffer<> image, Parameter param, Expr predicate, ModulusRemainder alignment) {
@@ -246,7 +247,7 @@ Expr Load::make(Type type, const std::string &name, Expr index, Buffer<> image,
     node->image = std::move(image);
     node->param = std::move(param);
     node->alignment = alignment;
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Ramp::make(Expr base, Expr stride, int lanes) {
@@ -260,7 +261,7 @@ Expr Ramp::make(Expr base, Expr stride, int lanes) {
     node->base = std::move(base);
     node->stride = std::move(stride);
     node->lanes = lanes;
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Broadcast::make(Expr value, int lanes) {
@@ -271,7 +272,7 @@ Expr Broadcast::make(Expr value, int lanes) {
     node->type = value.type().with_lanes(lanes * value.type().lanes());
     node->value = std::move(value);
     node->lanes = lanes;
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Let::make(const std::string &name, Expr value, Expr body) {
@@ -283,7 +284,7 @@ Expr Let::make(const std::string &name, Expr value, Expr body) {
     node->name = name;
     node->value = std::move(value);
     node->body = std::move(body);
-    return node;
+    return intern_expr_node(node);
 }
 
 Stmt LetStmt::make(const std::string &name, Expr value, Stmt body) {
@@ -616,6 +617,7 @@ const char *const intrinsic_op_names[] = {
     "mod_round_to_zero",
     "mulhi_shr",
     "mux",
+    "parallel_min_grain",
     "popcount",
     "prefetch",
     "promise_clamped",
@@ -699,7 +701,7 @@ Expr Call::make(Type type, const std::string &name, const std::vector<Expr> &arg
     node->value_index = value_index;
     node->image = std::move(image);
     node->param = std::move(param);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Variable::make(Type type, const std::string &name, Buffer<> image, Parameter param, ReductionDomain reduction_domain) {
@@ -710,7 +712,7 @@ Expr Variable::make(Type type, const std::string &name, Buffer<> image, Paramete
     node->image = std::move(image);
     node->param = std::move(param);
     node->reduction_domain = std::move(reduction_domain);
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Shuffle::make(const std::vector<Expr> &vectors,
@@ -731,7 +733,7 @@ Expr Shuffle::make(const std::vector<Expr> &vectors,
     node->type = element_ty.with_lanes((int)indices.size());
     node->vectors = vectors;
     node->indices = indices;
-    return node;
+    return intern_expr_node(node);
 }
 
 Expr Shuffle::make_interleave(const std::vector<Expr> &vectors) {
@@ -897,7 +899,7 @@ Expr VectorReduce::make(VectorReduce::Operator op,
     node->type = vec.type().with_lanes(lanes);
     node->op = op;
     node->value = std::move(vec);
-    return node;
+    return intern_expr_node(node);
 }
 
 namespace {
@@ -528,6 +528,7 @@ struct Call : public ExprNode<Call> {
         mod_round_to_zero,
         mulhi_shr,  // Compute high_half(arg[0] * arg[1]) >> arg[3]. Note that this is a shift in addition to taking the upper half of multiply result. arg[3] must be an unsigned integer immediate.
         mux,
+        parallel_min_grain,  // Marks the body of a parallel loop with the minimum number of iterations to run as one unit. See Func::min_grain.
         popcount,
         prefetch,
         promise_clamped,
@@ -617,11 +617,26 @@ void IRComparer::visit(const VectorReduce *op) {
 }  // namespace
 
 // Now the methods exposed in the header.
+namespace {
+
+// Interned nodes are equal only if they are the same node.
+bool both_interned(const Expr &a, const Expr &b) {
+    return a.defined() && b.defined() && a.get()->interned && b.get()->interned;
+}
+
+}  // namespace
+
 bool equal(const Expr &a, const Expr &b) {
+    if (both_interned(a, b)) {
+        return a.same_as(b);
+    }
     return IRComparer().compare_expr(a, b) == IRComparer::Equal;
 }
 
 bool graph_equal(const Expr &a, const Expr &b) {
+    if (both_interned(a, b)) {
+        return a.same_as(b);
+    }
     IRCompareCache cache(8);
     return IRComparer(&cache).compare_expr(a, b) == IRComparer::Equal;
 }
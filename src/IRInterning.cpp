@@ -0,0 +1,462 @@
+#include "IRInterning.h"
+#include "IR.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+// The number of interning scopes active on this thread.
+thread_local int interning_depth = 0;
+
+// The number of interning scopes active on all threads. Protected by
+// scope_mutex, which also serializes the final sweep of the table
+// against new scopes starting.
+int active_scopes = 0;
+std::mutex scope_mutex;
+
+std::atomic<uint64_t> interning_hits{0}, interning_misses{0};
+
+inline void hash_combine(size_t &h, size_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+inline size_t hash_string(const std::string &s) {
+    return std::hash<std::string>()(s);
+}
+
+inline size_t hash_double(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return std::hash<uint64_t>()(bits);
+}
+
+// Hashes a node by its own fields and the addresses of its children.
+struct ShallowHash {
+    size_t operator()(const Expr &e) const {
+        const BaseExprNode *n = e.get();
+        size_t h = (size_t)n->node_type;
+        hash_combine(h, n->type.code());
+        hash_combine(h, n->type.bits());
+        hash_combine(h, n->type.lanes());
+        switch (n->node_type) {
+        case IRNodeType::IntImm:
+            hash_combine(h, std::hash<int64_t>()(((const IntImm *)n)->value));
+            break;
+        case IRNodeType::UIntImm:
+            hash_combine(h, std::hash<uint64_t>()(((const UIntImm *)n)->value));
+            break;
+        case IRNodeType::FloatImm:
+            hash_combine(h, hash_double(((const FloatImm *)n)->value));
+            break;
+        case IRNodeType::StringImm:
+            hash_combine(h, hash_string(((const StringImm *)n)->value));
+            break;
+        case IRNodeType::Broadcast:
+            hash_combine(h, (size_t)((const Broadcast *)n)->value.get());
+            break;
+        case IRNodeType::Cast:
+            hash_combine(h, (size_t)((const Cast *)n)->value.get());
+            break;
+        case IRNodeType::Variable:
+            hash_combine(h, hash_string(((const Variable *)n)->name));
+            break;
+        case IRNodeType::Add:
+        case IRNodeType::Sub:
+        case IRNodeType::Mod:
+        case IRNodeType::Mul:
+        case IRNodeType::Div:
+        case IRNodeType::Min:
+        case IRNodeType::Max:
+        case IRNodeType::EQ:
+        case IRNodeType::NE:
+        case IRNodeType::LT:
+        case IRNodeType::LE:
+        case IRNodeType::GT:
+        case IRNodeType::GE:
+        case IRNodeType::And:
+        case IRNodeType::Or: {
+            // All binary operators have the same layout as Add.
+            const Add *op = (const Add *)n;
+            hash_combine(h, (size_t)op->a.get());
+            hash_combine(h, (size_t)op->b.get());
+            break;
+        }
+        case IRNodeType::Not:
+            hash_combine(h, (size_t)((const Not *)n)->a.get());
+            break;
+        case IRNodeType::Select: {
+            const Select *op = (const Select *)n;
+            hash_combine(h, (size_t)op->condition.get());
+            hash_combine(h, (size_t)op->true_value.get());
+            hash_combine(h, (size_t)op->false_value.get());
+            break;
+        }
+        case IRNodeType::Load: {
+            const Load *op = (const Load *)n;
+            hash_combine(h, hash_string(op->name));
+            hash_combine(h, (size_t)op->index.get());
+            hash_combine(h, (size_t)op->predicate.get());
+            break;
+        }
+        case IRNodeType::Ramp: {
+            const Ramp *op = (const Ramp *)n;
+            hash_combine(h, (size_t)op->base.get());
+            hash_combine(h, (size_t)op->stride.get());
+            break;
+        }
+        case IRNodeType::Call: {
+            const Call *op = (const Call *)n;
+            hash_combine(h, hash_string(op->name));
+            for (const Expr &a : op->args) {
+                hash_combine(h, (size_t)a.get());
+            }
+            hash_combine(h, op->value_index);
+            break;
+        }
+        case IRNodeType::Let: {
+            const Let *op = (const Let *)n;
+            hash_combine(h, hash_string(op->name));
+            hash_combine(h, (size_t)op->value.get());
+            hash_combine(h, (size_t)op->body.get());
+            break;
+        }
+        case IRNodeType::Shuffle: {
+            const Shuffle *op = (const Shuffle *)n;
+            for (const Expr &v : op->vectors) {
+                hash_combine(h, (size_t)v.get());
+            }
+            for (int i : op->indices) {
+                hash_combine(h, i);
+            }
+            break;
+        }
+        case IRNodeType::VectorReduce: {
+            const VectorReduce *op = (const VectorReduce *)n;
+            hash_combine(h, op->op);
+            hash_combine(h, (size_t)op->value.get());
+            break;
+        }
+        default:
+            internal_error << "Can't intern a Stmt node\n";
+        }
+        return h;
+    }
+};
+
+bool same_exprs(const std::vector<Expr> &a, const std::vector<Expr> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (!a[i].same_as(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Two nodes are equal if they have the same fields and the same
+// children. Everything that isn't an Expr is compared exactly, so
+// that, for example, a Call with a strong reference to its Function
+// never stands in for one with a weak reference.
+struct ShallowEqual {
+    bool operator()(const Expr &ea, const Expr &eb) const {
+        const BaseExprNode *a = ea.get(), *b = eb.get();
+        if (a->node_type != b->node_type || !(a->type == b->type)) {
+            return false;
+        }
+        switch (a->node_type) {
+        case IRNodeType::IntImm:
+            return ((const IntImm *)a)->value == ((const IntImm *)b)->value;
+        case IRNodeType::UIntImm:
+            return ((const UIntImm *)a)->value == ((const UIntImm *)b)->value;
+        case IRNodeType::FloatImm: {
+            // Compare the bits, so that 0 and -0 stay distinct.
+            double va = ((const FloatImm *)a)->value, vb = ((const FloatImm *)b)->value;
+            return memcmp(&va, &vb, sizeof(double)) == 0;
+        }
+        case IRNodeType::StringImm:
+            return ((const StringImm *)a)->value == ((const StringImm *)b)->value;
+        case IRNodeType::Broadcast: {
+            const Broadcast *x = (const Broadcast *)a, *y = (const Broadcast *)b;
+            return x->value.same_as(y->value) && x->lanes == y->lanes;
+        }
+        case IRNodeType::Cast:
+            return ((const Cast *)a)->value.same_as(((const Cast *)b)->value);
+        case IRNodeType::Variable: {
+            const Variable *x = (const Variable *)a, *y = (const Variable *)b;
+            return (x->name == y->name &&
+                    x->param.same_as(y->param) &&
+                    x->image.same_as(y->image) &&
+                    x->reduction_domain.same_as(y->reduction_domain));
+        }
+        case IRNodeType::Add:
+        case IRNodeType::Sub:
+        case IRNodeType::Mod:
+        case IRNodeType::Mul:
+        case IRNodeType::Div:
+        case IRNodeType::Min:
+        case IRNodeType::Max:
+        case IRNodeType::EQ:
+        case IRNodeType::NE:
+        case IRNodeType::LT:
+        case IRNodeType::LE:
+        case IRNodeType::GT:
+        case IRNodeType::GE:
+        case IRNodeType::And:
+        case IRNodeType::Or: {
+            const Add *x = (const Add *)a, *y = (const Add *)b;
+            return x->a.same_as(y->a) && x->b.same_as(y->b);
+        }
+        case IRNodeType::Not:
+            return ((const Not *)a)->a.same_as(((const Not *)b)->a);
+        case IRNodeType::Select: {
+            const Select *x = (const Select *)a, *y = (const Select *)b;
+            return (x->condition.same_as(y->condition) &&
+                    x->true_value.same_as(y->true_value) &&
+                    x->false_value.same_as(y->false_value));
+        }
+        case IRNodeType::Load: {
+            const Load *x = (const Load *)a, *y = (const Load *)b;
+            return (x->name == y->name &&
+                    x->index.same_as(y->index) &&
+                    x->predicate.same_as(y->predicate) &&
+                    x->image.same_as(y->image) &&
+                    x->param.same_as(y->param) &&
+                    x->alignment == y->alignment);
+        }
+        case IRNodeType::Ramp: {
+            const Ramp *x = (const Ramp *)a, *y = (const Ramp *)b;
+            return x->base.same_as(y->base) && x->stride.same_as(y->stride) && x->lanes == y->lanes;
+        }
+        case IRNodeType::Call: {
+            const Call *x = (const Call *)a, *y = (const Call *)b;
+            return (x->name == y->name &&
+                    x->call_type == y->call_type &&
+                    x->value_index == y->value_index &&
+                    x->func.strong.same_as(y->func.strong) &&
+                    x->func.weak == y->func.weak &&
+                    x->func.idx == y->func.idx &&
+                    x->image.same_as(y->image) &&
+                    x->param.same_as(y->param) &&
+                    same_exprs(x->args, y->args));
+        }
+        case IRNodeType::Let: {
+            const Let *x = (const Let *)a, *y = (const Let *)b;
+            return x->name == y->name && x->value.same_as(y->value) && x->body.same_as(y->body);
+        }
+        case IRNodeType::Shuffle: {
+            const Shuffle *x = (const Shuffle *)a, *y = (const Shuffle *)b;
+            return x->indices == y->indices && same_exprs(x->vectors, y->vectors);
+        }
+        case IRNodeType::VectorReduce: {
+            const VectorReduce *x = (const VectorReduce *)a, *y = (const VectorReduce *)b;
+            return x->op == y->op && x->value.same_as(y->value);
+        }
+        default:
+            internal_error << "Can't intern a Stmt node\n";
+            return false;
+        }
+    }
+};
+
+bool all_interned(const std::vector<Expr> &v) {
+    for (const Expr &e : v) {
+        if (!e.get()->interned) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether a node can be marked as interned: its children must all be
+// interned, and the fields that make it distinct in the table must be
+// the ones equal() compares too. Otherwise two interned nodes that
+// equal() considers the same could be distinct, e.g. Variables with
+// the same name referring to different Parameters, or 0.0 and -0.0.
+bool can_mark_interned(const BaseExprNode *n) {
+    auto in = [](const Expr &e) { return !e.defined() || e.get()->interned; };
+    switch (n->node_type) {
+    case IRNodeType::IntImm:
+    case IRNodeType::UIntImm:
+    case IRNodeType::StringImm:
+        return true;
+    case IRNodeType::FloatImm: {
+        double v = ((const FloatImm *)n)->value;
+        return v != 0 && v == v;
+    }
+    case IRNodeType::Variable: {
+        const Variable *op = (const Variable *)n;
+        return !op->param.defined() && !op->image.defined() && !op->reduction_domain.defined();
+    }
+    case IRNodeType::Broadcast:
+        return in(((const Broadcast *)n)->value);
+    case IRNodeType::Cast:
+        return in(((const Cast *)n)->value);
+    case IRNodeType::Not:
+        return in(((const Not *)n)->a);
+    case IRNodeType::Select: {
+        const Select *op = (const Select *)n;
+        return in(op->condition) && in(op->true_value) && in(op->false_value);
+    }
+    case IRNodeType::Load: {
+        const Load *op = (const Load *)n;
+        return (!op->image.defined() && !op->param.defined() &&
+                in(op->index) && in(op->predicate));
+    }
+    case IRNodeType::Ramp: {
+        const Ramp *op = (const Ramp *)n;
+        return in(op->base) && in(op->stride);
+    }
+    case IRNodeType::Call: {
+        const Call *op = (const Call *)n;
+        return (!op->func.group() && !op->image.defined() && !op->param.defined() &&
+                all_interned(op->args));
+    }
+    case IRNodeType::Let: {
+        const Let *op = (const Let *)n;
+        return in(op->value) && in(op->body);
+    }
+    case IRNodeType::Shuffle:
+        return all_interned(((const Shuffle *)n)->vectors);
+    case IRNodeType::VectorReduce:
+        return in(((const VectorReduce *)n)->value);
+    default: {
+        const Add *op = (const Add *)n;
+        return in(op->a) && in(op->b);
+    }
+    }
+}
+
+bool is_constant_node(const BaseExprNode *n) {
+    return (n->node_type == IRNodeType::IntImm ||
+            n->node_type == IRNodeType::UIntImm ||
+            n->node_type == IRNodeType::FloatImm ||
+            n->node_type == IRNodeType::StringImm);
+}
+
+// The table is split into shards with their own locks, so that threads
+// lowering different pipelines rarely contend.
+struct Shard {
+    std::mutex mutex;
+    std::unordered_set<Expr, ShallowHash, ShallowEqual> nodes;
+    // Sweep when the table has doubled since the last sweep.
+    size_t sweep_threshold = 4096;
+
+    // Drop the nodes that only the table refers to, and return how
+    // many there were. Dropping a node may leave its children only
+    // referred to by the table, but they are left for the next
+    // sweep. Must hold the mutex.
+    size_t sweep(bool include_constants) {
+        size_t removed = 0;
+        for (auto it = nodes.begin(); it != nodes.end();) {
+            const BaseExprNode *n = it->get();
+            if (n->ref_count.is_const_one() &&
+                (include_constants || !is_constant_node(n))) {
+                it = nodes.erase(it);
+                removed++;
+            } else {
+                it++;
+            }
+        }
+        sweep_threshold = std::max((size_t)4096, nodes.size() * 2);
+        return removed;
+    }
+};
+
+const int num_shards = 16;
+Shard shards[num_shards];
+
+Expr intern(BaseExprNode *node) {
+    Expr e(node);
+    const size_t h = ShallowHash()(e);
+    Shard &shard = shards[(h >> 7) % num_shards];
+    const bool interned = can_mark_interned(node);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.nodes.find(e);
+    if (it != shard.nodes.end()) {
+        interning_hits++;
+        // Drops the new node.
+        return *it;
+    }
+    interning_misses++;
+    node->interned = interned;
+    if (shard.nodes.size() >= shard.sweep_threshold) {
+        shard.sweep(false);
+    }
+    shard.nodes.insert(e);
+    return e;
+}
+
+}  // namespace
+
+ScopedIRInterning::ScopedIRInterning(bool enable)
+    : enabled(enable) {
+    if (enabled) {
+        std::lock_guard<std::mutex> lock(scope_mutex);
+        active_scopes++;
+        interning_depth++;
+    }
+}
+
+ScopedIRInterning::~ScopedIRInterning() {
+    if (enabled) {
+        std::lock_guard<std::mutex> lock(scope_mutex);
+        interning_depth--;
+        if (--active_scopes == 0) {
+            // No thread can be holding a bare pointer to an interned
+            // constant now, so drop everything no longer in use. The
+            // nodes that are still in use stay in the table, so that
+            // they remain the only interned nodes with their structure.
+            size_t removed;
+            do {
+                removed = 0;
+                for (Shard &shard : shards) {
+                    std::lock_guard<std::mutex> shard_lock(shard.mutex);
+                    removed += shard.sweep(true);
+                }
+            } while (removed > 0);
+        }
+    }
+}
+
+bool ir_interning_enabled() {
+    return interning_depth > 0;
+}
+
+Expr intern_expr_node(BaseExprNode *node) {
+    if (interning_depth == 0) {
+        return Expr(node);
+    }
+    return intern(node);
+}
+
+const BaseExprNode *intern_constant_node(BaseExprNode *node) {
+    if (interning_depth == 0) {
+        return node;
+    }
+    // The table keeps constants alive until interning ends
+    // everywhere, so the result is valid without a reference.
+    return intern(node).get();
+}
+
+IRInterningStats get_ir_interning_stats() {
+    IRInterningStats stats;
+    stats.hits = interning_hits;
+    stats.misses = interning_misses;
+    for (Shard &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.entries += shard.nodes.size();
+    }
+    return stats;
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,69 @@
+#ifndef HALIDE_IR_INTERNING_H
+#define HALIDE_IR_INTERNING_H
+
+/** \file
+ * Hash-consing of Expr nodes.
+ *
+ * While interning is enabled on a thread, the make() functions of all
+ * Expr nodes return an existing node instead of a new one if there is
+ * one with the same type, fields and children. Structurally identical
+ * subexpressions then share memory, and most Exprs built entirely
+ * while interning are marked as interned (see IRNode::interned), which
+ * lets equal() compare them by pointer instead of walking them.
+ *
+ * Nodes are never modified after they are made, so sharing them is
+ * invisible to the rest of the compiler.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Expr.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Enables interning of Exprs made on this thread for the lifetime of
+ * the object. These nest, and may be active on several threads at
+ * once: all threads share one table of interned nodes. */
+class ScopedIRInterning {
+    bool enabled;
+
+public:
+    explicit ScopedIRInterning(bool enable = true);
+    ~ScopedIRInterning();
+
+    ScopedIRInterning(const ScopedIRInterning &) = delete;
+    ScopedIRInterning &operator=(const ScopedIRInterning &) = delete;
+};
+
+/** Is interning enabled on this thread? */
+bool ir_interning_enabled();
+
+/** Called by the make() functions of Expr nodes on a node they have
+ * just allocated and filled in. If interning is enabled, returns the
+ * interned node equal to it, deleting the new node if there already
+ * was one. Otherwise returns the new node. */
+Expr intern_expr_node(BaseExprNode *node);
+
+/** The same, for the constant nodes (IntImm, UIntImm, FloatImm and
+ * StringImm), whose make() functions return a bare pointer. Interned
+ * constants stay alive until interning ends on every thread. */
+const BaseExprNode *intern_constant_node(BaseExprNode *node);
+
+/** Counters for the interning table, for benchmarking. */
+struct IRInterningStats {
+    /** Number of makes that returned an existing node. */
+    uint64_t hits = 0;
+    /** Number of makes that added a new node to the table. */
+    uint64_t misses = 0;
+    /** Number of nodes currently in the table. */
+    size_t entries = 0;
+};
+
+IRInterningStats get_ir_interning_stats();
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <limits>
 #include <mutex>
 #include <set>
+#include <sstream>
 #include <string>
 
 #ifdef _WIN32
@@ -20,6 +24,7 @@
 #include "LLVM_Headers.h"
 #include "LLVM_Output.h"
 #include "LLVM_Runtime_Linker.h"
+#include "Module.h"
 #include "Pipeline.h"
 
 namespace Halide {
@@ -140,6 +145,21 @@ public:
     JITModule::Symbol argv_entrypoint;
 
     std::string name;
+
+    // Where compile_module should write the object code to the
+    // compilation cache, or load it from (if cached_object is set)
+    // instead of compiling the llvm module.
+    std::string cache_path;
+    int64_t cache_max_size = 0;
+    std::string cache_target_options;
+    object::OwningBinary<object::ObjectFile> cached_object;
+
+    // The modules of functions that are only compiled when first
+    // called, which compile_module adds to the execution engine, and
+    // the names of the ones compiled so far.
+    std::vector<std::unique_ptr<llvm::Module>> lazy_modules;
+    std::mutex lazy_mutex;
+    std::set<std::string> lazily_compiled;
 };
 
 template<>
@@ -157,8 +177,10 @@ namespace {
 // Retrieve a function pointer from an llvm module, possibly by compiling it.
 JITModule::Symbol compile_and_get_function(ExecutionEngine &ee, const string &name) {
     debug(2) << "JIT Compiling " << name << "\n";
+    // The function isn't in the llvm module if the code was loaded from
+    // the compilation cache.
     llvm::Function *fn = ee.FindFunctionNamed(name);
-    internal_assert(fn->getName() == name);
+    internal_assert(!fn || fn->getName() == name);
     void *f = (void *)ee.getFunctionAddress(name);
     if (!f) {
         internal_error << "Compiling " << name << " returned nullptr\n";
@@ -171,6 +193,27 @@ JITModule::Symbol compile_and_get_function(ExecutionEngine &ee, const string &na
     return symbol;
 }
 
+// The names by which the stubs of lazily compiled functions find
+// lazy_compile and the JITModuleContents to compile them in.
+const char *const lazy_compile_name = "halide_jit_lazy_compile";
+const char *const lazy_module_name = "halide_jit_lazy_module";
+
+std::atomic<uint64_t> lazy_functions_deferred{0};
+std::atomic<uint64_t> lazy_functions_compiled{0};
+
+// Called by the stub of a lazily compiled function the first time it
+// runs. Compiles the module containing the function, and returns its
+// address.
+void *lazy_compile(void *contents, const char *name) {
+    JITModuleContents *m = (JITModuleContents *)contents;
+    std::lock_guard<std::mutex> lock(m->lazy_mutex);
+    if (m->lazily_compiled.insert(name).second) {
+        debug(1) << "JIT compiling " << name << " on its first call\n";
+        lazy_functions_compiled++;
+    }
+    return compile_and_get_function(*m->execution_engine, name).address;
+}
+
 // Expand LLVM's search for symbols to include code contained in a set of JITModule.
 class HalideJITMemoryManager : public SectionMemoryManager {
     std::vector<JITModule> modules;
@@ -182,6 +225,9 @@ public:
     }
 
     uint64_t getSymbolAddress(const std::string &name) override {
+        if (name == lazy_compile_name || name == std::string("_") + lazy_compile_name) {
+            return (uint64_t)&lazy_compile;
+        }
         for (size_t i = 0; i < modules.size(); i++) {
             const JITModule &m = modules[i];
             std::map<std::string, JITModule::Symbol>::const_iterator iter = m.exports().find(name);
@@ -224,8 +270,594 @@ public:
     }
 };
 
+// The on-disk cache of compiled JIT modules. See
+// JITSharedRuntime::set_compilation_cache.
+
+// Changes whenever the layout of a cache entry does.
+const char jit_cache_magic[8] = {'H', 'L', 'J', 'I', 'T', 'C', '0', '1'};
+
+// A cache entry is this header, followed by the bitcode of an empty
+// llvm module that carries the target options of the compiled one,
+// followed by the object code.
+struct JITCacheEntryHeader {
+    char magic[8];
+    uint64_t target_options_size;
+    uint64_t object_size;
+    // Of everything after the header.
+    uint64_t checksum;
+};
+
+const int64_t default_jit_cache_size = 256 * 1024 * 1024;
+
+// Entries still being written are renamed into place when complete.
+// Ones that are left behind by a process that died are removed after
+// this long.
+const int stale_temp_file_seconds = 60 * 60;
+
+std::mutex jit_cache_mutex;
+bool jit_cache_configured = false;
+std::string jit_cache_dir;
+int64_t jit_cache_size = default_jit_cache_size;
+
+// Returns the cache directory, or an empty string if the cache is off.
+std::string get_jit_cache_dir(int64_t &max_size) {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    if (!jit_cache_configured) {
+        jit_cache_dir = get_env_variable("HL_JIT_CACHE_DIR");
+        std::string mb = get_env_variable("HL_JIT_CACHE_MB");
+        if (!mb.empty()) {
+            jit_cache_size = std::atoll(mb.c_str()) * 1024 * 1024;
+        }
+        jit_cache_configured = true;
+    }
+    max_size = jit_cache_size;
+    return jit_cache_dir;
+}
+
+uint64_t jit_cache_checksum(const char *data, size_t size) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Identifies the build of Halide and LLVM doing the compiling, so that
+// entries written by other builds never match.
+std::string compiler_fingerprint() {
+    std::ostringstream s;
+    s << "LLVM " << LLVM_VERSION;
+#ifndef _WIN32
+    // Use the size and modification time of the binary this code is
+    // in, so that rebuilding Halide invalidates the cache.
+    Dl_info info;
+    if (dladdr((void *)&compiler_fingerprint, &info) && info.dli_fname) {
+        sys::fs::file_status status;
+        if (!sys::fs::status(info.dli_fname, status)) {
+            s << " " << status.getSize()
+              << " " << sys::toTimeT(status.getLastModificationTime());
+        }
+    }
+#endif
+    return s.str();
+}
+
+// Hash what printing a Module leaves out: the types of the arguments,
+// and the contents of any buffers and external code.
+void hash_module_data(SHA1 &hash, const Module &m) {
+    for (const Module &sub : m.submodules()) {
+        hash_module_data(hash, sub);
+    }
+    std::ostringstream s;
+    for (const LoweredFunc &f : m.functions()) {
+        s << f.name << " " << (int)f.name_mangling << "\n";
+        for (const LoweredArgument &arg : f.args) {
+            s << arg.name << " " << (int)arg.kind << " " << arg.type
+              << " " << (int)arg.dimensions << "\n";
+        }
+    }
+    for (const Buffer<> &b : m.buffers()) {
+        s << b.name() << " " << b.type();
+        for (int i = 0; i < b.dimensions(); i++) {
+            s << " " << b.dim(i).min() << " " << b.dim(i).extent() << " " << b.dim(i).stride();
+        }
+        s << "\n";
+    }
+    hash.update(s.str());
+    for (const Buffer<> &b : m.buffers()) {
+        const halide_buffer_t *raw = b.raw_buffer();
+        if (raw->host) {
+            hash.update(ArrayRef<uint8_t>(raw->begin(), raw->end()));
+        }
+    }
+    for (const ExternalCode &code : m.external_code()) {
+        hash.update(ArrayRef<uint8_t>(code.contents()));
+    }
+}
+
+// The path of the cache entry for a module, or an empty string if the
+// cache is off. The key covers everything that goes into compiling the
+// module: its IR, which includes the target, any constant data, and
+// the build of Halide and LLVM doing the compiling.
+std::string jit_cache_path(const Module &m, int64_t &max_size) {
+    std::string dir = get_jit_cache_dir(max_size);
+    if (dir.empty()) {
+        return "";
+    }
+    static const std::string fingerprint = compiler_fingerprint();
+    std::ostringstream s;
+    // Print floating point constants exactly.
+    s.precision(std::numeric_limits<double>::max_digits10);
+    s << fingerprint << "\n"
+      << get_env_variable("HL_LLVM_ARGS") << "\n"
+      << m;
+    SHA1 hash;
+    hash.update(s.str());
+    hash_module_data(hash, m);
+    return dir + "/" + toHex(hash.final(), true) + ".hjit";
+}
+
+// The path of the cache entry for a shared runtime module, or an empty
+// string if the cache is off. Besides the target, the runtime depends
+// on the target options it copies from the first module compiled (see
+// clone_target_options).
+std::string jit_runtime_cache_path(const std::string &module_name, const Target &target,
+                                   const llvm::Module *for_module, int64_t &max_size) {
+    std::string dir = get_jit_cache_dir(max_size);
+    if (dir.empty()) {
+        return "";
+    }
+    static const std::string fingerprint = compiler_fingerprint();
+    std::string key;
+    raw_string_ostream s(key);
+    s << fingerprint << "\n"
+      << get_env_variable("HL_LLVM_ARGS") << "\n"
+      << "runtime " << module_name << " " << target.to_string() << "\n";
+    if (for_module) {
+        s << for_module->getTargetTriple() << "\n";
+        for (const char *flag : {"halide_use_soft_float_abi", "halide_mcpu", "halide_mattrs", "halide_use_pic"}) {
+            if (const Metadata *md = for_module->getModuleFlag(flag)) {
+                s << flag << " ";
+                md->print(s);
+                s << "\n";
+            }
+        }
+    }
+    s.flush();
+    SHA1 hash;
+    hash.update(key);
+    return dir + "/" + toHex(hash.final(), true) + ".hjit";
+}
+
+// An empty llvm module with the same target options as the given one.
+// A module loaded from the cache has no code of its own, so this also
+// records the names of the functions it exports, if given, and
+// declarations of its static constructors and destructors, so that
+// the execution engine can find and run them. Static constructors and
+// destructors with internal linkage are made hidden instead, as they
+// can't be found by name otherwise.
+std::string jit_cache_target_options(llvm::Module &m, const std::vector<std::string> &exports = {}) {
+    llvm::Module options(m.getModuleIdentifier(), m.getContext());
+    options.setTargetTriple(m.getTargetTriple());
+    options.setDataLayout(m.getDataLayout());
+    SmallVector<llvm::Module::ModuleFlagEntry, 8> flags;
+    m.getModuleFlagsMetadata(flags);
+    for (const auto &flag : flags) {
+        options.addModuleFlag(flag.Behavior, flag.Key->getString(), flag.Val);
+    }
+    if (!exports.empty()) {
+        NamedMDNode *md = options.getOrInsertNamedMetadata("halide_jit_exports");
+        for (const std::string &e : exports) {
+            md->addOperand(MDNode::get(m.getContext(), MDString::get(m.getContext(), e)));
+        }
+    }
+    for (const char *name : {"llvm.global_ctors", "llvm.global_dtors"}) {
+        const GlobalVariable *gv = m.getNamedGlobal(name);
+        const ConstantArray *init = gv && gv->hasInitializer() ? dyn_cast<ConstantArray>(gv->getInitializer()) : nullptr;
+        if (!init) {
+            continue;
+        }
+        std::vector<Constant *> entries;
+        for (const Use &u : init->operands()) {
+            const ConstantStruct *entry = dyn_cast<ConstantStruct>(u.get());
+            llvm::Function *f = entry ? dyn_cast<llvm::Function>(entry->getOperand(1)->stripPointerCasts()) : nullptr;
+            if (!f) {
+                continue;
+            }
+            if (f->hasLocalLinkage()) {
+                f->setLinkage(GlobalValue::ExternalLinkage);
+                f->setVisibility(GlobalValue::HiddenVisibility);
+            }
+            Constant *decl = cast<Constant>(options.getOrInsertFunction(f->getName(), f->getFunctionType()).getCallee());
+            std::vector<Constant *> fields;
+            for (unsigned i = 0; i < entry->getNumOperands(); i++) {
+                Constant *field = entry->getOperand(i);
+                if (i == 1) {
+                    fields.push_back(ConstantExpr::getPointerCast(decl, field->getType()));
+                } else if (i == 0) {
+                    fields.push_back(field);
+                } else {
+                    fields.push_back(Constant::getNullValue(field->getType()));
+                }
+            }
+            entries.push_back(ConstantStruct::get(entry->getType(), fields));
+        }
+        ArrayType *t = ArrayType::get(init->getType()->getElementType(), entries.size());
+        new GlobalVariable(options, t, false, GlobalValue::AppendingLinkage, ConstantArray::get(t, entries), name);
+    }
+    std::string result;
+    raw_string_ostream stream(result);
+    WriteBitcodeToFile(options, stream);
+    stream.flush();
+    return result;
+}
+
+// The names of the exported functions recorded by
+// jit_cache_target_options.
+std::vector<std::string> jit_cache_exports(const llvm::Module &options) {
+    std::vector<std::string> result;
+    if (const NamedMDNode *md = options.getNamedMetadata("halide_jit_exports")) {
+        for (const MDNode *e : md->operands()) {
+            result.push_back(cast<MDString>(e->getOperand(0))->getString().str());
+        }
+    }
+    return result;
+}
+
+// Load a cache entry. Returns the module carrying the target options,
+// or nullptr if there is no usable entry.
+std::unique_ptr<llvm::Module> jit_cache_load(const std::string &path, LLVMContext &context,
+                                             object::OwningBinary<object::ObjectFile> &object) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> file = MemoryBuffer::getFile(path);
+    if (!file) {
+        return nullptr;
+    }
+    const char *data = (*file)->getBufferStart();
+    size_t size = (*file)->getBufferSize();
+    JITCacheEntryHeader header;
+    if (size < sizeof(header)) {
+        return nullptr;
+    }
+    memcpy(&header, data, sizeof(header));
+    const char *payload = data + sizeof(header);
+    size_t payload_size = size - sizeof(header);
+    if (memcmp(header.magic, jit_cache_magic, sizeof(header.magic)) != 0 ||
+        header.target_options_size > payload_size ||
+        header.object_size != payload_size - header.target_options_size ||
+        header.checksum != jit_cache_checksum(payload, payload_size)) {
+        debug(1) << "Ignoring bad JIT cache entry " << path << "\n";
+        return nullptr;
+    }
+
+    Expected<std::unique_ptr<llvm::Module>> options =
+        parseBitcodeFile(MemoryBufferRef(StringRef(payload, header.target_options_size), path), context);
+    if (!options) {
+        consumeError(options.takeError());
+        return nullptr;
+    }
+    std::unique_ptr<MemoryBuffer> object_buffer =
+        MemoryBuffer::getMemBufferCopy(StringRef(payload + header.target_options_size, header.object_size), path);
+    Expected<std::unique_ptr<object::ObjectFile>> object_file =
+        object::ObjectFile::createObjectFile(object_buffer->getMemBufferRef());
+    if (!object_file) {
+        consumeError(object_file.takeError());
+        return nullptr;
+    }
+    object = object::OwningBinary<object::ObjectFile>(std::move(*object_file), std::move(object_buffer));
+
+    // Entries are evicted least recently used first.
+    int fd;
+    if (!sys::fs::openFileForWrite(path, fd, sys::fs::CD_OpenExisting, sys::fs::OF_Append)) {
+        sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+        sys::Process::SafelyCloseFileDescriptor(fd);
+    }
+    debug(1) << "Loaded JIT compiled module from " << path << "\n";
+    return std::move(*options);
+}
+
+// Remove the least recently used entries until the cache is no bigger
+// than max_size, keeping the one just written. Entries may be removed
+// from under us by other processes at any point.
+void jit_cache_evict(const std::string &dir, const std::string &keep, int64_t max_size) {
+    struct Entry {
+        std::string path;
+        sys::TimePoint<> time;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    int64_t total_size = 0;
+    auto now = std::chrono::system_clock::now();
+    std::error_code ec;
+    for (sys::fs::directory_iterator it(dir, ec), end; it != end && !ec; it.increment(ec)) {
+        ErrorOr<sys::fs::basic_file_status> status = it->status();
+        if (!status || status->type() != sys::fs::file_type::regular_file) {
+            continue;
+        }
+        const std::string &path = it->path();
+        bool is_kept = sys::path::filename(path) == sys::path::filename(keep);
+        if (ends_with(path, ".tmp")) {
+            if (now - status->getLastModificationTime() > std::chrono::seconds(stale_temp_file_seconds)) {
+                sys::fs::remove(path);
+            }
+        } else if (is_kept) {
+            total_size += status->getSize();
+        } else if (ends_with(path, ".hjit")) {
+            entries.push_back({path, status->getLastModificationTime(), status->getSize()});
+            total_size += status->getSize();
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.time < b.time;
+    });
+    for (const Entry &e : entries) {
+        if (total_size <= max_size) {
+            break;
+        }
+        debug(1) << "Evicting JIT cache entry " << e.path << "\n";
+        sys::fs::remove(e.path);
+        total_size -= e.size;
+    }
+}
+
+// Write a cache entry. It is written to a temporary file that is then
+// renamed into place, so other processes only ever see complete
+// entries.
+void jit_cache_store(const std::string &path, const std::string &target_options,
+                     StringRef object, int64_t max_size) {
+    std::string dir = path.substr(0, path.rfind('/'));
+    if (sys::fs::create_directories(dir)) {
+        debug(1) << "Could not create JIT cache directory " << dir << "\n";
+        return;
+    }
+
+    JITCacheEntryHeader header;
+    memcpy(header.magic, jit_cache_magic, sizeof(header.magic));
+    header.target_options_size = target_options.size();
+    header.object_size = object.size();
+    std::string payload = target_options + object.str();
+    header.checksum = jit_cache_checksum(payload.data(), payload.size());
+
+    int fd;
+    SmallString<256> temp_path;
+    if (sys::fs::createUniqueFile(path + "-%%%%%%%%.tmp", fd, temp_path)) {
+        debug(1) << "Could not create a file in JIT cache directory " << dir << "\n";
+        return;
+    }
+    {
+        raw_fd_ostream out(fd, /* shouldClose */ true);
+        out.write((const char *)&header, sizeof(header));
+        out << payload;
+        out.close();
+        if (out.has_error()) {
+            out.clear_error();
+            sys::fs::remove(temp_path);
+            return;
+        }
+    }
+    if (sys::fs::rename(temp_path, path)) {
+        sys::fs::remove(temp_path);
+        return;
+    }
+    debug(1) << "Stored JIT compiled module in " << path << "\n";
+    jit_cache_evict(dir, path, max_size);
+}
+
+// Receives the object code MCJIT generates, so that it can be stored
+// in the cache.
+class JITObjectCapture : public ObjectCache {
+public:
+    std::string object;
+
+    void notifyObjectCompiled(const llvm::Module *, MemoryBufferRef obj) override {
+        object.assign(obj.getBufferStart(), obj.getBufferSize());
+    }
+
+    std::unique_ptr<MemoryBuffer> getObject(const llvm::Module *) override {
+        return nullptr;
+    }
+};
+
+// Move each function that codegen marked with "halide-jit-lazy" into an
+// llvm module of its own, along with the local functions only it uses
+// (such as the bodies of its parallel loops), and return those modules.
+// MCJIT compiles a module the first time a symbol in it is looked up,
+// so the calls to each function are made through a pointer that starts
+// out pointing to a stub, which calls lazy_compile to look up the
+// function and then replaces the pointer with it.
+std::vector<std::unique_ptr<llvm::Module>> split_lazy_functions(llvm::Module &m) {
+    std::vector<llvm::Function *> lazy;
+    for (llvm::Function &f : m) {
+        if (!f.isDeclaration() && f.hasFnAttribute("halide-jit-lazy")) {
+            lazy.push_back(&f);
+        }
+    }
+    if (lazy.empty() || !m.alias_empty() || !m.ifunc_empty()) {
+        return {};
+    }
+
+    LLVMContext &context = m.getContext();
+    llvm::PointerType *i8_ptr_t = llvm::Type::getInt8PtrTy(context);
+    llvm::FunctionType *compile_t = llvm::FunctionType::get(i8_ptr_t, {i8_ptr_t, i8_ptr_t}, false);
+    FunctionCallee compile_fn = m.getOrInsertFunction(lazy_compile_name, compile_t);
+    GlobalVariable *module_handle = new GlobalVariable(m, i8_ptr_t, false, GlobalValue::ExternalLinkage,
+                                                       ConstantPointerNull::get(i8_ptr_t), lazy_module_name);
+    const Align ptr_align = m.getDataLayout().getPointerABIAlignment(0);
+
+    for (llvm::Function *f : lazy) {
+        llvm::FunctionType *f_t = f->getFunctionType();
+        llvm::PointerType *f_ptr_t = f_t->getPointerTo();
+        const std::string name = f->getName().str();
+
+        llvm::Function *stub = llvm::Function::Create(f_t, GlobalValue::InternalLinkage, name + ".stub", m);
+        stub->setCallingConv(f->getCallingConv());
+        stub->setAttributes(f->getAttributes());
+        stub->removeFnAttr("halide-jit-lazy");
+        GlobalVariable *slot = new GlobalVariable(m, f_ptr_t, false, GlobalValue::InternalLinkage, stub, name + ".slot");
+
+        IRBuilder<> builder(BasicBlock::Create(context, "entry", stub));
+        Value *handle = builder.CreateAlignedLoad(i8_ptr_t, module_handle, ptr_align);
+        Value *address = builder.CreateCall(compile_fn, {handle, builder.CreateGlobalStringPtr(name)});
+        Value *compiled = builder.CreatePointerCast(address, f_ptr_t);
+        builder.CreateAlignedStore(compiled, slot, ptr_align)->setAtomic(AtomicOrdering::Release);
+        std::vector<Value *> args;
+        for (llvm::Argument &arg : stub->args()) {
+            args.push_back(&arg);
+        }
+        CallInst *forward = builder.CreateCall(f_t, compiled, args);
+        forward->setCallingConv(f->getCallingConv());
+        forward->setTailCall();
+        if (f_t->getReturnType()->isVoidTy()) {
+            builder.CreateRetVoid();
+        } else {
+            builder.CreateRet(forward);
+        }
+
+        std::vector<CallInst *> calls;
+        for (User *u : f->users()) {
+            CallInst *call = dyn_cast<CallInst>(u);
+            internal_assert(call && call->getCalledOperand() == f)
+                << "Lazily compiled function " << name << " is used other than by calling it\n";
+            calls.push_back(call);
+        }
+        for (CallInst *call : calls) {
+            IRBuilder<> builder(call);
+            LoadInst *target = builder.CreateAlignedLoad(f_ptr_t, slot, ptr_align);
+            target->setAtomic(AtomicOrdering::Acquire);
+            std::vector<Value *> args(call->arg_begin(), call->arg_end());
+            CallInst *new_call = builder.CreateCall(f_t, target, args);
+            new_call->setCallingConv(call->getCallingConv());
+            new_call->setAttributes(call->getAttributes());
+            new_call->setTailCallKind(call->getTailCallKind());
+            call->replaceAllUsesWith(new_call);
+            call->eraseFromParent();
+        }
+    }
+
+    // Each lazy function takes the local functions that are only used
+    // by it with it, transitively.
+    std::map<llvm::Function *, llvm::Function *> owner;
+    for (llvm::Function *f : lazy) {
+        owner[f] = f;
+    }
+    std::function<bool(const Value *, llvm::Function *&)> only_used_by = [&](const Value *v, llvm::Function *&root) {
+        for (const User *u : v->users()) {
+            if (const Instruction *inst = dyn_cast<Instruction>(u)) {
+                auto it = owner.find(const_cast<llvm::Function *>(inst->getFunction()));
+                if (it == owner.end() || (root && root != it->second)) {
+                    return false;
+                }
+                root = it->second;
+            } else if (!isa<ConstantExpr>(u) || !only_used_by(u, root)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (llvm::Function &f : m) {
+            llvm::Function *root = nullptr;
+            if (!f.isDeclaration() && f.hasLocalLinkage() && !owner.count(&f) &&
+                only_used_by(&f, root) && root) {
+                owner[&f] = root;
+                changed = true;
+            }
+        }
+    }
+
+    // The modules refer to each other's symbols, so none can be local.
+    for (GlobalValue &gv : m.global_values()) {
+        if (gv.hasLocalLinkage() && !gv.isDeclaration() && !gv.getName().startswith("llvm.")) {
+            if (!gv.hasName()) {
+                gv.setName("lazy_anon");
+            }
+            gv.setLinkage(GlobalValue::ExternalLinkage);
+            gv.setVisibility(GlobalValue::DefaultVisibility);
+        }
+    }
+
+    // Make a module for each lazy function from a copy of the whole
+    // one (via bitcode, as llvm::CloneModule has issues with debug
+    // info), keeping only the definitions it owns.
+    SmallVector<char, 16> bitcode;
+    raw_svector_ostream bitcode_ostream(bitcode);
+    WriteBitcodeToFile(m, bitcode_ostream);
+    std::vector<std::unique_ptr<llvm::Module>> result;
+    for (llvm::Function *f : lazy) {
+        std::set<std::string> owned;
+        for (const auto &p : owner) {
+            if (p.second == f) {
+                owned.insert(p.first->getName().str());
+            }
+        }
+
+        Expected<std::unique_ptr<llvm::Module>> parsed =
+            parseBitcodeFile(MemoryBufferRef(StringRef(bitcode.data(), bitcode.size()), f->getName()), context);
+        internal_assert(parsed) << "Could not copy module to split out " << f->getName().str() << "\n";
+        std::unique_ptr<llvm::Module> part = std::move(*parsed);
+        part->setModuleIdentifier(f->getName());
+
+        std::vector<GlobalValue *> dead;
+        for (llvm::Function &g : *part) {
+            if (!g.isDeclaration() && !owned.count(g.getName().str())) {
+                g.deleteBody();
+                g.setComdat(nullptr);
+            }
+        }
+        for (GlobalVariable &g : part->globals()) {
+            if (g.getName().startswith("llvm.")) {
+                dead.push_back(&g);
+            } else if (!g.isDeclaration()) {
+                g.setInitializer(nullptr);
+                g.setLinkage(GlobalValue::ExternalLinkage);
+                g.setComdat(nullptr);
+                g.clearMetadata();
+            }
+        }
+        for (GlobalValue *g : dead) {
+            g->eraseFromParent();
+        }
+        dead.clear();
+        for (GlobalValue &g : part->global_values()) {
+            g.removeDeadConstantUsers();
+            if (g.isDeclaration() && g.use_empty()) {
+                dead.push_back(&g);
+            }
+        }
+        for (GlobalValue *g : dead) {
+            g->eraseFromParent();
+        }
+        internal_assert(!verifyModule(*part, &llvm::errs()));
+        result.push_back(std::move(part));
+    }
+
+    // Remove what went into those modules from this one.
+    for (const auto &p : owner) {
+        p.first->dropAllReferences();
+    }
+    for (const auto &p : owner) {
+        p.first->removeDeadConstantUsers();
+        internal_assert(p.first->use_empty());
+        p.first->eraseFromParent();
+    }
+    internal_assert(!verifyModule(m, &llvm::errs()));
+
+    debug(1) << "Deferring JIT compilation of " << lazy.size() << " functions in "
+             << m.getModuleIdentifier() << " until they are called\n";
+    lazy_functions_deferred += lazy.size();
+    return result;
+}
+
 }  // namespace
 
+JITLazyCompilationStats get_jit_lazy_compilation_stats() {
+    JITLazyCompilationStats stats;
+    stats.deferred = lazy_functions_deferred;
+    stats.compiled = lazy_functions_compiled;
+    return stats;
+}
+
 JITModule::JITModule() {
     jit_module = new JITModuleContents();
 }
@@ -233,7 +865,25 @@ JITModule::JITModule() {
 JITModule::JITModule(const Module &m, const LoweredFunc &fn,
                      const std::vector<JITModule> &dependencies) {
     jit_module = new JITModuleContents();
-    std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(m, jit_module->context));
+    std::unique_ptr<llvm::Module> llvm_module;
+    int64_t cache_max_size = 0;
+    std::string cache_path = jit_cache_path(m, cache_max_size);
+    if (!cache_path.empty()) {
+        // On a hit, the llvm module is just an empty one with the
+        // right target options, and the code comes from the object.
+        llvm_module = jit_cache_load(cache_path, jit_module->context, jit_module->cached_object);
+    }
+    if (!llvm_module) {
+        llvm_module = compile_module_to_llvm_module(m, jit_module->context);
+        jit_module->lazy_modules = split_lazy_functions(*llvm_module);
+        // An entry in the cache holds the code for a whole module, so
+        // nothing is stored if some of it is compiled lazily.
+        if (!cache_path.empty() && jit_module->lazy_modules.empty()) {
+            jit_module->cache_path = cache_path;
+            jit_module->cache_max_size = cache_max_size;
+            jit_module->cache_target_options = jit_cache_target_options(*llvm_module);
+        }
+    }
     std::vector<JITModule> deps_with_runtime = dependencies;
     std::vector<JITModule> shared_runtime = JITSharedRuntime::get(llvm_module.get(), m.target());
     deps_with_runtime.insert(deps_with_runtime.end(), shared_runtime.begin(), shared_runtime.end());
@@ -305,6 +955,21 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
         ee->RegisterJITEventListener(listeners[i]);
     }
 
+    // Lazily compiled functions are only compiled when their stubs
+    // look them up.
+    const bool has_lazy_modules = !jit_module->lazy_modules.empty();
+    for (auto &lazy_module : jit_module->lazy_modules) {
+        ee->addModule(std::move(lazy_module));
+    }
+    jit_module->lazy_modules.clear();
+
+    JITObjectCapture object_capture;
+    if (jit_module->cached_object.getBinary()) {
+        ee->addObjectFile(std::move(jit_module->cached_object));
+    } else if (!jit_module->cache_path.empty()) {
+        ee->setObjectCache(&object_capture);
+    }
+
     // Retrieve function pointers from the compiled module (which also
     // triggers compilation)
     debug(1) << "JIT compiling " << module_name
@@ -325,8 +990,24 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
         exports[requested_exports[i]] = compile_and_get_function(*ee, requested_exports[i]);
     }
 
-    debug(2) << "Finalizing object\n";
-    ee->finalizeObject();
+    if (has_lazy_modules) {
+        // Getting the entrypoints finalized the main module, and
+        // finalizeObject would compile everything else too. The stubs
+        // pass this to lazy_compile.
+        void **handle = (void **)ee->getGlobalValueAddress(lazy_module_name);
+        internal_assert(handle) << "Could not find " << lazy_module_name << " in " << module_name << "\n";
+        *handle = jit_module.get();
+    } else {
+        debug(2) << "Finalizing object\n";
+        ee->finalizeObject();
+    }
+    ee->setObjectCache(nullptr);
+    if (!object_capture.object.empty()) {
+        jit_cache_store(jit_module->cache_path, jit_module->cache_target_options,
+                        object_capture.object, jit_module->cache_max_size);
+    }
+    jit_module->cache_path.clear();
+    jit_module->cache_target_options.clear();
     // Do any target-specific post-compilation module meddling
     for (size_t i = 0; i < listeners.size(); i++) {
         ee->UnregisterJITEventListener(listeners[i]);
@@ -457,6 +1138,16 @@ void JITModule::memoization_cache_evict(uint64_t eviction_key) const {
     }
 }
 
+bool JITModule::memoization_cache_set_persistent_file(const std::string &path, int64_t size) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_set_persistent_file");
+    if (f != exports().end()) {
+        const char *path_arg = path.empty() ? nullptr : path.c_str();
+        return (reinterpret_bits<int (*)(void *, const char *, int64_t)>(f->second.address))(nullptr, path_arg, size) == 0;
+    }
+    return false;
+}
+
 void JITModule::reuse_device_allocations(bool b) const {
     std::map<std::string, Symbol>::const_iterator f =
         exports().find("halide_reuse_device_allocations");
@@ -475,6 +1166,9 @@ JITHandlers runtime_internal_handlers;
 JITHandlers default_handlers;
 JITHandlers active_handlers;
 int64_t default_cache_size;
+bool default_persistent_file_set;
+std::string default_persistent_file;
+int64_t default_persistent_file_size;
 
 void merge_handlers(JITHandlers &base, const JITHandlers &addins) {
     if (addins.custom_print) {
@@ -736,28 +1430,55 @@ JITModule &make_module(llvm::Module *for_module, Target target,
             break;
         }
 
-        // This function is protected by a mutex so this is thread safe.
-        auto module =
-            get_initial_module_for_target(one_gpu,
-                                          &runtime.jit_module->context,
-                                          true,
-                                          runtime_kind != MainShared);
-        if (for_module) {
-            clone_target_options(*for_module, *module);
+        // Linking and optimizing the runtime modules, and compiling
+        // them, takes a while, so they are kept in the compilation
+        // cache too. On a hit, the module only carries the target
+        // options and the names of the exports.
+        std::unique_ptr<llvm::Module> module;
+        std::vector<std::string> halide_exports;
+        int64_t cache_max_size = 0;
+        std::string cache_path = jit_runtime_cache_path(module_name, one_gpu, for_module, cache_max_size);
+        if (!cache_path.empty()) {
+            module = jit_cache_load(cache_path, runtime.jit_module->context, runtime.jit_module->cached_object);
+            if (module) {
+                halide_exports = jit_cache_exports(*module);
+                if (halide_exports.empty()) {
+                    module.reset();
+                    runtime.jit_module->cached_object = object::OwningBinary<object::ObjectFile>();
+                }
+            }
         }
-        module->setModuleIdentifier(module_name);
 
-        std::set<std::string> halide_exports_unique;
+        if (!module) {
+            // This function is protected by a mutex so this is thread safe.
+            module =
+                get_initial_module_for_target(one_gpu,
+                                              &runtime.jit_module->context,
+                                              true,
+                                              runtime_kind != MainShared);
+            if (for_module) {
+                clone_target_options(*for_module, *module);
+            }
+            module->setModuleIdentifier(module_name);
+
+            std::set<std::string> halide_exports_unique;
 
-        // Enumerate the functions.
-        for (auto &f : *module) {
-            // LLVM_Runtime_Linker has marked everything that should be exported as weak
-            if (f.hasWeakLinkage()) {
-                halide_exports_unique.insert(get_llvm_function_name(f));
+            // Enumerate the functions.
+            for (auto &f : *module) {
+                // LLVM_Runtime_Linker has marked everything that should be exported as weak
+                if (f.hasWeakLinkage()) {
+                    halide_exports_unique.insert(get_llvm_function_name(f));
+                }
             }
-        }
 
-        std::vector<std::string> halide_exports(halide_exports_unique.begin(), halide_exports_unique.end());
+            halide_exports.assign(halide_exports_unique.begin(), halide_exports_unique.end());
+
+            if (!cache_path.empty()) {
+                runtime.jit_module->cache_path = cache_path;
+                runtime.jit_module->cache_max_size = cache_max_size;
+                runtime.jit_module->cache_target_options = jit_cache_target_options(*module, halide_exports);
+            }
+        }
 
         runtime.compile_module(std::move(module), "", target, deps, halide_exports);
 
@@ -798,6 +1519,9 @@ JITModule &make_module(llvm::Module *for_module, Target target,
             if (default_cache_size != 0) {
                 runtime.memoization_cache_set_size(default_cache_size);
             }
+            if (default_persistent_file_set) {
+                runtime.memoization_cache_set_persistent_file(default_persistent_file, default_persistent_file_size);
+            }
 
             runtime.jit_module->name = "MainShared";
         } else {
@@ -927,6 +1651,27 @@ void JITSharedRuntime::memoization_cache_evict(uint64_t eviction_key) {
     shared_runtimes(MainShared).memoization_cache_evict(eviction_key);
 }
 
+bool JITSharedRuntime::memoization_cache_set_persistent_file(const std::string &path, int64_t size) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    default_persistent_file_set = true;
+    default_persistent_file = path;
+    default_persistent_file_size = size;
+    JITModule &runtime = shared_runtimes(MainShared);
+    if (runtime.compiled()) {
+        return runtime.memoization_cache_set_persistent_file(path, size);
+    }
+    // Applied when the runtime is created.
+    return true;
+}
+
+void JITSharedRuntime::set_compilation_cache(const std::string &dir, int64_t max_size) {
+    std::lock_guard<std::mutex> lock(jit_cache_mutex);
+    jit_cache_configured = true;
+    jit_cache_dir = dir;
+    jit_cache_size = max_size > 0 ? max_size : default_jit_cache_size;
+}
+
 void JITSharedRuntime::reuse_device_allocations(bool b) {
     std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
     shared_runtimes(MainShared).reuse_device_allocations(b);
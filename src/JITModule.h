@@ -130,6 +130,9 @@ struct JITModule {
     /** See JITSharedRuntime::memoization_cache_evict */
     void memoization_cache_evict(uint64_t eviction_key) const;
 
+    /** See JITSharedRuntime::memoization_cache_set_persistent_file */
+    bool memoization_cache_set_persistent_file(const std::string &path, int64_t size) const;
+
     /** See JITSharedRuntime::reuse_device_allocations */
     void reuse_device_allocations(bool) const;
 
@@ -177,6 +180,31 @@ public:
      */
     static void memoization_cache_evict(uint64_t eviction_key);
 
+    /** Back the memoization cache with a memory-mapped file shared
+     * with other processes, so results memoized by one process can be
+     * reused by later ones. An empty path stops using a file. Returns
+     * false if the file can't be used. If you are compiling
+     * statically, you should include HalideRuntime.h and call
+     * halide_memoization_cache_set_persistent_file() instead.
+     */
+    static bool memoization_cache_set_persistent_file(const std::string &path, int64_t size = 0);
+
+    /** Keep the object code of JIT compiled pipelines in a directory,
+     * and load it from there instead of compiling a pipeline again if
+     * it lowers to exactly the same thing, possibly in another
+     * process. Entries are keyed on a hash of the lowered module, the
+     * target, and the build of Halide and LLVM. The least recently used
+     * ones are removed to keep the directory under max_size bytes (256MB
+     * if zero or less). Several processes may share a directory. An
+     * empty dir turns the cache off, which is the default unless the
+     * HL_JIT_CACHE_DIR environment variable is set (with the size in
+     * HL_JIT_CACHE_MB). Note that compiler-generated names are part of
+     * the lowered module, so a process must compile its pipelines in
+     * the same order each time to reuse the compiled code. Affects
+     * pipelines compiled after the call, and the shared runtime if it
+     * has not been made yet. */
+    static void set_compilation_cache(const std::string &dir, int64_t max_size = 0);
+
     /** Set whether or not Halide may hold onto and reuse device
      * allocations to avoid calling expensive device API allocation
      * functions. If you are compiling statically, you should include
@@ -189,6 +217,16 @@ public:
 
 void *get_symbol_address(const char *s);
 
+/** The number of functions that JIT compilation has deferred compiling
+ * until they are first called (see HL_JIT_LAZY in README.md), and the
+ * number of those that have been compiled since, summed over all JIT
+ * modules. */
+struct JITLazyCompilationStats {
+    uint64_t deferred = 0, compiled = 0;
+};
+
+JITLazyCompilationStats get_jit_lazy_compilation_stats();
+
 }  // namespace Internal
 }  // namespace Halide
 
@@ -5,7 +5,9 @@
 #include "CompilerLogger.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Runtime_Linker.h"
+#include "ThreadPool.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -340,33 +342,24 @@ std::unique_ptr<llvm::Module> clone_module(const llvm::Module &module_in) {
     return std::move(cloned_module.get());
 }
 
-}  // namespace
-
-void emit_file(const llvm::Module &module_in, Internal::LLVMOStream &out,
-               llvm::CodeGenFileType file_type) {
-    Internal::debug(1) << "emit_file.Compiling to native code...\n";
-    Internal::debug(2) << "Target triple: " << module_in.getTargetTriple() << "\n";
-
-    auto time_start = std::chrono::high_resolution_clock::now();
-
-    // Work on a copy of the module to avoid modifying the original.
-    std::unique_ptr<llvm::Module> module = clone_module(module_in);
-
+// Run the code generator on a module, modifying it in place.
+void emit_module(llvm::Module &module, Internal::LLVMOStream &out,
+                 llvm::CodeGenFileType file_type) {
     // Get the target specific parser.
-    auto target_machine = Internal::make_target_machine(*module);
+    auto target_machine = Internal::make_target_machine(module);
     internal_assert(target_machine.get()) << "Could not allocate target machine!\n";
 
     llvm::DataLayout target_data_layout(target_machine->createDataLayout());
-    if (!(target_data_layout == module->getDataLayout())) {
+    if (!(target_data_layout == module.getDataLayout())) {
         internal_error << "Warning: module's data layout does not match target machine's\n"
                        << target_data_layout.getStringRepresentation() << "\n"
-                       << module->getDataLayout().getStringRepresentation() << "\n";
+                       << module.getDataLayout().getStringRepresentation() << "\n";
     }
 
     // Build up all of the passes that we want to do to the module.
     llvm::legacy::PassManager pass_manager;
 
-    pass_manager.add(new llvm::TargetLibraryInfoWrapperPass(llvm::Triple(module->getTargetTriple())));
+    pass_manager.add(new llvm::TargetLibraryInfoWrapperPass(llvm::Triple(module.getTargetTriple())));
 
     // Make sure things marked as always-inline get inlined
     pass_manager.add(llvm::createAlwaysInlinerLegacyPass());
@@ -386,19 +379,65 @@ void emit_file(const llvm::Module &module_in, Internal::LLVMOStream &out,
     // Ask the target to add backend passes as necessary.
     target_machine->addPassesToEmitFile(pass_manager, out, nullptr, file_type);
 
-    pass_manager.run(*module);
+    pass_manager.run(module);
+}
 
+// Make every definition with local linkage a hidden global instead, so
+// that the partitions of a split module can refer to each other's
+// symbols. As in ThinLTO, the promoted names get a suffix derived from
+// the contents of the module, so that they can't collide with the
+// symbols of anything else in the same binary.
+void promote_local_symbols(llvm::Module &module) {
+    llvm::SmallVector<char, 16> bitcode;
+    llvm::raw_svector_ostream bitcode_ostream(bitcode);
+    WriteBitcodeToFile(module, bitcode_ostream);
+    llvm::SHA1 hash;
+    hash.update(llvm::StringRef(bitcode.data(), bitcode.size()));
+    const std::string suffix = ".llvm." + llvm::toHex(hash.final(), true).substr(0, 16);
+
+    for (llvm::GlobalValue &gv : module.global_values()) {
+        if (!gv.hasLocalLinkage() || gv.isDeclaration() || gv.getName().startswith("llvm.")) {
+            continue;
+        }
+        gv.setName((gv.hasName() ? gv.getName().str() : "anon") + suffix);
+        gv.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        gv.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+}
+
+void record_llvm_time(std::chrono::high_resolution_clock::time_point time_start, const llvm::Module &module) {
     auto *logger = Internal::get_compiler_logger();
     if (logger) {
         auto time_end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> diff = time_end - time_start;
         logger->record_compilation_time(Internal::CompilerLogger::Phase::LLVM, diff.count());
+        // Machine code generation doesn't change the IR.
+        const int64_t instructions = module.getInstructionCount();
+        logger->record_compilation_pass("llvm_codegen", diff.count(), instructions, instructions,
+                                        Internal::get_peak_memory_usage());
     }
 
     // If -time-passes is in HL_LLVM_ARGS, this will print llvm passes time statstics otherwise its no-op.
     llvm::reportAndResetTimings();
 }
 
+}  // namespace
+
+void emit_file(const llvm::Module &module_in, Internal::LLVMOStream &out,
+               llvm::CodeGenFileType file_type) {
+    Internal::debug(1) << "emit_file.Compiling to native code...\n";
+    Internal::debug(2) << "Target triple: " << module_in.getTargetTriple() << "\n";
+
+    auto time_start = std::chrono::high_resolution_clock::now();
+
+    // Work on a copy of the module to avoid modifying the original.
+    std::unique_ptr<llvm::Module> module = clone_module(module_in);
+
+    emit_module(*module, out, file_type);
+
+    record_llvm_time(time_start, module_in);
+}
+
 std::unique_ptr<llvm::Module> compile_module_to_llvm_module(const Module &module, llvm::LLVMContext &context) {
     return codegen_llvm(module, context);
 }
@@ -407,6 +446,56 @@ void compile_llvm_module_to_object(llvm::Module &module, Internal::LLVMOStream &
     emit_file(module, out, llvm::CGFT_ObjectFile);
 }
 
+void compile_llvm_module_to_object_partitions(llvm::Module &module, const std::vector<std::string> &object_files) {
+    const unsigned num_partitions = (unsigned)object_files.size();
+    internal_assert(num_partitions > 0);
+    Internal::debug(1) << "compile_llvm_module_to_object_partitions: Compiling to " << num_partitions << " objects...\n";
+
+    auto time_start = std::chrono::high_resolution_clock::now();
+
+    std::unique_ptr<llvm::Module> whole = clone_module(module);
+    promote_local_symbols(*whole);
+
+    // An LLVMContext can only be used by one thread at a time, so each
+    // partition is handed to its thread as bitcode.
+    std::vector<llvm::SmallVector<char, 16>> partitions;
+    auto add_partition = [&](std::unique_ptr<llvm::Module> partition) {
+        partitions.emplace_back();
+        llvm::raw_svector_ostream bitcode_ostream(partitions.back());
+        WriteBitcodeToFile(*partition, bitcode_ostream);
+    };
+#if LLVM_VERSION >= 130
+    llvm::SplitModule(*whole, num_partitions, add_partition, /* PreserveLocals */ true);
+#else
+    llvm::SplitModule(std::move(whole), num_partitions, add_partition, /* PreserveLocals */ true);
+#endif
+    internal_assert(partitions.size() == num_partitions);
+
+    const size_t num_threads = std::min((size_t)num_partitions, Internal::ThreadPool<void>::num_processors_online());
+    Internal::ThreadPool<void> pool(num_threads);
+    std::vector<std::future<void>> futures;
+    for (unsigned i = 0; i < num_partitions; i++) {
+        futures.emplace_back(pool.async([&, i]() {
+            llvm::LLVMContext context;
+            const auto &bitcode = partitions[i];
+            llvm::MemoryBufferRef buffer_ref(llvm::StringRef(bitcode.data(), bitcode.size()), object_files[i]);
+            auto partition = llvm::parseBitcodeFile(buffer_ref, context);
+            if (!partition) {
+                internal_error << "Could not read back partition " << i << ": "
+                               << llvm::toString(partition.takeError()) << "\n";
+            }
+            auto out = make_raw_fd_ostream(object_files[i]);
+            emit_module(*partition.get(), *out, llvm::CGFT_ObjectFile);
+            out->flush();
+        }));
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+
+    record_llvm_time(time_start, module);
+}
+
 void compile_llvm_module_to_assembly(llvm::Module &module, Internal::LLVMOStream &out) {
     emit_file(module, out, llvm::CGFT_AssemblyFile);
 }
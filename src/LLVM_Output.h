@@ -39,6 +39,14 @@ void compile_llvm_module_to_object(llvm::Module &module, Internal::LLVMOStream &
 void compile_llvm_module_to_assembly(llvm::Module &module, Internal::LLVMOStream &out);
 // @}
 
+/** Compile an LLVM module to one object file per entry of object_files,
+ * splitting its functions and globals between them and running the
+ * code generator on the partitions in parallel. Together the objects
+ * define the same symbols as the output of compile_llvm_module_to_object,
+ * plus hidden, uniquely named copies of its local symbols, so they can
+ * be archived into a static library in its place. */
+void compile_llvm_module_to_object_partitions(llvm::Module &module, const std::vector<std::string> &object_files);
+
 /** Compile an LLVM module to LLVM targets (bitcode, LLVM assembly). */
 // @{
 void compile_llvm_module_to_llvm_bitcode(llvm::Module &module, Internal::LLVMOStream &out);
@@ -30,6 +30,7 @@
 #include "FuseGPUThreadLoops.h"
 #include "FuzzFloatStores.h"
 #include "HexagonOffload.h"
+#include "IRInterning.h"
 #include "IRMutator.h"
 #include "IROperator.h"
 #include "IRPrinter.h"
@@ -39,7 +40,9 @@
 #include "LICM.h"
 #include "LoopCarry.h"
 #include "LowerWarpShuffles.h"
+#include "LoweringCache.h"
 #include "Memoization.h"
+#include "ParallelLowering.h"
 #include "PartitionLoops.h"
 #include "Prefetch.h"
 #include "Profiling.h"
@@ -88,6 +91,16 @@ Module lower(const vector<Function> &output_funcs,
              bool trace_pipeline,
              const vector<IRMutator *> &custom_passes) {
     auto time_start = std::chrono::high_resolution_clock::now();
+    CompilerPassLogger passes;
+
+    // Share structurally identical Exprs made while lowering.
+    ScopedIRInterning interning(get_env_variable("HL_IR_INTERNING") == "1");
+    // Remember the results of simplifier and bounds queries until
+    // lowering is done.
+    ScopedLoweringCache query_cache(get_env_variable("HL_LOWERING_CACHE") == "1");
+    // Run the passes that transform each loop nest independently on
+    // a thread pool.
+    ScopedParallelLowering parallel(get_env_variable("HL_PARALLEL_LOWERING") == "1");
 
     std::vector<std::string> namespaces;
     std::string simple_pipeline_name = extract_namespaces(pipeline_name, namespaces);
@@ -103,6 +116,7 @@ Module lower(const vector<Function> &output_funcs,
     // Create a deep-copy of the entire graph of Funcs.
     vector<Function> outputs;
     std::tie(outputs, env) = deep_copy(output_funcs, env);
+    passes.record("deep_copy", Stmt());
 
     bool any_strict_float = strictify_float(env, t);
     result_module.set_any_strict_float(any_strict_float);
@@ -119,26 +133,31 @@ Module lower(const vector<Function> &output_funcs,
 
     // Substitute in wrapper Funcs
     env = wrap_func_calls(env);
+    passes.record("wrap_func_calls", Stmt());
 
     // Compute a realization order and determine group of functions which loops
     // are to be fused together
     vector<string> order;
     vector<vector<string>> fused_groups;
     std::tie(order, fused_groups) = realization_order(outputs, env);
+    passes.record("realization_order", Stmt());
 
     // Try to simplify the RHS/LHS of a function definition by propagating its
     // specializations' conditions
     simplify_specializations(env);
+    passes.record("simplify_specializations", Stmt());
 
     debug(1) << "Creating initial loop nests...\n";
     bool any_memoized = false;
     Stmt s = schedule_functions(outputs, fused_groups, env, t, any_memoized);
+    passes.record("schedule_functions", s);
     debug(2) << "Lowering after creating initial loop nests:\n"
              << s << "\n";
 
     if (any_memoized) {
         debug(1) << "Injecting memoization...\n";
         s = inject_memoization(s, env, pipeline_name, outputs);
+        passes.record("inject_memoization", s);
         debug(2) << "Lowering after injecting memoization:\n"
                  << s << "\n";
     } else {
@@ -147,11 +166,13 @@ Module lower(const vector<Function> &output_funcs,
 
     debug(1) << "Injecting tracing...\n";
     s = inject_tracing(s, pipeline_name, trace_pipeline, env, outputs, t);
+    passes.record("inject_tracing", s);
     debug(2) << "Lowering after injecting tracing:\n"
              << s << "\n";
 
     debug(1) << "Adding checks for parameters\n";
     s = add_parameter_checks(requirements, s, t);
+    passes.record("add_parameter_checks", s);
     debug(2) << "Lowering after injecting parameter checks:\n"
              << s << "\n";
 
@@ -159,22 +180,26 @@ Module lower(const vector<Function> &output_funcs,
     // function. Used in later bounds inference passes.
     debug(1) << "Computing bounds of each function's value\n";
     FuncValueBounds func_bounds = compute_function_value_bounds(order, env);
+    passes.record("compute_function_value_bounds", s);
 
     // This pass injects nested definitions of variable names, so we
     // can't simplify statements from here until we fix them up. (We
     // can still simplify Exprs).
     debug(1) << "Performing computation bounds inference...\n";
     s = bounds_inference(s, outputs, order, fused_groups, env, func_bounds, t);
+    passes.record("bounds_inference", s);
     debug(2) << "Lowering after computation bounds inference:\n"
              << s << "\n";
 
     debug(1) << "Removing extern loops...\n";
     s = remove_extern_loops(s);
+    passes.record("remove_extern_loops", s);
     debug(2) << "Lowering after removing extern loops:\n"
              << s << "\n";
 
     debug(1) << "Performing sliding window optimization...\n";
     s = sliding_window(s, env);
+    passes.record("sliding_window", s);
     debug(2) << "Lowering after sliding window:\n"
              << s << "\n";
 
@@ -183,21 +208,25 @@ Module lower(const vector<Function> &output_funcs,
     // equivalence means semantic equivalence.
     debug(1) << "Uniquifying variable names...\n";
     s = uniquify_variable_names(s);
+    passes.record("uniquify_variable_names", s);
     debug(2) << "Lowering after uniquifying variable names:\n"
              << s << "\n\n";
 
     debug(1) << "Simplifying...\n";
     s = simplify(s, false);  // Storage folding and allocation bounds inference needs .loop_max symbols
+    passes.record("simplify", s);
     debug(2) << "Lowering after first simplification:\n"
              << s << "\n\n";
 
     debug(1) << "Simplifying correlated differences...\n";
     s = simplify_correlated_differences(s);
+    passes.record("simplify_correlated_differences", s);
     debug(2) << "Lowering after simplifying correlated differences:\n"
              << s << "\n";
 
     debug(1) << "Performing allocation bounds inference...\n";
     s = allocation_bounds_inference(s, env, func_bounds);
+    passes.record("allocation_bounds_inference", s);
     debug(2) << "Lowering after allocation bounds inference:\n"
              << s << "\n";
 
@@ -209,46 +238,55 @@ Module lower(const vector<Function> &output_funcs,
 
     debug(1) << "Adding checks for images\n";
     s = add_image_checks(s, outputs, t, order, env, func_bounds, will_inject_host_copies);
+    passes.record("add_image_checks", s);
     debug(2) << "Lowering after injecting image checks:\n"
              << s << '\n';
 
     debug(1) << "Removing code that depends on undef values...\n";
     s = remove_undef(s);
+    passes.record("remove_undef", s);
     debug(2) << "Lowering after removing code that depends on undef values:\n"
              << s << "\n\n";
 
     debug(1) << "Performing storage folding optimization...\n";
     s = storage_folding(s, env);
+    passes.record("storage_folding", s);
     debug(2) << "Lowering after storage folding:\n"
              << s << "\n";
 
     debug(1) << "Injecting debug_to_file calls...\n";
     s = debug_to_file(s, outputs, env);
+    passes.record("debug_to_file", s);
     debug(2) << "Lowering after injecting debug_to_file calls:\n"
              << s << "\n";
 
     debug(1) << "Injecting prefetches...\n";
     s = inject_prefetch(s, env);
+    passes.record("inject_prefetch", s);
     debug(2) << "Lowering after injecting prefetches:\n"
              << s << "\n\n";
 
     debug(1) << "Discarding safe promises...\n";
     s = lower_safe_promises(s);
+    passes.record("lower_safe_promises", s);
     debug(2) << "Lowering after discarding safe promises:\n"
              << s << "\n\n";
 
     debug(1) << "Dynamically skipping stages...\n";
     s = skip_stages(s, order);
+    passes.record("skip_stages", s);
     debug(2) << "Lowering after dynamically skipping stages:\n"
              << s << "\n\n";
 
     debug(1) << "Forking asynchronous producers...\n";
     s = fork_async_producers(s, env);
+    passes.record("fork_async_producers", s);
     debug(2) << "Lowering after forking asynchronous producers:\n"
              << s << "\n";
 
     debug(1) << "Destructuring tuple-valued realizations...\n";
     s = split_tuples(s, env);
+    passes.record("split_tuples", s);
     debug(2) << "Lowering after destructuring tuple-valued realizations:\n"
              << s << "\n\n";
 
@@ -258,34 +296,41 @@ Module lower(const vector<Function> &output_funcs,
         t.has_feature(Target::OpenGLCompute)) {
         debug(1) << "Canonicalizing GPU var names...\n";
         s = canonicalize_gpu_vars(s);
+        passes.record("canonicalize_gpu_vars", s);
         debug(2) << "Lowering after canonicalizing GPU var names:\n"
                  << s << "\n";
     }
 
     debug(1) << "Bounding small realizations...\n";
     s = simplify_correlated_differences(s);
+    passes.record("simplify_correlated_differences", s);
     s = bound_small_allocations(s);
+    passes.record("bound_small_allocations", s);
     debug(2) << "Lowering after bounding small realizations:\n"
              << s << "\n\n";
 
     debug(1) << "Performing storage flattening...\n";
     s = storage_flattening(s, outputs, env, t);
+    passes.record("storage_flattening", s);
     debug(2) << "Lowering after storage flattening:\n"
              << s << "\n\n";
 
     debug(1) << "Adding atomic mutex allocation...\n";
     s = add_atomic_mutex(s, env);
+    passes.record("add_atomic_mutex", s);
     debug(2) << "Lowering after adding atomic mutex allocation:\n"
              << s << "\n\n";
 
     debug(1) << "Unpacking buffer arguments...\n";
     s = unpack_buffers(s);
+    passes.record("unpack_buffers", s);
     debug(2) << "Lowering after unpacking buffer arguments...\n"
              << s << "\n\n";
 
     if (any_memoized) {
         debug(1) << "Rewriting memoized allocations...\n";
         s = rewrite_memoized_allocations(s, env);
+        passes.record("rewrite_memoized_allocations", s);
         debug(2) << "Lowering after rewriting memoized allocations:\n"
                  << s << "\n\n";
     } else {
@@ -295,45 +340,57 @@ Module lower(const vector<Function> &output_funcs,
     if (will_inject_host_copies) {
         debug(1) << "Selecting a GPU API for GPU loops...\n";
         s = select_gpu_api(s, t);
+        passes.record("select_gpu_api", s);
         debug(2) << "Lowering after selecting a GPU API:\n"
                  << s << "\n\n";
 
         debug(1) << "Injecting host <-> dev buffer copies...\n";
         s = inject_host_dev_buffer_copies(s, t);
+        passes.record("inject_host_dev_buffer_copies", s);
         debug(2) << "Lowering after injecting host <-> dev buffer copies:\n"
                  << s << "\n\n";
 
         debug(1) << "Selecting a GPU API for extern stages...\n";
         s = select_gpu_api(s, t);
+        passes.record("select_gpu_api", s);
         debug(2) << "Lowering after selecting a GPU API for extern stages:\n"
                  << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
     s = simplify(s);
+    passes.record("simplify", s);
     s = unify_duplicate_lets(s);
+    passes.record("unify_duplicate_lets", s);
     debug(2) << "Lowering after second simplifcation:\n"
              << s << "\n\n";
 
     debug(1) << "Reduce prefetch dimension...\n";
     s = reduce_prefetch_dimension(s, t);
+    passes.record("reduce_prefetch_dimension", s);
     debug(2) << "Lowering after reduce prefetch dimension:\n"
              << s << "\n";
 
     debug(1) << "Simplifying correlated differences...\n";
     s = simplify_correlated_differences(s);
+    passes.record("simplify_correlated_differences", s);
     debug(2) << "Lowering after simplifying correlated differences:\n"
              << s << "\n";
 
     debug(1) << "Unrolling...\n";
-    s = unroll_loops(s);
+    // Unrolling may look at the lets around a loop.
+    s = mutate_loops_in_parallel(s, unroll_loops, true);
+    passes.record("unroll_loops", s);
     s = simplify(s);
+    passes.record("simplify", s);
     debug(2) << "Lowering after unrolling:\n"
              << s << "\n\n";
 
     debug(1) << "Vectorizing...\n";
-    s = vectorize_loops(s, env, t);
+    s = mutate_loops_in_parallel(s, [&](const Stmt &s) { return vectorize_loops(s, env, t); });
+    passes.record("vectorize_loops", s);
     s = simplify(s);
+    passes.record("simplify", s);
     debug(2) << "Lowering after vectorizing:\n"
              << s << "\n\n";
 
@@ -341,57 +398,69 @@ Module lower(const vector<Function> &output_funcs,
         t.has_feature(Target::OpenGLCompute)) {
         debug(1) << "Injecting per-block gpu synchronization...\n";
         s = fuse_gpu_thread_loops(s);
+        passes.record("fuse_gpu_thread_loops", s);
         debug(2) << "Lowering after injecting per-block gpu synchronization:\n"
                  << s << "\n\n";
     }
 
     debug(1) << "Detecting vector interleavings...\n";
     s = rewrite_interleavings(s);
+    passes.record("rewrite_interleavings", s);
     s = simplify(s);
+    passes.record("simplify", s);
     debug(2) << "Lowering after rewriting vector interleavings:\n"
              << s << "\n\n";
 
     debug(1) << "Partitioning loops to simplify boundary conditions...\n";
-    s = partition_loops(s);
+    s = mutate_loops_in_parallel(s, partition_loops);
+    passes.record("partition_loops", s);
     s = simplify(s);
+    passes.record("simplify", s);
     debug(2) << "Lowering after partitioning loops:\n"
              << s << "\n\n";
 
     debug(1) << "Trimming loops to the region over which they do something...\n";
     s = trim_no_ops(s);
+    passes.record("trim_no_ops", s);
     debug(2) << "Lowering after loop trimming:\n"
              << s << "\n\n";
 
     debug(1) << "Hoisting loop invariant if statements...\n";
     s = hoist_loop_invariant_if_statements(s);
+    passes.record("hoist_loop_invariant_if_statements", s);
     debug(2) << "Lowering after hoisting loop invariant if statements:\n"
              << s << "\n\n";
 
     debug(1) << "Injecting early frees...\n";
     s = inject_early_frees(s);
+    passes.record("inject_early_frees", s);
     debug(2) << "Lowering after injecting early frees:\n"
              << s << "\n\n";
 
     if (t.has_feature(Target::FuzzFloatStores)) {
         debug(1) << "Fuzzing floating point stores...\n";
         s = fuzz_float_stores(s);
+        passes.record("fuzz_float_stores", s);
         debug(2) << "Lowering after fuzzing floating point stores:\n"
                  << s << "\n\n";
     }
 
     debug(1) << "Simplifying correlated differences...\n";
     s = simplify_correlated_differences(s);
+    passes.record("simplify_correlated_differences", s);
     debug(2) << "Lowering after simplifying correlated differences:\n"
              << s << "\n";
 
     debug(1) << "Bounding small allocations...\n";
     s = bound_small_allocations(s);
+    passes.record("bound_small_allocations", s);
     debug(2) << "Lowering after bounding small allocations:\n"
              << s << "\n\n";
 
     if (t.has_feature(Target::Profile)) {
         debug(1) << "Injecting profiling...\n";
         s = inject_profiling(s, pipeline_name);
+        passes.record("inject_profiling", s);
         debug(2) << "Lowering after injecting profiling:\n"
                  << s << "\n\n";
     }
@@ -399,32 +468,40 @@ Module lower(const vector<Function> &output_funcs,
     if (t.has_feature(Target::CUDA)) {
         debug(1) << "Injecting warp shuffles...\n";
         s = lower_warp_shuffles(s);
+        passes.record("lower_warp_shuffles", s);
         debug(2) << "Lowering after injecting warp shuffles:\n"
                  << s << "\n\n";
     }
 
     debug(1) << "Simplifying...\n";
-    s = common_subexpression_elimination(s);
+    s = mutate_loops_in_parallel(s, [](const Stmt &s) { return common_subexpression_elimination(s); });
+    passes.record("common_subexpression_elimination", s);
 
     debug(1) << "Lowering unsafe promises...\n";
     s = lower_unsafe_promises(s, t);
+    passes.record("lower_unsafe_promises", s);
     debug(2) << "Lowering after lowering unsafe promises:\n"
              << s << "\n\n";
 
     debug(1) << "Flattening nested ramps...\n";
     s = flatten_nested_ramps(s);
+    passes.record("flatten_nested_ramps", s);
     debug(2) << "Lowering after flattening nested ramps:\n"
              << s << "\n\n";
 
     debug(1) << "Removing dead allocations and moving loop invariant code...\n";
     s = remove_dead_allocations(s);
+    passes.record("remove_dead_allocations", s);
     s = simplify(s);
+    passes.record("simplify", s);
     s = hoist_loop_invariant_values(s);
+    passes.record("hoist_loop_invariant_values", s);
     debug(2) << "Lowering after removing dead allocations and hoisting loop invariant values:\n"
              << s << "\n\n";
 
     debug(1) << "Finding intrinsics...\n";
     s = find_intrinsics(s);
+    passes.record("find_intrinsics", s);
     debug(2) << "Lowering after finding intrinsics:\n"
              << s << "\n\n";
 
@@ -434,6 +511,7 @@ Module lower(const vector<Function> &output_funcs,
     if (t.arch != Target::Hexagon && t.has_feature(Target::HVX)) {
         debug(1) << "Splitting off Hexagon offload...\n";
         s = inject_hexagon_rpc(s, t, result_module);
+        passes.record("inject_hexagon_rpc", s);
         debug(2) << "Lowering after splitting off Hexagon offload:\n"
                  << s << "\n";
     } else {
@@ -444,6 +522,7 @@ Module lower(const vector<Function> &output_funcs,
         for (size_t i = 0; i < custom_passes.size(); i++) {
             debug(1) << "Running custom lowering pass " << i << "...\n";
             s = custom_passes[i]->mutate(s);
+            passes.record("custom_pass_" + std::to_string(i), s);
             debug(1) << "Lowering after custom pass " << i << ":\n"
                      << s << "\n\n";
         }
@@ -459,6 +538,7 @@ Module lower(const vector<Function> &output_funcs,
     }
 
     vector<InferredArgument> inferred_args = infer_arguments(s, outputs);
+    passes.record("infer_arguments", s);
     for (const InferredArgument &arg : inferred_args) {
         if (arg.param.defined() && arg.param.name() == "__user_context") {
             // The user context is always in the inferred args, but is
@@ -0,0 +1,361 @@
+#include "LoweringCache.h"
+#include "Debug.h"
+#include "IR.h"
+#include "IRVisitor.h"
+#include "Simplify.h"
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace Halide {
+namespace Internal {
+
+namespace {
+
+using std::string;
+using std::vector;
+
+// The names a node looks up in a scope, and the functions whose
+// value bounds it looks up. Found once per node.
+struct Dependencies {
+    vector<string> names;
+    vector<std::pair<string, int>> calls;
+};
+
+class FindDependencies : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    // Let names are included too: they shadow entries in the scope,
+    // and some queries look up their bounds.
+    void visit(const Variable *op) override {
+        names.insert(op->name);
+    }
+
+    void visit(const Let *op) override {
+        names.insert(op->name);
+        IRGraphVisitor::visit(op);
+    }
+
+    void visit(const LetStmt *op) override {
+        names.insert(op->name);
+        IRGraphVisitor::visit(op);
+    }
+
+    void visit(const For *op) override {
+        names.insert(op->name);
+        names.insert(op->name + ".loop_min");
+        names.insert(op->name + ".loop_max");
+        IRGraphVisitor::visit(op);
+    }
+
+    void visit(const Call *op) override {
+        if (op->call_type == Call::Halide) {
+            calls.emplace(op->name, op->value_index);
+        }
+        IRGraphVisitor::visit(op);
+    }
+
+public:
+    std::set<string> names;
+    std::set<std::pair<string, int>> calls;
+};
+
+enum class Query : uint8_t {
+    Simplify,
+    CanProve,
+    Bounds,
+    Boxes,
+};
+
+struct Key {
+    Query query;
+    uint8_t flags = 0;
+    IRHandle e, s;
+    string fn;
+    // The scope entries and function value bounds for each dependency
+    // in order, with a flag in ints for whether each one is present.
+    vector<Expr> facts;
+    vector<int64_t> ints;
+    size_t hash = 0;
+
+    bool operator==(const Key &other) const {
+        if (hash != other.hash ||
+            query != other.query ||
+            flags != other.flags ||
+            !e.same_as(other.e) ||
+            !s.same_as(other.s) ||
+            fn != other.fn ||
+            ints != other.ints ||
+            facts.size() != other.facts.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < facts.size(); i++) {
+            if (!facts[i].same_as(other.facts[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct KeyHash {
+    size_t operator()(const Key &k) const {
+        return k.hash;
+    }
+};
+
+inline void hash_combine(size_t &h, size_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+// Stop remembering results when a table gets this big, so that a huge
+// pipeline can't hold on to all the IR it ever made.
+const size_t max_entries = 1 << 16;
+
+// Totals across all caches, for reporting.
+std::atomic<uint64_t> total_hits[4], total_misses[4];
+
+template<typename T>
+struct Memo {
+    std::unordered_map<Key, T, KeyHash> results;
+    uint64_t hits = 0, misses = 0;
+
+    T get(Key &&key, const std::function<T()> &compute) {
+        const int q = (int)key.query;
+        auto it = results.find(key);
+        if (it != results.end()) {
+            hits++;
+            total_hits[q]++;
+            return it->second;
+        }
+        misses++;
+        total_misses[q]++;
+        // Queries recurse into other queries, so don't hold on to the
+        // iterator while computing.
+        T result = compute();
+        if (results.size() >= max_entries) {
+            results.clear();
+        }
+        results.emplace(std::move(key), result);
+        return result;
+    }
+};
+
+struct Cache {
+    std::unordered_map<const IRNode *, std::pair<IRHandle, Dependencies>> dependencies;
+    Memo<Expr> simplify;
+    Memo<bool> can_prove;
+    Memo<Interval> bounds;
+    Memo<std::map<string, Box>> boxes;
+
+    const Dependencies &dependencies_of(const IRHandle &n) {
+        static const Dependencies none;
+        if (!n.defined()) {
+            return none;
+        }
+        auto it = dependencies.find(n.get());
+        if (it != dependencies.end()) {
+            return it->second.second;
+        }
+        FindDependencies finder;
+        n.get()->accept(&finder);
+        Dependencies d;
+        d.names.assign(finder.names.begin(), finder.names.end());
+        d.calls.assign(finder.calls.begin(), finder.calls.end());
+        if (dependencies.size() >= max_entries) {
+            dependencies.clear();
+        }
+        return dependencies.emplace(n.get(), std::make_pair(n, std::move(d))).first->second.second;
+    }
+};
+
+// The cache is per-thread, so that none of this needs locks.
+thread_local Cache *current_cache = nullptr;
+
+void add_fact(Key &key, bool present, const Interval &i) {
+    key.ints.push_back(present);
+    if (present) {
+        key.facts.push_back(i.min);
+        key.facts.push_back(i.max);
+    }
+}
+
+// Add the entries for the names a node uses. If top_level_only is
+// true, only entries in the innermost scope count, as in the
+// simplifier. Otherwise containing scopes count too.
+void add_scope_facts(Key &key, const Dependencies &d, const Scope<Interval> &scope, bool top_level_only) {
+    for (const string &n : d.names) {
+        bool present = top_level_only ? scope.count(n) > 0 : scope.contains(n);
+        add_fact(key, present, present ? scope.get(n) : Interval());
+    }
+}
+
+// Add the alignments the simplifier would use for the names a node
+// uses. It only looks them up for names in the innermost level of the
+// bounds scope.
+void add_alignment_facts(Key &key, const Dependencies &d, const Scope<Interval> &bounds,
+                         const Scope<ModulusRemainder> &alignment) {
+    for (const string &n : d.names) {
+        if (bounds.count(n) > 0) {
+            ModulusRemainder m = simplify_alignment_of(alignment, n);
+            key.ints.push_back(m.modulus);
+            key.ints.push_back(m.remainder);
+        }
+    }
+}
+
+void add_func_facts(Key &key, const Dependencies &d, const FuncValueBounds &fb) {
+    for (const auto &c : d.calls) {
+        auto it = fb.find(c);
+        add_fact(key, it != fb.end(), it != fb.end() ? it->second : Interval());
+    }
+}
+
+void finish_key(Key &key) {
+    size_t h = (size_t)key.query;
+    hash_combine(h, key.flags);
+    hash_combine(h, std::hash<const void *>()(key.e.get()));
+    hash_combine(h, std::hash<const void *>()(key.s.get()));
+    hash_combine(h, std::hash<string>()(key.fn));
+    for (const Expr &f : key.facts) {
+        hash_combine(h, std::hash<const void *>()(f.get()));
+    }
+    for (int64_t i : key.ints) {
+        hash_combine(h, std::hash<int64_t>()(i));
+    }
+    key.hash = h;
+}
+
+LoweringCacheStats::Counts counts(Query q) {
+    LoweringCacheStats::Counts c;
+    c.hits = total_hits[(int)q];
+    c.misses = total_misses[(int)q];
+    return c;
+}
+
+}  // namespace
+
+ScopedLoweringCache::ScopedLoweringCache(bool enable) {
+    if (enable && !current_cache) {
+        current_cache = new Cache;
+        owner = true;
+    }
+}
+
+ScopedLoweringCache::~ScopedLoweringCache() {
+    if (owner) {
+        Cache *c = current_cache;
+        auto report = [](const char *name, uint64_t hits, uint64_t misses) {
+            if (hits + misses) {
+                debug(1) << "  " << name << ": " << hits << " hits, " << misses << " misses ("
+                         << (100 * hits) / (hits + misses) << "%)\n";
+            }
+        };
+        debug(1) << "Lowering cache:\n";
+        report("simplify", c->simplify.hits, c->simplify.misses);
+        report("can_prove", c->can_prove.hits, c->can_prove.misses);
+        report("bounds_of_expr_in_scope", c->bounds.hits, c->bounds.misses);
+        report("boxes_touched", c->boxes.hits, c->boxes.misses);
+        current_cache = nullptr;
+        delete c;
+    }
+}
+
+bool lowering_cache_enabled() {
+    return current_cache != nullptr;
+}
+
+Expr cached_simplify(const Expr &e, bool remove_dead_lets,
+                     const Scope<Interval> &bounds,
+                     const Scope<ModulusRemainder> &alignment,
+                     const std::function<Expr()> &compute) {
+    Cache *c = current_cache;
+    if (!c || !e.defined()) {
+        return compute();
+    }
+    Key key;
+    key.query = Query::Simplify;
+    key.flags = remove_dead_lets;
+    key.e = e;
+    const Dependencies &d = c->dependencies_of(e);
+    // The simplifier only uses the innermost level of its scopes.
+    add_scope_facts(key, d, bounds, true);
+    add_alignment_facts(key, d, bounds, alignment);
+    finish_key(key);
+    return c->simplify.get(std::move(key), compute);
+}
+
+bool cached_can_prove(const Expr &e, const Scope<Interval> &bounds,
+                      const std::function<bool()> &compute) {
+    Cache *c = current_cache;
+    if (!c || !e.defined()) {
+        return compute();
+    }
+    Key key;
+    key.query = Query::CanProve;
+    key.e = e;
+    add_scope_facts(key, c->dependencies_of(e), bounds, true);
+    finish_key(key);
+    return c->can_prove.get(std::move(key), compute);
+}
+
+Interval cached_bounds_of_expr_in_scope(const Expr &e, const Scope<Interval> &scope,
+                                        const FuncValueBounds &fb, bool const_bound,
+                                        const std::function<Interval()> &compute) {
+    Cache *c = current_cache;
+    if (!c || !e.defined()) {
+        return compute();
+    }
+    Key key;
+    key.query = Query::Bounds;
+    key.flags = const_bound;
+    key.e = e;
+    const Dependencies &d = c->dependencies_of(e);
+    add_scope_facts(key, d, scope, false);
+    add_func_facts(key, d, fb);
+    finish_key(key);
+    return c->bounds.get(std::move(key), compute);
+}
+
+std::map<string, Box> cached_boxes_touched(const Expr &e, const Stmt &s,
+                                           bool consider_calls, bool consider_provides,
+                                           const string &fn,
+                                           const Scope<Interval> &scope,
+                                           const FuncValueBounds &fb,
+                                           const std::function<std::map<string, Box>()> &compute) {
+    Cache *c = current_cache;
+    if (!c) {
+        return compute();
+    }
+    Key key;
+    key.query = Query::Boxes;
+    key.flags = consider_calls | (consider_provides << 1);
+    key.e = e;
+    key.s = s;
+    key.fn = fn;
+    // Copy these, because finding the dependencies of s may clear the
+    // table that those of e live in.
+    const Dependencies de = c->dependencies_of(e);
+    const Dependencies &ds = c->dependencies_of(s);
+    add_scope_facts(key, de, scope, false);
+    add_scope_facts(key, ds, scope, false);
+    add_func_facts(key, de, fb);
+    add_func_facts(key, ds, fb);
+    finish_key(key);
+    return c->boxes.get(std::move(key), compute);
+}
+
+LoweringCacheStats get_lowering_cache_stats() {
+    LoweringCacheStats stats;
+    stats.simplify = counts(Query::Simplify);
+    stats.can_prove = counts(Query::CanProve);
+    stats.bounds = counts(Query::Bounds);
+    stats.boxes = counts(Query::Boxes);
+    return stats;
+}
+
+}  // namespace Internal
+}  // namespace Halide
@@ -0,0 +1,86 @@
+#ifndef HALIDE_LOWERING_CACHE_H
+#define HALIDE_LOWERING_CACHE_H
+
+/** \file
+ * Memoization of simplifier and bounds queries during lowering.
+ *
+ * Lowering asks the same questions many times: several passes
+ * simplify the same index expressions, prove the same conditions, and
+ * compute the bounds of the same expressions in the same scopes. While
+ * a ScopedLoweringCache is active on a thread, simplify(Expr),
+ * can_prove, bounds_of_expr_in_scope and the boxes_* queries remember
+ * their results, keyed on the identity of the Expr or Stmt and on the
+ * scope entries and function value bounds for the names it uses.
+ *
+ * Nodes that passes leave unchanged keep their identity, so the cache
+ * hits across passes. With IR interning (see IRInterning.h) rebuilt
+ * nodes do too.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+#include "Bounds.h"
+#include "Interval.h"
+#include "ModulusRemainder.h"
+#include "Scope.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Caches queries made on this thread for the lifetime of the
+ * object. Nested scopes share the outermost one's cache. */
+class ScopedLoweringCache {
+    bool owner = false;
+
+public:
+    explicit ScopedLoweringCache(bool enable = true);
+    ~ScopedLoweringCache();
+
+    ScopedLoweringCache(const ScopedLoweringCache &) = delete;
+    ScopedLoweringCache &operator=(const ScopedLoweringCache &) = delete;
+};
+
+/** Is a cache active on this thread? */
+bool lowering_cache_enabled();
+
+/** Return the cached result of a query with the same arguments, or
+ * call compute and remember its result. Each one calls compute
+ * directly if no cache is active. */
+// @{
+Expr cached_simplify(const Expr &e, bool remove_dead_lets,
+                     const Scope<Interval> &bounds,
+                     const Scope<ModulusRemainder> &alignment,
+                     const std::function<Expr()> &compute);
+
+bool cached_can_prove(const Expr &e, const Scope<Interval> &bounds,
+                      const std::function<bool()> &compute);
+
+Interval cached_bounds_of_expr_in_scope(const Expr &e, const Scope<Interval> &scope,
+                                        const FuncValueBounds &fb, bool const_bound,
+                                        const std::function<Interval()> &compute);
+
+std::map<std::string, Box> cached_boxes_touched(const Expr &e, const Stmt &s,
+                                                bool consider_calls, bool consider_provides,
+                                                const std::string &fn,
+                                                const Scope<Interval> &scope,
+                                                const FuncValueBounds &fb,
+                                                const std::function<std::map<std::string, Box>()> &compute);
+// @}
+
+/** Hit counts for each kind of query, summed over all threads. */
+struct LoweringCacheStats {
+    struct Counts {
+        uint64_t hits = 0, misses = 0;
+    };
+    Counts simplify, can_prove, bounds, boxes;
+};
+
+LoweringCacheStats get_lowering_cache_stats();
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
@@ -3,6 +3,7 @@
 #include "Function.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "IRPrinter.h"
 #include "IRVisitor.h"
 #include "Param.h"
 #include "Scope.h"
@@ -10,21 +11,38 @@
 #include "Var.h"
 
 #include <map>
+#include <set>
+#include <sstream>
 
 namespace Halide {
 namespace Internal {
 
 namespace {
 
+// 64-bit FNV-1a
+uint64_t fnv1a(const uint8_t *data, size_t size, uint64_t h = 0xcbf29ce484222325ULL) {
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
 class FindParameterDependencies : public IRGraphVisitor {
 public:
     FindParameterDependencies() = default;
     ~FindParameterDependencies() override = default;
 
     void visit_function(const Function &function) {
+        if (!visited_functions.insert(function.name()).second) {
+            return;
+        }
+        describe(function);
         function.accept(this);
 
         if (function.has_extern_definition()) {
+            // The name is all we know about the extern stage, and the
+            // function it names may be different in another process.
+            persistable = false;
             const std::vector<ExternFuncArgument> &extern_args =
                 function.extern_arguments();
             for (size_t i = 0; i < extern_args.size(); i++) {
@@ -47,6 +65,18 @@ public:
             record(call->param);
         }
 
+        if (call->image.defined()) {
+            describe(call->image);
+        }
+
+        // As with extern stages, an impure extern function is only
+        // known by name. Pure ones are assumed to be the same function
+        // everywhere, like the math library ones.
+        if (call->call_type == Call::Extern ||
+            call->call_type == Call::ExternCPlusPlus) {
+            persistable = false;
+        }
+
         if (call->is_intrinsic(Call::memoize_expr)) {
             internal_assert(!call->args.empty());
             if (call->args.size() == 1) {
@@ -118,7 +148,73 @@ public:
         info.type = expr.type();
         info.size_expr = info.type.bytes();
         info.value_expr = expr;
-        dependency_info[DependencyKey(info.type.bytes(), unique_name("memoize_tag"))] = info;
+        // Named by a count rather than unique_name, so that the order
+        // of the key doesn't depend on what else the process has
+        // compiled.
+        dependency_info[DependencyKey(info.type.bytes(), "memoize_tag$" + std::to_string(memoize_tags++))] = info;
+    }
+
+    // Print the definitions of a Func, for hashing into the key.
+    void describe(const Function &function) {
+        std::ostringstream s;
+        auto describe_definition = [&](const Definition &def) {
+            s << function.name() << "(";
+            for (const Expr &arg : def.args()) {
+                s << arg << ", ";
+            }
+            s << ") =";
+            for (const Expr &value : def.values()) {
+                s << " " << value;
+            }
+            s << " if " << def.predicate() << "\n";
+        };
+        if (function.has_pure_definition()) {
+            describe_definition(function.definition());
+        }
+        for (const Definition &def : function.updates()) {
+            describe_definition(def);
+        }
+        if (function.has_extern_definition()) {
+            s << function.name() << " = " << function.extern_function_name() << "(";
+            for (const ExternFuncArgument &arg : function.extern_arguments()) {
+                if (arg.is_func()) {
+                    s << Function(arg.func).name();
+                } else if (arg.is_expr()) {
+                    s << arg.expr;
+                } else if (arg.is_buffer()) {
+                    s << arg.buffer.name();
+                } else if (arg.is_image_param()) {
+                    s << arg.image_param.name();
+                }
+                s << ", ";
+            }
+            s << ")\n";
+        }
+        definitions[function.name()] = s.str();
+    }
+
+    // Print the shape of a Buffer embedded in a definition, and a
+    // digest of its contents.
+    void describe(const Buffer<> &buffer) {
+        const std::string key = "buffer " + buffer.name();
+        if (definitions.count(key)) {
+            return;
+        }
+        std::ostringstream s;
+        s << buffer.name() << " : " << buffer.type();
+        for (int i = 0; i < buffer.dimensions(); i++) {
+            s << " [" << buffer.dim(i).min()
+              << ", " << buffer.dim(i).extent()
+              << ", " << buffer.dim(i).stride() << "]";
+        }
+        if (buffer.data() == nullptr || buffer.device_dirty()) {
+            // Can't see the contents.
+            persistable = false;
+        } else {
+            s << " " << fnv1a((const uint8_t *)buffer.begin(), buffer.size_in_bytes());
+        }
+        s << "\n";
+        definitions[key] = s.str();
     }
 
     // Used to make sure larger parameters come before smaller ones
@@ -148,6 +244,19 @@ public:
     };
 
     std::map<DependencyKey, DependencyInfo> dependency_info;
+
+    // The printed definitions of the Funcs the memoized Func depends
+    // on, by name, and of the Buffers they use.
+    std::map<std::string, std::string> definitions;
+
+    // Whether everything the memoized Func depends on is captured by
+    // the key and the definitions, so that the result may be reused
+    // by another process.
+    bool persistable = true;
+
+private:
+    std::set<std::string> visited_functions;
+    int memoize_tags = 0;
 };
 
 typedef std::pair<FindParameterDependencies::DependencyKey, FindParameterDependencies::DependencyInfo> DependencyKeyInfoPair;
@@ -158,7 +267,7 @@ class KeyInfo {
     Expr key_size_expr;
     const std::string &top_level_name;
     const std::string &function_name;
-    int memoize_instance;
+    uint64_t definition_hash;
 
     size_t parameters_alignment() {
         int32_t max_alignment = 0;
@@ -177,14 +286,33 @@ class KeyInfo {
         return size_t(1) << i;
     }
 
+    // A hash of the definitions of the memoized Func and everything it
+    // depends on, and of the types and sources of the parameters in
+    // the key. It is the same each time the same pipeline is built, in
+    // this process or another, so the persistent cache can find results
+    // computed by earlier builds, but it changes when the code does.
+    // The lowest bit is set if the result may be persisted at all
+    // (see halide_memoization_cache_set_persistent_file).
+    uint64_t compute_definition_hash() const {
+        std::ostringstream s;
+        for (const auto &it : dependencies.definitions) {
+            s << it.second;
+        }
+        for (const ConstDependencyKeyInfoPair &i : dependencies.dependency_info) {
+            s << i.second.type << " " << i.second.value_expr << "\n";
+        }
+        const std::string str = s.str();
+        uint64_t h = fnv1a((const uint8_t *)str.data(), str.size());
+        return (h & ~(uint64_t)1) | (dependencies.persistable ? 1 : 0);
+    }
+
     // TODO: Using the full names in the key results in a (hopefully incredibly
     // slight) performance difference based on how one names filters and
     // functions. It is arguably a little easier to debug if something
     // goes wrong as one doesn't need to destructure the cache key by hand
-    // in the debugger. Also, if a pointer is used, a counter must also be
-    // put in the cache key to avoid aliasing on reuse of the address in
-    // JIT situations where code is regenerated into the same region of
-    // memory.
+    // in the debugger. Also, if a pointer is used, the definition hash
+    // in the key is what keeps code regenerated into the same region of
+    // memory in JIT situations from aliasing different computations.
     //
     // There is a plan to change the hash function used in the cache and
     // after that happens, we'll measure performance again and maybe decide
@@ -192,13 +320,13 @@ class KeyInfo {
     // It was deleted as part of the address_of intrinsic cleanup).
 
 public:
-    KeyInfo(const Function &function, const std::string &name, int memoize_instance)
+    KeyInfo(const Function &function, const std::string &name)
         : top_level_name(name),
-          function_name(function.origin_name()),
-          memoize_instance(memoize_instance) {
+          function_name(function.origin_name()) {
         dependencies.visit_function(function);
+        definition_hash = compute_definition_hash();
         size_t size_so_far = 0;
-        size_so_far += Handle().bytes() + 4;
+        size_so_far += Handle().bytes() + 8;
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -235,13 +363,16 @@ public:
         size_t alignment = Handle().bytes();
         index += Handle().bytes();
 
-        // Halide compilation is not threadsafe anyway...
-        writes.push_back(Store::make(key_name,
-                                     memoize_instance,
-                                     (index / Int(32).bytes()),
-                                     Parameter(), const_true(), ModulusRemainder()));
-        alignment += 4;
-        index += 4;
+        // Written as two words, low word first, because the pointer
+        // may only be 4 bytes.
+        for (int i = 0; i < 2; i++) {
+            writes.push_back(Store::make(key_name,
+                                         make_const(UInt(32), (uint64_t)(uint32_t)(definition_hash >> (32 * i))),
+                                         (index / UInt(32).bytes()),
+                                         Parameter(), const_true(), ModulusRemainder()));
+            alignment += 4;
+            index += 4;
+        }
 
         size_t needed_alignment = parameters_alignment();
         if (needed_alignment > 1) {
@@ -322,15 +453,13 @@ public:
 class InjectMemoization : public IRMutator {
 public:
     const std::map<std::string, Function> &env;
-    int memoize_instance;
     const std::string &top_level_name;
     const std::vector<Function> &outputs;
 
     InjectMemoization(const std::map<std::string, Function> &e,
-                      int memoize_instance,
                       const std::string &name,
                       const std::vector<Function> &outputs)
-        : env(e), memoize_instance(memoize_instance), top_level_name(name), outputs(outputs) {
+        : env(e), top_level_name(name), outputs(outputs) {
     }
 
 private:
@@ -363,7 +492,7 @@ private:
 
             Stmt mutated_body = mutate(op->body);
 
-            KeyInfo key_info(f, top_level_name, memoize_instance);
+            KeyInfo key_info(f, top_level_name);
 
             std::string cache_key_name = op->name + ".cache_key";
             std::string cache_result_name = op->name + ".cache_result";
@@ -433,7 +562,7 @@ private:
                 return ProducerConsumer::make(op->name, op->is_producer, mutated_body);
             } else {
                 const Function f(iter->second);
-                KeyInfo key_info(f, top_level_name, memoize_instance);
+                KeyInfo key_info(f, top_level_name);
 
                 std::string cache_key_name = op->name + ".cache_key";
                 std::string computed_bounds_name = op->name + ".computed_bounds.buffer";
@@ -461,13 +590,7 @@ private:
 Stmt inject_memoization(const Stmt &s, const std::map<std::string, Function> &env,
                         const std::string &name,
                         const std::vector<Function> &outputs) {
-    // Cache keys use the addresses of names of Funcs. For JIT, a
-    // counter for the pipeline is needed as the address may be reused
-    // across pipelines. This isn't a problem when using full names as
-    // the function names already are uniquefied by a counter.
-    static std::atomic<int> memoize_instance{0};
-
-    InjectMemoization injector(env, memoize_instance++, name, outputs);
+    InjectMemoization injector(env, name, outputs);
 
     return injector.mutate(s);
 }
@@ -1,5 +1,6 @@
 #include "Module.h"
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <future>
@@ -18,6 +19,7 @@
 #include "Pipeline.h"
 #include "PythonExtensionGen.h"
 #include "StmtToHtml.h"
+#include "ThreadPool.h"
 
 using Halide::Internal::debug;
 
@@ -140,6 +142,20 @@ std::string add_suffix(const std::string &path, const std::string &suffix) {
     }
 }
 
+// The number of objects to split the code of a static library between,
+// so that LLVM can generate them in parallel. The split depends only on
+// this number, so a build with the same setting is reproducible on any
+// machine.
+int get_codegen_partitions() {
+    const std::string partitions = get_env_variable("HL_CODEGEN_PARTITIONS");
+    if (partitions.empty()) {
+        return 1;
+    }
+    int n = std::atoi(partitions.c_str());
+    user_assert(n > 0) << "HL_CODEGEN_PARTITIONS must be a positive integer, not \"" << partitions << "\"\n";
+    return n;
+}
+
 void validate_outputs(const std::map<Output, std::string> &in) {
     // We don't care about the extensions, so any Target will do
     auto known = get_output_info(Target());
@@ -605,7 +621,22 @@ void Module::compile(const std::map<Output, std::string> &output_files) const {
             // at the same time, so there is no meaningful performance advantage
             // to be had.
             TemporaryObjectFileDir temp_dir;
-            {
+            const int partitions = get_codegen_partitions();
+            if (partitions > 1) {
+                std::vector<std::string> objects;
+                for (int i = 0; i < partitions; i++) {
+                    objects.push_back(temp_dir.add_temp_object_file(output_files.at(Output::static_library), "_" + std::to_string(i), target()));
+                }
+                debug(1) << "Module.compile(): " << partitions << " temporary objects\n";
+                compile_llvm_module_to_object_partitions(*llvm_module, objects);
+                if (logger && !contains(output_files, Output::object)) {
+                    uint64_t size = 0;
+                    for (const auto &object : objects) {
+                        size += file_stat(object).file_size;
+                    }
+                    logger->record_object_code_size(size);
+                }
+            } else {
                 std::string object = temp_dir.add_temp_object_file(output_files.at(Output::static_library), "", target());
                 debug(1) << "Module.compile(): temporary object " << object << "\n";
                 auto out = make_raw_fd_ostream(object);
@@ -705,6 +736,7 @@ void Module::compile(const std::map<Output, std::string> &output_files) const {
     // If HL_DEBUG_COMPILER_LOGGER is set, dump the log (if any) to stderr now, whether or it is required
     if (get_env_variable("HL_DEBUG_COMPILER_LOGGER") == "1" && get_compiler_logger() != nullptr) {
         get_compiler_logger()->emit_to_stream(std::cerr);
+        get_compiler_logger()->emit_pass_summary_to_stream(std::cerr);
     }
 }
 
@@ -731,6 +763,49 @@ void compile_standalone_runtime(const std::string &object_filename, const Target
 
 namespace {
 
+// The number of sub-targets compile_multitarget may lower and compile
+// at once. Each one holds a Module and its LLVM module in memory.
+int get_multitarget_jobs() {
+    const std::string jobs = get_env_variable("HL_MULTITARGET_JOBS");
+    if (jobs.empty()) {
+        return 1;
+    }
+    int n = std::atoi(jobs.c_str());
+    user_assert(n > 0) << "HL_MULTITARGET_JOBS must be a positive integer, not \"" << jobs << "\"\n";
+    return n;
+}
+
+// Run the tasks of a multitarget build, several at a time if
+// HL_MULTITARGET_JOBS allows it. Each task names things as a
+// unique_name() task of its own, whether or not it runs in parallel,
+// so the names in the output depend only on the task's position, not
+// on how the tasks interleave or how many run at once.
+void run_multitarget_tasks(const std::vector<std::function<void()>> &tasks) {
+    const UniqueNameTaskIds ids = reserve_unique_name_tasks((int)tasks.size());
+    size_t num_threads = std::min({(size_t)get_multitarget_jobs(), tasks.size(),
+                                   ThreadPool<void>::num_processors_online()});
+    // Debug output from several threads at once is unreadable.
+    if (num_threads <= 1 || debug::debug_level() > 0) {
+        for (size_t i = 0; i < tasks.size(); i++) {
+            ScopedUniqueNameTask naming(ids[(int)i]);
+            tasks[i]();
+        }
+        return;
+    }
+
+    ThreadPool<void> pool(num_threads);
+    std::vector<std::future<void>> futures;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        futures.emplace_back(pool.async([&, i]() {
+            ScopedUniqueNameTask naming(ids[(int)i]);
+            tasks[i]();
+        }));
+    }
+    for (auto &f : futures) {
+        f.get();
+    }
+}
+
 class ScopedCompilerLogger {
 public:
     ScopedCompilerLogger(const CompilerLoggerFactory &compiler_logger_factory, const std::string &fn_name, const Target &target) {
@@ -826,8 +901,14 @@ void compile_multitarget(const std::string &fn_name,
 
     TemporaryObjectFileDir temp_obj_dir, temp_compiler_log_dir;
     std::vector<Expr> wrapper_args;
-    std::vector<LoweredArgument> base_target_args;
-    std::vector<AutoSchedulerResults> auto_scheduler_results;
+    std::vector<std::vector<LoweredArgument>> sub_target_args(targets.size());
+    std::vector<AutoSchedulerResults> auto_scheduler_results(targets.size());
+
+    // The sub-targets share no state, so they can be lowered and
+    // compiled at the same time. The names and output paths are all
+    // worked out up front, in order, so the results don't depend on
+    // the order in which they finish.
+    std::vector<std::function<void()>> tasks;
 
     for (size_t i = 0; i < targets.size(); ++i) {
         const Target &target = targets[i];
@@ -868,29 +949,30 @@ void compile_multitarget(const std::string &fn_name,
             sub_fn_target = sub_fn_target.without_feature(Target::Matlab);
         }
 
-        {
+        auto sub_out = add_suffixes(output_files, suffix);
+        if (contains(output_files, Output::static_library)) {
+            sub_out[Output::object] = temp_obj_dir.add_temp_object_file(output_files.at(Output::static_library), suffix, target);
+            sub_out.erase(Output::static_library);
+        }
+        sub_out.erase(Output::registration);
+        sub_out.erase(Output::schedule);
+        sub_out.erase(Output::c_header);
+        if (contains(sub_out, Output::compiler_log)) {
+            sub_out[Output::compiler_log] = temp_compiler_log_dir.add_temp_file(output_files.at(Output::compiler_log), suffix, target);
+        }
+
+        tasks.emplace_back([&, i, sub_fn_name, sub_fn_target, sub_out]() {
             ScopedCompilerLogger activate(compiler_logger_factory, sub_fn_name, sub_fn_target);
             Module sub_module = module_factory(sub_fn_name, sub_fn_target);
-            // Re-assign every time -- should be the same across all targets anyway,
-            // but base_target is always the last one we encounter.
-            base_target_args = sub_module.get_function_by_name(sub_fn_name).args;
-
-            auto sub_out = add_suffixes(output_files, suffix);
-            if (contains(output_files, Output::static_library)) {
-                sub_out[Output::object] = temp_obj_dir.add_temp_object_file(output_files.at(Output::static_library), suffix, target);
-                sub_out.erase(Output::static_library);
-            }
-            sub_out.erase(Output::registration);
-            sub_out.erase(Output::schedule);
-            sub_out.erase(Output::c_header);
-            if (contains(sub_out, Output::compiler_log)) {
-                sub_out[Output::compiler_log] = temp_compiler_log_dir.add_temp_file(output_files.at(Output::compiler_log), suffix, target);
-            }
-            debug(1) << "compile_multitarget: compile_sub_target " << sub_out[Output::object] << "\n";
+            // Should be the same across all targets anyway, but the
+            // base target's are the ones used.
+            sub_target_args[i] = sub_module.get_function_by_name(sub_fn_name).args;
+
+            debug(1) << "compile_multitarget: compile_sub_target " << sub_out.at(Output::object) << "\n";
             sub_module.compile(sub_out);
             const auto *r = sub_module.get_auto_scheduler_results();
-            auto_scheduler_results.push_back(r ? *r : AutoSchedulerResults());
-        }
+            auto_scheduler_results[i] = r ? *r : AutoSchedulerResults();
+        });
 
         uint64_t cur_target_features[kFeaturesWordCount] = {0};
         for (int i = 0; i < Target::FeatureEnd; ++i) {
@@ -942,10 +1024,15 @@ void compile_multitarget(const std::string &fn_name,
 
         std::map<Output, std::string> runtime_out =
             {{Output::object, runtime_path}};
-        debug(1) << "compile_multitarget: compile_standalone_runtime " << runtime_out.at(Output::object) << "\n";
-        compile_standalone_runtime(runtime_out, runtime_target);
+        tasks.emplace_back([runtime_out, runtime_target]() {
+            debug(1) << "compile_multitarget: compile_standalone_runtime " << runtime_out.at(Output::object) << "\n";
+            compile_standalone_runtime(runtime_out, runtime_target);
+        });
     }
 
+    run_multitarget_tasks(tasks);
+    const std::vector<LoweredArgument> &base_target_args = sub_target_args.back();
+
     if (needs_wrapper) {
         Expr indirect_result = Call::make(Int(32), Call::call_cached_indirect_function, wrapper_args, Call::Intrinsic);
         std::string private_result_name = unique_name(fn_name + "_result");
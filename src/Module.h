@@ -220,6 +220,12 @@ std::map<Output, std::string> compile_standalone_runtime(const std::map<Output,
 using ModuleFactory = std::function<Module(const std::string &fn_name, const Target &target)>;
 using CompilerLoggerFactory = std::function<std::unique_ptr<Internal::CompilerLogger>(const std::string &fn_name, const Target &target)>;
 
+/** Compile a Module for each of the targets, along with a runtime
+ * and a wrapper that picks the best one the machine running it
+ * supports. If the HL_MULTITARGET_JOBS environment variable is set to
+ * more than one, up to that many sub-targets are lowered and compiled
+ * at once, so the factories may be called from several threads at the
+ * same time. */
 void compile_multitarget(const std::string &fn_name,
                          const std::map<Output, std::string> &output_files,
                          const std::vector<Target> &targets,
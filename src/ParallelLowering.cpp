@@ -0,0 +1,203 @@
+#include "ParallelLowering.h"
+#include "CompilerLogger.h"
+#include "Debug.h"
+#include "IR.h"
+#include "IRInterning.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "ThreadPool.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace Halide {
+namespace Internal {
+
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+thread_local bool parallel_lowering = false;
+
+const char *const placeholder_name = "halide_parallel_lowering_task";
+
+struct Task {
+    Stmt loop;
+    // The LetStmts around the loop, outermost first.
+    vector<pair<string, Expr>> lets;
+};
+
+// Replace each outermost loop with a placeholder, and record it as a
+// task. Exprs can't contain loops, so they're skipped.
+class ExtractLoops : public IRMutator {
+    using IRMutator::visit;
+
+    vector<pair<string, Expr>> lets;
+
+    Stmt visit(const LetStmt *op) override {
+        lets.emplace_back(op->name, op->value);
+        Stmt body = mutate(op->body);
+        lets.pop_back();
+        if (body.same_as(op->body)) {
+            return op;
+        }
+        return LetStmt::make(op->name, op->value, body);
+    }
+
+    Stmt visit(const For *op) override {
+        int id = (int)tasks.size();
+        tasks.push_back({op, lets});
+        return Evaluate::make(Call::make(Int(32), placeholder_name, {id}, Call::Extern));
+    }
+
+public:
+    using IRMutator::mutate;
+
+    Expr mutate(const Expr &e) override {
+        return e;
+    }
+
+    vector<Task> tasks;
+};
+
+// Put the transformed loops back in place of the placeholders.
+class InsertLoops : public IRMutator {
+    using IRMutator::visit;
+
+    const vector<Stmt> &loops;
+
+    Stmt visit(const Evaluate *op) override {
+        const Call *c = op->value.as<Call>();
+        if (c && c->call_type == Call::Extern && c->name == placeholder_name) {
+            const int64_t *id = as_const_int(c->args[0]);
+            internal_assert(id && *id >= 0 && *id < (int64_t)loops.size());
+            inserted++;
+            return loops[*id];
+        }
+        return op;
+    }
+
+public:
+    using IRMutator::mutate;
+
+    Expr mutate(const Expr &e) override {
+        return e;
+    }
+
+    InsertLoops(const vector<Stmt> &loops)
+        : loops(loops) {
+    }
+
+    size_t inserted = 0;
+};
+
+}  // namespace
+
+ScopedParallelLowering::ScopedParallelLowering(bool enable)
+    : old_enabled(parallel_lowering) {
+    parallel_lowering = enable;
+}
+
+ScopedParallelLowering::~ScopedParallelLowering() {
+    parallel_lowering = old_enabled;
+}
+
+bool parallel_lowering_enabled() {
+    return parallel_lowering;
+}
+
+Stmt mutate_loops_in_parallel(const Stmt &s,
+                              const std::function<Stmt(const Stmt &)> &pass,
+                              bool with_enclosing_lets) {
+    if (!parallel_lowering) {
+        return pass(s);
+    }
+
+    ExtractLoops extract;
+    Stmt skeleton = extract.mutate(s);
+    const vector<Task> &tasks = extract.tasks;
+    if (tasks.size() < 2) {
+        return pass(s);
+    }
+
+    // Each task names things within its own id, so the names don't
+    // depend on the order the tasks run in.
+    const UniqueNameTaskIds ids = reserve_unique_name_tasks((int)tasks.size());
+    const bool interning = ir_interning_enabled();
+    vector<Stmt> loops(tasks.size());
+    auto run = [&](size_t i) {
+        ScopedUniqueNameTask naming(ids[(int)i]);
+        ScopedIRInterning intern(interning);
+        const Task &task = tasks[i];
+        Stmt stmt = task.loop;
+        if (with_enclosing_lets) {
+            for (auto it = task.lets.rbegin(); it != task.lets.rend(); it++) {
+                stmt = LetStmt::make(it->first, it->second, stmt);
+            }
+        }
+        stmt = pass(stmt);
+        if (with_enclosing_lets) {
+            for (const auto &l : task.lets) {
+                const LetStmt *let = stmt.as<LetStmt>();
+                internal_assert(let && let->name == l.first)
+                    << "Pass did not preserve the LetStmt " << l.first << " around a loop\n";
+                stmt = let->body;
+            }
+        }
+        loops[i] = stmt;
+    };
+
+    // Debug output and the compiler logger aren't safe to use from
+    // several threads, so run the same tasks in order instead.
+    const size_t num_threads = std::min(tasks.size(), ThreadPool<void>::num_processors_online());
+    if (num_threads <= 1 || debug::debug_level() > 0 || get_compiler_logger()) {
+        for (size_t i = 0; i < tasks.size(); i++) {
+            run(i);
+        }
+        skeleton = pass(skeleton);
+    } else {
+#ifdef HALIDE_WITH_EXCEPTIONS
+        // Errors must be thrown on this thread, and the first one in
+        // task order wins, as if the tasks had run serially.
+        vector<std::exception_ptr> errors(tasks.size());
+        auto run_task = [&](size_t i) {
+            try {
+                run(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        };
+#else
+        auto run_task = run;
+#endif
+        ThreadPool<void> pool(num_threads);
+        vector<std::future<void>> futures;
+        for (size_t i = 0; i < tasks.size(); i++) {
+            futures.emplace_back(pool.async(run_task, i));
+        }
+        // Do the rest of the Stmt on this thread meanwhile.
+        skeleton = pass(skeleton);
+        for (auto &f : futures) {
+            f.get();
+        }
+#ifdef HALIDE_WITH_EXCEPTIONS
+        for (const auto &e : errors) {
+            if (e) {
+                std::rethrow_exception(e);
+            }
+        }
+#endif
+    }
+
+    InsertLoops insert(loops);
+    Stmt result = insert.mutate(skeleton);
+    internal_assert(insert.inserted == loops.size())
+        << "Pass removed or duplicated a loop placeholder\n";
+    return result;
+}
+
+}  // namespace Internal
+}  // namespace Halide
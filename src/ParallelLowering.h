@@ -0,0 +1,50 @@
+#ifndef HALIDE_PARALLEL_LOWERING_H
+#define HALIDE_PARALLEL_LOWERING_H
+
+/** \file
+ * Running lowering passes over independent loop nests in parallel.
+ */
+
+#include <functional>
+
+#include "Expr.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Lets mutate_loops_in_parallel use a thread pool when it is called
+ * on this thread, for the lifetime of the object. */
+class ScopedParallelLowering {
+    bool old_enabled;
+
+public:
+    explicit ScopedParallelLowering(bool enable = true);
+    ~ScopedParallelLowering();
+
+    ScopedParallelLowering(const ScopedParallelLowering &) = delete;
+    ScopedParallelLowering &operator=(const ScopedParallelLowering &) = delete;
+};
+
+/** Is parallel lowering enabled on this thread? */
+bool parallel_lowering_enabled();
+
+/** Apply a pass to a Stmt. If parallel lowering is enabled, the
+ * outermost loops of the Stmt are each given to the pass separately
+ * and in parallel, and the rest of the Stmt is given to it with the
+ * loops replaced by placeholders. This is only valid for passes that
+ * transform each of those loops independently of the code around it,
+ * such as vectorization and unrolling. If with_enclosing_lets is true,
+ * each loop is given to the pass wrapped in the LetStmts that enclose
+ * it, which the pass must leave in place.
+ *
+ * The names the pass makes with unique_name() depend on how the Stmt
+ * is split, but not on the number of threads or the order in which
+ * they run, so the result is deterministic. */
+Stmt mutate_loops_in_parallel(const Stmt &s,
+                              const std::function<Stmt(const Stmt &)> &pass,
+                              bool with_enclosing_lets = false);
+
+}  // namespace Internal
+}  // namespace Halide
+
+#endif
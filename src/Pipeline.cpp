@@ -1,11 +1,13 @@
 #include <algorithm>
 #include <atomic>
+#include <mutex>
 #include <utility>
 
 #include "Argument.h"
 #include "CodeGen_Internal.h"
 #include "FindCalls.h"
 #include "Func.h"
+#include "HostMachineParams.h"
 #include "IRVisitor.h"
 #include "InferArguments.h"
 #include "LLVM_Output.h"
@@ -335,7 +337,11 @@ void Pipeline::compile_to_static_library(const string &filename_prefix,
 void Pipeline::compile_to_multitarget_static_library(const std::string &filename_prefix,
                                                      const std::vector<Argument> &args,
                                                      const std::vector<Target> &targets) {
-    auto module_producer = [this, &args](const std::string &name, const Target &target) -> Module {
+    // Sub-targets may be compiled in parallel, but they all lower
+    // this Pipeline, which keeps the last module it lowered.
+    std::mutex mutex;
+    auto module_producer = [this, &args, &mutex](const std::string &name, const Target &target) -> Module {
+        std::lock_guard<std::mutex> lock(mutex);
         return compile_to_module(args, name, target);
     };
     auto outputs = static_library_outputs(filename_prefix, targets.back());
@@ -346,7 +352,11 @@ void Pipeline::compile_to_multitarget_object_files(const std::string &filename_p
                                                    const std::vector<Argument> &args,
                                                    const std::vector<Target> &targets,
                                                    const std::vector<std::string> &suffixes) {
-    auto module_producer = [this, &args](const std::string &name, const Target &target) -> Module {
+    // Sub-targets may be compiled in parallel, but they all lower
+    // this Pipeline, which keeps the last module it lowered.
+    std::mutex mutex;
+    auto module_producer = [this, &args, &mutex](const std::string &name, const Target &target) -> Module {
+        std::lock_guard<std::mutex> lock(mutex);
         return compile_to_module(args, name, target);
     };
     auto outputs = object_file_outputs(filename_prefix, targets.back());
@@ -1166,6 +1176,195 @@ void Pipeline::realize(RealizationArg outputs, const Target &t,
     jit_context.finalize(exit_status);
 }
 
+struct CallableContents {
+    mutable RefCount ref_count;
+
+    // The compiled code, kept alive independently of the Pipeline.
+    JITModule jit_module;
+    WasmModule wasm_module;
+    Target target;
+    JITHandlers jit_handlers;
+
+    // The arguments of the compiled function, which hold on to the
+    // Parameters and Buffers the arguments below point into.
+    vector<InferredArgument> inferred_args;
+
+    // The arguments of the Callable, and their types.
+    vector<Argument> arguments;
+    vector<halide_type_t> types;
+
+    // The void * arguments of the compiled function that don't
+    // change between calls, and the index in them of each argument of
+    // the Callable (or -1 if the pipeline doesn't use it).
+    vector<const void *> argv_template;
+    vector<int> argv_index;
+
+    // Unlisted ImageParams, which are looked up on each call, as they
+    // may be rebound.
+    vector<std::pair<int, Parameter>> bound_buffers;
+
+    int user_context_index = -1;
+
+    // Set if the pipeline is compiled with the profiler.
+    void (*profiler_report)(void *) = nullptr;
+    void (*profiler_reset)() = nullptr;
+};
+
+namespace Internal {
+template<>
+RefCount &ref_count<CallableContents>(const CallableContents *p) noexcept {
+    return p->ref_count;
+}
+
+template<>
+void destroy<CallableContents>(const CallableContents *p) {
+    delete p;
+}
+}  // namespace Internal
+
+Callable Pipeline::compile_to_callable(const vector<Argument> &args, const Target &t) {
+    user_assert(defined()) << "Can't compile an undefined Pipeline\n";
+
+    Target target = t;
+    if (target.has_unknowns()) {
+        target = get_compiled_jit_target();
+        if (target.has_unknowns()) {
+            target = get_jit_target_from_environment();
+        }
+    }
+    compile_jit(target);
+
+    Callable result;
+    result.contents = new CallableContents;
+    CallableContents &c = *result.contents;
+    c.jit_module = contents->jit_module;
+    c.wasm_module = contents->wasm_module;
+    c.target = target;
+    c.jit_handlers = contents->jit_handlers;
+    c.inferred_args = contents->inferred_args;
+
+    // Fill in everything that isn't an argument of the Callable.
+    size_t num_outputs = 0;
+    for (const Function &out : contents->outputs) {
+        num_outputs += out.output_types().size();
+    }
+    c.argv_template.resize(c.inferred_args.size() + num_outputs, nullptr);
+    for (size_t i = 0; i < c.inferred_args.size(); i++) {
+        const InferredArgument &arg = c.inferred_args[i];
+        if (arg.param.same_as(contents->user_context_arg.param)) {
+            c.user_context_index = (int)i;
+        } else if (!arg.param.defined()) {
+            internal_assert(arg.buffer.defined());
+            c.argv_template[i] = arg.buffer.raw_buffer();
+        } else if (arg.param.is_buffer()) {
+            c.bound_buffers.emplace_back((int)i, arg.param);
+        } else {
+            c.argv_template[i] = arg.param.scalar_address();
+        }
+    }
+    internal_assert(c.user_context_index >= 0);
+
+    // Then find the arguments of the Callable in there.
+    for (const Argument &arg : args) {
+        user_assert(arg.name != contents->user_context_arg.arg.name)
+            << "The user context argument of a Callable is supplied by the JIT\n";
+        int index = -1;
+        for (size_t i = 0; i < c.inferred_args.size(); i++) {
+            if (c.inferred_args[i].arg.name == arg.name) {
+                user_assert(c.inferred_args[i].arg.is_buffer() == arg.is_buffer())
+                    << "Argument " << arg.name << " of the Callable is a "
+                    << (arg.is_buffer() ? "buffer" : "scalar") << ", but the Pipeline uses it as a "
+                    << (arg.is_buffer() ? "scalar" : "buffer") << "\n";
+                index = (int)i;
+            }
+        }
+        for (auto it = c.bound_buffers.begin(); it != c.bound_buffers.end(); it++) {
+            if (it->first == index) {
+                c.bound_buffers.erase(it);
+                break;
+            }
+        }
+        c.arguments.push_back(arg);
+        c.types.push_back(arg.type);
+        c.argv_index.push_back(index);
+    }
+    int output_index = (int)c.inferred_args.size();
+    for (const Function &out : contents->outputs) {
+        for (Type type : out.output_types()) {
+            c.arguments.emplace_back(out.name(), Argument::OutputBuffer, type, out.dimensions(), ArgumentEstimates{});
+            c.types.push_back(type);
+            c.argv_index.push_back(output_index++);
+        }
+    }
+
+    if (target.has_feature(Target::Profile)) {
+        c.profiler_report = (void (*)(void *))(c.jit_module.find_symbol_by_name("halide_profiler_report").address);
+        c.profiler_reset = (void (*)())(c.jit_module.find_symbol_by_name("halide_profiler_reset").address);
+    }
+
+    return result;
+}
+
+Callable::Callable()
+    : contents(nullptr) {
+}
+
+bool Callable::defined() const {
+    return contents.defined();
+}
+
+const vector<Argument> &Callable::arguments() const {
+    user_assert(defined()) << "Callable is undefined\n";
+    return contents->arguments;
+}
+
+int Callable::call_argv(size_t argc, const void *const *argv, const ArgInfo *info) const {
+    user_assert(defined()) << "Can't call an undefined Callable\n";
+    CallableContents &c = *contents;
+    user_assert(argc == c.arguments.size())
+        << "Callable takes " << c.arguments.size() << " arguments (including the outputs), but was passed " << argc << "\n";
+
+    JITFuncCallContext jit_context(c.jit_handlers);
+    void *user_context_storage = &jit_context.jit_context;
+
+    Pipeline::JITCallArgs args(c.argv_template.size());
+    std::copy(c.argv_template.begin(), c.argv_template.end(), args.store);
+    args.store[c.user_context_index] = &user_context_storage;
+    for (const auto &b : c.bound_buffers) {
+        args.store[b.first] = b.second.buffer().defined() ? b.second.raw_buffer() : nullptr;
+    }
+    for (size_t i = 0; i < argc; i++) {
+        const Argument &arg = c.arguments[i];
+        if (arg.is_buffer()) {
+            user_assert(info[i].is_buffer)
+                << "Argument " << i << " of Callable (" << arg.name << ") should be a buffer\n";
+        } else {
+            user_assert(!info[i].is_buffer && info[i].type == c.types[i])
+                << "Argument " << i << " of Callable (" << arg.name << ") should be a scalar of type "
+                << arg.type << ", but was passed a "
+                << (info[i].is_buffer ? std::string("buffer") : type_to_c_type(info[i].type, false)) << "\n";
+        }
+        if (c.argv_index[i] >= 0) {
+            args.store[c.argv_index[i]] = argv[i];
+        }
+    }
+
+    int exit_status;
+    if (c.target.arch == Target::WebAssembly) {
+        exit_status = c.wasm_module.run(args.store);
+    } else {
+        exit_status = c.jit_module.argv_function()(args.store);
+    }
+
+    if (c.profiler_report && c.profiler_reset) {
+        c.profiler_report(&jit_context.jit_context);
+        c.profiler_reset();
+    }
+
+    jit_context.finalize(exit_status);
+    return exit_status;
+}
+
 void Pipeline::infer_input_bounds(RealizationArg outputs, const Target &target, const ParamMap &param_map) {
     user_assert(!target.has_feature(Target::NoBoundsQuery)) << "You may not call infer_input_bounds() with Target::NoBoundsQuery set.";
     compile_jit(target);
@@ -1305,11 +1504,19 @@ MachineParams MachineParams::generic() {
     std::string params = Internal::get_env_variable("HL_MACHINE_PARAMS");
     if (params.empty()) {
         return MachineParams(16, 16 * 1024 * 1024, 40);
+    } else if (params == "host") {
+        return MachineParams::host();
     } else {
         return MachineParams(params);
     }
 }
 
+MachineParams MachineParams::host() {
+    static const MachineParams params =
+        Internal::machine_params_from_measurements(Internal::measure_host_machine());
+    return params;
+}
+
 std::string MachineParams::to_string() const {
     std::ostringstream o;
     o << parallelism << "," << last_level_cache_size << "," << balance;
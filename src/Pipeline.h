@@ -23,6 +23,8 @@
 namespace Halide {
 
 struct Argument;
+class Callable;
+struct CallableContents;
 class Func;
 struct PipelineContents;
 
@@ -41,9 +43,18 @@ struct MachineParams {
         : parallelism(parallelism), last_level_cache_size(llc), balance(balance) {
     }
 
-    /** Default machine parameters for generic CPU architecture. */
+    /** Default machine parameters for generic CPU architecture. If
+     * HL_MACHINE_PARAMS is set to "host", these are the measured
+     * machine parameters of the host instead. */
     static MachineParams generic();
 
+    /** Machine parameters measured by running microbenchmarks on the
+     * host: the parallel speedup, the size of the largest cache, and
+     * the cost of loading a float from memory relative to a
+     * floating-point operation. The first call takes about a second;
+     * later calls return the same result. */
+    static MachineParams host();
+
     /** Convert the MachineParams into canonical string form. */
     std::string to_string() const;
 
@@ -139,6 +150,8 @@ public:
 private:
     Internal::IntrusivePtr<PipelineContents> contents;
 
+    friend class Callable;
+
     struct JITCallArgs;  // Opaque structure to optimize away dynamic allocation in this path.
 
     // For the three method below, precisely one of the first two args should be non-null
@@ -519,6 +532,16 @@ public:
     void realize(RealizationArg output, const Target &target = Target(),
                  const ParamMap &param_map = ParamMap::empty_map());
 
+    /** JIT compile the pipeline for the given target, and return a
+     * Callable that runs it with the given arguments, which may be
+     * Params and ImageParams. Calling the result costs much less than
+     * calling realize, so use this for pipelines that are run many
+     * times on small inputs. Any Params and ImageParams the pipeline
+     * uses that are not in args keep the values they are bound to
+     * when it runs, as with realize. */
+    Callable compile_to_callable(const std::vector<Argument> &args,
+                                 const Target &target = Target());
+
     /** For a given size of output, or a given set of output buffers,
      * determine the bounds required of all unbound ImageParams
      * referenced. Communicates the result by allocating new buffers
@@ -574,6 +597,102 @@ private:
     std::string generate_function_name() const;
 };
 
+/** A Pipeline JIT compiled with a fixed list of arguments. Calling it
+ * skips the argument lookup, compilation checks and allocations that
+ * Pipeline::realize makes each time, so it costs little more than
+ * calling an ahead-of-time compiled pipeline. Make one with
+ * Pipeline::compile_to_callable or Func::compile_to_callable. It
+ * keeps the compiled code alive, and may be called from several
+ * threads at once. If the pipeline was compiled with the profiler,
+ * every call reports and resets the profiler's state, which all the
+ * calls share, so the reports of concurrent calls are mixed together.
+ \code
+ Param<float> scale;
+ ImageParam in(Float(32), 2);
+ Func f;
+ f(x, y) = in(x, y) * scale;
+ Callable c = f.compile_to_callable({in, scale});
+ Buffer<float> input(64, 64), output(64, 64);
+ c(input, 2.0f, output);
+ \endcode
+ */
+class Callable {
+    Internal::IntrusivePtr<CallableContents> contents;
+
+    friend class Pipeline;
+
+    struct ArgInfo {
+        halide_type_t type;
+        bool is_buffer;
+    };
+
+    // Scalars are passed by address. Pointers to buffers are buffers.
+    template<typename T>
+    using is_scalar_arg = std::integral_constant<bool, (std::is_arithmetic<T>::value || std::is_pointer<T>::value) &&
+                                                           !std::is_convertible<T, const halide_buffer_t *>::value>;
+
+    template<typename T, typename = typename std::enable_if<is_scalar_arg<T>::value>::type>
+    static HALIDE_ALWAYS_INLINE const void *arg_pointer(const T &scalar) {
+        return &scalar;
+    }
+    static HALIDE_ALWAYS_INLINE const void *arg_pointer(const halide_buffer_t *buf) {
+        return buf;
+    }
+    template<typename T>
+    static HALIDE_ALWAYS_INLINE const void *arg_pointer(const Buffer<T> &buf) {
+        return buf.raw_buffer();
+    }
+    template<typename T, int D>
+    static HALIDE_ALWAYS_INLINE const void *arg_pointer(const Runtime::Buffer<T, D> &buf) {
+        return buf.raw_buffer();
+    }
+
+    template<typename T, typename = typename std::enable_if<is_scalar_arg<T>::value>::type>
+    static HALIDE_ALWAYS_INLINE ArgInfo arg_info(const T &) {
+        return {halide_type_of<T>(), false};
+    }
+    static HALIDE_ALWAYS_INLINE ArgInfo arg_info(const halide_buffer_t *) {
+        return {halide_type_t(), true};
+    }
+    template<typename T>
+    static HALIDE_ALWAYS_INLINE ArgInfo arg_info(const Buffer<T> &) {
+        return {halide_type_t(), true};
+    }
+    template<typename T, int D>
+    static HALIDE_ALWAYS_INLINE ArgInfo arg_info(const Runtime::Buffer<T, D> &) {
+        return {halide_type_t(), true};
+    }
+
+    int call_argv(size_t argc, const void *const *argv, const ArgInfo *info) const;
+
+public:
+    /** Make an undefined Callable. */
+    Callable();
+
+    /** Check if this Callable has been compiled. */
+    bool defined() const;
+
+    /** The arguments the Callable takes, in order: the ones passed
+     * to compile_to_callable, then one output buffer per tuple
+     * element per output Func. */
+    const std::vector<Argument> &arguments() const;
+
+    /** Run the pipeline with the given argument values, followed by
+     * the output buffers. Scalars must have exactly the type of the
+     * Param they are for, and buffers may be Buffers, Runtime::Buffers
+     * or halide_buffer_t pointers. Errors are reported in the same
+     * way as for Pipeline::realize. Returns the pipeline's exit
+     * status, which is only non-zero if a custom error handler that
+     * returns is installed. */
+    template<typename... Args>
+    HALIDE_NO_USER_CODE_INLINE int operator()(Args &&... args) const {
+        // One spare entry, so that the arrays are never empty.
+        const void *argv[sizeof...(Args) + 1] = {arg_pointer(args)..., nullptr};
+        const ArgInfo info[sizeof...(Args) + 1] = {arg_info(args)..., ArgInfo()};
+        return call_argv(sizeof...(Args), argv, info);
+    }
+};
+
 struct ExternSignature {
 private:
     Type ret_type_;  // Only meaningful if is_void_return is false; must be default value otherwise
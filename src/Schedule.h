@@ -391,6 +391,11 @@ struct Dim {
      * loop (see the DimType enum above). */
     DimType dim_type;
 
+    /** If this loop is parallel, the smallest number of consecutive
+     * iterations the thread pool should run as one unit of work. Zero
+     * or one means no minimum. Set by Func::min_grain. */
+    int min_grain;
+
     /** Can this loop be evaluated in any order (including in
      * parallel)? Equivalently, are there no data hazards between
      * evaluations of the Func at distinct values of this var? */
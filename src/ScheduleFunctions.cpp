@@ -287,6 +287,12 @@ Stmt build_loop_nest(
             const Dim &dim = stage_s.dims()[nest[i].dim_idx];
             Expr min = Variable::make(Int(32), nest[i].name + ".loop_min");
             Expr extent = Variable::make(Int(32), nest[i].name + ".loop_extent");
+            if (dim.for_type == ForType::Parallel && dim.min_grain > 1) {
+                // Leave a note in the loop body for codegen to pass on
+                // to the thread pool.
+                Expr grain = Call::make(Int(32), Call::parallel_min_grain, {dim.min_grain}, Call::Intrinsic);
+                stmt = Block::make(Evaluate::make(grain), stmt);
+            }
             stmt = For::make(nest[i].name, min, extent, dim.for_type, dim.device_api, stmt);
         }
     }
@@ -4,6 +4,7 @@
 #include "CSE.h"
 #include "CompilerLogger.h"
 #include "IRMutator.h"
+#include "LoweringCache.h"
 #include "Substitute.h"
 
 namespace Halide {
@@ -34,9 +35,7 @@ Simplify::Simplify(bool r, const Scope<Interval> *bi, const Scope<ModulusRemaind
             bounds.max = *i_max;
         }
 
-        if (ai->contains(iter.name())) {
-            bounds.alignment = ai->get(iter.name());
-        }
+        bounds.alignment = simplify_alignment_of(*ai, iter.name());
 
         if (bounds.min_defined || bounds.max_defined || bounds.alignment.modulus != 1) {
             bounds_and_alignment_info.push(iter.name(), bounds);
@@ -304,10 +303,19 @@ Simplify::ScopedFact::~ScopedFact() {
     }
 }
 
+ModulusRemainder simplify_alignment_of(const Scope<ModulusRemainder> &alignment, const std::string &name) {
+    if (alignment.contains(name)) {
+        return alignment.get(name);
+    }
+    return ModulusRemainder();
+}
+
 Expr simplify(const Expr &e, bool remove_dead_let_stmts,
               const Scope<Interval> &bounds,
               const Scope<ModulusRemainder> &alignment) {
-    return Simplify(remove_dead_let_stmts, &bounds, &alignment).mutate(e, nullptr);
+    return cached_simplify(e, remove_dead_let_stmts, bounds, alignment, [&]() {
+        return Simplify(remove_dead_let_stmts, &bounds, &alignment).mutate(e, nullptr);
+    });
 }
 
 Stmt simplify(const Stmt &s, bool remove_dead_let_stmts,
@@ -328,10 +336,9 @@ Stmt simplify_exprs(const Stmt &s) {
     return SimplifyExprs().mutate(s);
 }
 
-bool can_prove(Expr e, const Scope<Interval> &bounds) {
-    internal_assert(e.type().is_bool())
-        << "Argument to can_prove is not a boolean Expr: " << e << "\n";
+namespace {
 
+bool can_prove_uncached(Expr e, const Scope<Interval> &bounds) {
     e = remove_likelies(e);
     e = common_subexpression_elimination(e);
 
@@ -411,5 +418,19 @@ bool can_prove(Expr e, const Scope<Interval> &bounds) {
     return is_const_one(e);
 }
 
+}  // namespace
+
+bool can_prove(Expr e, const Scope<Interval> &bounds) {
+    internal_assert(e.type().is_bool())
+        << "Argument to can_prove is not a boolean Expr: " << e << "\n";
+
+    // Failed proofs get examined and logged, so always make them.
+    const bool check_failed_proofs = debug::debug_level() > 0 || get_compiler_logger() != nullptr;
+    if (check_failed_proofs) {
+        return can_prove_uncached(e, bounds);
+    }
+    return cached_can_prove(e, bounds, [&]() { return can_prove_uncached(e, bounds); });
+}
+
 }  // namespace Internal
 }  // namespace Halide
@@ -28,6 +28,12 @@ Expr simplify(const Expr &, bool remove_dead_let_stmts = true,
               const Scope<ModulusRemainder> &alignment = Scope<ModulusRemainder>::empty_scope());
 // @}
 
+/** The alignment simplify() assumes for a variable that has an entry
+ * in the innermost level of its bounds scope. Alignments of other
+ * variables are ignored. The lowering cache keys simplify() on the
+ * same facts. */
+ModulusRemainder simplify_alignment_of(const Scope<ModulusRemainder> &alignment, const std::string &name);
+
 /** Attempt to statically prove an expression is true using the simplifier. */
 bool can_prove(Expr e, const Scope<Interval> &bounds = Scope<Interval>::empty_scope());
 
@@ -31,8 +31,11 @@
 #include <Objbase.h>  // needed for CoCreateGuid
 #include <Shlobj.h>   // needed for SHGetFolderPath
 #include <windows.h>
+// Must come after windows.h
+#include <psapi.h>  // needed for GetProcessMemoryInfo
 #else
 #include <dlfcn.h>
+#include <sys/resource.h>
 #endif
 #ifdef __APPLE__
 #define CAN_GET_RUNNING_PROGRAM_NAME
@@ -132,6 +135,27 @@ string running_program_name() {
 #endif
 }
 
+uint64_t get_peak_memory_usage() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // OS X reports bytes, everything else reports kilobytes.
+    return usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
 namespace {
 // We use 64K of memory to store unique counters for the purpose of
 // making names unique. Using less memory increases the likelihood of
@@ -151,20 +175,39 @@ int unique_count(size_t h) {
     h = h & (num_unique_name_counters - 1);
     return unique_name_counters[h]++;
 }
+
+std::atomic<int> unique_name_task_counter{0};
+
+// The id of the naming task active on this thread, or the empty
+// string, the number of names it has made so far, and the number of
+// ids of nested tasks it has reserved.
+thread_local std::string unique_name_task;
+thread_local int unique_name_task_count = 0;
+thread_local int unique_name_task_children = 0;
+
+std::string task_unique_name(const std::string &sanitized) {
+    return sanitized + "$" + unique_name_task + "$" + std::to_string(unique_name_task_count++);
+}
 }  // namespace
 
-// There are three possible families of names returned by the methods below:
+// There are four possible families of names returned by the methods below:
 // 1) char pattern: (char that isn't '$') + number (e.g. v234)
 // 2) string pattern: (string without '$') + '$' + number (e.g. fr#nk82$42)
-// 3) a string that does not match the patterns above
+// 3) task pattern: (string without '$') + '$' + task + '$' + number,
+//    where task is numbers joined by '_' (e.g. t$3$12 or t$3_1$12)
+// 4) a string that does not match the patterns above, and that has no
+//    '$' once any naming task has existed
 // There are no collisions within each family, due to the unique_count
-// done above, and there can be no collisions across families by
-// construction.
+// done above and the per-task counts, and there can be no collisions
+// across families by construction.
 
 string unique_name(char prefix) {
     if (prefix == '$') {
         prefix = '_';
     }
+    if (!unique_name_task.empty()) {
+        return task_unique_name(std::string(1, prefix));
+    }
     return prefix + std::to_string(unique_count((size_t)(prefix)));
 }
 
@@ -198,14 +241,22 @@ string unique_name(const std::string &prefix) {
     matches_string_pattern &= num_dollars == 1;
     matches_char_pattern &= prefix.size() > 1;
 
+    if (!unique_name_task.empty()) {
+        return task_unique_name(sanitized);
+    }
+
     // Then add a suffix that's globally unique relative to the hash
     // of the sanitized name.
     int count = unique_count(std::hash<std::string>()(sanitized));
     if (count == 0) {
         // We can return the name as-is if there's no risk of it
         // looking like something unique_name has ever returned in the
-        // past or will ever return in the future.
-        if (!matches_char_pattern && !matches_string_pattern) {
+        // past or will ever return in the future. A string with more
+        // than one '$' could be a name made by a naming task, but
+        // those only exist once a task has been reserved, so names
+        // are unchanged in programs that never use them.
+        if (!matches_char_pattern && !matches_string_pattern &&
+            (num_dollars == 0 || unique_name_task_counter.load() == 0)) {
             return prefix;
         }
     }
@@ -213,6 +264,38 @@ string unique_name(const std::string &prefix) {
     return sanitized + "$" + std::to_string(count);
 }
 
+std::string UniqueNameTaskIds::operator[](int i) const {
+    internal_assert(i >= 0 && i < count);
+    std::string id = std::to_string(first + i);
+    return parent.empty() ? id : parent + "_" + id;
+}
+
+UniqueNameTaskIds reserve_unique_name_tasks(int n) {
+    UniqueNameTaskIds ids;
+    ids.count = n;
+    if (unique_name_task.empty()) {
+        ids.first = unique_name_task_counter.fetch_add(n);
+    } else {
+        ids.parent = unique_name_task;
+        ids.first = unique_name_task_children;
+        unique_name_task_children += n;
+    }
+    return ids;
+}
+
+ScopedUniqueNameTask::ScopedUniqueNameTask(const std::string &task)
+    : old_task(unique_name_task), old_count(unique_name_task_count), old_children(unique_name_task_children) {
+    unique_name_task = task;
+    unique_name_task_count = 0;
+    unique_name_task_children = 0;
+}
+
+ScopedUniqueNameTask::~ScopedUniqueNameTask() {
+    unique_name_task = old_task;
+    unique_name_task_count = old_count;
+    unique_name_task_children = old_children;
+}
+
 bool starts_with(const string &str, const string &prefix) {
     if (str.size() < prefix.size()) {
         return false;
@@ -130,6 +130,10 @@ std::string get_env_variable(char const *env_var_name);
  * If program name cannot be retrieved, function returns an empty string. */
 std::string running_program_name();
 
+/** Get the peak resident memory of this process so far, in
+ * bytes. Platform-specific. Returns zero if it can't be retrieved. */
+uint64_t get_peak_memory_usage();
+
 /** Generate a unique name starting with the given prefix. It's unique
  * relative to all other strings returned by unique_name in this
  * process.
@@ -151,6 +155,38 @@ std::string unique_name(char prefix);
 std::string unique_name(const std::string &prefix);
 // @}
 
+/** The ids of a block of naming tasks. */
+struct UniqueNameTaskIds {
+    std::string parent;
+    int first = 0, count = 0;
+
+    /** The id of the i'th task of the block. */
+    std::string operator[](int i) const;
+};
+
+/** Reserve the ids of n naming tasks. Outside of a naming task they
+ * are numbered across the process. Inside one, they are numbered
+ * within that task and prefixed with its id, so tasks nested in
+ * concurrent tasks get the same ids however the threads interleave. */
+UniqueNameTaskIds reserve_unique_name_tasks(int n);
+
+/** While one of these is alive, unique_name() on the calling thread
+ * returns names of the form prefix$task$count, where count starts at
+ * zero for each task. Work that is split into tasks that run
+ * concurrently then gets the same names however the tasks
+ * interleave. The task id must come from reserve_unique_name_tasks. */
+class ScopedUniqueNameTask {
+    std::string old_task;
+    int old_count, old_children;
+
+public:
+    explicit ScopedUniqueNameTask(const std::string &task);
+    ~ScopedUniqueNameTask();
+
+    ScopedUniqueNameTask(const ScopedUniqueNameTask &) = delete;
+    ScopedUniqueNameTask &operator=(const ScopedUniqueNameTask &) = delete;
+};
+
 /** Test if the first string starts with the second string */
 bool starts_with(const std::string &str, const std::string &prefix);
 
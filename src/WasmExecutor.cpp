@@ -870,6 +870,17 @@ WABT_HOST_CALLBACK(abort) {
     return wabt::Result::Ok;
 }
 
+WABT_HOST_CALLBACK(atoi) {
+    WabtContext &wabt_context = get_wabt_context(thread);
+    const int32_t s = args[0].Get<int32_t>();
+
+    uint8_t *base = get_wasm_memory_base(wabt_context);
+    int32_t r = atoi((char *)base + s);
+
+    results[0] = wabt::interp::Value::Make(r);
+    return wabt::Result::Ok;
+}
+
 WABT_HOST_CALLBACK_UNIMPLEMENTED(fclose)
 
 WABT_HOST_CALLBACK_UNIMPLEMENTED(fileno)
@@ -1076,6 +1087,7 @@ const HostCallbackMap &get_host_callback_map() {
         DEFINE_CALLBACK(__extendhfsf2)
         DEFINE_CALLBACK(__truncsfhf2)
         DEFINE_CALLBACK(abort)
+        DEFINE_CALLBACK(atoi)
         DEFINE_CALLBACK(fclose)
         DEFINE_CALLBACK(fileno)
         DEFINE_CALLBACK(fopen)
@@ -32,7 +32,7 @@
   Needs to be converted to a sample file with the runtime using featurization_to_sample before it can be used to train.
 
   HL_MACHINE_PARAMS
-  An architecture description string. Used by Halide master to configure the cost model. We only use the first term. Set it to the number of cores to target.
+  An architecture description string. Used by Halide master to configure the cost model. We only use the first term. Set it to the number of cores to target, or to "host" to measure the number of cores on this machine (see MachineParams::host).
 
   HL_PERMIT_FAILED_UNROLL
   Set to 1 to tell Halide not to freak out if we try to unroll a loop that doesn't have a constant extent. Should generally not be necessary, but sometimes the autoscheduler's model for what will and will not turn into a constant during lowering is inaccurate, because Halide isn't perfect at constant-folding.
@@ -61,6 +61,15 @@
   HL_AUTOSCHEDULE_MEMORY_LIMIT
   If set, only consider schedules that allocate at most this much memory (measured in bytes).
 
+  HL_AUTOSCHEDULE_NUM_THREADS
+  Number of threads used to generate and featurize the children of the states in the beam. Defaults to 1. The schedule found does not depend on it.
+
+  HL_SCHEDULE_DATABASE
+  A directory of schedules found by autotuning (see autotune.cpp). If it has a schedule for the pipeline, target and machine params being scheduled, use it instead of searching.
+
+  HL_INCREMENTAL_FEATURIZATION
+  If set to 0, featurizes each state from scratch. If set to 1 (the default), reuses the features of loop nests at the root shared with states featurized earlier. If set to 2, does both and checks that they agree bit for bit.
+
   TODO: expose these settings by adding some means to pass args to
   generator plugins instead of environment vars.
 */
@@ -69,6 +78,7 @@
 #include <algorithm>
 #include <chrono>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <queue>
 #include <random>
@@ -88,6 +98,7 @@
 #include "LoopNest.h"
 #include "NetworkSize.h"
 #include "PerfectHashMap.h"
+#include "ScheduleDatabase.h"
 #include "State.h"
 #include "Timer.h"
 
@@ -156,11 +167,28 @@ uint32_t get_dropout_threshold() {
     }
 }
 
+// Get the HL_AUTOSCHEDULE_NUM_THREADS environment variable. Purpose of this is described above.
+int get_num_search_threads() {
+    string num_threads_str = get_env_variable("HL_AUTOSCHEDULE_NUM_THREADS");
+    if (!num_threads_str.empty()) {
+        int num_threads = atoi(num_threads_str.c_str());
+        user_assert(num_threads > 0) << "HL_AUTOSCHEDULE_NUM_THREADS must be positive: " << num_threads_str << "\n";
+        return num_threads;
+    } else {
+        return 1;
+    }
+}
+
+// Get the HL_AUTOSCHEDULE_MEMORY_LIMIT environment variable. Purpose of this is described above.
+int64_t get_memory_limit() {
+    string memory_limit_str = get_env_variable("HL_AUTOSCHEDULE_MEMORY_LIMIT");
+    return memory_limit_str.empty() ? (uint64_t)(-1) : std::atoll(memory_limit_str.c_str());
+}
+
 // Decide whether or not to drop a beam search state. Used for
 // randomly exploring the search tree for autotuning and to generate
 // training data.
-bool random_dropout(std::mt19937 &rng, size_t num_decisions) {
-    static double random_dropout_threshold = get_dropout_threshold();
+bool random_dropout(std::mt19937 &rng, size_t num_decisions, uint32_t random_dropout_threshold) {
     if (random_dropout_threshold >= 100) {
         return false;
     }
@@ -242,6 +270,83 @@ public:
     }
 };
 
+// The children of one state in the beam, generated on a worker
+// thread. Rather than going to the real cost model, the states to
+// evaluate are recorded here, and replayed onto the real cost model
+// afterwards interleaved with the children in the original order. The
+// cost model and the beam then see exactly what they would have seen
+// if the state had been expanded serially.
+class DeferredExpansion : public CostModel {
+    // The schedule features of each state to evaluate, and where to
+    // put its cost.
+    vector<std::pair<StageMapOfScheduleFeatures, double *>> enqueued;
+
+    // Each child accepted, and how many states had been enqueued at
+    // the time.
+    vector<std::pair<IntrusivePtr<State>, size_t>> children;
+
+public:
+    void set_pipeline_features(const FunctionDAG &dag,
+                               const MachineParams &params) override {
+        internal_error << "DeferredExpansion has no pipeline features\n";
+    }
+
+    void enqueue(const FunctionDAG &dag,
+                 const StageMapOfScheduleFeatures &schedule_feats,
+                 double *cost_ptr) override {
+        enqueued.emplace_back(schedule_feats, cost_ptr);
+    }
+
+    void evaluate_costs() override {
+        internal_error << "DeferredExpansion cannot evaluate costs\n";
+    }
+
+    void reset() override {
+        enqueued.clear();
+        children.clear();
+    }
+
+    // Generate the children of a state. Safe to call on several
+    // threads at once, as long as each uses its own DeferredExpansion.
+    void expand(const State &state,
+                const FunctionDAG &dag,
+                const MachineParams &params,
+                int64_t memory_limit) {
+        std::function<void(IntrusivePtr<State> &&)> accept_child =
+            [&](IntrusivePtr<State> &&s) {
+                children.emplace_back(std::move(s), enqueued.size());
+            };
+        state.generate_children(dag, params, this, memory_limit, accept_child);
+    }
+
+    // The children generated so far, in order.
+    size_t num_children() const {
+        return children.size();
+    }
+
+    IntrusivePtr<State> take_child(size_t i) {
+        return std::move(children[i].first);
+    }
+
+    // Pass the children on to the real cost model and the beam.
+    void replay(const FunctionDAG &dag,
+                CostModel *cost_model,
+                std::function<void(IntrusivePtr<State> &&)> &accept_child) {
+        size_t next = 0;
+        auto enqueue_up_to = [&](size_t end) {
+            for (; next < end; next++) {
+                cost_model->enqueue(dag, enqueued[next].first, enqueued[next].second);
+            }
+        };
+        for (auto &c : children) {
+            enqueue_up_to(c.second);
+            accept_child(std::move(c.first));
+        }
+        enqueue_up_to(enqueued.size());
+        reset();
+    }
+};
+
 // Configure a cost model to process a specific pipeline.
 void configure_pipeline_features(const FunctionDAG &dag,
                                  const MachineParams &params,
@@ -257,11 +362,13 @@ IntrusivePtr<State> optimal_schedule_pass(FunctionDAG &dag,
                                           CostModel *cost_model,
                                           std::mt19937 &rng,
                                           int beam_size,
+                                          uint32_t dropout_threshold,
                                           int64_t memory_limit,
                                           int pass_idx,
                                           int num_passes,
                                           ProgressBar &tick,
-                                          std::unordered_set<uint64_t> &permitted_hashes) {
+                                          std::unordered_set<uint64_t> &permitted_hashes,
+                                          ThreadPool<void> *pool) {
 
     if (cost_model) {
         configure_pipeline_features(dag, params, cost_model);
@@ -316,11 +423,13 @@ IntrusivePtr<State> optimal_schedule_pass(FunctionDAG &dag,
                                              cost_model,
                                              rng,
                                              beam_size * 2,
+                                             dropout_threshold,
                                              memory_limit,
                                              pass_idx,
                                              num_passes,
                                              tick,
-                                             permitted_hashes);
+                                             permitted_hashes,
+                                             pool);
             } else {
                 internal_error << "Ran out of legal states with beam size " << beam_size << "\n";
             }
@@ -330,8 +439,10 @@ IntrusivePtr<State> optimal_schedule_pass(FunctionDAG &dag,
             aslog(0) << "Warning: Huge number of states generated (" << pending.size() << ").\n";
         }
 
-        expanded = 0;
-        while (expanded < beam_size && !pending.empty()) {
+        // Pick the states to expand. This draws on the random number
+        // generator, so it always happens serially and in order.
+        vector<IntrusivePtr<State>> to_expand;
+        while ((int)to_expand.size() < beam_size && !pending.empty()) {
 
             IntrusivePtr<State> state{pending.pop()};
 
@@ -373,7 +484,7 @@ IntrusivePtr<State> optimal_schedule_pass(FunctionDAG &dag,
             }
 
             // Random dropout
-            if (pending.size() > 1 && random_dropout(rng, dag.nodes.size() * 2)) {
+            if (pending.size() > 1 && random_dropout(rng, dag.nodes.size() * 2, dropout_threshold)) {
                 continue;
             }
 
@@ -408,8 +519,37 @@ IntrusivePtr<State> optimal_schedule_pass(FunctionDAG &dag,
                 return best;
             }
 
-            state->generate_children(dag, params, cost_model, memory_limit, enqueue_new_children);
-            expanded++;
+            to_expand.emplace_back(std::move(state));
+        }
+
+        expanded = 0;
+        if (!pool || to_expand.size() <= 1) {
+            for (const auto &state : to_expand) {
+                state->generate_children(dag, params, cost_model, memory_limit, enqueue_new_children);
+                expanded++;
+            }
+        } else {
+            // Generate the children of each state concurrently, then
+            // hand them over in the same order as above, so the search
+            // is deterministic however the threads are scheduled.
+            vector<DeferredExpansion> expansions(to_expand.size());
+            vector<std::future<void>> futures;
+            for (size_t j = 0; j < to_expand.size(); j++) {
+                futures.push_back(pool->async([&, j]() {
+                    expansions[j].expand(*to_expand[j], dag, params, memory_limit);
+                }));
+            }
+            // Wait for all of them before rethrowing any errors.
+            for (auto &f : futures) {
+                f.wait();
+            }
+            for (auto &f : futures) {
+                f.get();
+            }
+            for (auto &e : expansions) {
+                e.replay(dag, cost_model, enqueue_new_children);
+                expanded++;
+            }
         }
 
         // Drop the other states unconsidered.
@@ -457,6 +597,7 @@ IntrusivePtr<State> optimal_schedule(FunctionDAG &dag,
                                      CostModel *cost_model,
                                      std::mt19937 &rng,
                                      int beam_size,
+                                     uint32_t dropout_threshold,
                                      int64_t memory_limit) {
 
     IntrusivePtr<State> best;
@@ -479,14 +620,24 @@ IntrusivePtr<State> optimal_schedule(FunctionDAG &dag,
         num_passes = std::atoi(num_passes_str.c_str());
     }
 
+    // Expanding the states in the beam is the expensive part, and can
+    // be done in parallel.
+    std::unique_ptr<ThreadPool<void>> pool;
+    int num_threads = get_num_search_threads();
+    if (num_threads > 1) {
+        pool.reset(new ThreadPool<void>(num_threads));
+    }
+    aslog(1) << "Expanding states on " << num_threads << " threads\n";
+
     for (int i = 0; i < num_passes; i++) {
         ProgressBar tick;
 
         Timer timer;
 
         auto pass = optimal_schedule_pass(dag, outputs, params, cost_model,
-                                          rng, beam_size, memory_limit,
-                                          i, num_passes, tick, permitted_hashes);
+                                          rng, beam_size, dropout_threshold, memory_limit,
+                                          i, num_passes, tick, permitted_hashes,
+                                          pool.get());
 
         std::chrono::duration<double> total_time = timer.elapsed();
         auto milli = std::chrono::duration_cast<std::chrono::milliseconds>(total_time).count();
@@ -512,8 +663,47 @@ IntrusivePtr<State> optimal_schedule(FunctionDAG &dag,
     return best;
 }
 
+// The choices that lead from the initial state to a state: the
+// child_index of each state along the way.
+vector<int> search_path(const State *state) {
+    vector<int> path;
+    for (const State *s = state; s->parent.defined(); s = s->parent.get()) {
+        path.push_back(s->child_index);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+// Follow a path through the search space, as recorded in a schedule
+// database, to the schedule at its end. The children at each step are
+// still generated and featurized, as in the search, but the cost model
+// never evaluates them and only one child is expanded further, so this
+// is much faster than searching. Returns nullptr if the path doesn't
+// lead to a complete schedule, which can happen if the autoscheduler
+// has changed since it was recorded.
+IntrusivePtr<State> follow_search_path(const FunctionDAG &dag,
+                                       const MachineParams &params,
+                                       int64_t memory_limit,
+                                       const vector<int> &path) {
+    IntrusivePtr<State> state{new State};
+    state->root = new LoopNest;
+    DeferredExpansion expansion;
+    for (int i : path) {
+        expansion.expand(*state, dag, params, memory_limit);
+        if (i < 0 || i >= (int)expansion.num_children()) {
+            return nullptr;
+        }
+        state = expansion.take_child(i);
+        expansion.reset();
+    }
+    if (state->num_decisions_made != 2 * (int)dag.nodes.size()) {
+        return nullptr;
+    }
+    return state;
+}
+
 // Keep track of how many times we evaluated a state.
-int State::cost_calculations = 0;
+std::atomic<int> State::cost_calculations{0};
 
 // The main entrypoint to generate a schedule for a pipeline.
 void generate_schedule(const std::vector<Function> &outputs,
@@ -551,8 +741,7 @@ void generate_schedule(const std::vector<Function> &outputs,
     string randomize_weights_str = get_env_variable("HL_RANDOMIZE_WEIGHTS");
     bool randomize_weights = randomize_weights_str == "1";
 
-    string memory_limit_str = get_env_variable("HL_AUTOSCHEDULE_MEMORY_LIMIT");
-    int64_t memory_limit = memory_limit_str.empty() ? (uint64_t)(-1) : std::atoll(memory_limit_str.c_str());
+    int64_t memory_limit = get_memory_limit();
 
     // Analyse the Halide algorithm and construct our abstract representation of it
     FunctionDAG dag(outputs, params, target);
@@ -568,8 +757,31 @@ void generate_schedule(const std::vector<Function> &outputs,
 
     IntrusivePtr<State> optimal;
 
-    // Run beam search
-    optimal = optimal_schedule(dag, outputs, params, cost_model.get(), rng, beam_size, memory_limit);
+    // Use the schedule found by autotuning, if there is one.
+    string database_dir = get_env_variable("HL_SCHEDULE_DATABASE");
+    if (!database_dir.empty()) {
+        string key = schedule_database_key(dag, target, params, memory_limit);
+        ScheduleDatabaseEntry entry;
+        if (load_schedule_database_entry(database_dir, key, &entry)) {
+            optimal = follow_search_path(dag, params, memory_limit, entry.path);
+            if (optimal.defined()) {
+                aslog(0) << "Using schedule " << key << " from " << database_dir
+                         << ", with runtime " << entry.runtime * 1000 << " ms\n";
+                configure_pipeline_features(dag, params, cost_model.get());
+            } else {
+                user_warning << "Schedule " << key << " in " << database_dir
+                             << " no longer applies to this pipeline. Searching for a new one.\n";
+            }
+        } else {
+            aslog(1) << "No schedule " << key << " in " << database_dir << "\n";
+        }
+    }
+
+    if (!optimal.defined()) {
+        // Run beam search
+        optimal = optimal_schedule(dag, outputs, params, cost_model.get(), rng,
+                                   beam_size, get_dropout_threshold(), memory_limit);
+    }
 
     HALIDE_TOC;
 
@@ -646,7 +858,8 @@ void find_and_apply_schedule(FunctionDAG &dag,
                              StageMap<ScheduleFeatures> *schedule_features) {
 
     std::mt19937 rng(12345);
-    IntrusivePtr<State> optimal = optimal_schedule(dag, outputs, params, cost_model, rng, beam_size, memory_limit);
+    IntrusivePtr<State> optimal = optimal_schedule(dag, outputs, params, cost_model, rng,
+                                                   beam_size, get_dropout_threshold(), memory_limit);
 
     // Apply the schedules
     optimal->apply_schedule(dag, params);
@@ -656,6 +869,33 @@ void find_and_apply_schedule(FunctionDAG &dag,
     }
 }
 
+// An entrypoint for autotuning, which explores the search space with
+// the given seed and random dropout.
+void find_and_apply_schedule(FunctionDAG &dag,
+                             const std::vector<Function> &outputs,
+                             const MachineParams &params,
+                             CostModel *cost_model,
+                             int beam_size,
+                             uint32_t dropout_threshold,
+                             uint32_t seed,
+                             int64_t memory_limit,
+                             SearchResult *result) {
+
+    std::mt19937 rng(seed);
+    IntrusivePtr<State> optimal = optimal_schedule(dag, outputs, params, cost_model, rng,
+                                                   beam_size, dropout_threshold, memory_limit);
+
+    // Apply the schedules
+    optimal->apply_schedule(dag, params);
+
+    result->path = search_path(optimal.get());
+    result->schedule_source = optimal->schedule_source;
+    optimal->compute_featurization(dag, params, &result->features);
+    std::ostringstream out;
+    optimal->save_featurization(dag, params, out);
+    result->featurization = out.str();
+}
+
 }  // namespace Autoscheduler
 
 // Intrusive shared ptr helpers.
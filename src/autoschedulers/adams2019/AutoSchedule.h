@@ -11,8 +11,28 @@ namespace Autoscheduler {
 
 typedef PerfectHashMap<FunctionDAG::Node::Stage, ScheduleFeatures> StageMapOfScheduleFeatures;
 
+// What a search found, for autotuning.
+struct SearchResult {
+    // The choices that lead to the schedule (see ScheduleDatabaseEntry).
+    std::vector<int> path;
+    // The C++ source code of the schedule.
+    std::string schedule_source;
+    // The features of the schedule, for training the cost model.
+    StageMapOfScheduleFeatures features;
+    // The same, serialized as in a .featurization file.
+    std::string featurization;
+};
+
+// The memory limit set by HL_AUTOSCHEDULE_MEMORY_LIMIT, if any.
+int64_t get_memory_limit();
+
+void find_and_apply_schedule(FunctionDAG &dag, const std::vector<Function> &outputs, const MachineParams &params,
+                             CostModel *cost_model, int beam_size, int64_t memory_limit,
+                             StageMapOfScheduleFeatures *schedule_features);
+
 void find_and_apply_schedule(FunctionDAG &dag, const std::vector<Function> &outputs, const MachineParams &params,
-                             CostModel *cost_model, int beam_size, StageMapOfScheduleFeatures *schedule_features);
+                             CostModel *cost_model, int beam_size, uint32_t dropout_threshold, uint32_t seed,
+                             int64_t memory_limit, SearchResult *result);
 
 }  // namespace Autoscheduler
 }  // namespace Internal
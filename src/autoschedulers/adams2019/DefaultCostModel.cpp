@@ -166,37 +166,46 @@ void DefaultCostModel::enqueue(int ns, Runtime::Buffer<float> *schedule_feats, d
 
 // Backprop state. To run ADAM we need a running average of the
 // gradients and gradients squared. We add an outer dimension of
-// size 3 to the new weight outputs to track this state. So buf(_,
+// size 4 to the new weight outputs to track this state. So buf(_,
 // 0) is the new weight, buf(_, 1) is the ADAM running average of
-// the first moment, and buf(_, 2) is the ADAM running average of
-// the second moment.
-float DefaultCostModel::backprop(const Runtime::Buffer<const float> &true_runtimes, float learning_rate) {
+// the first moment, buf(_, 2) is the ADAM running average of the
+// second moment, and buf(_, 3) is the gradient of the loss.
+void DefaultCostModel::init_weight_updates() {
+    if (head1_filter_update.data()) {
+        return;
+    }
+
+    auto weight_update_buffer = [](const Runtime::Buffer<float> &w) {
+        std::vector<int> size;
+        for (int i = 0; i < w.dimensions(); i++) {
+            size.push_back(w.dim(i).extent());
+        }
+        size.push_back(4);
+        auto buf = Runtime::Buffer<float>(size);
+        buf.fill(0.0f);
+        return buf;
+    };
+
+    head1_filter_update = weight_update_buffer(weights.head1_filter);
+    head1_bias_update = weight_update_buffer(weights.head1_bias);
+    head2_filter_update = weight_update_buffer(weights.head2_filter);
+    head2_bias_update = weight_update_buffer(weights.head2_bias);
+    conv1_filter_update = weight_update_buffer(weights.conv1_filter);
+    conv1_bias_update = weight_update_buffer(weights.conv1_bias);
+    timestep = 0;
+}
+
+// Run the training pipeline on the enqueued schedules, which fills
+// in the weight update buffers and the predictions, and returns the
+// loss.
+float DefaultCostModel::run_train_cost_model(const Runtime::Buffer<const float> &true_runtimes, float learning_rate) {
     internal_assert(cursor != 0);
     internal_assert(pipeline_feat_queue.data());
     internal_assert(schedule_feat_queue.data());
 
     auto loss = Runtime::Buffer<float>::make_scalar();
 
-    if (!head1_filter_update.data()) {
-        auto weight_update_buffer = [](const Runtime::Buffer<float> &w) {
-            std::vector<int> size;
-            for (int i = 0; i < w.dimensions(); i++) {
-                size.push_back(w.dim(i).extent());
-            }
-            size.push_back(4);
-            auto buf = Runtime::Buffer<float>(size);
-            buf.fill(0.0f);
-            return buf;
-        };
-
-        head1_filter_update = weight_update_buffer(weights.head1_filter);
-        head1_bias_update = weight_update_buffer(weights.head1_bias);
-        head2_filter_update = weight_update_buffer(weights.head2_filter);
-        head2_bias_update = weight_update_buffer(weights.head2_bias);
-        conv1_filter_update = weight_update_buffer(weights.conv1_filter);
-        conv1_bias_update = weight_update_buffer(weights.conv1_bias);
-        timestep = 0;
-    }
+    init_weight_updates();
 
     Runtime::Buffer<float> dst = costs.cropped(0, 0, cursor);
 
@@ -251,6 +260,12 @@ float DefaultCostModel::backprop(const Runtime::Buffer<const float> &true_runtim
         abort();
     }
 
+    return loss();
+}
+
+float DefaultCostModel::backprop(const Runtime::Buffer<const float> &true_runtimes, float learning_rate) {
+    float loss = run_train_cost_model(true_runtimes, learning_rate);
+
     // Update weights locally
     auto update_weight = [](const Runtime::Buffer<float> &src, Runtime::Buffer<float> &dst) {
         dst.copy_from(src.sliced(src.dimensions() - 1, 0));
@@ -264,7 +279,78 @@ float DefaultCostModel::backprop(const Runtime::Buffer<const float> &true_runtim
 
     internal_assert(cursor != 0);
 
-    return loss();
+    return loss;
+}
+
+// The training pipeline also takes an ADAM step, using this model's
+// weight update buffers as its state. Those are only scratch space
+// here, so a model used to compute gradients shouldn't also be the
+// one they are applied to.
+float DefaultCostModel::compute_loss_gradients(const Runtime::Buffer<const float> &true_runtimes,
+                                               Internal::Weights *gradients) {
+    float loss = run_train_cost_model(true_runtimes, 0.0f);
+
+    auto get_gradient = [](const Runtime::Buffer<float> &src, Runtime::Buffer<float> &dst) {
+        dst.copy_from(src.sliced(src.dimensions() - 1, 3));
+    };
+    get_gradient(head1_filter_update, gradients->head1_filter);
+    get_gradient(head1_bias_update, gradients->head1_bias);
+    get_gradient(head2_filter_update, gradients->head2_filter);
+    get_gradient(head2_bias_update, gradients->head2_bias);
+    get_gradient(conv1_filter_update, gradients->conv1_filter);
+    get_gradient(conv1_bias_update, gradients->conv1_bias);
+
+    return loss;
+}
+
+// The same ADAM step that the training pipeline takes (see
+// ModelWeight<true>::backprop in cost_model_generator.cpp), for
+// gradients computed elsewhere.
+void DefaultCostModel::apply_loss_gradients(const Internal::Weights &gradients, float learning_rate) {
+    init_weight_updates();
+
+    const float smoothed_deriv_correction = 1 / (1 - std::pow(0.9f, (float)(timestep + 1)));
+    const float smoothed_second_moment_correction = 1 / (1 - std::pow(0.999f, (float)(timestep + 1)));
+    timestep++;
+
+    auto adam = [&](const Runtime::Buffer<float> &gradient, Runtime::Buffer<float> &update, Runtime::Buffer<float> &weight) {
+        const int d = update.dimensions() - 1;
+        Runtime::Buffer<float> new_weight = update.sliced(d, 0);
+        Runtime::Buffer<float> smoothed_deriv = update.sliced(d, 1);
+        Runtime::Buffer<float> smoothed_second_moment = update.sliced(d, 2);
+        Runtime::Buffer<float> loss_gradient = update.sliced(d, 3);
+        weight.for_each_element([&](const int *pos) {
+            const float g = gradient(pos);
+            loss_gradient(pos) = g;
+            smoothed_deriv(pos) = 0.9f * smoothed_deriv(pos) + 0.1f * g;
+            smoothed_second_moment(pos) = 0.999f * smoothed_second_moment(pos) + 0.001f * g * g;
+            float step = learning_rate * smoothed_deriv(pos) * smoothed_deriv_correction;
+            step /= std::sqrt(smoothed_second_moment(pos) * smoothed_second_moment_correction) + 1e-5f;
+            new_weight(pos) = weight(pos) - step;
+            weight(pos) = new_weight(pos);
+        });
+    };
+    adam(gradients.head1_filter, head1_filter_update, weights.head1_filter);
+    adam(gradients.head1_bias, head1_bias_update, weights.head1_bias);
+    adam(gradients.head2_filter, head2_filter_update, weights.head2_filter);
+    adam(gradients.head2_bias, head2_bias_update, weights.head2_bias);
+    adam(gradients.conv1_filter, conv1_filter_update, weights.conv1_filter);
+    adam(gradients.conv1_bias, conv1_bias_update, weights.conv1_bias);
+}
+
+const Internal::Weights &DefaultCostModel::get_weights() const {
+    return weights;
+}
+
+void DefaultCostModel::set_weights(const Internal::Weights &w) {
+    weights.pipeline_features_version = w.pipeline_features_version;
+    weights.schedule_features_version = w.schedule_features_version;
+    weights.head1_filter.copy_from(w.head1_filter);
+    weights.head1_bias.copy_from(w.head1_bias);
+    weights.head2_filter.copy_from(w.head2_filter);
+    weights.head2_bias.copy_from(w.head2_bias);
+    weights.conv1_filter.copy_from(w.conv1_filter);
+    weights.conv1_bias.copy_from(w.conv1_bias);
 }
 
 void DefaultCostModel::evaluate_costs() {
@@ -23,6 +23,9 @@ private:
         conv1_filter_update, conv1_bias_update;
     int timestep = 0;
 
+    void init_weight_updates();
+    float run_train_cost_model(const Runtime::Buffer<const float> &true_runtimes, float learning_rate);
+
 public:
     DefaultCostModel(const std::string &weights_in_path,
                      const std::string &weights_out_path,
@@ -56,6 +59,19 @@ public:
     // Update model weights using true measured runtimes.
     float backprop(const Runtime::Buffer<const float> &true_runtimes, float learning_rate);
 
+    // Data-parallel training. Compute the gradient of the loss for the
+    // enqueued schedules without changing the weights, so that the
+    // gradients from several copies of the model can be averaged and
+    // then applied to one of them with a single ADAM step.
+    float compute_loss_gradients(const Runtime::Buffer<const float> &true_runtimes,
+                                 Internal::Weights *gradients);
+    void apply_loss_gradients(const Internal::Weights &gradients, float learning_rate);
+
+    // Access the current weights, e.g. to copy them into the other copies
+    // of the model used for data-parallel training.
+    const Internal::Weights &get_weights() const;
+    void set_weights(const Internal::Weights &w);
+
     // Save/Load the model weights to/from disk.
     void save_weights();
     void load_weights();
@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <cstdint>
 #include <map>
+#include <mutex>
 #include <string>
 #include <utility>
 
@@ -317,9 +318,13 @@ struct BoundContents {
     // We're frequently going to need to make these concrete bounds
     // arrays.  It makes things more efficient if we figure out the
     // memory layout of those data structures once ahead of time, and
-    // make each individual instance just use that. Note that this is
-    // not thread-safe.
+    // make each individual instance just use that. The pool is shared
+    // by all the threads expanding states in the beam search, so
+    // make() and release() hold a lock.
     class Layout {
+        // Guards the pool, blocks and num_live
+        mutable std::mutex mutex;
+
         // A memory pool of free BoundContent objects with this layout
         mutable std::vector<BoundContents *> pool;
 
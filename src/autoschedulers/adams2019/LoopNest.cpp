@@ -1,5 +1,8 @@
 #include "LoopNest.h"
 
+#include <cstring>
+#include <mutex>
+
 using std::map;
 using std::pair;
 using std::set;
@@ -28,6 +31,137 @@ bool may_subtile() {
     return b;
 }
 
+namespace {
+
+// The bounds and features of a loop nest are cached lazily, and loop
+// nests are shared between states of the beam search that may be
+// expanded on different threads. Accesses to the caches of a loop
+// nest hold one of these locks, picked by its address.
+std::mutex &cache_mutex(const LoopNest *n) {
+    static std::mutex mutexes[64];
+    return mutexes[(reinterpret_cast<uintptr_t>(n) / sizeof(LoopNest)) % 64];
+}
+
+}  // namespace
+
+struct LoopNest::FeatureRecording {
+    FeatureCache *cache;
+
+    // All the loop nests within the one being recorded.
+    std::set<const LoopNest *> subtree;
+
+    // Where each stage is in the sites read and features written.
+    StageMap<int> site_index, written_index;
+
+    // The stages whose num_realizations has been recorded.
+    StageMap<bool> realizations_read;
+
+    FeatureRecording(FeatureCache *cache, const LoopNest *n)
+        : cache(cache) {
+        add_to_subtree(n);
+    }
+
+    void add_to_subtree(const LoopNest *n) {
+        subtree.insert(n);
+        for (const auto &c : n->children) {
+            add_to_subtree(c.get());
+        }
+    }
+
+    // Sites are recorded by address, which only means the same thing
+    // in another state within this loop nest or at the root.
+    const LoopNest *relative_site(const LoopNest *l) {
+        if (l != cache->root && !subtree.count(l)) {
+            cache->reusable = false;
+        }
+        return l;
+    }
+
+    void read_site(const FunctionDAG::Node::Stage *s, int fields, const Sites &site) {
+        if (!site_index.contains(s)) {
+            site_index.insert(s, (int)cache->sites_read.size());
+            cache->sites_read.emplace_back();
+            cache->sites_read.back().stage = s;
+        }
+        auto &r = cache->sites_read[site_index.get(s)];
+        int new_fields = fields & ~r.fields;
+        r.fields |= fields;
+        if (new_fields & FeatureCache::Inlined) {
+            r.inlined = site.inlined;
+        }
+        if (new_fields & FeatureCache::Compute) {
+            r.compute = relative_site(site.compute);
+        }
+        if (new_fields & FeatureCache::Store) {
+            r.store = relative_site(site.store);
+        }
+        if (new_fields & FeatureCache::Task) {
+            r.task = relative_site(site.task);
+        }
+        if (new_fields & FeatureCache::Produce) {
+            r.produced = site.produce != nullptr;
+            if (site.produce) {
+                r.vector_dim = site.produce->vector_dim;
+                r.vectorized_loop_index = site.produce->vectorized_loop_index;
+            }
+        }
+    }
+
+    void read_realizations(const FunctionDAG::Node::Stage *s, double num_realizations) {
+        // Once written, the value no longer depends on the context.
+        if (written_index.contains(s) || realizations_read.contains(s)) {
+            return;
+        }
+        realizations_read.insert(s, true);
+        cache->realizations_read.emplace_back(s, num_realizations);
+    }
+
+    void write_features(const StageMap<ScheduleFeatures> &features, const FunctionDAG::Node::Stage *s) {
+        if (written_index.contains(s)) {
+            return;
+        }
+        written_index.insert(s, (int)cache->features_written.size());
+        cache->features_written.emplace_back();
+        auto &w = cache->features_written.back();
+        w.stage = s;
+        if (features.contains(s)) {
+            w.before = features.get(s);
+        }
+    }
+
+    void finish(const StageMap<ScheduleFeatures> &features) {
+        for (auto &w : cache->features_written) {
+            w.after = features.get(w.stage);
+        }
+    }
+};
+
+namespace {
+
+// Get the sites of a stage, recording which fields are used.
+const LoopNest::Sites &read_site(const StageMap<LoopNest::Sites> &sites,
+                                 const FunctionDAG::Node::Stage *s,
+                                 int fields,
+                                 LoopNest::FeatureRecording *recording) {
+    const auto &site = sites.get(s);
+    if (recording) {
+        recording->read_site(s, fields, site);
+    }
+    return site;
+}
+
+// Get the features of a stage to update.
+ScheduleFeatures &write_features(StageMap<ScheduleFeatures> *features,
+                                 const FunctionDAG::Node::Stage *s,
+                                 LoopNest::FeatureRecording *recording) {
+    if (recording) {
+        recording->write_features(*features, s);
+    }
+    return features->get_or_create(s);
+}
+
+}  // namespace
+
 // Given a multi-dimensional box of dimensionality d, generate a list
 // of candidate tile sizes for it, logarithmically spacing the sizes
 // using the given factor. If 'allow_splits' is false, every dimension
@@ -128,7 +262,7 @@ void LoopNest::copy_from(const LoopNest &n) {
     children = n.children;
     inlined = n.inlined;
     store_at = n.store_at;
-    bounds = n.bounds;
+    bounds = n.copy_bounds();
     node = n.node;
     stage = n.stage;
     innermost = n.innermost;
@@ -197,12 +331,21 @@ void LoopNest::structural_hash(uint64_t &h, int depth) const {
 // Compute all the sites of interest for each pipeline stage
 void LoopNest::get_sites(StageMap<Sites> &sites,
                          const LoopNest *task,
-                         const LoopNest *parent) const {
+                         const LoopNest *parent,
+                         bool use_cache) const {
     if (!task && !is_root()) {
         task = this;
     }
     for (const auto &c : children) {
-        c->get_sites(sites, task, this);
+        std::shared_ptr<const FeatureCache> cache;
+        if (use_cache) {
+            cache = c->get_feature_cache();
+        }
+        if (cache) {
+            cache->add_sites(sites, this);
+        } else {
+            c->get_sites(sites, task, this);
+        }
     }
     if (parent && node != parent->node) {
         auto &s = sites.get_or_create(stage);
@@ -236,7 +379,9 @@ void LoopNest::compute_features(const FunctionDAG &dag,
                                 const LoopNest *grandparent,
                                 const LoopNest &root,
                                 int64_t *working_set,
-                                StageMap<ScheduleFeatures> *features) const {
+                                StageMap<ScheduleFeatures> *features,
+                                bool use_cache,
+                                FeatureRecording *recording) const {
     int64_t working_set_here = 0;
 
     int64_t loop_instances = 1, parallel_tasks = 1;
@@ -274,7 +419,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
         for (size_t s = 0; s < node->stages.size(); s++) {
             // TODO: Lift invariants from this loop. Most of it's the same for every stage.
             internal_assert(!node->is_input);
-            ScheduleFeatures &feat = features->get_or_create(&(node->stages[s]));
+            ScheduleFeatures &feat = write_features(features, &(node->stages[s]), recording);
 
             feat.num_realizations = subinstances;
 
@@ -285,7 +430,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
                 const auto &p = bounds->loops(s, i);
                 int64_t extent = p.extent();
                 feat.points_computed_per_realization *= extent;
-                if (i == sites.get(&(node->stages[s])).produce->vectorized_loop_index) {
+                if (i == read_site(sites, &(node->stages[s]), FeatureCache::Produce, recording).produce->vectorized_loop_index) {
                     // Assumes that we're not going to split
                     // things such that non-native-width
                     // vectorization is a problem, except for the
@@ -309,7 +454,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
                 feat.bytes_at_realization *= p.extent();
             }
             int64_t innermost_storage_extent = 1;
-            int v = sites.get(&(node->stages[s])).produce->vector_dim;
+            int v = read_site(sites, &(node->stages[s]), FeatureCache::Produce, recording).produce->vector_dim;
             if (v >= 0 && node->dimensions > 0) {
                 innermost_storage_extent = bounds->region_computed(v).extent();
             }
@@ -325,7 +470,12 @@ void LoopNest::compute_features(const FunctionDAG &dag,
     if (is_root()) {
         // TODO: This block of code is repeated below. Refactor
         for (const auto &c : children) {
-            c->compute_features(dag, params, sites, subinstances, parallelism, this, parent, root, &working_set_here, features);
+            if (use_cache) {
+                internal_assert(parent == nullptr);
+                c->compute_features_incrementally(dag, params, sites, subinstances, parallelism, root, &working_set_here, features);
+            } else {
+                c->compute_features(dag, params, sites, subinstances, parallelism, this, parent, root, &working_set_here, features);
+            }
         }
 
         for (const auto *node : store_at) {
@@ -394,7 +544,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
 
     // Figure out the features at the compute_at level
     internal_assert(!stage->node->is_input);
-    ScheduleFeatures &feat = features->get_or_create(stage);
+    ScheduleFeatures &feat = write_features(features, stage, recording);
 
     if (innermost) {
         if (vectorized_loop_index >= 0 && vectorized_loop_index < (int)size.size()) {
@@ -476,7 +626,8 @@ void LoopNest::compute_features(const FunctionDAG &dag,
                 continue;
             }
             done.insert(e->producer);
-            const auto &site = sites.get(&(e->producer->stages[0]));
+            const auto &site = read_site(sites, &(e->producer->stages[0]),
+                                         FeatureCache::Store | FeatureCache::Produce, recording);
             if (site.store->is_root()) {
                 const auto &b = get_bounds(e->producer);
                 int64_t bytes = e->producer->bytes_per_point, lines = 1;
@@ -536,7 +687,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
 
     // Recurse inwards
     for (const auto &c : children) {
-        c->compute_features(dag, params, sites, subinstances, subparallelism, this, parent, root, &working_set_here, features);
+        c->compute_features(dag, params, sites, subinstances, subparallelism, this, parent, root, &working_set_here, features, false, recording);
     }
     for (const auto *node : store_at) {
         auto &feat = features->get(&(node->stages[0]));
@@ -597,7 +748,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
            num_loads = 0;
     if (innermost || at_production) {  // These are the sites at which we compute load footprints
         // Pick the site at which we will compute the footprint relationship
-        const auto &consumer_site = sites.get(stage);
+        const auto &consumer_site = read_site(sites, stage, FeatureCache::Store | FeatureCache::Task, recording);
 
         // The store_at location of the consumer
         const auto *consumer_store_site = innermost ? parent : consumer_site.store;
@@ -620,9 +771,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
                 internal_assert(sites.contains(&(e->producer->stages[0])))
                     << "No site found for " << e->producer->func.name() << "\n";
 
-                const auto &site = sites.get(&(e->producer->stages[0]));
-
-                bool producer_has_been_scheduled = e->producer->is_input || (site.produce != nullptr);
+                const auto &site = read_site(sites, &(e->producer->stages[0]), FeatureCache::Inlined, recording);
 
                 if (innermost) {
                     if (e->consumer == stage) {
@@ -652,6 +801,14 @@ void LoopNest::compute_features(const FunctionDAG &dag,
                     continue;
                 }
 
+                if (recording) {
+                    recording->read_site(&(e->producer->stages[0]),
+                                         FeatureCache::Compute | FeatureCache::Store | FeatureCache::Produce,
+                                         site);
+                }
+
+                bool producer_has_been_scheduled = e->producer->is_input || (site.produce != nullptr);
+
                 // The producer's compute_at site
                 const auto *producer_compute_site = site.compute;
 
@@ -857,6 +1014,9 @@ void LoopNest::compute_features(const FunctionDAG &dag,
 
                 if (producer_has_been_scheduled && !e->producer->is_input) {
                     const auto &producer_feat = features->get_or_create(&(e->producer->stages[0]));
+                    if (recording) {
+                        recording->read_realizations(&(e->producer->stages[0]), producer_feat.num_realizations);
+                    }
 
                     if (producer_feat.num_realizations) {
                         // The producer's realization is nested inside this Func's realization
@@ -933,7 +1093,7 @@ void LoopNest::compute_features(const FunctionDAG &dag,
     for (auto it = inlined.begin(); it != inlined.end(); it++) {
         const auto *f = it.key();
         internal_assert(f);
-        auto &inlined_feat = features->get_or_create(&(f->stages[0]));
+        auto &inlined_feat = write_features(features, &(f->stages[0]), recording);
         inlined_feat.inlined_calls += it.value() * subinstances;
         inlined_feat.num_vectors += it.value() * feat.num_vectors;
         inlined_feat.num_scalars += it.value() * feat.num_scalars;
@@ -958,12 +1118,15 @@ void LoopNest::compute_features(const FunctionDAG &dag,
 // Get the region required of a Func at this site, from which we
 // know what region would be computed if it were scheduled here,
 // and what its loop nest would be.
-const Bound &LoopNest::get_bounds(const FunctionDAG::Node *f) const {
-    if (bounds.contains(f)) {
-        const Bound &b = bounds.get(f);
-        // Expensive validation for debugging
-        // b->validate();
-        return b;
+Bound LoopNest::get_bounds(const FunctionDAG::Node *f) const {
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex(this));
+        if (bounds.contains(f)) {
+            const Bound &b = bounds.get(f);
+            // Expensive validation for debugging
+            // b->validate();
+            return b;
+        }
     }
     auto *bound = f->make_bound();
 
@@ -1015,10 +1178,161 @@ const Bound &LoopNest::get_bounds(const FunctionDAG::Node *f) const {
         f->loop_nest_for_region(i, &(bound->region_computed(0)), &(bound->loops(i, 0)));
     }
 
-    const Bound &b = set_bounds(f, bound);
+    Bound b = bound;
     // Validation is expensive, turn if off by default.
     // b->validate();
-    return b;
+
+    // Another thread may have computed the same bounds while we
+    // weren't holding the lock. They're identical, so keep the
+    // first.
+    std::lock_guard<std::mutex> lock(cache_mutex(this));
+    if (bounds.contains(f)) {
+        return bounds.get(f);
+    }
+    return bounds.emplace(f, std::move(b));
+}
+
+NodeMap<Bound> LoopNest::copy_bounds() const {
+    std::lock_guard<std::mutex> lock(cache_mutex(this));
+    return bounds;
+}
+
+std::shared_ptr<const LoopNest::FeatureCache> LoopNest::get_feature_cache() const {
+    std::lock_guard<std::mutex> lock(cache_mutex(this));
+    return feature_cache;
+}
+
+void LoopNest::set_feature_cache(std::shared_ptr<const FeatureCache> cache) const {
+    std::lock_guard<std::mutex> lock(cache_mutex(this));
+    feature_cache = std::move(cache);
+}
+
+bool LoopNest::FeatureCache::matches(const StageMap<Sites> &sites,
+                                     const StageMap<ScheduleFeatures> &features,
+                                     const LoopNest *root,
+                                     int64_t instances,
+                                     int64_t parallelism) const {
+    if (!reusable || instances != this->instances || parallelism != this->parallelism) {
+        return false;
+    }
+
+    auto same_site = [&](const LoopNest *recorded, const LoopNest *current) {
+        return recorded == this->root ? current == root : current == recorded;
+    };
+    for (const auto &r : sites_read) {
+        if (!sites.contains(r.stage)) {
+            return false;
+        }
+        const auto &site = sites.get(r.stage);
+        if (((r.fields & Inlined) && site.inlined != r.inlined) ||
+            ((r.fields & Compute) && !same_site(r.compute, site.compute)) ||
+            ((r.fields & Store) && !same_site(r.store, site.store)) ||
+            ((r.fields & Task) && !same_site(r.task, site.task))) {
+            return false;
+        }
+        if (r.fields & Produce) {
+            if ((site.produce != nullptr) != r.produced) {
+                return false;
+            }
+            if (site.produce &&
+                (site.produce->vector_dim != r.vector_dim ||
+                 site.produce->vectorized_loop_index != r.vectorized_loop_index)) {
+                return false;
+            }
+        }
+    }
+
+    for (const auto &r : realizations_read) {
+        double num_realizations = features.contains(r.first) ? features.get(r.first).num_realizations : 0;
+        if (num_realizations != r.second) {
+            return false;
+        }
+    }
+
+    for (const auto &w : features_written) {
+        ScheduleFeatures before;
+        if (features.contains(w.stage)) {
+            before = features.get(w.stage);
+        }
+        if (memcmp(&before, &w.before, sizeof(ScheduleFeatures)) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void LoopNest::FeatureCache::replay(StageMap<ScheduleFeatures> *features, int64_t *working_set) const {
+    for (const auto &r : realizations_read) {
+        features->get_or_create(r.first);
+    }
+    for (const auto &w : features_written) {
+        features->get_or_create(w.stage) = w.after;
+    }
+    *working_set += this->working_set;
+}
+
+void LoopNest::FeatureCache::add_sites(StageMap<Sites> &sites, const LoopNest *root) const {
+    // get_sites never assigns a default value, so copying the fields
+    // that were set has the same effect as calling it.
+    auto site = [&](const LoopNest *l) {
+        return l == this->root ? root : l;
+    };
+    for (const auto &p : this->sites) {
+        auto &s = sites.get_or_create(p.first);
+        if (p.second.compute) {
+            s.compute = site(p.second.compute);
+        }
+        if (p.second.store) {
+            s.store = site(p.second.store);
+        }
+        if (p.second.produce) {
+            s.produce = site(p.second.produce);
+        }
+        if (p.second.innermost) {
+            s.innermost = site(p.second.innermost);
+        }
+        if (p.second.task) {
+            s.task = site(p.second.task);
+        }
+        if (p.second.inlined) {
+            s.inlined = true;
+        }
+    }
+}
+
+void LoopNest::compute_features_incrementally(const FunctionDAG &dag,
+                                              const MachineParams &params,
+                                              const StageMap<Sites> &sites,
+                                              int64_t instances,
+                                              int64_t parallelism,
+                                              const LoopNest &root,
+                                              int64_t *working_set,
+                                              StageMap<ScheduleFeatures> *features) const {
+    std::shared_ptr<const FeatureCache> cache = get_feature_cache();
+    if (cache && cache->matches(sites, *features, &root, instances, parallelism)) {
+        cache->replay(features, working_set);
+        return;
+    }
+
+    std::shared_ptr<FeatureCache> recorded = std::make_shared<FeatureCache>();
+    recorded->root = &root;
+    recorded->instances = instances;
+    recorded->parallelism = parallelism;
+
+    FeatureRecording recording(recorded.get(), this);
+    compute_features(dag, params, sites, instances, parallelism, &root, nullptr, root,
+                     &recorded->working_set, features, false, &recording);
+    recording.finish(*features);
+    *working_set += recorded->working_set;
+
+    StageMap<Sites> own_sites;
+    get_sites(own_sites, nullptr, &root);
+    for (auto it = own_sites.begin(); it != own_sites.end(); it++) {
+        recorded->sites.emplace_back(it.key(), it.value());
+    }
+
+    set_feature_cache(std::move(recorded));
 }
 
 // Recursively print a loop nest representation to stderr
@@ -1309,7 +1623,7 @@ IntrusivePtr<const LoopNest> LoopNest::parallelize_in_tiles(const MachineParams
     inner->innermost = innermost;
     inner->children = children;
     inner->inlined = inlined;
-    inner->bounds = bounds;
+    inner->bounds = copy_bounds();
     inner->store_at = store_at;
 
     auto *b = inner->get_bounds(node)->make_copy();
@@ -1479,7 +1793,7 @@ vector<IntrusivePtr<const LoopNest>> LoopNest::compute_in_tiles(const FunctionDA
             inner->innermost = innermost;
             inner->children = children;
             inner->inlined = inlined;
-            inner->bounds = bounds;
+            inner->bounds = copy_bounds();
             inner->store_at = store_at;
 
             {
@@ -9,6 +9,7 @@
 #include "FunctionDAG.h"
 #include "PerfectHashMap.h"
 #include <map>
+#include <memory>
 #include <set>
 #include <utility>
 #include <vector>
@@ -55,6 +56,12 @@ struct LoopNest {
     // little boxes to the left of the loop nest tree figures.
     mutable NodeMap<Bound> bounds;
 
+    struct FeatureCache;
+
+    // The features last computed for this loop nest as a child of the
+    // root, and what they depended on. Filled in lazily, like bounds.
+    mutable std::shared_ptr<const FeatureCache> feature_cache;
+
     // The Func this loop nest belongs to
     const FunctionDAG::Node *node = nullptr;
 
@@ -108,10 +115,92 @@ struct LoopNest {
         bool inlined = false;                 // Is the Func inlined?
     };
 
-    // Compute all the sites of interest for each pipeline stage
+    // Compute all the sites of interest for each pipeline stage. At
+    // the root, use_cache reuses the sites recorded in the feature
+    // caches of the children.
     void get_sites(StageMap<Sites> &sites,
                    const LoopNest *task = nullptr,
-                   const LoopNest *parent = nullptr) const;
+                   const LoopNest *parent = nullptr,
+                   bool use_cache = false) const;
+
+    // A record of a call to compute_features on a child of the root:
+    // the sites and features of other stages it read, and the
+    // features it wrote. The children of a state share most of the
+    // loop nests at the root with their parent and siblings. When
+    // the reads of one of them come out the same in another state,
+    // replaying its writes gives exactly the features recomputing it
+    // would.
+    struct FeatureCache {
+        // The root the record was made under. Sites at the root are
+        // compared as being the root, because every state has its
+        // own. Other sites are always within this loop nest.
+        const LoopNest *root = nullptr;
+
+        // False if a read could not be recorded relative to this loop
+        // nest, in which case the record is never reused.
+        bool reusable = true;
+
+        int64_t instances = 0, parallelism = 0;
+
+        // The sites this loop nest assigns in get_sites.
+        std::vector<std::pair<const FunctionDAG::Node::Stage *, Sites>> sites;
+
+        // The fields of Sites that were read.
+        enum SiteFields {
+            Inlined = 1,
+            Compute = 2,
+            Store = 4,
+            Task = 8,
+            Produce = 16,
+        };
+
+        // The sites read. Of the produce site only the parts
+        // compute_features uses are recorded, so that it may be
+        // outside of this loop nest.
+        struct SiteRead {
+            const FunctionDAG::Node::Stage *stage = nullptr;
+            int fields = 0;
+            bool inlined = false;
+            const LoopNest *compute = nullptr, *store = nullptr, *task = nullptr;
+            bool produced = false;
+            int vector_dim = -1, vectorized_loop_index = -1;
+        };
+        std::vector<SiteRead> sites_read;
+
+        // The num_realizations of producers read before this loop
+        // nest wrote to their features.
+        std::vector<std::pair<const FunctionDAG::Node::Stage *, double>> realizations_read;
+
+        // The features written, before and after.
+        struct FeaturesWritten {
+            const FunctionDAG::Node::Stage *stage = nullptr;
+            ScheduleFeatures before, after;
+        };
+        std::vector<FeaturesWritten> features_written;
+
+        // What was added to the working set of the root.
+        int64_t working_set = 0;
+
+        // Would compute_features read the same things in this context?
+        bool matches(const StageMap<Sites> &sites,
+                     const StageMap<ScheduleFeatures> &features,
+                     const LoopNest *root,
+                     int64_t instances,
+                     int64_t parallelism) const;
+
+        // Apply the writes recorded.
+        void replay(StageMap<ScheduleFeatures> *features, int64_t *working_set) const;
+
+        // Assign the sites recorded, under the given root.
+        void add_sites(StageMap<Sites> &sites, const LoopNest *root) const;
+    };
+
+    // Collects a FeatureCache while computing features. Defined in
+    // LoopNest.cpp.
+    struct FeatureRecording;
+
+    std::shared_ptr<const FeatureCache> get_feature_cache() const;
+    void set_feature_cache(std::shared_ptr<const FeatureCache> cache) const;
 
     // A helper for the working_set_at_task feature. Most features are
     // computed in the recursive pass 'compute_features' below, but
@@ -124,7 +213,11 @@ struct LoopNest {
         }
     }
 
-    // Do a recursive walk over the loop nest computing features to feed the cost model.
+    // Do a recursive walk over the loop nest computing features to
+    // feed the cost model. With use_cache, the children of the root
+    // are featurized incrementally. If recording is set, reads and
+    // writes of the sites and features of other stages are recorded
+    // in it.
     void compute_features(const FunctionDAG &dag,
                           const MachineParams &params,
                           const StageMap<Sites> &sites,
@@ -134,7 +227,21 @@ struct LoopNest {
                           const LoopNest *grandparent,
                           const LoopNest &root,
                           int64_t *working_set,
-                          StageMap<ScheduleFeatures> *features) const;
+                          StageMap<ScheduleFeatures> *features,
+                          bool use_cache = false,
+                          FeatureRecording *recording = nullptr) const;
+
+    // Compute the features of a child of the root, reusing its
+    // FeatureCache if it still applies, and recording a new one if
+    // not.
+    void compute_features_incrementally(const FunctionDAG &dag,
+                                        const MachineParams &params,
+                                        const StageMap<Sites> &sites,
+                                        int64_t instances,
+                                        int64_t parallelism,
+                                        const LoopNest &root,
+                                        int64_t *working_set,
+                                        StageMap<ScheduleFeatures> *features) const;
 
     bool is_root() const {
         // The root is the sole node without a Func associated with
@@ -142,15 +249,23 @@ struct LoopNest {
         return node == nullptr;
     }
 
-    // Set the region required of a Func at this site.
+    // Set the region required of a Func at this site. Only used on
+    // loop nests still under construction, which no other thread
+    // can see yet.
     const Bound &set_bounds(const FunctionDAG::Node *f, BoundContents *b) const {
         return bounds.emplace(f, b);
     }
 
     // Get the region required of a Func at this site, from which we
     // know what region would be computed if it were scheduled here,
-    // and what its loop nest would be.
-    const Bound &get_bounds(const FunctionDAG::Node *f) const;
+    // and what its loop nest would be. Loop nests are shared between
+    // states that may be expanded on different threads, so this
+    // returns the Bound by value rather than a reference into the
+    // cache.
+    Bound get_bounds(const FunctionDAG::Node *f) const;
+
+    // Get a copy of all the bounds computed so far at this site.
+    NodeMap<Bound> copy_bounds() const;
 
     // Recursively print a loop nest representation to stderr
     void dump(string prefix, const LoopNest *parent) const;
@@ -0,0 +1,188 @@
+#include "ScheduleDatabase.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+#include "LoopNest.h"
+
+namespace Halide {
+namespace Internal {
+namespace Autoscheduler {
+
+namespace {
+
+// A hash that is the same in every build, unlike std::hash, so that
+// keys stay valid as long as the pipeline does. (64-bit FNV-1a.)
+uint64_t stable_hash(const string &s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : s) {
+        h ^= (uint8_t)c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// The target, without the features that only affect how the code is
+// packaged or instrumented, so that a JIT target used for autotuning
+// matches the ahead-of-time target used to build the pipeline later.
+Target search_target(const Target &target) {
+    Target t = target;
+    for (auto f : {Target::JIT, Target::Debug, Target::NoAsserts, Target::NoBoundsQuery,
+                   Target::UserContext, Target::Matlab, Target::Profile, Target::NoRuntime,
+                   Target::CPlusPlusMangling, Target::TraceLoads, Target::TraceStores,
+                   Target::TraceRealizations, Target::TracePipeline, Target::MSAN,
+                   Target::TSAN, Target::ASAN, Target::EmbedBitcode,
+                   Target::EnableLLVMLoopOpt, Target::DisableLLVMLoopOpt}) {
+        t = t.without_feature(f);
+    }
+    return t;
+}
+
+string entry_path(const string &dir, const string &key) {
+    return dir + "/" + key + ".schedule_entry";
+}
+
+// Write a file all at once, so that other processes reading the
+// database never see it half-written.
+bool write_file_atomically(const string &path, const string &contents) {
+    std::random_device rd;
+    string tmp = path + ".tmp" + std::to_string(rd());
+    {
+        std::ofstream f(tmp, std::ios::binary | std::ios_base::trunc);
+        f << contents;
+        f.close();
+        if (f.fail()) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+string schedule_database_key(const FunctionDAG &dag,
+                             const Target &target,
+                             const MachineParams &params,
+                             int64_t memory_limit) {
+    // Only the shape of the DAG goes into the key, not the names of
+    // the Funcs. Unnamed Funcs get a different name each time a
+    // generator runs in the same process.
+    std::ostringstream s;
+    for (const auto &n : dag.nodes) {
+        s << "Node " << n.id << ": " << n.dimensions << " " << n.bytes_per_point
+          << " " << n.vector_size << " " << n.is_input << n.is_output << n.is_pointwise
+          << n.is_wrapper << n.is_boundary_condition << "\n";
+        for (const auto &r : n.estimated_region_required) {
+            s << "  " << r.min() << " " << r.max() << "\n";
+        }
+        for (const auto &stage : n.stages) {
+            s << " Stage " << stage.id << ": " << stage.vector_size << "\n";
+            for (const auto &l : stage.loop) {
+                s << "  " << l.pure << l.rvar << " " << l.pure_dim << "\n";
+            }
+            stage.features.dump(s);
+        }
+    }
+    for (const auto &e : dag.edges) {
+        s << "Edge: " << e.producer->id << " -> " << e.consumer->id
+          << " " << e.calls << " " << e.all_bounds_affine << "\n";
+        for (const auto &b : e.bounds) {
+            for (const auto *i : {&b.first, &b.second}) {
+                s << "  " << i->affine << i->uses_max << " " << i->coeff
+                  << " " << i->constant << " " << i->consumer_dim << "\n";
+            }
+        }
+    }
+    s << "Target: " << search_target(target).to_string() << "\n"
+      << "Machine params: " << params.to_string() << "\n"
+      << "Memory limit: " << memory_limit << "\n"
+      << "May subtile: " << may_subtile() << "\n";
+
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << stable_hash(s.str());
+    return key.str();
+}
+
+bool load_schedule_database_entry(const string &dir,
+                                  const string &key,
+                                  ScheduleDatabaseEntry *entry) {
+    std::ifstream f(entry_path(dir, key));
+    if (!f) {
+        return false;
+    }
+
+    ScheduleDatabaseEntry result;
+    string field;
+    size_t path_length = 0;
+    if (!(f >> field) || field != "runtime" || !(f >> result.runtime) ||
+        !(f >> field) || field != "path" || !(f >> path_length)) {
+        aslog(0) << "Ignoring malformed schedule database entry " << entry_path(dir, key) << "\n";
+        return false;
+    }
+    // Each step of the path takes at least one byte, so a longer
+    // length than the rest of the file means the entry is corrupt.
+    const std::streampos here = f.tellg();
+    f.seekg(0, std::ios::end);
+    const std::streamoff remaining = f.tellg() - here;
+    f.seekg(here);
+    if (!f || remaining < 0 || path_length > (size_t)remaining) {
+        aslog(0) << "Ignoring truncated schedule database entry " << entry_path(dir, key) << "\n";
+        return false;
+    }
+    result.path.resize(path_length);
+    for (int &i : result.path) {
+        if (!(f >> i)) {
+            aslog(0) << "Ignoring truncated schedule database entry " << entry_path(dir, key) << "\n";
+            return false;
+        }
+    }
+
+    std::ifstream source(dir + "/" + key + ".schedule.h");
+    if (source) {
+        std::ostringstream s;
+        s << source.rdbuf();
+        result.schedule_source = s.str();
+    }
+
+    *entry = std::move(result);
+    return true;
+}
+
+bool save_schedule_database_entry(const string &dir,
+                                  const string &key,
+                                  const ScheduleDatabaseEntry &entry) {
+    ScheduleDatabaseEntry existing;
+    if (load_schedule_database_entry(dir, key, &existing) &&
+        existing.runtime <= entry.runtime) {
+        return false;
+    }
+
+    // Write the source first, so that it is never older than the
+    // entry it belongs to.
+    if (!entry.schedule_source.empty() &&
+        !write_file_atomically(dir + "/" + key + ".schedule.h", entry.schedule_source)) {
+        return false;
+    }
+
+    std::ostringstream s;
+    s << std::setprecision(17)
+      << "runtime " << entry.runtime << "\n"
+      << "path " << entry.path.size();
+    for (int i : entry.path) {
+        s << " " << i;
+    }
+    s << "\n";
+    return write_file_atomically(entry_path(dir, key), s.str());
+}
+
+}  // namespace Autoscheduler
+}  // namespace Internal
+}  // namespace Halide
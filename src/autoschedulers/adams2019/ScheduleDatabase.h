@@ -0,0 +1,59 @@
+/** This file defines the schedule database, a directory of the
+ * fastest schedules found by autotuning each pipeline, so that
+ * later compilations of the same pipeline can use them without
+ * searching again. */
+
+#ifndef SCHEDULE_DATABASE_H
+#define SCHEDULE_DATABASE_H
+
+#include <string>
+#include <vector>
+
+#include "FunctionDAG.h"
+
+namespace Halide {
+namespace Internal {
+namespace Autoscheduler {
+
+struct ScheduleDatabaseEntry {
+    // The child taken at each step of the search from the initial
+    // state, numbered in the order generate_children produces
+    // them. Following these choices again leads to the same
+    // schedule without consulting the cost model.
+    vector<int> path;
+
+    // The best measured runtime of the schedule, in seconds.
+    double runtime = 0;
+
+    // The C++ source code of the schedule, stored alongside the
+    // entry for the user to inspect or include in a generator.
+    string schedule_source;
+};
+
+// The key under which schedules for a pipeline are stored. A hash of
+// the structure of the algorithm and its bounds estimates, the
+// target features that affect the search, the machine params, and
+// the other settings that change which children each state has.
+string schedule_database_key(const FunctionDAG &dag,
+                             const Target &target,
+                             const MachineParams &params,
+                             int64_t memory_limit);
+
+// Read the entry for a key from the database in a directory. Returns
+// false if there is none.
+bool load_schedule_database_entry(const string &dir,
+                                  const string &key,
+                                  ScheduleDatabaseEntry *entry);
+
+// Store an entry in the database in a directory, unless it already
+// has a faster schedule for the key. Returns whether the entry was
+// stored. The directory must exist.
+bool save_schedule_database_entry(const string &dir,
+                                  const string &key,
+                                  const ScheduleDatabaseEntry &entry);
+
+}  // namespace Autoscheduler
+}  // namespace Internal
+}  // namespace Halide
+
+#endif  // SCHEDULE_DATABASE_H
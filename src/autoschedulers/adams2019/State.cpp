@@ -1,5 +1,7 @@
 #include "State.h"
 
+#include <cstring>
+
 namespace Halide {
 namespace Internal {
 namespace Autoscheduler {
@@ -14,12 +16,53 @@ uint64_t State::structural_hash(int depth) const {
     return h;
 }
 
+// Get the HL_INCREMENTAL_FEATURIZATION environment variable. Purpose
+// described in AutoSchedule.cpp.
+int get_incremental_featurization() {
+    string incremental_str = get_env_variable("HL_INCREMENTAL_FEATURIZATION");
+    if (incremental_str.empty()) {
+        return 1;
+    }
+    int incremental = atoi(incremental_str.c_str());
+    user_assert(incremental >= 0 && incremental <= 2)
+        << "HL_INCREMENTAL_FEATURIZATION must be 0, 1 or 2: " << incremental_str << "\n";
+    return incremental;
+}
+
 void State::compute_featurization(const FunctionDAG &dag, const MachineParams &params, StageMap<ScheduleFeatures> *features) {
+    static int incremental = get_incremental_featurization();
+    compute_featurization(dag, params, features, incremental != 0);
+
+    if (incremental == 2) {
+        // Check the incremental featurization against the full one.
+        StageMap<ScheduleFeatures> expected;
+        compute_featurization(dag, params, &expected, false);
+        internal_assert(expected.size() == features->size())
+            << "Incremental featurization has " << features->size()
+            << " stages instead of " << expected.size() << "\n";
+        for (auto it = expected.begin(); it != expected.end(); it++) {
+            const auto &stage = *(it.key());
+            internal_assert(features->contains(&stage))
+                << "Incremental featurization is missing " << stage.stage.name() << "\n";
+            const auto &feat = features->get(&stage);
+            if (memcmp(&feat, &it.value(), sizeof(ScheduleFeatures)) != 0) {
+                aslog(0) << "Incremental features for " << stage.stage.name() << ":\n";
+                feat.dump();
+                aslog(0) << "Expected:\n";
+                it.value().dump();
+                internal_error << "Incremental featurization differs for " << stage.stage.name() << "\n";
+            }
+        }
+    }
+}
+
+void State::compute_featurization(const FunctionDAG &dag, const MachineParams &params,
+                                  StageMap<ScheduleFeatures> *features, bool incremental) {
     StageMap<LoopNest::Sites> sites;
     sites.make_large(dag.nodes[0].stages[0].max_id);
     features->make_large(dag.nodes[0].stages[0].max_id);
     internal_assert(root.defined());
-    root->get_sites(sites);
+    root->get_sites(sites, nullptr, nullptr, incremental);
 
     // For the input nodes and unscheduled outputs, the compute
     // and store sites are root, and the produce and innermost
@@ -74,7 +117,7 @@ void State::compute_featurization(const FunctionDAG &dag, const MachineParams &p
         }
     }
 
-    root->compute_features(dag, params, sites, 1, 1, nullptr, nullptr, *root, nullptr, features);
+    root->compute_features(dag, params, sites, 1, 1, nullptr, nullptr, *root, nullptr, features, incremental);
 
     for (const auto &n : dag.nodes) {
         if (sites.get(&(n.stages[0])).produce == nullptr) {
@@ -259,7 +302,7 @@ void State::generate_children(const FunctionDAG &dag,
                 child->root = new_root;
                 child->num_decisions_made++;
                 if (child->calculate_cost(dag, params, cost_model, memory_limit)) {
-                    num_children++;
+                    child->child_index = num_children++;
                     accept_child(std::move(child));
                 }
             }
@@ -341,7 +384,7 @@ void State::generate_children(const FunctionDAG &dag,
                 child->root = std::move(n);
                 child->num_decisions_made++;
                 if (child->calculate_cost(dag, params, cost_model, memory_limit)) {
-                    num_children++;
+                    child->child_index = num_children++;
                     accept_child(std::move(child));
                 }
             }
@@ -366,9 +409,9 @@ void State::generate_children(const FunctionDAG &dag,
             // The Func must be scalar, or not compute_root, or
             // we're not asking to use multiple cores.  Just
             // return a copy of the parent state
-            num_children++;
             auto child = make_child();
             child->num_decisions_made++;
+            child->child_index = num_children++;
             accept_child(std::move(child));
         } else {
             internal_assert(pure_size);
@@ -449,9 +492,9 @@ void State::generate_children(const FunctionDAG &dag,
             // parallelize. This tends to happen for things like
             // compute_root color matrices.
             if (options.empty()) {
-                num_children++;
                 auto child = make_child();
                 child->num_decisions_made++;
+                child->child_index = num_children++;
                 accept_child(std::move(child));
                 return;
             }
@@ -495,7 +538,7 @@ void State::generate_children(const FunctionDAG &dag,
                 child->root = new_root;
                 child->num_decisions_made++;
                 if (child->calculate_cost(dag, params, cost_model, memory_limit)) {
-                    num_children++;
+                    child->child_index = num_children++;
                     accept_child(std::move(child));
                 }
             }
@@ -8,6 +8,7 @@
 #include "Halide.h"
 #include "LoopNest.h"
 #include "PerfectHashMap.h"
+#include <atomic>
 #include <map>
 #include <utility>
 
@@ -29,14 +30,18 @@ struct State {
     int num_decisions_made = 0;
     // Penalization is determined based on structural hash during beam search.
     bool penalized = false;
+    // Which of the children of its parent this is, in the order
+    // generate_children produced them. The sequence of these from the
+    // initial state identifies a schedule independently of the cost model.
+    int child_index = 0;
 
     // The C++ source code of the generated schedule for this State.
     // Computed if `apply_schedule` is called.
     string schedule_source;
 
     // The number of times a cost is enqueued into the cost model,
-    // for all states.
-    static int cost_calculations;
+    // for all states. Children are generated on several threads.
+    static std::atomic<int> cost_calculations;
 
     State() = default;
     State(const State &) = delete;
@@ -50,10 +55,19 @@ struct State {
 
     // Compute the featurization of this state (based on `root`),
     // and store features in `features`. Defers to `root->compute_features()`.
+    // Unless HL_INCREMENTAL_FEATURIZATION is 0, the features of loop
+    // nests at the root shared with states featurized earlier are
+    // reused where they still apply.
     void compute_featurization(const FunctionDAG &dag,
                                const MachineParams &params,
                                StageMap<ScheduleFeatures> *features);
 
+    // As above, but choosing whether to reuse features explicitly.
+    void compute_featurization(const FunctionDAG &dag,
+                               const MachineParams &params,
+                               StageMap<ScheduleFeatures> *features,
+                               bool incremental);
+
     // Calls `compute_featurization` and prints those features to `out`.
     void save_featurization(const FunctionDAG &dag,
                             const MachineParams &params,
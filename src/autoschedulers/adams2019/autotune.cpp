@@ -0,0 +1,506 @@
+// An in-process autotuning loop, doing the same job as
+// autotune_loop.sh without running any other programs. Link it with
+// one or more generators. For each batch, it searches for schedules
+// for the generator's pipeline with random dropout, JIT-compiles them
+// in parallel, benchmarks them one at a time on this machine, and
+// retrains the cost model on everything benchmarked so far. The
+// fastest schedule for each pipeline is kept in a schedule database,
+// which later compilations use instead of searching if
+// HL_SCHEDULE_DATABASE points at it.
+//
+// Usage:
+//   demo.autotune -g demo --database=db_dir [--batches=N] [--batch_size=32]
+//                 [--weights=in.weights] [--weights_out=out.weights]
+//                 [--samples=samples_dir] [generator_param=value ...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cmdline.h"
+
+#include "ASLog.h"
+#include "AutoSchedule.h"
+#include "DefaultCostModel.h"
+#include "Halide.h"
+#include "ScheduleDatabase.h"
+#include "halide_benchmark.h"
+
+namespace {
+
+using namespace Halide;
+using namespace Halide::Internal;
+using Halide::Internal::Autoscheduler::FunctionDAG;
+using Halide::Internal::Autoscheduler::ScheduleDatabaseEntry;
+using Halide::Internal::Autoscheduler::SearchResult;
+using std::map;
+using std::string;
+using std::vector;
+
+struct Flags {
+    string generator;
+    int batches = 1;
+    int batch_size = 32;
+    int epochs = 32;
+    float learning_rate = 0.0001f;
+    string weights_path;
+    string weights_out_path;
+    string database_dir;
+    string samples_dir;
+    int compile_threads = 1;
+    uint32_t seed = 0;
+    double benchmark_min_time = 0.1;
+    MachineParams machine_params = MachineParams::generic();
+    Target target;
+    GeneratorParamsMap generator_params;
+
+    Flags(int argc, char **argv) {
+        cmdline::parser a;
+
+        const char *kNoDesc = "";
+
+        constexpr bool kOptional = false;
+        a.add<string>("generator", 'g');
+        a.add<int>("batches", '\0', kNoDesc, kOptional, 1);
+        a.add<int>("batch_size", '\0', kNoDesc, kOptional, 32);
+        a.add<int>("epochs", '\0', kNoDesc, kOptional, 32);
+        a.add<float>("learning_rate", '\0', kNoDesc, kOptional, 0.0001f);
+        a.add<string>("weights", '\0', kNoDesc, kOptional, "");
+        a.add<string>("weights_out", '\0', kNoDesc, kOptional, "");
+        a.add<string>("database", '\0', kNoDesc, kOptional, "");
+        a.add<string>("samples", '\0', kNoDesc, kOptional, "");
+        a.add<int>("compile_threads", '\0', kNoDesc, kOptional, (int)std::thread::hardware_concurrency());
+        a.add<int>("seed", '\0', kNoDesc, kOptional, (int)time(nullptr));
+        a.add<double>("benchmark_min_time", '\0', kNoDesc, kOptional, 0.1);
+        a.add<string>("machine_params", '\0', kNoDesc, kOptional, MachineParams::generic().to_string());
+        a.footer("[generator_param=value ...]");
+
+        a.parse_check(argc, argv);  // exits if parsing fails
+
+        generator = a.get<string>("generator");
+        batches = a.get<int>("batches");
+        batch_size = a.get<int>("batch_size");
+        epochs = a.get<int>("epochs");
+        learning_rate = a.get<float>("learning_rate");
+        weights_path = a.get<string>("weights");
+        weights_out_path = a.get<string>("weights_out");
+        database_dir = a.get<string>("database");
+        samples_dir = a.get<string>("samples");
+        compile_threads = std::max(a.get<int>("compile_threads"), 1);
+        seed = (uint32_t)a.get<int>("seed");
+        benchmark_min_time = a.get<double>("benchmark_min_time");
+        machine_params = MachineParams(a.get<string>("machine_params"));
+
+        // The schedules are benchmarked here, so the target must be
+        // one this machine can run.
+        target = get_jit_target_from_environment();
+        for (const string &arg : a.rest()) {
+            size_t eq = arg.find('=');
+            if (eq == string::npos) {
+                std::cerr << "Generator params must be of the form name=value: " << arg << "\n";
+                std::cerr << a.usage();
+                exit(1);
+            }
+            string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+            if (name == "target") {
+                target = Target(value);
+            } else {
+                generator_params[name] = value;
+            }
+        }
+
+        if (batches <= 0 || batch_size <= 0) {
+            std::cerr << "--batches and --batch_size must be > 0.\n";
+            std::cerr << a.usage();
+            exit(1);
+        }
+        if (database_dir.empty() && weights_out_path.empty() && samples_dir.empty()) {
+            std::cerr << "At least one of --database, --weights_out or --samples must be specified.\n";
+            std::cerr << a.usage();
+            exit(1);
+        }
+    }
+};
+
+// Finds the Params and ImageParams a pipeline uses.
+class FindParameters : public IRGraphVisitor {
+    using IRGraphVisitor::visit;
+
+    void visit(const Variable *op) override {
+        if (op->param.defined()) {
+            found[op->param.name()] = op->param;
+        }
+    }
+
+    void visit(const Call *op) override {
+        IRGraphVisitor::visit(op);
+        if (op->param.defined()) {
+            found[op->param.name()] = op->param;
+        }
+    }
+
+public:
+    map<string, Parameter> found;
+};
+
+int64_t get_estimate(const Expr &e, const string &what) {
+    const int64_t *i = e.defined() ? as_const_int(simplify(e)) : nullptr;
+    user_assert(i) << "Autotuning requires a constant estimate for " << what << "\n";
+    return *i;
+}
+
+// Set a scalar parameter to its estimate, as the autoscheduler
+// assumed, or leave it at its default if it has none.
+void set_to_estimate(Parameter &p) {
+    if (!p.estimate().defined()) {
+        return;
+    }
+    Expr e = simplify(cast(p.type(), p.estimate()));
+    halide_scalar_value_t v = {};
+    if (const int64_t *i = as_const_int(e)) {
+        switch (p.type().bits()) {
+        case 8:
+            v.u.i8 = (int8_t)*i;
+            break;
+        case 16:
+            v.u.i16 = (int16_t)*i;
+            break;
+        case 32:
+            v.u.i32 = (int32_t)*i;
+            break;
+        default:
+            v.u.i64 = *i;
+        }
+    } else if (const uint64_t *u = as_const_uint(e)) {
+        switch (p.type().bits()) {
+        case 1:
+            v.u.b = *u != 0;
+            break;
+        case 8:
+            v.u.u8 = (uint8_t)*u;
+            break;
+        case 16:
+            v.u.u16 = (uint16_t)*u;
+            break;
+        case 32:
+            v.u.u32 = (uint32_t)*u;
+            break;
+        default:
+            v.u.u64 = *u;
+        }
+    } else if (const double *f = as_const_float(e)) {
+        if (p.type().bits() == 32) {
+            v.u.f32 = (float)*f;
+        } else {
+            v.u.f64 = *f;
+        }
+    } else {
+        return;
+    }
+    p.set_scalar(p.type(), v);
+}
+
+// Fill a buffer with values in a range that keeps floating-point
+// code off the slow paths for denormals and NaNs.
+void fill_random(Buffer<> &b, std::mt19937 &rng) {
+    const Type t = b.type();
+    const size_t n = b.number_of_elements();
+    if (t == Float(32)) {
+        std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+        float *p = (float *)b.data();
+        for (size_t i = 0; i < n; i++) {
+            p[i] = dist(rng);
+        }
+    } else if (t == Float(64)) {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        double *p = (double *)b.data();
+        for (size_t i = 0; i < n; i++) {
+            p[i] = dist(rng);
+        }
+    } else {
+        uint8_t *p = (uint8_t *)b.data();
+        for (size_t i = 0; i < b.size_in_bytes(); i++) {
+            p[i] = t.is_bool() ? (rng() & 1) : (uint8_t)rng();
+        }
+    }
+}
+
+// Bind every input the pipeline uses to a value of its estimated
+// size, and make output buffers of the estimated size.
+Realization bind_inputs_and_make_outputs(Pipeline &p, std::mt19937 &rng) {
+    FindParameters finder;
+    std::map<string, Function> env;
+    for (const Func &f : p.outputs()) {
+        const auto calls = find_transitive_calls(f.function());
+        env.insert(calls.begin(), calls.end());
+    }
+    for (const auto &it : env) {
+        it.second.accept(&finder);
+    }
+    for (auto &it : finder.found) {
+        Parameter &param = it.second;
+        if (!param.is_buffer()) {
+            set_to_estimate(param);
+            continue;
+        }
+        vector<int> mins, extents;
+        for (int i = 0; i < param.dimensions(); i++) {
+            string what = "dimension " + std::to_string(i) + " of " + param.name();
+            mins.push_back((int)get_estimate(param.min_constraint_estimate(i), "the min of " + what));
+            extents.push_back((int)get_estimate(param.extent_constraint_estimate(i), "the extent of " + what));
+        }
+        Buffer<> buf(param.type(), extents);
+        buf.set_min(mins);
+        fill_random(buf, rng);
+        param.set_buffer(buf);
+    }
+
+    vector<Buffer<>> bufs;
+    for (const Func &out : p.outputs()) {
+        const Function &f = out.function();
+        vector<int> mins, extents;
+        for (const string &arg : f.args()) {
+            string what = "dimension " + arg + " of " + f.name();
+            Expr min, extent;
+            for (const auto &b : f.schedule().estimates()) {
+                if (b.var == arg) {
+                    min = b.min;
+                    extent = b.extent;
+                }
+            }
+            mins.push_back((int)get_estimate(min, "the min of " + what));
+            extents.push_back((int)get_estimate(extent, "the extent of " + what));
+        }
+        for (const Type &t : f.output_types()) {
+            bufs.emplace_back(t, extents);
+            bufs.back().set_min(mins);
+        }
+    }
+    return Realization(bufs);
+}
+
+// One schedule for the pipeline, and what we learn about it.
+struct Sample {
+    std::unique_ptr<GeneratorBase> generator;
+    Pipeline pipeline;
+    std::unique_ptr<FunctionDAG> dag;
+    SearchResult search;
+    string key;
+    uint32_t seed = 0;
+    bool compiled = false;
+    // The fastest time per run, in seconds. Negative if the schedule
+    // failed to compile or run.
+    double runtime = -1;
+    // What the cost model predicts, in milliseconds.
+    double prediction = 0;
+};
+
+// Search for a schedule for a fresh copy of the pipeline. Sample 0 in
+// each batch is a regular beam search, and the others are random
+// probes biased by the cost model, as in autotune_loop.sh.
+void search(Sample &s, int index_in_batch, DefaultCostModel *cost_model, const Flags &flags) {
+    GeneratorContext context(flags.target, true, flags.machine_params);
+    s.generator = GeneratorRegistry::create(flags.generator, context);
+    s.generator->set_generator_param_values(flags.generator_params);
+    s.pipeline = s.generator->configure_and_build_pipeline();
+
+    vector<Function> outputs;
+    for (const Func &f : s.pipeline.outputs()) {
+        outputs.push_back(f.function());
+    }
+    s.dag.reset(new FunctionDAG(outputs, flags.machine_params, flags.target));
+
+    const int64_t memory_limit = Autoscheduler::get_memory_limit();
+    const bool greedy_probe = index_in_batch > 0;
+    find_and_apply_schedule(*s.dag, outputs, flags.machine_params, cost_model,
+                            greedy_probe ? 1 : 32, greedy_probe ? 1 : 100, s.seed,
+                            memory_limit, &s.search);
+    s.key = Autoscheduler::schedule_database_key(*s.dag, flags.target, flags.machine_params, memory_limit);
+}
+
+void compile(Sample &s, const Flags &flags) {
+#ifdef HALIDE_WITH_EXCEPTIONS
+    try {
+#endif
+        s.pipeline.compile_jit(flags.target);
+        s.compiled = true;
+#ifdef HALIDE_WITH_EXCEPTIONS
+    } catch (const Halide::Error &e) {
+        std::cerr << "Schedule " << s.seed << " failed to compile: " << e.what() << "\n";
+    }
+#endif
+}
+
+void benchmark(Sample &s, const Flags &flags) {
+    if (!s.compiled) {
+        return;
+    }
+#ifdef HALIDE_WITH_EXCEPTIONS
+    try {
+#endif
+        std::mt19937 rng(s.seed);
+        Realization r = bind_inputs_and_make_outputs(s.pipeline, rng);
+        auto run = [&]() {
+            s.pipeline.realize(r, flags.target);
+        };
+        // Runs until the best few samples agree, and takes the
+        // fastest, which filters out interference from the rest of
+        // the machine far better than taking a mean.
+        Tools::BenchmarkConfig config;
+        config.min_time = flags.benchmark_min_time;
+        config.max_time = flags.benchmark_min_time * 4;
+        s.runtime = Tools::benchmark(run, config).wall_time;
+#ifdef HALIDE_WITH_EXCEPTIONS
+    } catch (const Halide::Error &e) {
+        std::cerr << "Schedule " << s.seed << " failed to run: " << e.what() << "\n";
+    }
+#endif
+}
+
+// Write a sample in the format retrain_cost_model reads: the
+// featurization, then the runtime in milliseconds, a pipeline id and
+// a schedule id.
+void save_sample(const Sample &s, const Flags &flags) {
+    string path = flags.samples_dir + "/" + flags.generator + "_" + s.key + "_" +
+                  std::to_string(s.seed) + ".sample";
+    std::ofstream f(path, std::ios::binary | std::ios_base::trunc);
+    f << s.search.featurization;
+    float runtime = (float)(s.runtime * 1000);
+    int32_t pipeline_id = (int32_t)(std::stoull(s.key, nullptr, 16) & 0x7fffffff);
+    int32_t schedule_id = (int32_t)s.seed;
+    f.write((const char *)&runtime, 4);
+    f.write((const char *)&pipeline_id, 4);
+    f.write((const char *)&schedule_id, 4);
+    f.close();
+    if (f.fail()) {
+        std::cerr << "Failed to write " << path << "\n";
+    }
+}
+
+// Retrain the cost model on the samples benchmarked so far. Returns
+// the loss of the last epoch.
+float retrain(DefaultCostModel *cost_model, const vector<Sample *> &samples, const Flags &flags) {
+    // The cost model takes at most this many schedules at once.
+    const size_t max_samples = 1024;
+    size_t first = samples.size() > max_samples ? samples.size() - max_samples : 0;
+    size_t n = samples.size() - first;
+    Runtime::Buffer<float> runtimes((int)n);
+    for (size_t i = 0; i < n; i++) {
+        runtimes((int)i) = (float)(samples[first + i]->runtime * 1000);
+    }
+
+    float loss = 0;
+    for (int e = 0; e < flags.epochs; e++) {
+        cost_model->reset();
+        cost_model->set_pipeline_features(*samples[first]->dag, flags.machine_params);
+        for (size_t i = first; i < samples.size(); i++) {
+            cost_model->enqueue(*samples[i]->dag, samples[i]->search.features, &samples[i]->prediction);
+        }
+        loss = cost_model->backprop(runtimes, flags.learning_rate);
+    }
+    cost_model->reset();
+    return loss;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Flags flags(argc, argv);
+
+    std::unique_ptr<DefaultCostModel> cost_model =
+        make_default_cost_model(flags.weights_path, flags.weights_out_path, false);
+
+    std::cout.setf(std::ios::fixed, std::ios::floatfield);
+    std::cout.precision(4);
+    std::cout << "Autotuning " << flags.generator << " for " << flags.target.to_string()
+              << " using seed = " << flags.seed << "\n";
+
+    ThreadPool<void> pool(flags.compile_threads);
+
+    // Samples from all batches so far, for retraining. The DAG of
+    // each is kept alive along with it, because its features are
+    // keyed by the DAG's stages.
+    vector<std::unique_ptr<Sample>> samples;
+    vector<Sample *> benchmarked;
+    for (int b = 0; b < flags.batches; b++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t batch_start = samples.size();
+        for (int i = 0; i < flags.batch_size; i++) {
+            samples.emplace_back(new Sample);
+            Sample &s = *samples.back();
+            s.seed = flags.seed + (uint32_t)(b * flags.batch_size + i);
+            search(s, i, cost_model.get(), flags);
+        }
+
+        // Compiling is the slow part, and the pipelines are
+        // independent, so compile the whole batch at once...
+        vector<std::future<void>> futures;
+        for (size_t i = batch_start; i < samples.size(); i++) {
+            Sample *s = samples[i].get();
+            futures.push_back(pool.async([s, &flags]() { compile(*s, flags); }));
+        }
+        for (auto &f : futures) {
+            f.get();
+        }
+
+        // ...but benchmark one at a time, so that the schedules don't
+        // compete for the machine.
+        Sample *best = nullptr;
+        for (size_t i = batch_start; i < samples.size(); i++) {
+            Sample &s = *samples[i];
+            benchmark(s, flags);
+            if (s.runtime < 0) {
+                continue;
+            }
+            std::cout << "Schedule " << s.seed << ": " << s.runtime * 1000 << " ms\n";
+            benchmarked.push_back(&s);
+            if (!flags.samples_dir.empty()) {
+                save_sample(s, flags);
+            }
+            if (!best || s.runtime < best->runtime) {
+                best = &s;
+            }
+        }
+
+        if (best && !flags.database_dir.empty()) {
+            ScheduleDatabaseEntry entry;
+            entry.path = best->search.path;
+            entry.runtime = best->runtime;
+            entry.schedule_source = best->search.schedule_source;
+            if (Autoscheduler::save_schedule_database_entry(flags.database_dir, best->key, entry)) {
+                std::cout << "New best schedule " << best->key << ": " << best->runtime * 1000 << " ms\n";
+            }
+        }
+
+        if (!benchmarked.empty()) {
+            float loss = retrain(cost_model.get(), benchmarked, flags);
+            std::cout << "Retrained on " << benchmarked.size() << " samples, loss = " << loss << "\n";
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        std::cout << "Batch " << b << " took " << elapsed.count() << " seconds to compile, benchmark, and retrain\n";
+
+        // Free the compiled code of this batch. The DAGs and features
+        // are all retraining needs.
+        for (size_t i = batch_start; i < samples.size(); i++) {
+            samples[i]->pipeline = Pipeline();
+            samples[i]->generator.reset();
+        }
+    }
+
+    if (!flags.weights_out_path.empty()) {
+        cost_model->save_weights();
+    }
+
+    return 0;
+}
@@ -43,6 +43,12 @@ HL_TARGET=`${AUTOSCHED_BIN}/get_host_target avx512 avx512_knl avx512_skylake avx
 fi
 echo Training target is: ${HL_TARGET}
 
+if [ -z ${HL_MACHINE_PARAMS} ]; then
+# Set this to "host", or the output of get_host_machine_params, to use
+# the measured parameters of this machine instead.
+HL_MACHINE_PARAMS=32,24000000,40
+fi
+
 if [ -z ${GENERATOR} ]; then
 GENERATOR=./bin/demo.generator
 fi
@@ -107,7 +113,7 @@ make_featurization() {
         HL_WEIGHTS_DIR=${WEIGHTS} \
         HL_RANDOM_DROPOUT=${dropout} \
         HL_BEAM_SIZE=${beam} \
-        HL_MACHINE_PARAMS=32,24000000,40 \
+        HL_MACHINE_PARAMS=${HL_MACHINE_PARAMS} \
         ${TIMEOUT_CMD} -k ${COMPILATION_TIMEOUT} ${COMPILATION_TIMEOUT} \
         ${GENERATOR} \
         -g ${PIPELINE} \
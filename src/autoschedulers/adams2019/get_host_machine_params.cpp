@@ -0,0 +1,29 @@
+#include "Halide.h"
+
+using namespace Halide;
+
+// Measure the host and print its machine params to stdout, in the
+// form HL_MACHINE_PARAMS and the machine_params generator param
+// take. With -v, also print what was measured to stderr.
+int main(int argc, char **argv) {
+    bool verbose = argc == 2 && std::string(argv[1]) == "-v";
+    if (argc > 2 || (argc == 2 && !verbose)) {
+        fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+        return 1;
+    }
+
+    Internal::HostMachineMeasurements m = Internal::measure_host_machine();
+    if (verbose) {
+        for (size_t i = 0; i < m.cache_sizes.size(); i++) {
+            fprintf(stderr, "L%d cache: %llu bytes\n", (int)i + 1, (unsigned long long)m.cache_sizes[i]);
+        }
+        fprintf(stderr, "Threads: %d\n", m.threads);
+        for (const auto &f : m.flops) {
+            fprintf(stderr, "%d tasks: %.1f GFLOP/s\n", f.first, f.second * 1e-9);
+        }
+        fprintf(stderr, "Memory bandwidth: %.1f GB/s on one core, %.1f GB/s on all threads\n",
+                m.single_core_memory_bandwidth * 1e-9, m.total_memory_bandwidth * 1e-9);
+    }
+    printf("%s", Internal::machine_params_from_measurements(m).to_string().c_str());
+    return 0;
+}
@@ -1,14 +1,26 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <random>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "cmdline.h"
 
 #include "DefaultCostModel.h"
@@ -33,6 +45,9 @@ struct Flags {
     bool randomize_weights = false;
     string best_benchmark_path;
     string best_schedule_path;
+    string samples_file_path;
+    string save_samples_file_path;
+    int num_threads = 1;
 
     Flags(int argc, char **argv) {
         cmdline::parser a;
@@ -48,6 +63,9 @@ struct Flags {
         a.add<int>("num_cores");
         a.add<string>("best_benchmark");
         a.add<string>("best_schedule");
+        a.add<string>("samples_file", '\0', kNoDesc, kOptional, "");
+        a.add<string>("save_samples_file", '\0', kNoDesc, kOptional, "");
+        a.add<int>("num_threads", '\0', kNoDesc, kOptional, 1);
 
         a.parse_check(argc, argv);  // exits if parsing fails
 
@@ -58,6 +76,9 @@ struct Flags {
         randomize_weights = a.exist("randomize_weights") && a.get<bool>("randomize_weights");
         best_benchmark_path = a.get<string>("best_benchmark");
         best_schedule_path = a.get<string>("best_schedule");
+        samples_file_path = a.get<string>("samples_file");
+        save_samples_file_path = a.get<string>("save_samples_file");
+        num_threads = a.get<int>("num_threads");
 
         if (epochs <= 0) {
             std::cerr << "--epochs must be specified and > 0.\n";
@@ -74,6 +95,16 @@ struct Flags {
             std::cerr << a.usage();
             exit(1);
         }
+        if (num_threads <= 0) {
+            std::cerr << "--num_threads must be > 0.\n";
+            std::cerr << a.usage();
+            exit(1);
+        }
+        if (!samples_file_path.empty() && !save_samples_file_path.empty()) {
+            std::cerr << "--samples_file and --save_samples_file can't be used together.\n";
+            std::cerr << a.usage();
+            exit(1);
+        }
         if (rates.empty()) {
             std::cerr << "--rates cannot be empty.\n";
             std::cerr << a.usage();
@@ -159,57 +190,119 @@ string leaf(const string &path) {
     }
 }
 
-// Load all the samples, reading filenames from stdin
+// A samples file holds the contents of many .sample files, so that
+// they can be loaded in one go rather than opened one at a time. It
+// starts with samples_file_magic, then each sample has a header of
+// two uint32_t's: the length of the name of the .sample file it came
+// from, and the number of floats in it. Then comes the name, padded
+// with zeros to a multiple of four bytes so that the floats after it
+// are aligned, and then the floats.
+const char samples_file_magic[8] = {'h', 'l', 's', 'a', 'm', 'p', 'l', '1'};
+
+size_t padded_name_length(uint32_t name_length) {
+    return (name_length + 3) & ~(size_t)3;
+}
+
+// A read-only view of a whole file, memory-mapped where possible, so
+// that samples can be parsed where they are instead of copied.
+class MappedFile {
+    const char *contents = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    vector<char> storage;
+#else
+    void *mapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const string &path) {
+#ifdef _WIN32
+        std::ifstream f(path, std::ios::binary);
+        storage.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        if (f.is_open()) {
+            contents = storage.data();
+            length = storage.size();
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                // We read it once, front to back.
+                madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+                mapping = m;
+                contents = (const char *)m;
+                length = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapping) {
+            munmap(mapping, length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const {
+        return contents;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+void write_packed_sample(std::ofstream &out, const string &name, const float *data, size_t floats_read) {
+    const uint32_t header[2] = {(uint32_t)name.size(), (uint32_t)floats_read};
+    const char padding[4] = {0, 0, 0, 0};
+    out.write((const char *)header, sizeof(header));
+    out.write(name.data(), name.size());
+    out.write(padding, padded_name_length(header[0]) - name.size());
+    out.write((const char *)data, floats_read * sizeof(float));
+}
+
+// Load all the samples, reading filenames from stdin, or from a
+// samples file if one is specified.
 map<int, PipelineSample> load_samples(const Flags &flags) {
     map<int, PipelineSample> result;
-    vector<float> scratch(10 * 1024 * 1024);
 
     int best = -1;
     float best_runtime = 1e20f;
     string best_path;
 
     size_t num_read = 0, num_unique = 0;
-    while (!std::cin.eof()) {
-        string s;
-        std::cin >> s;
-        if (s.empty()) {
-            continue;
-        }
-        if (!ends_with(s, ".sample")) {
-            std::cout << "Skipping file: " << s << "\n";
-            continue;
-        }
-        std::ifstream file(s);
-        file.read((char *)(scratch.data()), scratch.size() * sizeof(float));
-        const size_t floats_read = file.gcount() / sizeof(float);
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto add_sample = [&](const string &s, const float *data, size_t floats_read) {
         const size_t num_features = floats_read - 3;
         const size_t features_per_stage = head2_w + (head1_w + 1) * head1_h;
-        file.close();
-        // Note we do not check file.fail(). The various failure cases
-        // are handled below by checking the number of floats read. We
-        // expect truncated files if the benchmarking or
-        // autoscheduling procedure crashes and want to filter them
-        // out with a warning.
-
-        if (floats_read == scratch.size()) {
-            std::cout << "Too-large sample: " << s << " " << floats_read << "\n";
-            continue;
-        }
-        if (num_features % features_per_stage != 0) {
+        if (floats_read < 3 || num_features % features_per_stage != 0) {
             std::cout << "Truncated sample: " << s << " " << floats_read << "\n";
-            continue;
+            return;
         }
         const size_t num_stages = num_features / features_per_stage;
 
-        const float runtime = scratch[num_features];
+        const float runtime = data[num_features];
         if (runtime > 100000) {  // Don't try to predict runtime over 100s
             std::cout << "Implausible runtime in ms: " << runtime << "\n";
-            continue;
+            return;
         }
         // std::cout << "Runtime: " << runtime << "\n";
 
-        int pipeline_id = *((int32_t *)(&scratch[num_features + 1]));
-        const int schedule_id = *((int32_t *)(&scratch[num_features + 2]));
+        int pipeline_id = *((const int32_t *)(&data[num_features + 1]));
+        const int schedule_id = *((const int32_t *)(&data[num_features + 2]));
 
         if (runtime < best_runtime) {
             best_runtime = runtime;
@@ -227,7 +320,7 @@ map<int, PipelineSample> load_samples(const Flags &flags) {
             for (size_t i = 0; i < num_stages; i++) {
                 for (int x = 0; x < head1_w; x++) {
                     for (int y = 0; y < head1_h; y++) {
-                        float f = scratch[i * features_per_stage + (x + 1) * 7 + y + head2_w];
+                        float f = data[i * features_per_stage + (x + 1) * 7 + y + head2_w];
                         if (f < 0 || std::isnan(f)) {
                             std::cout << "Negative or NaN pipeline feature: " << x << " " << y << " " << i << " " << f << "\n";
                         }
@@ -243,8 +336,8 @@ map<int, PipelineSample> load_samples(const Flags &flags) {
         for (size_t i = 0; i < num_stages; i++) {
             schedule_hash =
                 hash_floats(schedule_hash,
-                            &scratch[i * features_per_stage],
-                            &scratch[i * features_per_stage + head2_w]);
+                            &data[i * features_per_stage],
+                            &data[i * features_per_stage + head2_w]);
         }
 
         auto it = ps.schedules.find(schedule_hash);
@@ -275,7 +368,7 @@ map<int, PipelineSample> load_samples(const Flags &flags) {
             bool ok = true;
             for (size_t i = 0; i < num_stages; i++) {
                 for (int x = 0; x < head2_w; x++) {
-                    float f = scratch[i * features_per_stage + x];
+                    float f = data[i * features_per_stage + x];
                     if (f < 0 || f > 1e14 || std::isnan(f)) {
                         std::cout << "Negative or implausibly large schedule feature: " << i << " " << x << " " << f << "\n";
                         // Something must have overflowed
@@ -304,8 +397,85 @@ map<int, PipelineSample> load_samples(const Flags &flags) {
         if (num_read % 10000 == 0) {
             std::cout << "Samples loaded: " << num_read << " (" << num_unique << " unique)\n";
         }
+    };
+
+    if (!flags.samples_file_path.empty()) {
+        MappedFile file(flags.samples_file_path);
+        const char *p = file.data(), *end = file.data() + file.size();
+        if (!p || file.size() < sizeof(samples_file_magic) ||
+            memcmp(p, samples_file_magic, sizeof(samples_file_magic)) != 0) {
+            std::cerr << "Not a samples file: " << flags.samples_file_path << "\n";
+            exit(1);
+        }
+        p += sizeof(samples_file_magic);
+        while (p < end) {
+            uint32_t header[2];
+            if ((size_t)(end - p) < sizeof(header)) {
+                std::cout << "Truncated samples file: " << flags.samples_file_path << "\n";
+                break;
+            }
+            memcpy(header, p, sizeof(header));
+            p += sizeof(header);
+            const size_t name_size = padded_name_length(header[0]);
+            const size_t data_size = (size_t)header[1] * sizeof(float);
+            if ((size_t)(end - p) < name_size + data_size) {
+                std::cout << "Truncated samples file: " << flags.samples_file_path << "\n";
+                break;
+            }
+            string s(p, header[0]);
+            p += name_size;
+            add_sample(s, (const float *)p, header[1]);
+            p += data_size;
+        }
+    } else {
+        vector<float> scratch(10 * 1024 * 1024);
+        std::ofstream packed;
+        if (!flags.save_samples_file_path.empty()) {
+            packed.open(flags.save_samples_file_path, std::ios::binary | std::ios_base::trunc);
+            packed.write(samples_file_magic, sizeof(samples_file_magic));
+        }
+        while (!std::cin.eof()) {
+            string s;
+            std::cin >> s;
+            if (s.empty()) {
+                continue;
+            }
+            if (!ends_with(s, ".sample")) {
+                std::cout << "Skipping file: " << s << "\n";
+                continue;
+            }
+            std::ifstream file(s);
+            file.read((char *)(scratch.data()), scratch.size() * sizeof(float));
+            const size_t floats_read = file.gcount() / sizeof(float);
+            file.close();
+            // Note we do not check file.fail(). The various failure cases
+            // are handled below by checking the number of floats read. We
+            // expect truncated files if the benchmarking or
+            // autoscheduling procedure crashes and want to filter them
+            // out with a warning.
+
+            if (floats_read == scratch.size()) {
+                std::cout << "Too-large sample: " << s << " " << floats_read << "\n";
+                continue;
+            }
+            if (packed.is_open()) {
+                write_packed_sample(packed, s, scratch.data(), floats_read);
+            }
+            add_sample(s, scratch.data(), floats_read);
+        }
+        if (packed.is_open()) {
+            packed.close();
+            if (packed.fail()) {
+                std::cerr << "Failed to write samples file: " << flags.save_samples_file_path << "\n";
+                exit(1);
+            }
+        }
     }
 
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Loaded " << num_read << " samples in " << elapsed.count() << " seconds ("
+              << num_read / std::max(elapsed.count(), 1e-9) << " samples per second)\n";
+
     // Check the noise level
     for (const auto &pipe : result) {
         double variance_sum = 0;
@@ -365,6 +535,64 @@ map<int, PipelineSample> load_samples(const Flags &flags) {
     return result;
 }
 
+// The schedules of one pipeline to run the model on at once.
+struct Batch {
+    std::pair<const int, PipelineSample> *pipeline = nullptr;
+    size_t first = 0, size = 0;
+    float loss = 0;
+};
+
+// Run a batch through the model, recording its predictions in the
+// samples. In training mode, either update the weights, or if
+// gradients is non-null, just compute the gradients of the loss.
+float run_batch(DefaultCostModel *tp, const Batch &b, int model, bool train,
+                float learning_rate, int num_cores, Internal::Weights *gradients) {
+    PipelineSample &p = b.pipeline->second;
+    tp->reset();
+    tp->set_pipeline_features(p.pipeline_features, num_cores);
+
+    Halide::Runtime::Buffer<float> runtimes(b.size);
+
+    auto it = p.schedules.begin();
+    std::advance(it, b.first);
+    for (size_t j = 0; j < b.size; j++) {
+        auto &sched = it->second;
+        Halide::Runtime::Buffer<float> buf;
+        tp->enqueue(p.num_stages, &buf, &sched.prediction[model]);
+        runtimes(j) = sched.runtimes[0];
+        buf.copy_from(sched.schedule_features);
+        it++;
+    }
+
+    if (!train) {
+        tp->evaluate_costs();
+        return 0.0f;
+    } else if (gradients) {
+        return tp->compute_loss_gradients(runtimes, gradients);
+    } else {
+        return tp->backprop(runtimes, learning_rate);
+    }
+}
+
+// Average the first n sets of gradients into the first one.
+void average_gradients(vector<Internal::Weights> &gradients, size_t n) {
+    Buffer<float> Internal::Weights::*const buffers[] = {
+        &Internal::Weights::head1_filter,
+        &Internal::Weights::head1_bias,
+        &Internal::Weights::head2_filter,
+        &Internal::Weights::head2_bias,
+        &Internal::Weights::conv1_filter,
+        &Internal::Weights::conv1_bias};
+    for (auto b : buffers) {
+        Buffer<float> &sum = gradients[0].*b;
+        for (size_t i = 1; i < n; i++) {
+            sum.for_each_value([](float &a, float g) { a += g; }, gradients[i].*b);
+        }
+        const float scale = 1.0f / n;
+        sum.for_each_value([=](float &a) { a *= scale; });
+    }
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
@@ -378,6 +606,19 @@ int main(int argc, char **argv) {
         tpp.emplace_back(make_default_cost_model(flags.initial_weights_path, flags.weights_out_path, flags.randomize_weights));
     }
 
+    // Copies of each model for data-parallel training, and the
+    // gradients they compute.
+    vector<vector<std::unique_ptr<DefaultCostModel>>> workers(kModels);
+    vector<Internal::Weights> gradients;
+    if (flags.num_threads > 1) {
+        for (int i = 0; i < kModels; i++) {
+            for (int j = 0; j < flags.num_threads; j++) {
+                workers[i].emplace_back(make_default_cost_model());
+            }
+        }
+        gradients.resize(flags.num_threads);
+    }
+
     std::cout.setf(std::ios::fixed, std::ios::floatfield);
     std::cout.precision(4);
 
@@ -430,13 +671,80 @@ int main(int argc, char **argv) {
                 float badness = 0;
             } worst_inversion;
 
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
+            auto epoch_start = std::chrono::steady_clock::now();
+            size_t schedules_processed = 0;
+
+            // Gather the statistics for a batch after the model has
+            // run on it.
+            auto score = [&](const Batch &b, int model, bool train) {
+                auto &p = *b.pipeline;
+                if (train) {
+                    assert(!std::isnan(b.loss));
+                    loss_sum[model] += b.loss;
+                    loss_sum_counter[model]++;
+
+                    auto it = p.second.schedules.begin();
+                    std::advance(it, b.first);
+                    for (size_t j = 0; j < b.size; j++) {
+                        auto &sched = it->second;
+                        float m = sched.runtimes[0] / (sched.prediction[model] + 1e-10f);
+                        if (m > worst_miss) {
+                            worst_miss = m;
+                            worst_miss_pipeline_id = p.first;
+                            worst_miss_schedule_id = it->first;
+                        }
+                        it++;
+                    }
+                }
+
+                int good = 0, bad = 0;
+                for (auto &sched : p.second.schedules) {
+                    auto &ref = p.second.schedules[p.second.fastest_schedule_hash];
+                    if (sched.second.prediction[model] == 0) {
+                        continue;
+                    }
+                    assert(sched.second.runtimes[0] >= ref.runtimes[0]);
+                    float runtime_ratio = sched.second.runtimes[0] / ref.runtimes[0];
+                    if (runtime_ratio <= 1.3f) {
+                        continue;  // Within 30% of the runtime of the best
+                    }
+                    if (sched.second.prediction[model] >= ref.prediction[model]) {
+                        good++;
+                    } else {
+                        if (train) {
+                            float badness = (sched.second.runtimes[0] - ref.runtimes[0]) * (ref.prediction[model] - sched.second.prediction[model]);
+                            badness /= (ref.runtimes[0] * ref.runtimes[0]);
+                            if (badness > worst_inversion.badness) {
+                                worst_inversion.pipeline_id = p.first;
+                                worst_inversion.badness = badness;
+                                worst_inversion.r1 = ref.runtimes[0];
+                                worst_inversion.r2 = sched.second.runtimes[0];
+                                worst_inversion.p1 = ref.prediction[model];
+                                worst_inversion.p2 = sched.second.prediction[model];
+                                worst_inversion.f1 = ref.filename;
+                                worst_inversion.f2 = sched.second.filename;
+                            }
+                        }
+                        bad++;
+                    }
+                }
+                if (train) {
+                    correct_ordering_rate_sum[model] += good;
+                    correct_ordering_rate_count[model] += good + bad;
+                } else {
+                    v_correct_ordering_rate_sum[model] += good;
+                    v_correct_ordering_rate_count[model] += good + bad;
+                }
+            };
+
             for (int model = 0; model < kModels; model++) {
                 for (int train = 0; train < 2; train++) {
                     auto &tp = tpp[model];
 
+                    // Pick the schedules to use from each pipeline up
+                    // front, so that the random choices don't depend
+                    // on the number of threads.
+                    vector<Batch> batches;
                     for (auto &p : train ? samples : validation_set) {
                         if (kModels > 1 && rng() & 1) {
                             continue;  // If we are training multiple kModels, allow them to diverge.
@@ -444,95 +752,48 @@ int main(int argc, char **argv) {
                         if (p.second.schedules.size() < 8) {
                             continue;
                         }
-                        tp->reset();
-                        tp->set_pipeline_features(p.second.pipeline_features, flags.num_cores);
-
-                        size_t batch_size = std::min((size_t)1024, p.second.schedules.size());
-
-                        size_t fastest_idx = 0;
-                        Halide::Runtime::Buffer<float> runtimes(batch_size);
-
-                        size_t first = 0;
+                        Batch b;
+                        b.pipeline = &p;
+                        b.size = std::min((size_t)1024, p.second.schedules.size());
                         if (p.second.schedules.size() > 1024) {
-                            first = rng() % (p.second.schedules.size() - 1024);
+                            b.first = rng() % (p.second.schedules.size() - 1024);
                         }
+                        batches.push_back(b);
+                        schedules_processed += b.size;
+                    }
 
-                        auto it = p.second.schedules.begin();
-                        std::advance(it, first);
-                        for (size_t j = 0; j < batch_size; j++) {
-                            auto &sched = it->second;
-                            Halide::Runtime::Buffer<float> buf;
-                            tp->enqueue(p.second.num_stages, &buf, &sched.prediction[model]);
-                            runtimes(j) = sched.runtimes[0];
-                            if (runtimes(j) < runtimes(fastest_idx)) {
-                                fastest_idx = j;
-                            }
-                            buf.copy_from(sched.schedule_features);
-                            it++;
+                    if (flags.num_threads == 1) {
+                        for (Batch &b : batches) {
+                            b.loss = run_batch(tp.get(), b, model, train, learning_rate, flags.num_cores, nullptr);
+                            score(b, model, train);
                         }
+                        continue;
+                    }
 
-                        float loss = 0.0f;
+                    // Run a round of pipelines at once, one per thread,
+                    // each on its own copy of the model. In training
+                    // mode, average their gradients and take one ADAM
+                    // step with them.
+                    for (size_t round = 0; round < batches.size(); round += flags.num_threads) {
+                        const size_t round_size = std::min(batches.size() - round, (size_t)flags.num_threads);
+                        vector<std::thread> threads;
+                        for (size_t i = 0; i < round_size; i++) {
+                            workers[model][i]->set_weights(tp->get_weights());
+                            threads.emplace_back([&, i]() {
+                                Batch &b = batches[round + i];
+                                b.loss = run_batch(workers[model][i].get(), b, model, train, learning_rate,
+                                                   flags.num_cores, &gradients[i]);
+                            });
+                        }
+                        for (auto &t : threads) {
+                            t.join();
+                        }
                         if (train) {
-                            loss = tp->backprop(runtimes, learning_rate);
-                            assert(!std::isnan(loss));
-                            loss_sum[model] += loss;
-                            loss_sum_counter[model]++;
-
-                            auto it = p.second.schedules.begin();
-                            std::advance(it, first);
-                            for (size_t j = 0; j < batch_size; j++) {
-                                auto &sched = it->second;
-                                float m = sched.runtimes[0] / (sched.prediction[model] + 1e-10f);
-                                if (m > worst_miss) {
-                                    worst_miss = m;
-                                    worst_miss_pipeline_id = p.first;
-                                    worst_miss_schedule_id = it->first;
-                                }
-                                it++;
-                            }
-                        } else {
-                            tp->evaluate_costs();
+                            average_gradients(gradients, round_size);
+                            tp->apply_loss_gradients(gradients[0], learning_rate);
                         }
-
-                        if (true) {
-                            int good = 0, bad = 0;
-                            for (auto &sched : p.second.schedules) {
-                                auto &ref = p.second.schedules[p.second.fastest_schedule_hash];
-                                if (sched.second.prediction[model] == 0) {
-                                    continue;
-                                }
-                                assert(sched.second.runtimes[0] >= ref.runtimes[0]);
-                                float runtime_ratio = sched.second.runtimes[0] / ref.runtimes[0];
-                                if (runtime_ratio <= 1.3f) {
-                                    continue;  // Within 30% of the runtime of the best
-                                }
-                                if (sched.second.prediction[model] >= ref.prediction[model]) {
-                                    good++;
-                                } else {
-                                    if (train) {
-                                        float badness = (sched.second.runtimes[0] - ref.runtimes[0]) * (ref.prediction[model] - sched.second.prediction[model]);
-                                        badness /= (ref.runtimes[0] * ref.runtimes[0]);
-                                        if (badness > worst_inversion.badness) {
-                                            worst_inversion.pipeline_id = p.first;
-                                            worst_inversion.badness = badness;
-                                            worst_inversion.r1 = ref.runtimes[0];
-                                            worst_inversion.r2 = sched.second.runtimes[0];
-                                            worst_inversion.p1 = ref.prediction[model];
-                                            worst_inversion.p2 = sched.second.prediction[model];
-                                            worst_inversion.f1 = ref.filename;
-                                            worst_inversion.f2 = sched.second.filename;
-                                        }
-                                    }
-                                    bad++;
-                                }
-                            }
-                            if (train) {
-                                correct_ordering_rate_sum[model] += good;
-                                correct_ordering_rate_count[model] += good + bad;
-                            } else {
-                                v_correct_ordering_rate_sum[model] += good;
-                                v_correct_ordering_rate_count[model] += good + bad;
-                            }
+                        for (size_t i = 0; i < round_size; i++) {
+                            score(batches[round + i], model, train);
                         }
                     }
                 }
@@ -540,6 +801,10 @@ int main(int argc, char **argv) {
                 counter++;
             }
 
+            std::chrono::duration<double> epoch_time = std::chrono::steady_clock::now() - epoch_start;
+            std::cout << "Epoch " << e << ": " << schedules_processed << " samples in " << epoch_time.count()
+                      << " seconds (" << schedules_processed / std::max(epoch_time.count(), 1e-9) << " samples per second)\n";
+
             std::cout << "Loss: ";
             for (int model = 0; model < kModels; model++) {
                 std::cout << loss_sum[model] / loss_sum_counter[model] << " ";
@@ -0,0 +1,66 @@
+#include "Halide.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Halide;
+
+// A pipeline with several sibling stages at the root, so that
+// most children in the beam share their loop nests with the parent.
+Pipeline make_pipeline() {
+    const int stages = 6;
+    ImageParam input(Float(32), 3, "input");
+    Var x("x"), y("y"), c("c");
+    std::vector<Func> f;
+    f.push_back(BoundaryConditions::repeat_edge(input));
+    for (int i = 1; i <= stages; i++) {
+        Func g("stage_" + std::to_string(i));
+        const Func &p = f.back();
+        if (i % 2 == 0) {
+            g(x, y, c) = (p(x, y - 1, c) + p(x, y + 1, c) * 2 + f[i - 2](x, y, c)) * 0.25f;
+        } else {
+            g(x, y, c) = p(x - 1, y, c) * p(x + 1, y, c) + f[0](x, y, (c + 1) % 3);
+        }
+        f.push_back(g);
+    }
+    Func out("out");
+    out(x, y, c) = f[stages](x, y, c) + f[stages - 1](x / 2, y / 2, c) + f[1](x, y, c);
+    out.set_estimate(x, 0, 1536).set_estimate(y, 0, 2560).set_estimate(c, 0, 3);
+    input.set_estimates({{0, 1536}, {0, 2560}, {0, 3}});
+    return Pipeline(out);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <autoscheduler-lib>\n", argv[0]);
+        return 1;
+    }
+
+    load_plugin(argv[1]);
+
+    // Featurize every state both ways, and fail if the incremental
+    // features differ in any bit from the ones computed from scratch.
+    static char incremental_env[] = "HL_INCREMENTAL_FEATURIZATION=2";
+    static char dropout_env[] = "HL_RANDOM_DROPOUT=50";
+    putenv(incremental_env);
+    putenv(dropout_env);
+
+    MachineParams params(32, 16000000, 40);
+    // Use a fixed target for the analysis to get consistent results from this test.
+    Target target("x86-64-linux-sse41-avx-avx2");
+
+    for (int seed = 0; seed < 4; seed++) {
+        // Read each time the autoscheduler runs.
+        static char seed_env[32], threads_env[64];
+        snprintf(seed_env, sizeof(seed_env), "HL_SEED=%d", seed);
+        snprintf(threads_env, sizeof(threads_env), "HL_AUTOSCHEDULE_NUM_THREADS=%d", 1 + seed % 2);
+        putenv(seed_env);
+        putenv(threads_env);
+
+        Pipeline p = make_pipeline();
+        p.auto_schedule(target, params);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "Halide.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+using namespace Halide;
+
+// A pipeline with enough stages and enough ways to schedule each one
+// to keep a beam search busy for a while.
+Pipeline make_pipeline() {
+    const int stages = 8;
+    ImageParam input(Float(32), 3, "input");
+    Var x("x"), y("y"), c("c");
+    std::vector<Func> f;
+    f.push_back(BoundaryConditions::repeat_edge(input));
+    for (int i = 1; i <= stages; i++) {
+        Func g("stage_" + std::to_string(i));
+        const Func &p = f.back();
+        if (i % 3 == 0) {
+            g(x, y, c) = (p(x, y - 1, c) + p(x, y + 1, c) * 2 + p(x, y, (c + 1) % 3)) * 0.25f;
+        } else {
+            g(x, y, c) = (p(x - 1, y, c) + p(x + 1, y, c)) * 0.5f + f[i / 2](x, y, c);
+        }
+        f.push_back(g);
+    }
+    f.back().set_estimate(x, 0, 1536).set_estimate(y, 0, 2560).set_estimate(c, 0, 3);
+    input.set_estimates({{0, 1536}, {0, 2560}, {0, 3}});
+    return Pipeline(f.back());
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: %s <autoscheduler-lib> [max-threads]\n", argv[0]);
+        return 1;
+    }
+
+    load_plugin(argv[1]);
+
+    int max_threads = std::min((int)std::thread::hardware_concurrency(), 16);
+    if (argc == 3) {
+        max_threads = atoi(argv[2]);
+    }
+
+    // A fixed seed, with some random dropout so that the seed matters.
+    static char seed_env[] = "HL_SEED=17";
+    static char dropout_env[] = "HL_RANDOM_DROPOUT=50";
+    putenv(seed_env);
+    putenv(dropout_env);
+
+    MachineParams params(32, 16000000, 40);
+    // Use a fixed target for the analysis to get consistent results from this test.
+    Target target("x86-64-linux-sse41-avx-avx2");
+
+    std::string serial_schedule;
+    double serial_time = 0;
+    for (int threads = 1; threads <= std::max(max_threads, 1); threads *= 2) {
+        // Read each time the autoscheduler runs.
+        static char threads_env[64];
+        snprintf(threads_env, sizeof(threads_env), "HL_AUTOSCHEDULE_NUM_THREADS=%d", threads);
+        putenv(threads_env);
+
+        Pipeline p = make_pipeline();
+        auto start = std::chrono::high_resolution_clock::now();
+        AutoSchedulerResults results = p.auto_schedule(target, params);
+        auto end = std::chrono::high_resolution_clock::now();
+        double t = std::chrono::duration<double>(end - start).count();
+
+        if (threads == 1) {
+            serial_schedule = results.schedule_source;
+            serial_time = t;
+        } else if (results.schedule_source != serial_schedule) {
+            fprintf(stderr, "Searching on %d threads found a different schedule:\n%s\n\nvs\n\n%s\n",
+                    threads, results.schedule_source.c_str(), serial_schedule.c_str());
+            return 1;
+        }
+        printf("%2d threads: %f s, speedup %.2fx\n", threads, t, serial_time / t);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -162,6 +162,15 @@ extern int halide_do_par_for(void *user_context,
 extern void halide_shutdown_thread_pool();
 //@}
 
+/** Like halide_do_par_for, but hands the loop to do_par_for in tasks
+ * of min_grain consecutive iterations (the last may be shorter). The
+ * compiler calls this for parallel loops scheduled with
+ * Func::min_grain. */
+extern int halide_do_par_for_with_min_grain(void *user_context,
+                                            halide_task_t task,
+                                            int min, int size, uint8_t *closure,
+                                            int min_grain);
+
 /** Set a custom method for performing a parallel for loop. Returns
  * the old do_par_for handler. */
 typedef int (*halide_do_par_for_t)(void *, halide_task_t, int, int, uint8_t *);
@@ -333,6 +342,53 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Select how the default halide_do_par_for schedules parallel loops.
+ * By default every loop goes through one shared work queue. When
+ * enabled, each loop is instead split into per-thread ranges of
+ * iterations that idle threads steal from, which avoids contending on
+ * the work queue lock in pipelines with many small parallel
+ * loops. Tasks that use semaphores or need a minimum number of threads
+ * (from async() and nested parallelism) always use the shared work
+ * queue. The initial setting is taken from the HL_WORK_STEALING
+ * environment variable. Returns the old setting. */
+extern bool halide_set_work_stealing(bool enable);
+
+/** Let the default thread pool hand out the iterations of a parallel
+ * loop in chunks instead of one at a time. Chunks start large and
+ * shrink as the loop drains, so that threads still finish together,
+ * but are never shorter than a few microseconds of work, going by the
+ * measured cost of the iterations run so far. This makes the overhead
+ * of finely split parallel loops close to that of coarsely split
+ * ones. Applies to both the shared work queue and the work-stealing
+ * scheduler. The initial setting is taken from the HL_PAR_FOR_CHUNKING
+ * environment variable. Returns the old setting. */
+extern bool halide_set_par_for_chunking(bool enable);
+
+/** Pin the worker threads of the default thread pool to cpus, spread
+ * evenly over the NUMA nodes of the host, and keep the iterations of
+ * each parallel loop in contiguous per-node ranges. This keeps tiles
+ * produced and consumed by successive parallel loops over the same
+ * range on the same socket. Only affects worker threads created after
+ * the call, so call it before the first parallel loop runs or after
+ * halide_shutdown_thread_pool. Implies halide_set_work_stealing(true)
+ * unless that has been set explicitly. Does nothing on platforms
+ * without topology information. The initial setting is taken from the
+ * HL_THREAD_AFFINITY environment variable. Returns the old setting. */
+extern bool halide_set_thread_affinity(bool enable);
+
+/** Change what the default thread pool does with a task that is
+ * waiting on a semaphore, such as the consumer side of an async()
+ * producer. By default the task stays on the shared work queue, where
+ * every idle thread retries it until the producer releases the
+ * semaphore. When enabled, the thread running the consumer spins on the
+ * semaphore briefly, and then parks the task on the semaphore, off the
+ * work queue. Releasing the semaphore puts the task straight back and
+ * wakes one thread to run it. This helps streaming pipelines where the
+ * producer and consumer run in lockstep. The initial setting is taken
+ * from the HL_SEMAPHORE_PARKING environment variable. Returns the old
+ * setting. */
+extern bool halide_set_semaphore_parking(bool enable);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -361,6 +417,36 @@ extern halide_malloc_t halide_set_custom_malloc(halide_malloc_t user_malloc);
 extern halide_free_t halide_set_custom_free(halide_free_t user_free);
 //@}
 
+/** Turn pooling in halide_default_malloc/free on or off. When on,
+ * allocations of up to 1MB are rounded up to one of a set of size
+ * classes, and freed blocks are kept in per-thread caches backed by a
+ * global arena to service future requests instead of going back to
+ * the system allocator. This helps pipelines that allocate on the
+ * heap inside parallel loops. Turning it off releases all unused
+ * blocks. The initial setting is taken from the
+ * HL_HOST_ALLOCATION_POOL environment variable, and is off if that is
+ * unset. Returns the old setting. */
+extern bool halide_set_host_allocation_pooling(bool enable);
+
+/** Release all unused blocks held by the host allocation pool back to
+ * the system allocator. halide_reuse_device_allocations(false) also
+ * does this once pooling has been turned on. */
+extern int halide_release_unused_host_allocations(void *user_context);
+
+/** Statistics for the host allocation pool, summed over all threads. */
+struct halide_host_allocation_pool_stats {
+    /** Allocations serviced from a cache or the global arena. */
+    uint64_t hits;
+    /** Allocations that had to go to the system allocator. */
+    uint64_t misses;
+    /** Bytes held in unused blocks right now. */
+    uint64_t bytes_cached;
+};
+
+/** Get the current statistics for the host allocation pool. They are
+ * also printed in the profiler report when pooling is in use. */
+extern void halide_host_allocation_pool_get_stats(struct halide_host_allocation_pool_stats *stats);
+
 /** Halide calls these functions to interact with the underlying
  * system runtime functions. To replace in AOT code on platforms that
  * support weak linking, define these functions yourself, or use
@@ -676,6 +762,65 @@ struct halide_trace_packet_t {
 #endif
 };
 
+/** The first word of every chunk of a compact trace. Its first byte
+ * is odd, so it can't be mistaken for the size of a
+ * halide_trace_packet_t, and the two formats can be told apart
+ * record by record. */
+#define HALIDE_TRACE_CHUNK_MAGIC 0x43544889
+
+/** The header of a chunk of packets in the compact binary trace
+ * format. A compact trace is a sequence of chunks, each written in
+ * one piece by one thread, so a reader can build an index of a trace
+ * by reading the headers alone.
+ *
+ * The packets follow the header. Each one is encoded as:
+ * - a byte with the event code in the low bits, 0x80 set if a value
+ *   follows and 0x40 set if a trace tag follows
+ * - the index of the func name in this chunk's name table
+ * - the id, zigzag-encoded as the difference from the previous
+ *   packet's id (or first_id)
+ * - the parent id, zigzag-encoded as the difference from the previous
+ *   packet's parent id (or zero)
+ * - the value index
+ * - the type code and bits as one byte each, then the lanes
+ * - the number of dimensions, then each coordinate, zigzag-encoded
+ *   as the difference from the same coordinate of the previous
+ *   packet (for the first 16 coordinates)
+ * - the value, as raw bytes, if present
+ * - the length of the trace tag and its characters, if present
+ * - the time in nanoseconds since the previous packet (or begin_ns)
+ * All integers are unsigned LEB128 varints. The func names used by
+ * the chunk follow its packets, as nul-terminated strings. */
+struct halide_trace_chunk_t {
+    /** Always HALIDE_TRACE_CHUNK_MAGIC. */
+    uint32_t magic;
+
+    /** The size of the chunk in bytes, including this header. Always
+     * a multiple of four. */
+    uint32_t size;
+
+    /** The number of packets in the chunk. */
+    uint32_t packets;
+
+    /** The offset of the name table from the start of the chunk, and
+     * the number of names in it. */
+    uint32_t names_offset, num_names;
+
+    /** An identifier for the thread that wrote the chunk. */
+    uint32_t thread;
+
+    /** The times of the first and last packets in the chunk, in
+     * nanoseconds since the process started tracing. Packet times
+     * are only sampled every few packets, so they are approximate
+     * within a chunk. */
+    uint64_t begin_ns, end_ns;
+
+    /** The id the first packet's id is relative to. */
+    int32_t first_id;
+
+    uint32_t reserved;
+};
+
 /** Set the file descriptor that Halide should write binary trace
  * events to. If called with 0 as the argument, Halide outputs trace
  * information to stdout in a human-readable format. If never called,
@@ -693,6 +838,16 @@ extern void halide_set_trace_file(int fd);
  * information to stdout. */
 extern int halide_get_trace_file(void *user_context);
 
+/** Choose whether binary trace events are written as
+ * halide_trace_packet_t structs (the default), or in the compact
+ * format described at halide_trace_chunk_t. In the compact format,
+ * each thread buffers its own packets and full buffers are written
+ * out by whichever thread fills one, so tracing a parallel pipeline
+ * costs much less. Both formats can be read with the tools in
+ * util/. The initial setting is taken from the HL_TRACE_COMPACT
+ * environment variable. Returns the old setting. */
+extern bool halide_set_trace_compact(bool enable);
+
 /** If tracing is writing to a file. This call closes that file
  * (flushing the trace). Returns zero on success. */
 extern int halide_shutdown_trace();
@@ -920,6 +1075,25 @@ extern int halide_memoization_cache_store(void *user_context, const uint8_t *cac
  */
 extern void halide_memoization_cache_evict(void *user_context, uint64_t eviction_key);
 
+/** Back the memoization cache with a file of the given size in bytes
+ * (zero for the default of 64MB), memory-mapped and shared with any
+ * other process using the same file. Lookups that miss in memory then
+ * check the file, and stores write through to it, so a later process
+ * can reuse results without recomputing them. The file is created if
+ * it doesn't exist. Once it is full, the oldest entries are
+ * overwritten. Entries are keyed on the pipeline and Func names,
+ * everything the memoized Func depends on, and a hash of the
+ * definitions of the Funcs involved, including the contents of any
+ * Buffers they use, so changing a memoized pipeline doesn't reuse
+ * stale results. Funcs that depend on an extern stage or on an extern
+ * function that isn't pure are only cached in memory, as the function
+ * may be different in another process. Passing a null path stops
+ * using a file. The initial path
+ * and size in megabytes are taken from the HL_MEMOIZATION_CACHE_FILE
+ * and HL_MEMOIZATION_CACHE_FILE_MB environment variables. Only
+ * supported on Linux, Android and OS X. Returns zero on success. */
+extern int halide_memoization_cache_set_persistent_file(void *user_context, const char *path, int64_t size);
+
 /** If halide_memoization_cache_lookup succeeds,
  * halide_memoization_cache_release must be called to signal the
  * storage is no longer being used by the caller. It will be passed
@@ -1688,6 +1862,18 @@ void halide_register_argv_and_metadata(
  * the -profile target flag, which runs a sampling profiler thread
  * alongside the pipeline. */
 
+/** The hardware performance counters the sampling profiler can
+ * attribute to each Func. See halide_profiler_set_perf_counters. */
+typedef enum halide_profiler_perf_counter_t {
+    halide_profiler_perf_cycles = 0,
+    halide_profiler_perf_instructions,
+    /** Last-level cache misses. Each one moves a cache line to or from
+     * memory, so they also give an estimate of memory bandwidth. */
+    halide_profiler_perf_cache_misses,
+    halide_profiler_perf_branch_misses,
+    halide_profiler_num_perf_counters
+} halide_profiler_perf_counter_t;
+
 /** Per-Func state tracked by the sampling profiler. */
 struct halide_profiler_func_stats {
     /** Total time taken evaluating this Func (in nanoseconds). */
@@ -1713,6 +1899,10 @@ struct halide_profiler_func_stats {
 
     /** The total number of memory allocation of this Func. */
     int num_allocs;
+
+    /** Hardware performance counters for this Func, indexed by
+     * halide_profiler_perf_counter_t. Zero unless they were enabled. */
+    uint64_t perf_counters[halide_profiler_num_perf_counters];
 };
 
 /** Per-pipeline state tracked by the sampling profiler. These exist
@@ -1758,6 +1948,10 @@ struct halide_profiler_pipeline_stats {
 
     /** The total number of memory allocation of funcs in this pipeline. */
     int num_allocs;
+
+    /** Hardware performance counters for this pipeline, indexed by
+     * halide_profiler_perf_counter_t. */
+    uint64_t perf_counters[halide_profiler_num_perf_counters];
 };
 
 /** The global state of the profiler. */
@@ -1792,6 +1986,12 @@ struct halide_profiler_state {
 
     /** Sampling thread reference to be joined at shutdown. */
     struct halide_thread *sampling_thread;
+
+    /** While a timeline is being recorded (see
+     * halide_profiler_record_timeline), called by the pipeline with
+     * active = 1 when a thread starts doing work and active = 0 when it
+     * stops. Null otherwise. */
+    void (*thread_activity)(struct halide_profiler_state *s, int active);
 };
 
 /** Profiler func ids with special meanings. */
@@ -1831,6 +2031,49 @@ void halide_profiler_shutdown();
  * reset. Also happens at process exit. */
 extern void halide_profiler_report(void *user_context);
 
+/** Turn on or off collection of hardware performance counters by the
+ * sampling profiler. Each thread that works on a profiled pipeline
+ * opens its own counters, and the profiler attributes the change in
+ * their total since the last sample to the current Func, as it does
+ * for time. The counters then appear in the report and in
+ * halide_profiler_export. Only available on x86 Linux, and only if
+ * perf_event_open is permitted, which it often isn't in containers.
+ * Returns zero if the counters could be opened; otherwise they stay
+ * off and the profiler carries on without them. The initial setting
+ * is taken from the HL_PROFILER_PERF_COUNTERS environment variable. */
+extern int halide_profiler_set_perf_counters(void *user_context, bool enable);
+
+/** Start recording a timeline for halide_profiler_export: the Func
+ * seen by each profiler sample, and the times at which each thread
+ * starts and stops doing work. At most max_events of each are kept,
+ * and later ones are dropped. Passing zero stops recording and frees
+ * the timeline. Returns zero on success.
+ * WARNING: Do NOT call this method while any halide pipeline is
+ * running. */
+extern int halide_profiler_record_timeline(void *user_context, int max_events);
+
+/** File formats understood by halide_profiler_export. */
+typedef enum halide_profiler_export_format_t {
+    /** Chrome trace-event JSON, for chrome://tracing or Perfetto. Has
+     * the recorded timeline, with one track for the sampled Funcs, one
+     * per thread, and counters for active threads and heap usage. The
+     * per-Func and per-thread totals are in a "halide" object next to
+     * "traceEvents". */
+    halide_profiler_export_chrome_trace = 0,
+
+    /** An uncompressed pprof protobuf, with time, heap usage, hardware
+     * counters and per-thread busy time for each Func, under its
+     * pipeline. */
+    halide_profiler_export_pprof = 1,
+} halide_profiler_export_format_t;
+
+/** Write out everything the profiler has gathered since the last
+ * reset, in the given format. Per-thread activity and the
+ * imbalance between threads are only available if a timeline was
+ * being recorded. Returns zero on success. */
+extern int halide_profiler_export(void *user_context, const char *filename,
+                                  halide_profiler_export_format_t format);
+
 /// \name "Float16" functions
 /// These functions operate of bits (``uint16_t``) representing a half
 /// precision floating point number (IEEE-754 2008 binary16).
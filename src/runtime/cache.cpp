@@ -68,13 +68,15 @@ WEAK bool buffer_has_shape(const halide_buffer_t *buf, const halide_dimension_t
 }
 
 struct CacheEntry {
+    // The next entry in the same hash bucket.
     CacheEntry *next;
-    CacheEntry *more_recent;
-    CacheEntry *less_recent;
+    // The neighbouring entries in the owning shard's clock ring.
+    CacheEntry *clock_next;
+    CacheEntry *clock_prev;
     uint8_t *metadata_storage;
     size_t key_size;
     uint8_t *key;
-    uint32_t hash;
+    uint64_t hash;
     uint32_t in_use_count;  // 0 if none returned from halide_cache_lookup
     uint32_t tuple_count;
     // The shape of the computed data. There may be more data allocated than this.
@@ -84,19 +86,23 @@ struct CacheEntry {
     halide_buffer_t *buf;
     uint64_t eviction_key;
     bool has_eviction_key;
+    // Set by every hit and cleared when the clock hand passes over
+    // the entry. Only entries the hand finds unreferenced are evicted.
+    bool referenced;
 
     bool init(const uint8_t *cache_key, size_t cache_key_size,
-              uint32_t key_hash,
+              uint64_t key_hash,
               const halide_buffer_t *computed_bounds_buf,
               int32_t tuples, halide_buffer_t **tuple_buffers,
               bool has_eviction_key, uint64_t eviction_key);
     void destroy();
     halide_buffer_t &buffer(int32_t i);
+    size_t size_in_bytes() const;
 };
 
 struct CacheBlockHeader {
     CacheEntry *entry;
-    uint32_t hash;
+    uint64_t hash;
 };
 
 // Each host block has extra space to store a header just before the
@@ -115,17 +121,18 @@ WEAK CacheBlockHeader *get_pointer_to_header(uint8_t *host) {
 }
 
 WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
-                           uint32_t key_hash, const halide_buffer_t *computed_bounds_buf,
+                           uint64_t key_hash, const halide_buffer_t *computed_bounds_buf,
                            int32_t tuples, halide_buffer_t **tuple_buffers,
                            bool has_eviction_key_arg, uint64_t eviction_key_arg) {
     next = nullptr;
-    more_recent = nullptr;
-    less_recent = nullptr;
+    clock_next = nullptr;
+    clock_prev = nullptr;
     key_size = cache_key_size;
     hash = key_hash;
     in_use_count = 0;
     tuple_count = tuples;
     dimensions = computed_bounds_buf->dimensions;
+    referenced = false;
 
     // Allocate all the necessary space (or die)
     size_t storage_bytes = 0;
@@ -185,68 +192,155 @@ WEAK void CacheEntry::destroy() {
     halide_free(nullptr, metadata_storage);
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size) {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-        h = (h << 5) + h + key[i];
+WEAK size_t CacheEntry::size_in_bytes() const {
+    size_t result = 0;
+    for (uint32_t i = 0; i < tuple_count; i++) {
+        result += buf[i].size_in_bytes();
     }
-    return h;
+    return result;
 }
 
-WEAK halide_mutex memoization_lock = {{0}};
+// Constants for the key hash, taken from xxHash64.
+const uint64_t kHashPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kHashPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kHashPrime3 = 0x165667B19E3779F9ULL;
 
-const size_t kHashTableSize = 256;
+ALWAYS_INLINE uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
 
-WEAK CacheEntry *cache_entries[kHashTableSize];
+ALWAYS_INLINE uint64_t load_u64(const uint8_t *p) {
+    // Keys have no particular alignment.
+    uint64_t result;
+    memcpy(&result, p, sizeof(result));
+    return result;
+}
 
-WEAK CacheEntry *most_recently_used = nullptr;
-WEAK CacheEntry *least_recently_used = nullptr;
+ALWAYS_INLINE uint64_t hash_round(uint64_t acc, uint64_t word) {
+    return rotl64(acc + word * kHashPrime2, 31) * kHashPrime1;
+}
+
+// Keys are a concatenation of scalar params, buffer pointers and
+// bounds, typically a few dozen to a few hundred bytes. Consume them
+// eight bytes at a time, in four independent lanes when there is
+// enough input, so the hash isn't bound by the latency of a serial
+// per-byte chain. The final mix spreads entropy into both the top
+// bits (which pick the shard) and the bottom bits (which pick the
+// bucket).
+WEAK uint64_t hash_key(const uint8_t *key, size_t key_size) {
+    size_t i = 0;
+    uint64_t h;
+    if (key_size >= 32) {
+        uint64_t lane0 = kHashPrime1 + kHashPrime2;
+        uint64_t lane1 = kHashPrime2;
+        uint64_t lane2 = 0;
+        uint64_t lane3 = 0 - kHashPrime1;
+        for (; i + 32 <= key_size; i += 32) {
+            lane0 = hash_round(lane0, load_u64(key + i));
+            lane1 = hash_round(lane1, load_u64(key + i + 8));
+            lane2 = hash_round(lane2, load_u64(key + i + 16));
+            lane3 = hash_round(lane3, load_u64(key + i + 24));
+        }
+        h = rotl64(lane0, 1) + rotl64(lane1, 7) + rotl64(lane2, 12) + rotl64(lane3, 18);
+    } else {
+        h = kHashPrime3;
+    }
+    h += key_size;
+    for (; i + 8 <= key_size; i += 8) {
+        h ^= hash_round(0, load_u64(key + i));
+        h = rotl64(h, 27) * kHashPrime1 + kHashPrime3;
+    }
+    for (; i < key_size; i++) {
+        h ^= key[i] * kHashPrime3;
+        h = rotl64(h, 11) * kHashPrime1;
+    }
+    h ^= h >> 33;
+    h *= kHashPrime2;
+    h ^= h >> 29;
+    h *= kHashPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+// The table is split into independently locked shards, chosen by the
+// top bits of the key hash, so that threads memoizing different keys
+// rarely contend. Each shard's bucket array starts small and doubles
+// whenever the shard holds more entries than buckets.
+const int kCacheShardBits = 4;
+const uint32_t kCacheShards = 1 << kCacheShardBits;
+const uint32_t kInitialBucketCount = 16;
+
+struct CacheShard {
+    halide_mutex lock;
+    CacheEntry **buckets;
+    uint32_t bucket_count;
+    uint32_t entry_count;
+    // All entries in the shard form a ring. Eviction sweeps this
+    // hand around it, giving each referenced entry a second chance.
+    CacheEntry *clock_hand;
+    // Keep each shard's lock on its own cache line.
+    uint8_t padding[64];
+};
+
+WEAK CacheShard cache_shards[kCacheShards];
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
+// The total over all shards. Only ever updated atomically, so that
+// stores into different shards don't need a common lock.
 WEAK int64_t current_cache_size = 0;
 
+ALWAYS_INLINE uint32_t shard_index(uint64_t h) {
+    return (uint32_t)(h >> (64 - kCacheShardBits));
+}
+
+ALWAYS_INLINE CacheEntry **get_bucket(CacheShard &shard, uint64_t h) {
+    return &shard.buckets[h & (shard.bucket_count - 1)];
+}
+
+ALWAYS_INLINE bool cache_over_budget() {
+    return __atomic_load_n(&current_cache_size, __ATOMIC_RELAXED) >
+           __atomic_load_n(&max_cache_size, __ATOMIC_RELAXED);
+}
+
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(nullptr) << "validating cache, "
-                   << "current size " << current_cache_size
+WEAK void validate_shard(CacheShard &shard) {
+    print(nullptr) << "validating cache shard " << (int)(&shard - cache_shards)
+                   << ", current total size " << current_cache_size
                    << " of maximum " << max_cache_size << "\n";
-    int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
+    uint32_t entries_in_hash_table = 0;
+    for (uint32_t i = 0; shard.buckets != nullptr && i < shard.bucket_count; i++) {
+        CacheEntry *entry = shard.buckets[i];
         while (entry != nullptr) {
             entries_in_hash_table++;
-            if (entry->more_recent == nullptr && entry != most_recently_used) {
+            if (get_bucket(shard, entry->hash) != &shard.buckets[i] ||
+                &cache_shards[shard_index(entry->hash)] != &shard) {
                 halide_print(nullptr, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == nullptr && entry != least_recently_used) {
+            if (entry->clock_next == nullptr || entry->clock_next->clock_prev != entry) {
                 halide_print(nullptr, "cache invalid case 2\n");
                 __builtin_trap();
             }
             entry = entry->next;
         }
     }
-    int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
-    while (mru_chain != nullptr) {
-        entries_from_mru++;
-        mru_chain = mru_chain->less_recent;
-    }
-    int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
-    while (lru_chain != nullptr) {
-        entries_from_lru++;
-        lru_chain = lru_chain->more_recent;
+    uint32_t entries_in_ring = 0;
+    if (shard.clock_hand != nullptr) {
+        CacheEntry *entry = shard.clock_hand;
+        do {
+            entries_in_ring++;
+            entry = entry->clock_next;
+        } while (entry != shard.clock_hand && entries_in_ring <= shard.entry_count);
     }
     print(nullptr) << "hash entries " << entries_in_hash_table
-                   << ", mru entries " << entries_from_mru
-                   << ", lru entries " << entries_from_lru << "\n";
-    if (entries_in_hash_table != entries_from_mru) {
+                   << ", ring entries " << entries_in_ring
+                   << ", counted entries " << shard.entry_count << "\n";
+    if (entries_in_hash_table != shard.entry_count) {
         halide_print(nullptr, "cache invalid case 3\n");
         __builtin_trap();
     }
-    if (entries_in_hash_table != entries_from_lru) {
+    if (entries_in_ring != shard.entry_count) {
         halide_print(nullptr, "cache invalid case 4\n");
         __builtin_trap();
     }
@@ -257,62 +351,735 @@ WEAK void validate_cache() {
 }
 #endif
 
-WEAK void prune_cache() {
+// All the functions below that take a shard expect its lock to be held.
+
+WEAK void clock_insert(CacheShard &shard, CacheEntry *entry) {
+    // New entries go just behind the hand, so they survive a full
+    // sweep before they are first considered for eviction.
+    CacheEntry *hand = shard.clock_hand;
+    if (hand == nullptr) {
+        entry->clock_next = entry;
+        entry->clock_prev = entry;
+        shard.clock_hand = entry;
+    } else {
+        entry->clock_next = hand;
+        entry->clock_prev = hand->clock_prev;
+        hand->clock_prev->clock_next = entry;
+        hand->clock_prev = entry;
+    }
+}
+
+WEAK void clock_remove(CacheShard &shard, CacheEntry *entry) {
+    if (entry->clock_next == entry) {
+        shard.clock_hand = nullptr;
+    } else {
+        entry->clock_prev->clock_next = entry->clock_next;
+        entry->clock_next->clock_prev = entry->clock_prev;
+        if (shard.clock_hand == entry) {
+            shard.clock_hand = entry->clock_next;
+        }
+    }
+}
+
+// Unlink an entry, given the pointer to it from its hash chain, and free it.
+WEAK void remove_entry(CacheShard &shard, CacheEntry **link, CacheEntry *entry) {
+    *link = entry->next;
+    clock_remove(shard, entry);
+    shard.entry_count--;
+    __sync_fetch_and_sub(&current_cache_size, (int64_t)entry->size_in_bytes());
+    entry->destroy();
+    halide_free(nullptr, entry);
+}
+
+// Make sure there is a bucket array with room for one more entry. If
+// growing it fails, the shard just keeps its longer chains.
+WEAK void reserve_bucket(CacheShard &shard) {
+    if (shard.buckets != nullptr && shard.entry_count < shard.bucket_count) {
+        return;
+    }
+    uint32_t new_count = shard.buckets != nullptr ? shard.bucket_count * 2 : kInitialBucketCount;
+    CacheEntry **new_buckets = (CacheEntry **)halide_malloc(nullptr, new_count * sizeof(CacheEntry *));
+    if (new_buckets == nullptr) {
+        return;
+    }
+    memset(new_buckets, 0, new_count * sizeof(CacheEntry *));
+    for (uint32_t i = 0; shard.buckets != nullptr && i < shard.bucket_count; i++) {
+        CacheEntry *entry = shard.buckets[i];
+        while (entry != nullptr) {
+            CacheEntry *next = entry->next;
+            CacheEntry **bucket = &new_buckets[entry->hash & (new_count - 1)];
+            entry->next = *bucket;
+            *bucket = entry;
+            entry = next;
+        }
+    }
+    if (shard.buckets != nullptr) {
+        halide_free(nullptr, shard.buckets);
+    }
+    shard.buckets = new_buckets;
+    shard.bucket_count = new_count;
+}
+
+// Advance the clock hand until it evicts one entry. Returns false if
+// the shard is empty or everything in it is in use.
+WEAK bool evict_one(CacheShard &shard) {
+    // Two trips around the ring clear every reference bit and then
+    // find any entry that isn't in use.
+    for (uint32_t steps = 2 * shard.entry_count; steps > 0; steps--) {
+        CacheEntry *candidate = shard.clock_hand;
+        shard.clock_hand = candidate->clock_next;
+        if (candidate->in_use_count != 0) {
+            continue;
+        }
+        if (candidate->referenced) {
+            candidate->referenced = false;
+            continue;
+        }
+        CacheEntry **link = get_bucket(shard, candidate->hash);
+        while (*link != candidate) {
+            halide_assert(nullptr, *link != nullptr);
+            link = &(*link)->next;
+        }
+        remove_entry(shard, link, candidate);
+        return true;
+    }
+    return false;
+}
+
+// Evict entries until the cache is back under budget. Takes one victim
+// from each shard in turn, starting with the given one, so eviction
+// pressure is spread over the whole table and no thread ever holds
+// more than one shard lock.
+WEAK void prune_cache(uint32_t first_shard) {
+    bool evicted = true;
+    while (evicted && cache_over_budget()) {
+        evicted = false;
+        for (uint32_t i = 0; i < kCacheShards && cache_over_budget(); i++) {
+            CacheShard &shard = cache_shards[(first_shard + i) & (kCacheShards - 1)];
+            ScopedMutexLock lock(&shard.lock);
+            evicted |= evict_one(shard);
 #if CACHE_DEBUGGING
-    validate_cache();
+            validate_shard(shard);
 #endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != nullptr) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != nullptr && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
+        }
+    }
+}
+
+
+// The optional persistent level of the cache: a file that every process
+// using it maps, so results computed by one process (or an earlier run)
+// are picked up by later ones without recomputation. It sits under the
+// in-memory cache: lookups that miss in memory try the file, and stores
+// write through to it.
+//
+// The file starts with a PersistentHeader, followed by an index of
+// sets of kPersistentWays slots, and then a data region used as a ring
+// of records. New records go at the write offset, overwriting the
+// oldest ones, whose slots are cleared first. A record only becomes
+// reachable once its contents and checksum are written and its slot is
+// published, so a process dying mid-store leaves at worst an
+// unreachable record. Records are checked against their slot and their
+// checksum on every load.
+//
+// Processes exclude each other with an advisory lock on the file, and
+// threads within a process with persistent_cache.lock.
+
+const uint64_t kPersistentMagic = 0x3145484341434c48ULL;  // "HLCACHE1"
+const uint32_t kPersistentVersion = 1;
+const uint32_t kPersistentWays = 4;
+const uint64_t kPersistentBytesPerSlot = 4096;
+const uint64_t kPersistentAlignment = 64;
+const uint64_t kDefaultPersistentSize = 64 << 20;
+const uint64_t kMinPersistentSize = 1 << 20;
+
+struct PersistentHeader {
+    // Written last when the file is initialized.
+    uint64_t magic;
+    uint32_t version;
+    uint32_t set_count;
+    uint64_t file_size;
+    uint64_t data_begin;
+    uint64_t write_offset;
+    uint64_t next_sequence;
+};
+
+struct PersistentSlot {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+    // Zero if the slot is empty. Cleared first and set last on update.
+    uint64_t sequence;
+};
+
+struct PersistentRecord {
+    // Matches the slot pointing here, or zero if no slot should. Written last.
+    uint64_t sequence;
+    // Of everything in the record after this header.
+    uint64_t checksum;
+    uint64_t hash;
+    // Of the whole record, a multiple of kPersistentAlignment.
+    uint64_t size;
+    uint64_t eviction_key;
+    uint32_t has_eviction_key;
+    uint32_t name_size;
+    uint32_t key_size;
+    int32_t tuple_count;
+    int32_t dimensions;
+    uint32_t padding;
+    // Followed by the name and the rest of the key, the computed
+    // bounds, the shape and byte count of each tuple buffer, and then
+    // the contents of each tuple buffer, aligned.
+};
+
+const int kPersistentUnset = 0;
+const int kPersistentClosed = 1;
+const int kPersistentOpen = 2;
+const int kPersistentDisabled = 3;
+
+struct PersistentCache {
+    halide_mutex lock;
+    int state;
+    char path[1024];
+    uint64_t requested_size;
+    uint8_t *base;
+    size_t size;
+    void *file;
+};
+
+WEAK PersistentCache persistent_cache;
+
+// The in-memory key starts with a pointer to a string naming the
+// pipeline and Func (see Memoization.cpp), which is different in every
+// process. The persistent level uses the string itself instead. Next
+// comes a hash of the definitions as two 32-bit words, low word first,
+// the lowest bit of which is clear if the entry must not be persisted.
+struct PersistentKey {
+    const char *name;
+    size_t name_size;
+    const uint8_t *rest;
+    size_t rest_size;
+    uint64_t hash;
+
+    ALWAYS_INLINE bool init(const uint8_t *cache_key, int32_t size) {
+        if (size < (int32_t)(sizeof(const char *) + sizeof(uint64_t))) {
+            return false;
+        }
+        memcpy(&name, cache_key, sizeof(name));
+        if (name == nullptr) {
+            return false;
+        }
+        uint32_t definition_hash_low;
+        memcpy(&definition_hash_low, cache_key + sizeof(name), sizeof(definition_hash_low));
+        if (!(definition_hash_low & 1)) {
+            return false;
+        }
+        name_size = strlen(name) + 1;
+        rest = cache_key + sizeof(name);
+        rest_size = size - sizeof(name);
+        hash = hash_key((const uint8_t *)name, name_size) ^ (hash_key(rest, rest_size) * kHashPrime1);
+        return true;
+    }
+};
+
+ALWAYS_INLINE uint64_t align_up(uint64_t x, uint64_t alignment) {
+    return (x + alignment - 1) & ~(alignment - 1);
+}
+
+ALWAYS_INLINE PersistentSlot *persistent_set(uint8_t *base, uint64_t h) {
+    const PersistentHeader *header = (const PersistentHeader *)base;
+    PersistentSlot *slots = (PersistentSlot *)(base + sizeof(PersistentHeader));
+    return slots + (h & (header->set_count - 1)) * kPersistentWays;
+}
+
+ALWAYS_INLINE uint64_t persistent_shapes_offset(const PersistentKey &key) {
+    return align_up(sizeof(PersistentRecord) + key.name_size + key.rest_size, sizeof(uint64_t));
+}
+
+ALWAYS_INLINE uint64_t persistent_shape_size(int32_t dimensions) {
+    return sizeof(halide_dimension_t) * dimensions + sizeof(uint64_t);
+}
+
+ALWAYS_INLINE uint64_t persistent_data_offset(const PersistentKey &key, int32_t dimensions, int32_t tuple_count) {
+    return align_up(persistent_shapes_offset(key) + sizeof(halide_dimension_t) * dimensions +
+                        persistent_shape_size(dimensions) * tuple_count,
+                    kPersistentAlignment);
+}
+
+WEAK uint64_t persistent_record_size(const PersistentKey &key, const halide_buffer_t *computed_bounds,
+                                     int32_t tuple_count, halide_buffer_t **tuple_buffers) {
+    uint64_t size = persistent_data_offset(key, computed_bounds->dimensions, tuple_count);
+    for (int32_t i = 0; i < tuple_count; i++) {
+        size += align_up(tuple_buffers[i]->size_in_bytes(), kPersistentAlignment);
+    }
+    return size;
+}
+
+WEAK bool persistent_header_valid(const PersistentHeader *header, size_t mapped_size) {
+    if (header->magic != kPersistentMagic ||
+        header->version != kPersistentVersion ||
+        header->file_size > mapped_size ||
+        header->set_count == 0 ||
+        (header->set_count & (header->set_count - 1)) != 0) {
+        return false;
+    }
+    uint64_t data_begin = align_up(sizeof(PersistentHeader) +
+                                       sizeof(PersistentSlot) * kPersistentWays * (uint64_t)header->set_count,
+                                   kPersistentAlignment);
+    return (header->data_begin == data_begin &&
+            data_begin < header->file_size &&
+            header->write_offset >= data_begin &&
+            header->write_offset <= header->file_size);
+}
+
+WEAK void persistent_initialize(uint8_t *base, uint64_t size) {
+    PersistentHeader *header = (PersistentHeader *)base;
+    header->magic = 0;
+    __sync_synchronize();
+
+    uint32_t set_count = 1;
+    while ((uint64_t)set_count * 2 * kPersistentWays * kPersistentBytesPerSlot <= size) {
+        set_count *= 2;
+    }
+    uint64_t index_size = sizeof(PersistentSlot) * kPersistentWays * (uint64_t)set_count;
+    memset(base + sizeof(PersistentHeader), 0, index_size);
+    header->version = kPersistentVersion;
+    header->set_count = set_count;
+    header->file_size = size;
+    header->data_begin = align_up(sizeof(PersistentHeader) + index_size, kPersistentAlignment);
+    header->write_offset = header->data_begin;
+    header->next_sequence = 1;
+    // Mark the data region as never written (see persistent_retire).
+    memset(base + header->data_begin, 0, sizeof(PersistentRecord));
+
+    __sync_synchronize();
+    header->magic = kPersistentMagic;
+}
+
+ALWAYS_INLINE void persistent_set_state(int state) {
+    __atomic_store_n(&persistent_cache.state, state, __ATOMIC_RELAXED);
+}
+
+ALWAYS_INLINE bool persistent_disabled() {
+    return __atomic_load_n(&persistent_cache.state, __ATOMIC_RELAXED) == kPersistentDisabled;
+}
+
+// Map the file if it isn't already. Expects persistent_cache.lock to be held.
+WEAK bool persistent_open(void *user_context) {
+    PersistentCache &pc = persistent_cache;
+    if (pc.state == kPersistentOpen) {
+        return true;
+    } else if (pc.state == kPersistentDisabled) {
+        return false;
+    } else if (pc.state == kPersistentUnset) {
+        const char *path = getenv("HL_MEMOIZATION_CACHE_FILE");
+        if (path == nullptr || *path == 0 || strlen(path) >= sizeof(pc.path)) {
+            persistent_set_state(kPersistentDisabled);
+            return false;
+        }
+        memcpy(pc.path, path, strlen(path) + 1);
+        const char *megabytes = getenv("HL_MEMOIZATION_CACHE_FILE_MB");
+        int mb = megabytes ? atoi(megabytes) : 0;
+        pc.requested_size = mb > 0 ? (uint64_t)mb << 20 : 0;
+    }
+
+    size_t size = (size_t)(pc.requested_size != 0 ? max(pc.requested_size, kMinPersistentSize) : kDefaultPersistentSize);
+    uint8_t *base = (uint8_t *)halide_map_shared_file(user_context, pc.path, &size, &pc.file);
+    if (base != nullptr && size < kMinPersistentSize) {
+        halide_unmap_shared_file(user_context, base, size, pc.file);
+        base = nullptr;
+    }
+    if (base == nullptr) {
+        debug(user_context) << "Not using persistent memoization cache " << pc.path << "\n";
+        persistent_set_state(kPersistentDisabled);
+        return false;
+    }
+
+    halide_lock_shared_file(pc.file, true);
+    if (!persistent_header_valid((const PersistentHeader *)base, size)) {
+        persistent_initialize(base, size);
+    }
+    halide_unlock_shared_file(pc.file);
+
+    pc.base = base;
+    pc.size = size;
+    persistent_set_state(kPersistentOpen);
+    return true;
+}
+
+// Expects persistent_cache.lock to be held.
+WEAK void persistent_close(void *user_context) {
+    PersistentCache &pc = persistent_cache;
+    if (pc.state == kPersistentOpen) {
+        halide_unmap_shared_file(user_context, pc.base, pc.size, pc.file);
+        pc.base = nullptr;
+        pc.size = 0;
+        pc.file = nullptr;
+        persistent_set_state(kPersistentClosed);
+    }
+}
+
+// The record a slot points to, if it is still there.
+WEAK PersistentRecord *persistent_record(uint8_t *base, const PersistentSlot &slot) {
+    const PersistentHeader *header = (const PersistentHeader *)base;
+    if (slot.sequence == 0 ||
+        slot.offset < header->data_begin ||
+        slot.offset % kPersistentAlignment != 0 ||
+        slot.size < sizeof(PersistentRecord) ||
+        slot.offset > header->file_size ||
+        slot.size > header->file_size - slot.offset) {
+        return nullptr;
+    }
+    PersistentRecord *record = (PersistentRecord *)(base + slot.offset);
+    if (record->sequence != slot.sequence ||
+        record->hash != slot.hash ||
+        record->size != slot.size) {
+        return nullptr;
+    }
+    return record;
+}
+
+// Unpublish the records overlapping [begin, end) of the ring, which is
+// about to be overwritten. Records are contiguous, so this only needs
+// to walk the ones in the range. If the last of them extends past end,
+// cover the rest of it with an unpublished filler to keep the ring
+// walkable.
+WEAK void persistent_retire(uint8_t *base, uint64_t begin, uint64_t end) {
+    const PersistentHeader *header = (const PersistentHeader *)base;
+    uint64_t file_size = header->file_size;
+    uint64_t p = begin;
+    while (p < end) {
+        const PersistentRecord *record = (const PersistentRecord *)(base + p);
+        uint64_t size = record->size;
+        if (size == 0) {
+            // Never written, and neither is anything after it.
+            return;
+        }
+        if (size % kPersistentAlignment != 0 || size > file_size - p) {
+            // A store died part way through writing this header. Give up
+            // on the rest of the ring.
+            PersistentSlot *slots = (PersistentSlot *)(base + sizeof(PersistentHeader));
+            for (uint64_t i = 0; i < (uint64_t)header->set_count * kPersistentWays; i++) {
+                if (slots[i].offset >= p) {
+                    slots[i].sequence = 0;
                 }
-                halide_assert(nullptr, prev_hash_entry != nullptr);
-                prev_hash_entry->next = prune_candidate->next;
             }
+            size = file_size - p;
+        } else if (record->sequence != 0) {
+            PersistentSlot *set = persistent_set(base, record->hash);
+            for (uint32_t w = 0; w < kPersistentWays; w++) {
+                if (set[w].offset == p) {
+                    set[w].sequence = 0;
+                }
+            }
+        }
+        p += size;
+    }
+    if (p > end) {
+        PersistentRecord *filler = (PersistentRecord *)(base + end);
+        filler->sequence = 0;
+        filler->hash = 0;
+        filler->size = p - end;
+    }
+}
+
+WEAK bool persistent_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
+                            const halide_buffer_t *computed_bounds,
+                            int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                            bool *has_eviction_key, uint64_t *eviction_key) {
+    PersistentKey key;
+    if (persistent_disabled() || !key.init(cache_key, size)) {
+        return false;
+    }
+    uint64_t record_size = persistent_record_size(key, computed_bounds, tuple_count, tuple_buffers);
+    int32_t dimensions = computed_bounds->dimensions;
+
+    ScopedMutexLock lock(&persistent_cache.lock);
+    if (!persistent_open(user_context)) {
+        return false;
+    }
+    uint8_t *base = persistent_cache.base;
+
+    bool found = false;
+    halide_lock_shared_file(persistent_cache.file, false);
+    PersistentSlot *set = persistent_set(base, key.hash);
+    for (uint32_t w = 0; !found && w < kPersistentWays; w++) {
+        const PersistentRecord *record = persistent_record(base, set[w]);
+        // Checking the size first ensures everything below is in bounds.
+        if (record == nullptr ||
+            record->size != record_size ||
+            record->name_size != key.name_size ||
+            record->key_size != key.rest_size ||
+            record->tuple_count != tuple_count ||
+            record->dimensions != dimensions) {
+            continue;
+        }
+        const uint8_t *bytes = (const uint8_t *)record;
+        if (!keys_equal(bytes + sizeof(PersistentRecord), (const uint8_t *)key.name, key.name_size) ||
+            !keys_equal(bytes + sizeof(PersistentRecord) + key.name_size, key.rest, key.rest_size)) {
+            continue;
+        }
+        const uint8_t *shapes = bytes + persistent_shapes_offset(key);
+        if (!buffer_has_shape(computed_bounds, (const halide_dimension_t *)shapes)) {
+            continue;
+        }
+        shapes += sizeof(halide_dimension_t) * dimensions;
+        bool all_bounds_equal = true;
+        for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+            uint64_t buffer_bytes;
+            memcpy(&buffer_bytes, shapes + sizeof(halide_dimension_t) * dimensions, sizeof(buffer_bytes));
+            all_bounds_equal = (buffer_has_shape(tuple_buffers[i], (const halide_dimension_t *)shapes) &&
+                                buffer_bytes == tuple_buffers[i]->size_in_bytes());
+            shapes += persistent_shape_size(dimensions);
+        }
+        if (!all_bounds_equal ||
+            record->checksum != hash_key(bytes + sizeof(PersistentRecord), record->size - sizeof(PersistentRecord))) {
+            continue;
+        }
+
+        const uint8_t *data = bytes + persistent_data_offset(key, dimensions, tuple_count);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            size_t buffer_bytes = tuple_buffers[i]->size_in_bytes();
+            memcpy(tuple_buffers[i]->host, data, buffer_bytes);
+            data += align_up(buffer_bytes, kPersistentAlignment);
+        }
+        *has_eviction_key = record->has_eviction_key != 0;
+        *eviction_key = record->eviction_key;
+        found = true;
+    }
+    halide_unlock_shared_file(persistent_cache.file);
+
+    return found;
+}
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
+WEAK void persistent_store(void *user_context, const uint8_t *cache_key, int32_t size,
+                           const halide_buffer_t *computed_bounds,
+                           int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                           bool has_eviction_key, uint64_t eviction_key) {
+    PersistentKey key;
+    if (persistent_disabled() || !key.init(cache_key, size)) {
+        return;
+    }
+    for (int32_t i = 0; i < tuple_count; i++) {
+        if (tuple_buffers[i]->device_dirty()) {
+            // The host copy is stale.
+            return;
+        }
+    }
+    uint64_t record_size = persistent_record_size(key, computed_bounds, tuple_count, tuple_buffers);
+    int32_t dimensions = computed_bounds->dimensions;
+
+    ScopedMutexLock lock(&persistent_cache.lock);
+    if (!persistent_open(user_context)) {
+        return;
+    }
+    uint8_t *base = persistent_cache.base;
+    PersistentHeader *header = (PersistentHeader *)base;
+
+    // Don't let one record push out more than half of everything else.
+    if (record_size > (header->file_size - header->data_begin) / 2) {
+        return;
+    }
+
+    halide_lock_shared_file(persistent_cache.file, true);
+
+    uint64_t offset = header->write_offset;
+    if (offset + record_size > header->file_size) {
+        persistent_retire(base, offset, header->file_size);
+        offset = header->data_begin;
+    }
+    persistent_retire(base, offset, offset + record_size);
+
+    uint8_t *bytes = base + offset;
+    PersistentRecord *record = (PersistentRecord *)bytes;
+    record->sequence = 0;
+    record->size = record_size;
+    record->hash = key.hash;
+    record->eviction_key = eviction_key;
+    record->has_eviction_key = has_eviction_key ? 1 : 0;
+    record->name_size = (uint32_t)key.name_size;
+    record->key_size = (uint32_t)key.rest_size;
+    record->tuple_count = tuple_count;
+    record->dimensions = dimensions;
+    record->padding = 0;
+
+    // Zero everything before the data, so the padding is checksummed consistently.
+    uint64_t data_offset = persistent_data_offset(key, dimensions, tuple_count);
+    memset(bytes + sizeof(PersistentRecord), 0, data_offset - sizeof(PersistentRecord));
+    memcpy(bytes + sizeof(PersistentRecord), key.name, key.name_size);
+    memcpy(bytes + sizeof(PersistentRecord) + key.name_size, key.rest, key.rest_size);
+    uint8_t *shapes = bytes + persistent_shapes_offset(key);
+    memcpy(shapes, computed_bounds->dim, sizeof(halide_dimension_t) * dimensions);
+    shapes += sizeof(halide_dimension_t) * dimensions;
+    uint8_t *data = bytes + data_offset;
+    for (int32_t i = 0; i < tuple_count; i++) {
+        uint64_t buffer_bytes = tuple_buffers[i]->size_in_bytes();
+        memcpy(shapes, tuple_buffers[i]->dim, sizeof(halide_dimension_t) * dimensions);
+        memcpy(shapes + sizeof(halide_dimension_t) * dimensions, &buffer_bytes, sizeof(buffer_bytes));
+        shapes += persistent_shape_size(dimensions);
+
+        memcpy(data, tuple_buffers[i]->host, buffer_bytes);
+        uint64_t padded_bytes = align_up(buffer_bytes, kPersistentAlignment);
+        memset(data + buffer_bytes, 0, padded_bytes - buffer_bytes);
+        data += padded_bytes;
+    }
+    record->checksum = hash_key(bytes + sizeof(PersistentRecord), record_size - sizeof(PersistentRecord));
+
+    uint64_t sequence = header->next_sequence++;
+    __sync_synchronize();
+    record->sequence = sequence;
+    header->write_offset = offset + record_size;
+
+    // Replace an older copy of the same key if there is one, or else an
+    // empty slot, or else the oldest one in the set.
+    PersistentSlot *set = persistent_set(base, key.hash);
+    PersistentSlot *slot = &set[0];
+    for (uint32_t w = 0; w < kPersistentWays; w++) {
+        if (set[w].sequence != 0 && set[w].hash == key.hash) {
+            slot = &set[w];
+            break;
+        } else if (set[w].sequence < slot->sequence) {
+            slot = &set[w];
+        }
+    }
+    slot->sequence = 0;
+    __sync_synchronize();
+    slot->hash = key.hash;
+    slot->offset = offset;
+    slot->size = record_size;
+    __sync_synchronize();
+    slot->sequence = sequence;
+
+    halide_unlock_shared_file(persistent_cache.file);
+}
+
+WEAK void persistent_evict(void *user_context, uint64_t eviction_key) {
+    if (persistent_disabled()) {
+        return;
+    }
+
+    ScopedMutexLock lock(&persistent_cache.lock);
+    if (!persistent_open(user_context)) {
+        return;
+    }
+    uint8_t *base = persistent_cache.base;
+    const PersistentHeader *header = (const PersistentHeader *)base;
+
+    halide_lock_shared_file(persistent_cache.file, true);
+    PersistentSlot *slots = (PersistentSlot *)(base + sizeof(PersistentHeader));
+    for (uint64_t i = 0; i < (uint64_t)header->set_count * kPersistentWays; i++) {
+        const PersistentRecord *record = persistent_record(base, slots[i]);
+        if (record != nullptr && record->has_eviction_key && record->eviction_key == eviction_key) {
+            slots[i].sequence = 0;
+        }
+    }
+    halide_unlock_shared_file(persistent_cache.file);
+}
+
+// Add an entry for buffers allocated by halide_memoization_cache_lookup
+// to the in-memory cache, and mark it in use by the caller.
+WEAK void store_in_memory(void *user_context, const uint8_t *cache_key, int32_t size,
+                          halide_buffer_t *computed_bounds,
+                          int32_t tuple_count, halide_buffer_t **tuple_buffers,
+                          bool has_eviction_key, uint64_t eviction_key) {
+    uint64_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+    CacheShard &shard = cache_shards[shard_index(h)];
+
+    uint64_t added_size = 0;
+    {
+        ScopedMutexLock lock(&shard.lock);
+
+#if CACHE_DEBUGGING
+        debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
+
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
             }
-            if (more_recent != nullptr) {
-                more_recent->less_recent = prune_candidate->less_recent;
+        }
+#endif
+
+        CacheEntry *entry = shard.buckets != nullptr ? *get_bucket(shard, h) : nullptr;
+        while (entry != nullptr) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
+
+                bool all_bounds_equal = true;
+                bool no_host_pointers_equal = true;
+                {
+                    for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
+                        if (entry->buf[i].host == buf->host) {
+                            no_host_pointers_equal = false;
+                        }
+                    }
+                }
+                if (all_bounds_equal) {
+                    halide_assert(user_context, no_host_pointers_equal);
+                    // This entry is still in use by the caller. Mark it as having no cache entry
+                    // so halide_memoization_cache_release can free the buffer.
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        get_pointer_to_header(tuple_buffers[i]->host)->entry = nullptr;
+                    }
+                    return;
+                }
             }
+            entry = entry->next;
+        }
+
+        reserve_bucket(shard);
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
+        CacheEntry *new_entry = nullptr;
+        bool inited = false;
+        if (shard.buckets != nullptr) {
+            new_entry = (CacheEntry *)halide_malloc(nullptr, sizeof(CacheEntry));
+            if (new_entry) {
+                inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers,
+                                         has_eviction_key, eviction_key);
             }
-            if (prune_candidate->less_recent != nullptr) {
-                prune_candidate->less_recent = more_recent;
+        }
+        if (!inited) {
+            // This entry is still in use by the caller. Mark it as having no cache entry
+            // so halide_memoization_cache_release can free the buffer.
+            for (int32_t i = 0; i < tuple_count; i++) {
+                get_pointer_to_header(tuple_buffers[i]->host)->entry = nullptr;
             }
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
+            if (new_entry) {
+                halide_free(user_context, new_entry);
             }
+            return;
+        }
+
+        CacheEntry **bucket = get_bucket(shard, h);
+        new_entry->next = *bucket;
+        *bucket = new_entry;
+        clock_insert(shard, new_entry);
+        shard.entry_count++;
+
+        new_entry->in_use_count = tuple_count;
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(nullptr, prune_candidate);
+        for (int32_t i = 0; i < tuple_count; i++) {
+            get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
         }
+        added_size = new_entry->size_in_bytes();
 
-        prune_candidate = more_recent;
-    }
 #if CACHE_DEBUGGING
-    validate_cache();
+        validate_shard(shard);
 #endif
+    }
+
+    // The new entry is in use, so pruning can't evict it. Do it after
+    // dropping the shard lock, as it may need to visit other shards.
+    __sync_fetch_and_add(&current_cache_size, (int64_t)added_size);
+    if (cache_over_budget()) {
+        prune_cache(shard_index(h));
+    }
 }
 
 }  // namespace Internal
@@ -321,83 +1088,90 @@ WEAK void prune_cache() {
 
 extern "C" {
 
+WEAK int halide_memoization_cache_set_persistent_file(void *user_context, const char *path, int64_t size) {
+    ScopedMutexLock lock(&persistent_cache.lock);
+
+    persistent_close(user_context);
+    if (path == nullptr || *path == 0) {
+        persistent_set_state(kPersistentDisabled);
+        return 0;
+    }
+    if (strlen(path) >= sizeof(persistent_cache.path)) {
+        persistent_set_state(kPersistentDisabled);
+        return -1;
+    }
+    memcpy(persistent_cache.path, path, strlen(path) + 1);
+    persistent_cache.requested_size = size > 0 ? (uint64_t)size : 0;
+    persistent_set_state(kPersistentClosed);
+    return persistent_open(user_context) ? 0 : -1;
+}
+
 WEAK void halide_memoization_cache_set_size(int64_t size) {
     if (size == 0) {
         size = kDefaultCacheSize;
     }
 
-    ScopedMutexLock lock(&memoization_lock);
-
-    max_cache_size = size;
-    prune_cache();
+    __atomic_store_n(&max_cache_size, size, __ATOMIC_RELAXED);
+    prune_cache(0);
 }
 
 WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
                                          halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+    uint64_t h = hash_key(cache_key, size);
+    CacheShard &shard = cache_shards[shard_index(h)];
 
-    ScopedMutexLock lock(&memoization_lock);
+    {
+        ScopedMutexLock lock(&shard.lock);
 
 #if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
+        debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
 
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
+        debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
 
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
+        {
+            for (int32_t i = 0; i < tuple_count; i++) {
+                halide_buffer_t *buf = tuple_buffers[i];
+                debug_print_buffer(user_context, "Allocation bounds", *buf);
+            }
         }
-    }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
-    while (entry != nullptr) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            // Check all the tuple buffers have the same bounds (they should).
-            bool all_bounds_equal = true;
-            for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-            }
-
-            if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != nullptr);
-                    if (entry->less_recent != nullptr) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != nullptr);
-                    entry->more_recent->less_recent = entry->less_recent;
+        CacheEntry *entry = shard.buckets != nullptr ? *get_bucket(shard, h) : nullptr;
+        while (entry != nullptr) {
+            if (entry->hash == h && entry->key_size == (size_t)size &&
+                keys_equal(entry->key, cache_key, size) &&
+                buffer_has_shape(computed_bounds, entry->computed_bounds) &&
+                entry->tuple_count == (uint32_t)tuple_count) {
 
-                    entry->more_recent = nullptr;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != nullptr) {
-                        most_recently_used->more_recent = entry;
-                    }
-                    most_recently_used = entry;
+                // Check all the tuple buffers have the same bounds (they should).
+                bool all_bounds_equal = true;
+                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
+                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
                 }
 
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    *buf = entry->buf[i];
-                }
+                if (all_bounds_equal) {
+                    entry->referenced = true;
+
+                    for (int32_t i = 0; i < tuple_count; i++) {
+                        halide_buffer_t *buf = tuple_buffers[i];
+                        *buf = entry->buf[i];
+                    }
 
-                entry->in_use_count += tuple_count;
+                    entry->in_use_count += tuple_count;
 
-                return 0;
+                    return 0;
+                }
             }
+            entry = entry->next;
         }
-        entry = entry->next;
+
+#if CACHE_DEBUGGING
+        validate_shard(shard);
+#endif
     }
 
+    // Allocate the buffers for the caller to compute into (or for the
+    // persistent level to fill) outside the shard lock.
     for (int32_t i = 0; i < tuple_count; i++) {
         halide_buffer_t *buf = tuple_buffers[i];
 
@@ -415,9 +1189,14 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
         header->entry = nullptr;
     }
 
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
+    bool has_eviction_key = false;
+    uint64_t eviction_key = 0;
+    if (persistent_lookup(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers,
+                          &has_eviction_key, &eviction_key)) {
+        store_in_memory(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers,
+                        has_eviction_key, eviction_key);
+        return 0;
+    }
 
     return 1;
 }
@@ -428,107 +1207,11 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
                                         bool has_eviction_key, uint64_t eviction_key) {
     debug(user_context) << "halide_memoization_cache_store has_eviction_key: " << has_eviction_key << " eviction_key " << eviction_key << " .\n";
 
-    uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
-
-    uint32_t index = h % kHashTableSize;
-
-    ScopedMutexLock lock(&memoization_lock);
-
-#if CACHE_DEBUGGING
-    debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
-
-    debug_print_buffer(user_context, "computed_bounds", *computed_bounds);
-
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            debug_print_buffer(user_context, "Allocation bounds", *buf);
-        }
-    }
-#endif
-
-    CacheEntry *entry = cache_entries[index];
-    while (entry != nullptr) {
-        if (entry->hash == h && entry->key_size == (size_t)size &&
-            keys_equal(entry->key, cache_key, size) &&
-            buffer_has_shape(computed_bounds, entry->computed_bounds) &&
-            entry->tuple_count == (uint32_t)tuple_count) {
-
-            bool all_bounds_equal = true;
-            bool no_host_pointers_equal = true;
-            {
-                for (int32_t i = 0; all_bounds_equal && i < tuple_count; i++) {
-                    halide_buffer_t *buf = tuple_buffers[i];
-                    all_bounds_equal = buffer_has_shape(tuple_buffers[i], entry->buf[i].dim);
-                    if (entry->buf[i].host == buf->host) {
-                        no_host_pointers_equal = false;
-                    }
-                }
-            }
-            if (all_bounds_equal) {
-                halide_assert(user_context, no_host_pointers_equal);
-                // This entry is still in use by the caller. Mark it as having no cache entry
-                // so halide_memoization_cache_release can free the buffer.
-                for (int32_t i = 0; i < tuple_count; i++) {
-                    get_pointer_to_header(tuple_buffers[i]->host)->entry = nullptr;
-                }
-                return 0;
-            }
-        }
-        entry = entry->next;
-    }
-
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            added_size += buf->size_in_bytes();
-        }
-    }
-    current_cache_size += added_size;
-    prune_cache();
+    store_in_memory(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers,
+                    has_eviction_key, eviction_key);
+    persistent_store(user_context, cache_key, size, computed_bounds, tuple_count, tuple_buffers,
+                     has_eviction_key, eviction_key);
 
-    CacheEntry *new_entry = (CacheEntry *)halide_malloc(nullptr, sizeof(CacheEntry));
-    bool inited = false;
-    if (new_entry) {
-        inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers,
-                                 has_eviction_key, eviction_key);
-    }
-    if (!inited) {
-        current_cache_size -= added_size;
-
-        // This entry is still in use by the caller. Mark it as having no cache entry
-        // so halide_memoization_cache_release can free the buffer.
-        for (int32_t i = 0; i < tuple_count; i++) {
-            get_pointer_to_header(tuple_buffers[i]->host)->entry = nullptr;
-        }
-
-        if (new_entry) {
-            halide_free(user_context, new_entry);
-        }
-        return 0;
-    }
-
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != nullptr) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == nullptr) {
-        least_recently_used = new_entry;
-    }
-    cache_entries[index] = new_entry;
-
-    new_entry->in_use_count = tuple_count;
-
-    for (int32_t i = 0; i < tuple_count; i++) {
-        get_pointer_to_header(tuple_buffers[i]->host)->entry = new_entry;
-    }
-
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
     debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
     return 0;
@@ -542,12 +1225,13 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == nullptr) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard &shard = cache_shards[shard_index(header->hash)];
+        ScopedMutexLock lock(&shard.lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_shard(shard);
 #endif
     }
 
@@ -556,54 +1240,53 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
 
 WEAK void halide_memoization_cache_cleanup() {
     debug(nullptr) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = nullptr;
-        while (entry != nullptr) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(nullptr, entry);
-            entry = next;
+    for (uint32_t s = 0; s < kCacheShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        for (uint32_t i = 0; shard.buckets != nullptr && i < shard.bucket_count; i++) {
+            CacheEntry *entry = shard.buckets[i];
+            while (entry != nullptr) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(nullptr, entry);
+                entry = next;
+            }
         }
+        if (shard.buckets != nullptr) {
+            halide_free(nullptr, shard.buckets);
+        }
+        shard.buckets = nullptr;
+        shard.bucket_count = 0;
+        shard.entry_count = 0;
+        shard.clock_hand = nullptr;
     }
     current_cache_size = 0;
-    most_recently_used = nullptr;
-    least_recently_used = nullptr;
+
+    ScopedMutexLock lock(&persistent_cache.lock);
+    persistent_close(nullptr);
 }
 
 WEAK void halide_memoization_cache_evict(void *user_context, uint64_t eviction_key) {
-    ScopedMutexLock lock(&memoization_lock);
-
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        if (entry != nullptr) {
-            CacheEntry **prev = &cache_entries[i];
-            while (entry != nullptr) {
-                CacheEntry *next = entry->next;
+    for (uint32_t s = 0; s < kCacheShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        ScopedMutexLock lock(&shard.lock);
+
+        for (uint32_t i = 0; shard.buckets != nullptr && i < shard.bucket_count; i++) {
+            CacheEntry **link = &shard.buckets[i];
+            while (*link != nullptr) {
+                CacheEntry *entry = *link;
                 if (entry->has_eviction_key && entry->eviction_key == eviction_key) {
-                    *prev = next;
-                    if (entry->more_recent != nullptr) {
-                        entry->more_recent->less_recent = entry->less_recent;
-                    } else {
-                        most_recently_used = entry->less_recent;
-                    }
-                    if (entry->less_recent != nullptr) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        least_recently_used = entry->more_recent;
-                    }
-                    entry->destroy();
-                    halide_free(user_context, entry);
+                    remove_entry(shard, link, entry);
                 } else {
-                    prev = &entry->next;
+                    link = &entry->next;
                 }
-                entry = next;
             }
         }
-    }
 #if CACHE_DEBUGGING
-    validate_cache();
+        validate_shard(shard);
 #endif
+    }
+
+    persistent_evict(user_context, eviction_key);
 }
 
 namespace {
@@ -0,0 +1,21 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+WEAK int halide_perf_counters_open() {
+    return -1;
+}
+
+WEAK int halide_perf_counters_read(int handle, uint64_t *values) {
+    return -1;
+}
+
+WEAK void halide_perf_counters_close(int handle) {
+}
+
+WEAK int halide_perf_counters_thread_id() {
+    return -1;
+}
+
+}  // extern "C"
@@ -0,0 +1,21 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+WEAK void *halide_map_shared_file(void *user_context, const char *path, size_t *size, void **file) {
+    return nullptr;
+}
+
+WEAK void halide_unmap_shared_file(void *user_context, void *addr, size_t size, void *file) {
+}
+
+WEAK int halide_lock_shared_file(void *file, bool exclusive) {
+    return -1;
+}
+
+WEAK int halide_unlock_shared_file(void *file) {
+    return -1;
+}
+
+}  // extern "C"
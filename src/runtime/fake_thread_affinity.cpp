@@ -0,0 +1,18 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+WEAK int halide_host_cpu_numa_nodes(int *cpu_nodes, int max_cpus) {
+    return 0;
+}
+
+WEAK int halide_pin_current_thread(int cpu) {
+    return -1;
+}
+
+WEAK int halide_current_cpu() {
+    return -1;
+}
+
+}  // extern "C"
@@ -121,6 +121,22 @@ WEAK int halide_set_num_threads(int n) {
     return 1;
 }
 
+WEAK bool halide_set_work_stealing(bool enable) {
+    return false;
+}
+
+WEAK bool halide_set_par_for_chunking(bool enable) {
+    return false;
+}
+
+WEAK bool halide_set_thread_affinity(bool enable) {
+    return false;
+}
+
+WEAK bool halide_set_semaphore_parking(bool enable) {
+    return false;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -143,6 +159,13 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
     return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+WEAK int halide_do_par_for_with_min_grain(void *user_context, halide_task_t f,
+                                          int min, int size, uint8_t *closure,
+                                          int min_grain) {
+    // Everything runs serially anyway.
+    return halide_do_par_for(user_context, f, min, size, closure);
+}
+
 WEAK int halide_do_loop_task(void *user_context, halide_loop_task_t f,
                              int min, int size, uint8_t *closure, void *task_parent) {
     return custom_do_loop_task(user_context, f, min, size, closure, task_parent);
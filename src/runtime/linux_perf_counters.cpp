@@ -0,0 +1,173 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+extern int syscall(int num, ...);
+extern long read(int fd, void *buf, size_t count);
+
+}  // extern "C"
+
+namespace Halide {
+namespace Runtime {
+namespace Internal {
+
+// This module is only used on x86 Linux, where the syscall numbers are:
+#ifdef BITS_64
+#define SYS_PERF_EVENT_OPEN 298
+#define SYS_GETTID 186
+#else
+#define SYS_PERF_EVENT_OPEN 336
+#define SYS_GETTID 224
+#endif
+
+#define PERF_TYPE_HARDWARE 0
+#define PERF_FORMAT_TOTAL_TIME_ENABLED 1
+#define PERF_FORMAT_TOTAL_TIME_RUNNING 2
+#define PERF_FORMAT_GROUP 8
+#define PERF_FLAG_FD_CLOEXEC 8
+
+// perf_event_attr flag bits
+#define PERF_ATTR_EXCLUDE_KERNEL (1 << 5)
+#define PERF_ATTR_EXCLUDE_HV (1 << 6)
+
+// The first version of struct perf_event_attr. The kernel accepts it
+// from newer headers too, and we don't need any of the later fields.
+struct perf_event_attr_ver0 {
+    uint32_t type;
+    uint32_t size;
+    uint64_t config;
+    uint64_t sample_period;
+    uint64_t sample_type;
+    uint64_t read_format;
+    uint64_t flags;
+    uint32_t wakeup_events;
+    uint32_t bp_type;
+    uint64_t bp_addr;
+};
+
+// The PERF_COUNT_HW_* event for each of the profiler's counters, in
+// the order of halide_profiler_perf_counter_t.
+const uint64_t perf_counter_configs[halide_profiler_num_perf_counters] = {
+    0,  // PERF_COUNT_HW_CPU_CYCLES
+    1,  // PERF_COUNT_HW_INSTRUCTIONS
+    3,  // PERF_COUNT_HW_CACHE_MISSES
+    5,  // PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// The fds of each open group, indexed by handle. The first is the
+// group leader, which is the one that gets read.
+#define MAX_PERF_COUNTER_GROUPS 256
+WEAK int perf_counter_fds[MAX_PERF_COUNTER_GROUPS][halide_profiler_num_perf_counters];
+WEAK bool perf_counter_group_used[MAX_PERF_COUNTER_GROUPS];
+
+// Which counters could be opened on the first thread to try. The
+// others are left out of every thread's group, so that all groups read
+// back the same way. -1 until the first thread tries.
+WEAK int perf_counters_supported = -1;
+
+WEAK int perf_event_open(uint64_t config, int group_fd) {
+    perf_event_attr_ver0 attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Counting only user-space events for our own threads is allowed at
+    // the default perf_event_paranoid level.
+    attr.flags = PERF_ATTR_EXCLUDE_KERNEL | PERF_ATTR_EXCLUDE_HV;
+    // pid 0 and cpu -1 count the calling thread on any cpu.
+    return syscall(SYS_PERF_EVENT_OPEN, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+}  // namespace Internal
+}  // namespace Runtime
+}  // namespace Halide
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK int halide_perf_counters_open() {
+    int handle = 0;
+    while (handle < MAX_PERF_COUNTER_GROUPS && perf_counter_group_used[handle]) {
+        handle++;
+    }
+    if (handle == MAX_PERF_COUNTER_GROUPS) {
+        return -1;
+    }
+    int *fds = perf_counter_fds[handle];
+
+    // The counters are opened as one group, so that they are
+    // scheduled onto the PMU together and share one scale factor.
+    int num_fds = 0, supported = 0;
+    for (int i = 0; i < halide_profiler_num_perf_counters; i++) {
+        bool wanted = perf_counters_supported < 0 || (perf_counters_supported & (1 << i));
+        if (!wanted) {
+            continue;
+        }
+        int fd = perf_event_open(perf_counter_configs[i], num_fds ? fds[0] : -1);
+        if (fd >= 0) {
+            fds[num_fds++] = fd;
+            supported |= 1 << i;
+        } else if (perf_counters_supported >= 0) {
+            // This thread can't count what the first thread could.
+            supported = 0;
+            break;
+        }
+    }
+    if (!supported) {
+        while (num_fds > 0) {
+            close(fds[--num_fds]);
+        }
+        return -1;
+    }
+    while (num_fds < halide_profiler_num_perf_counters) {
+        fds[num_fds++] = -1;
+    }
+    if (perf_counters_supported < 0) {
+        perf_counters_supported = supported;
+    }
+    perf_counter_group_used[handle] = true;
+    return handle;
+}
+
+WEAK int halide_perf_counters_read(int handle, uint64_t *values) {
+    // nr, time_enabled, time_running, then one value per counter.
+    uint64_t buf[3 + halide_profiler_num_perf_counters];
+    long size = read(perf_counter_fds[handle][0], buf, sizeof(buf));
+    if (size < (long)(3 * sizeof(uint64_t))) {
+        return -1;
+    }
+    uint64_t enabled = buf[1], running = buf[2];
+    int j = 0;
+    for (int i = 0; i < halide_profiler_num_perf_counters; i++) {
+        values[i] = 0;
+        if (!(perf_counters_supported & (1 << i)) || j >= (int)buf[0]) {
+            continue;
+        }
+        uint64_t v = buf[3 + j++];
+        // The kernel may have multiplexed the group with other users
+        // of the PMU.
+        if (running > 0 && running < enabled) {
+            v = (uint64_t)((double)v * enabled / running);
+        }
+        values[i] = v;
+    }
+    return 0;
+}
+
+WEAK void halide_perf_counters_close(int handle) {
+    for (int i = 0; i < halide_profiler_num_perf_counters; i++) {
+        if (perf_counter_fds[handle][i] >= 0) {
+            close(perf_counter_fds[handle][i]);
+        }
+    }
+    perf_counter_group_used[handle] = false;
+}
+
+WEAK int halide_perf_counters_thread_id() {
+    return syscall(SYS_GETTID);
+}
+
+}  // extern "C"
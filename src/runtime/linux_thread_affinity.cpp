@@ -0,0 +1,105 @@
+#include "HalideRuntime.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+extern size_t fread(void *, size_t, size_t, void *);
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
+extern int sched_getcpu();
+
+}  // extern "C"
+
+namespace Halide {
+namespace Runtime {
+namespace Internal {
+
+// Matches CPU_SETSIZE in glibc.
+#define MAX_AFFINITY_CPUS 1024
+
+// Nodes are numbered densely on every machine we know of, but allow for
+// a few holes before giving up.
+#define MAX_NUMA_NODE_GAP 8
+
+// Parse a sysfs cpu list such as "0-15,32-47\n", marking each cpu in
+// it as belonging to the given node.
+WEAK void parse_cpu_list(const char *str, int node, int *cpu_nodes, int max_cpus, int *num_cpus) {
+    const char *p = str;
+    while (*p >= '0' && *p <= '9') {
+        int first = 0;
+        while (*p >= '0' && *p <= '9') {
+            first = first * 10 + (*p++ - '0');
+        }
+        int last = first;
+        if (*p == '-') {
+            p++;
+            last = 0;
+            while (*p >= '0' && *p <= '9') {
+                last = last * 10 + (*p++ - '0');
+            }
+        }
+        for (int cpu = first; cpu <= last && cpu < max_cpus; cpu++) {
+            cpu_nodes[cpu] = node;
+            if (cpu + 1 > *num_cpus) {
+                *num_cpus = cpu + 1;
+            }
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+}
+
+}  // namespace Internal
+}  // namespace Runtime
+}  // namespace Halide
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK int halide_host_cpu_numa_nodes(int *cpu_nodes, int max_cpus) {
+    for (int i = 0; i < max_cpus; i++) {
+        cpu_nodes[i] = -1;
+    }
+    int num_cpus = 0;
+    int gap = 0;
+    for (int node = 0; gap < MAX_NUMA_NODE_GAP; node++) {
+        char path[64];
+        char *end = path + sizeof(path);
+        char *dst = halide_string_to_string(path, end, "/sys/devices/system/node/node");
+        dst = halide_int64_to_string(dst, end, node, 1);
+        halide_string_to_string(dst, end, "/cpulist");
+
+        void *f = fopen(path, "r");
+        if (!f) {
+            gap++;
+            continue;
+        }
+        gap = 0;
+        char buf[1024];
+        size_t bytes = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[bytes] = 0;
+        parse_cpu_list(buf, node, cpu_nodes, max_cpus, &num_cpus);
+    }
+
+    // Without sysfs (e.g. in some containers) the topology is unknown.
+    // Cpus that no node claims are left at -1.
+    return num_cpus;
+}
+
+WEAK int halide_pin_current_thread(int cpu) {
+    if (cpu < 0 || cpu >= MAX_AFFINITY_CPUS) {
+        return -1;
+    }
+    uint64_t mask[MAX_AFFINITY_CPUS / 64] = {0};
+    mask[cpu / 64] = (uint64_t)1 << (cpu % 64);
+    // pid 0 means the calling thread.
+    return sched_setaffinity(0, sizeof(mask), mask);
+}
+
+WEAK int halide_current_cpu() {
+    return sched_getcpu();
+}
+
+}  // extern "C"
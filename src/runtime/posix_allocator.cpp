@@ -2,29 +2,383 @@
 #include "runtime_internal.h"
 
 #include "printer.h"
+#include "scoped_mutex_lock.h"
 
 extern "C" {
 
 extern void *malloc(size_t);
 extern void free(void *);
+}
+
+namespace Halide {
+namespace Runtime {
+namespace Internal {
+
+// Every block handed out by halide_default_malloc is preceded by this
+// header. The original pointer comes last, so that ((void **)ptr)[-1]
+// is still the pointer returned by malloc.
+struct HostBlockHeader {
+    uintptr_t size_class;
+    void *orig;
+};
+
+// Size classes go up in quarter steps between powers of two, from 64
+// bytes up to 1MB. Anything bigger goes straight to malloc and free.
+#define HOST_POOL_MIN_CLASS_BITS 6
+#define HOST_POOL_MAX_CLASS_BITS 20
+#define HOST_POOL_NUM_CLASSES (1 + (HOST_POOL_MAX_CLASS_BITS - HOST_POOL_MIN_CLASS_BITS) * 4)
+#define HOST_POOL_UNPOOLED ((uintptr_t)-1)
+
+// The number of thread caches. Threads are spread over them by their
+// stack address, as there is no portable thread-local storage in the
+// runtime. Two threads that land on the same one just share it.
+#define HOST_POOL_THREAD_CACHE_BITS 4
+#define HOST_POOL_NUM_THREAD_CACHES (1 << HOST_POOL_THREAD_CACHE_BITS)
+
+// How much a thread cache may hold in total, and how many blocks of
+// any one class. Blocks beyond that move to the global arena, half a
+// class at a time.
+#define HOST_POOL_THREAD_CACHE_BYTES (2 * 1024 * 1024)
+#define HOST_POOL_THREAD_CACHE_BLOCKS 32
+
+// How much the global arena may hold before blocks are freed again.
+#define HOST_POOL_GLOBAL_BYTES (64 * 1024 * 1024)
+
+ALWAYS_INLINE size_t host_pool_class_size(uintptr_t c) {
+    if (c == 0) {
+        return (size_t)1 << HOST_POOL_MIN_CLASS_BITS;
+    }
+    int k = (int)(c - 1) / 4 + HOST_POOL_MIN_CLASS_BITS;
+    int sub = (int)(c - 1) % 4;
+    return ((size_t)1 << k) + (sub + 1) * ((size_t)1 << (k - 2));
+}
+
+ALWAYS_INLINE uintptr_t host_pool_class_for(size_t x) {
+    if (x <= ((size_t)1 << HOST_POOL_MIN_CLASS_BITS)) {
+        return 0;
+    }
+    if (x > ((size_t)1 << HOST_POOL_MAX_CLASS_BITS)) {
+        return HOST_POOL_UNPOOLED;
+    }
+    uint64_t n = (uint64_t)(x - 1);
+    int k = 63 - __builtin_clzll(n);
+    int sub = (int)(n >> (k - 2)) & 3;
+    return (uintptr_t)((k - HOST_POOL_MIN_CLASS_BITS) * 4 + sub + 1);
+}
+
+// A free block is linked through its first word.
+ALWAYS_INLINE void *&host_pool_next(void *block) {
+    return *(void **)block;
+}
+
+struct HostPoolThreadCache {
+    // A spinlock. Only ever try-locked; a thread that finds it taken
+    // uses the global arena instead.
+    volatile int lock;
+    void *free_list[HOST_POOL_NUM_CLASSES];
+    int count[HOST_POOL_NUM_CLASSES];
+    uint64_t bytes_cached;
+    uint64_t hits;
+    // Keep each cache on its own cache lines.
+    char padding[64];
+};
+
+struct HostPoolArena {
+    halide_mutex lock;
+    void *free_list[HOST_POOL_NUM_CLASSES];
+    int count[HOST_POOL_NUM_CLASSES];
+    uint64_t bytes_cached;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+WEAK HostPoolThreadCache host_pool_thread_caches[HOST_POOL_NUM_THREAD_CACHES];
+WEAK HostPoolArena host_pool_arena;
+
+// -1 until the setting has been taken from the environment or set
+// explicitly.
+WEAK int host_pool_enabled = -1;
+WEAK int host_pool_registered = 0;
+
+WEAK int host_pool_release_unused(void *user_context);
+WEAK halide_device_allocation_pool host_pool_release_hook = {host_pool_release_unused, nullptr};
+
+WEAK void host_pool_set_enabled(bool enable) {
+    host_pool_enabled = enable ? 1 : 0;
+    if (enable && __sync_bool_compare_and_swap(&host_pool_registered, 0, 1)) {
+        // Make halide_reuse_device_allocations(false) release the
+        // host blocks too.
+        halide_register_device_allocation_pool(&host_pool_release_hook);
+    }
+}
+
+ALWAYS_INLINE bool host_pool_is_enabled() {
+    int enabled = host_pool_enabled;
+    if (enabled < 0) {
+        const char *str = getenv("HL_HOST_ALLOCATION_POOL");
+        host_pool_set_enabled(str && atoi(str) != 0);
+        enabled = host_pool_enabled;
+    }
+    return enabled != 0;
+}
+
+ALWAYS_INLINE HostPoolThreadCache *host_pool_thread_cache() {
+    return &host_pool_thread_caches[stack_address_slot(HOST_POOL_THREAD_CACHE_BITS)];
+}
+
+ALWAYS_INLINE bool host_pool_try_lock(HostPoolThreadCache *cache) {
+    return __sync_lock_test_and_set(&cache->lock, 1) == 0;
+}
+
+ALWAYS_INLINE void host_pool_unlock(HostPoolThreadCache *cache) {
+    __sync_lock_release(&cache->lock);
+}
+
+WEAK void *host_pool_malloc_block(size_t class_size) {
+    const size_t alignment = halide_malloc_alignment();
+    void *orig = malloc(class_size + alignment + sizeof(HostBlockHeader));
+    if (orig == nullptr) {
+        return nullptr;
+    }
+    void *ptr = (void *)(((size_t)orig + sizeof(HostBlockHeader) + alignment - 1) & ~(alignment - 1));
+    ((HostBlockHeader *)ptr)[-1].orig = orig;
+    return ptr;
+}
+
+WEAK void host_pool_free_list(void *block) {
+    while (block) {
+        void *next = host_pool_next(block);
+        free(((HostBlockHeader *)block)[-1].orig);
+        block = next;
+    }
+}
+
+// Moves up to n blocks of class c from the arena into the given thread
+// cache, and returns one more for the caller.
+WEAK void *host_pool_refill(HostPoolThreadCache *cache, uintptr_t c, int n) {
+    ScopedMutexLock lock(&host_pool_arena.lock);
+    void *block = host_pool_arena.free_list[c];
+    if (block == nullptr) {
+        host_pool_arena.misses++;
+        return nullptr;
+    }
+    host_pool_arena.hits++;
+    const size_t class_size = host_pool_class_size(c);
+    void *result = block;
+    block = host_pool_next(block);
+    int moved = 1;
+    if (cache) {
+        while (block && moved <= n) {
+            void *next = host_pool_next(block);
+            host_pool_next(block) = cache->free_list[c];
+            cache->free_list[c] = block;
+            cache->count[c]++;
+            cache->bytes_cached += class_size;
+            block = next;
+            moved++;
+        }
+    }
+    host_pool_arena.free_list[c] = block;
+    host_pool_arena.count[c] -= moved;
+    host_pool_arena.bytes_cached -= moved * class_size;
+    return result;
+}
+
+// Moves the given list of blocks of class c into the arena, and frees
+// whatever doesn't fit.
+WEAK void host_pool_spill(void *list, uintptr_t c) {
+    const size_t class_size = host_pool_class_size(c);
+    void *overflow = nullptr;
+    {
+        ScopedMutexLock lock(&host_pool_arena.lock);
+        while (list) {
+            void *next = host_pool_next(list);
+            if (host_pool_arena.bytes_cached + class_size <= HOST_POOL_GLOBAL_BYTES) {
+                host_pool_next(list) = host_pool_arena.free_list[c];
+                host_pool_arena.free_list[c] = list;
+                host_pool_arena.count[c]++;
+                host_pool_arena.bytes_cached += class_size;
+            } else {
+                host_pool_next(list) = overflow;
+                overflow = list;
+            }
+            list = next;
+        }
+    }
+    host_pool_free_list(overflow);
+}
+
+WEAK void *host_pool_malloc(size_t x) {
+    uintptr_t c = host_pool_class_for(x);
+    const size_t class_size = host_pool_class_size(c);
+
+    HostPoolThreadCache *cache = host_pool_thread_cache();
+    void *block = nullptr;
+    if (host_pool_try_lock(cache)) {
+        block = cache->free_list[c];
+        if (block) {
+            cache->free_list[c] = host_pool_next(block);
+            cache->count[c]--;
+            cache->bytes_cached -= class_size;
+            cache->hits++;
+        } else {
+            // Grab a batch from the arena, so that the next few
+            // allocations of this size don't have to.
+            block = host_pool_refill(cache, c, HOST_POOL_THREAD_CACHE_BLOCKS / 2);
+        }
+        host_pool_unlock(cache);
+    } else {
+        block = host_pool_refill(nullptr, c, 0);
+    }
+
+    if (block == nullptr) {
+        block = host_pool_malloc_block(class_size);
+        if (block == nullptr) {
+            return nullptr;
+        }
+    }
+    ((HostBlockHeader *)block)[-1].size_class = c;
+    return block;
+}
+
+WEAK void host_pool_free(void *ptr, uintptr_t c) {
+    const size_t class_size = host_pool_class_size(c);
+    HostPoolThreadCache *cache = host_pool_thread_cache();
+    if (!host_pool_try_lock(cache)) {
+        host_pool_next(ptr) = nullptr;
+        host_pool_spill(ptr, c);
+        return;
+    }
+
+    host_pool_next(ptr) = cache->free_list[c];
+    cache->free_list[c] = ptr;
+    cache->count[c]++;
+    cache->bytes_cached += class_size;
+
+    // If the cache is over budget, move half of this class over to the
+    // arena, so that a thread freeing what another allocated doesn't
+    // grow its cache without bound.
+    void *spilled = nullptr;
+    if (cache->count[c] > HOST_POOL_THREAD_CACHE_BLOCKS ||
+        cache->bytes_cached > HOST_POOL_THREAD_CACHE_BYTES) {
+        int keep = cache->count[c] / 2;
+        void **tail = &cache->free_list[c];
+        for (int i = 0; i < keep; i++) {
+            tail = &host_pool_next(*tail);
+        }
+        spilled = *tail;
+        *tail = nullptr;
+        int n = cache->count[c] - keep;
+        cache->count[c] = keep;
+        cache->bytes_cached -= n * class_size;
+    }
+    host_pool_unlock(cache);
+
+    if (spilled) {
+        host_pool_spill(spilled, c);
+    }
+}
+
+WEAK int host_pool_release_unused(void *user_context) {
+    for (int i = 0; i < HOST_POOL_NUM_THREAD_CACHES; i++) {
+        HostPoolThreadCache *cache = &host_pool_thread_caches[i];
+        while (!host_pool_try_lock(cache)) {
+        }
+        for (int c = 0; c < HOST_POOL_NUM_CLASSES; c++) {
+            host_pool_free_list(cache->free_list[c]);
+            cache->free_list[c] = nullptr;
+            cache->count[c] = 0;
+        }
+        cache->bytes_cached = 0;
+        host_pool_unlock(cache);
+    }
+
+    ScopedMutexLock lock(&host_pool_arena.lock);
+    for (int c = 0; c < HOST_POOL_NUM_CLASSES; c++) {
+        host_pool_free_list(host_pool_arena.free_list[c]);
+        host_pool_arena.free_list[c] = nullptr;
+        host_pool_arena.count[c] = 0;
+    }
+    host_pool_arena.bytes_cached = 0;
+    return 0;
+}
+
+}  // namespace Internal
+}  // namespace Runtime
+}  // namespace Halide
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
 
 WEAK void *halide_default_malloc(void *user_context, size_t x) {
+    if (host_pool_is_enabled() && host_pool_class_for(x) != HOST_POOL_UNPOOLED) {
+        return host_pool_malloc(x);
+    }
+
     // Allocate enough space for aligning the pointer we return.
     const size_t alignment = halide_malloc_alignment();
-    void *orig = malloc(x + alignment);
+    void *orig = malloc(x + alignment + sizeof(HostBlockHeader));
     if (orig == nullptr) {
         // Will result in a failed assertion and a call to halide_error
         return nullptr;
     }
     // We want to store the original pointer prior to the pointer we return.
-    void *ptr = (void *)(((size_t)orig + alignment + sizeof(void *) - 1) & ~(alignment - 1));
-    ((void **)ptr)[-1] = orig;
+    void *ptr = (void *)(((size_t)orig + alignment + sizeof(HostBlockHeader) - 1) & ~(alignment - 1));
+    ((HostBlockHeader *)ptr)[-1].size_class = HOST_POOL_UNPOOLED;
+    ((HostBlockHeader *)ptr)[-1].orig = orig;
     return ptr;
 }
 
 WEAK void halide_default_free(void *user_context, void *ptr) {
-    free(((void **)ptr)[-1]);
+    HostBlockHeader *header = (HostBlockHeader *)ptr - 1;
+    // Blocks from the pool go back to it, unless pooling has been
+    // turned off since.
+    if (header->size_class != HOST_POOL_UNPOOLED && host_pool_enabled > 0) {
+        host_pool_free(ptr, header->size_class);
+    } else {
+        free(header->orig);
+    }
+}
+
+WEAK bool halide_set_host_allocation_pooling(bool enable) {
+    bool result = host_pool_is_enabled();
+    host_pool_set_enabled(enable);
+    if (!enable) {
+        host_pool_release_unused(nullptr);
+    }
+    return result;
+}
+
+WEAK int halide_release_unused_host_allocations(void *user_context) {
+    return host_pool_release_unused(user_context);
+}
+
+WEAK void halide_host_allocation_pool_get_stats(struct halide_host_allocation_pool_stats *stats) {
+    stats->hits = 0;
+    stats->misses = 0;
+    stats->bytes_cached = 0;
+    for (int i = 0; i < HOST_POOL_NUM_THREAD_CACHES; i++) {
+        HostPoolThreadCache *cache = &host_pool_thread_caches[i];
+        while (!host_pool_try_lock(cache)) {
+        }
+        stats->hits += cache->hits;
+        stats->bytes_cached += cache->bytes_cached;
+        host_pool_unlock(cache);
+    }
+    ScopedMutexLock lock(&host_pool_arena.lock);
+    stats->hits += host_pool_arena.hits;
+    stats->misses += host_pool_arena.misses;
+    stats->bytes_cached += host_pool_arena.bytes_cached;
+}
+
+namespace {
+WEAK __attribute__((destructor)) void halide_allocator_cleanup() {
+    // The cached blocks would otherwise leak when a JIT runtime is
+    // torn down.
+    host_pool_release_unused(nullptr);
 }
+}  // namespace
 }
 
 namespace Halide {
@@ -0,0 +1,90 @@
+#include "HalideRuntime.h"
+#include "printer.h"
+#include "runtime_internal.h"
+
+extern "C" {
+
+// off_t is a long on every platform this module is used on (64-bit
+// macOS, and Linux/Android without _FILE_OFFSET_BITS).
+extern void *mmap(void *addr, size_t length, int prot, int flags, int fd, long offset);
+extern int munmap(void *addr, size_t length);
+extern int ftruncate(int fd, long length);
+extern long lseek(int fd, long offset, int whence);
+extern int flock(int fd, int operation);
+
+}  // extern "C"
+
+namespace Halide {
+namespace Runtime {
+namespace Internal {
+
+// These values are the same on Linux and macOS.
+#define HALIDE_PROT_READ 1
+#define HALIDE_PROT_WRITE 2
+#define HALIDE_MAP_SHARED 1
+#define HALIDE_MAP_FAILED ((void *)-1)
+#define HALIDE_LOCK_SH 1
+#define HALIDE_LOCK_EX 2
+#define HALIDE_LOCK_UN 8
+#define HALIDE_SEEK_END 2
+
+}  // namespace Internal
+}  // namespace Runtime
+}  // namespace Halide
+
+using namespace Halide::Runtime::Internal;
+
+extern "C" {
+
+WEAK void *halide_map_shared_file(void *user_context, const char *path, size_t *size, void **file) {
+    // "a+" creates the file if needed without truncating it, which
+    // matters if another process has it mapped already.
+    void *f = fopen(path, "a+b");
+    if (f == nullptr) {
+        debug(user_context) << "Could not open shared file " << path << "\n";
+        return nullptr;
+    }
+    int fd = fileno(f);
+
+    // Size the file while holding its lock, so that racing processes
+    // agree on the result.
+    flock(fd, HALIDE_LOCK_EX);
+    long current_size = lseek(fd, 0, HALIDE_SEEK_END);
+    if (current_size >= 0 && (size_t)current_size < *size) {
+        if (ftruncate(fd, (long)*size) != 0) {
+            current_size = -1;
+        }
+    } else if (current_size > 0) {
+        *size = (size_t)current_size;
+    }
+    flock(fd, HALIDE_LOCK_UN);
+    if (current_size < 0) {
+        debug(user_context) << "Could not size shared file " << path << "\n";
+        fclose(f);
+        return nullptr;
+    }
+
+    void *addr = mmap(nullptr, *size, HALIDE_PROT_READ | HALIDE_PROT_WRITE, HALIDE_MAP_SHARED, fd, 0);
+    if (addr == HALIDE_MAP_FAILED) {
+        debug(user_context) << "Could not map shared file " << path << "\n";
+        fclose(f);
+        return nullptr;
+    }
+    *file = f;
+    return addr;
+}
+
+WEAK void halide_unmap_shared_file(void *user_context, void *addr, size_t size, void *file) {
+    munmap(addr, size);
+    fclose(file);
+}
+
+WEAK int halide_lock_shared_file(void *file, bool exclusive) {
+    return flock(fileno(file), exclusive ? HALIDE_LOCK_EX : HALIDE_LOCK_SH);
+}
+
+WEAK int halide_unlock_shared_file(void *file) {
+    return flock(fileno(file), HALIDE_LOCK_UN);
+}
+
+}  // extern "C"
@@ -9,7 +9,7 @@
 extern "C" {
 // Returns the address of the global halide_profiler state
 WEAK halide_profiler_state *halide_profiler_get_state() {
-    static halide_profiler_state s = {{{0}}, 1, 0, 0, 0, nullptr, nullptr, nullptr};
+    static halide_profiler_state s = {{{0}}, 1, 0, 0, 0, nullptr, nullptr, nullptr, nullptr};
     return &s;
 }
 }
@@ -47,6 +47,9 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     p->memory_peak = 0;
     p->memory_total = 0;
     p->num_allocs = 0;
+    for (int j = 0; j < halide_profiler_num_perf_counters; j++) {
+        p->perf_counters[j] = 0;
+    }
     p->active_threads_numerator = 0;
     p->active_threads_denominator = 0;
     p->funcs = (halide_profiler_func_stats *)malloc(num_funcs * sizeof(halide_profiler_func_stats));
@@ -61,6 +64,9 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
         p->funcs[i].memory_peak = 0;
         p->funcs[i].memory_total = 0;
         p->funcs[i].num_allocs = 0;
+        for (int j = 0; j < halide_profiler_num_perf_counters; j++) {
+            p->funcs[i].perf_counters[j] = 0;
+        }
         p->funcs[i].stack_peak = 0;
         p->funcs[i].active_threads_numerator = 0;
         p->funcs[i].active_threads_denominator = 0;
@@ -70,7 +76,8 @@ WEAK halide_profiler_pipeline_stats *find_or_create_pipeline(const char *pipelin
     return p;
 }
 
-WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
+// Returns the pipeline the func belongs to, or null.
+WEAK halide_profiler_pipeline_stats *bill_func(halide_profiler_state *s, int func_id, uint64_t time, int active_threads) {
     halide_profiler_pipeline_stats *p_prev = nullptr;
     for (halide_profiler_pipeline_stats *p = s->pipelines; p;
          p = (halide_profiler_pipeline_stats *)(p->next)) {
@@ -89,11 +96,232 @@ WEAK void bill_func(halide_profiler_state *s, int func_id, uint64_t time, int ac
             p->samples++;
             p->active_threads_numerator += active_threads;
             p->active_threads_denominator += 1;
-            return;
+            return p;
         }
         p_prev = p;
     }
     // Someone must have called reset_state while a kernel was running. Do nothing.
+    return nullptr;
+}
+
+// The timeline recorded for halide_profiler_export, if any. Samples
+// are only touched with the profiler state's lock held. Thread events
+// are claimed atomically by the threads doing the work, so
+// timeline_num_thread_events may run past timeline_capacity.
+struct profiler_timeline_sample {
+    uint64_t begin, end;
+    uint64_t memory;
+    int func_id;
+    int active_threads;
+};
+
+struct profiler_thread_event {
+    uint64_t time;
+    uintptr_t thread;
+    int func_id;
+    int active;
+};
+
+WEAK profiler_timeline_sample *timeline_samples = nullptr;
+WEAK profiler_thread_event *timeline_thread_events = nullptr;
+WEAK int timeline_capacity = 0;
+WEAK int timeline_num_samples = 0;
+WEAK int timeline_num_thread_events = 0;
+WEAK uint64_t timeline_dropped_samples = 0;
+
+WEAK void record_timeline_sample(uint64_t begin, uint64_t end, int func_id, int active_threads, uint64_t memory) {
+    if (!timeline_samples) {
+        return;
+    }
+    // Runs of identical samples are merged, so a long-running Func
+    // costs one entry.
+    if (timeline_num_samples > 0) {
+        profiler_timeline_sample *last = timeline_samples + timeline_num_samples - 1;
+        if (last->end == begin &&
+            last->func_id == func_id &&
+            last->active_threads == active_threads &&
+            last->memory == memory) {
+            last->end = end;
+            return;
+        }
+    }
+    if (timeline_num_samples == timeline_capacity) {
+        timeline_dropped_samples++;
+        return;
+    }
+    profiler_timeline_sample *sample = timeline_samples + timeline_num_samples++;
+    sample->begin = begin;
+    sample->end = end;
+    sample->memory = memory;
+    sample->func_id = func_id;
+    sample->active_threads = active_threads;
+}
+
+WEAK void record_thread_activity(halide_profiler_state *s, int active) {
+    if (timeline_num_thread_events >= timeline_capacity) {
+        return;
+    }
+    int i = __sync_fetch_and_add(&timeline_num_thread_events, 1);
+    if (i >= timeline_capacity) {
+        return;
+    }
+    profiler_thread_event *e = timeline_thread_events + i;
+    // Thread stacks are at least a megabyte apart, so the megabyte of
+    // stack we're running on identifies the thread.
+    e->thread = (uint32_t)stack_address_slot(32);
+    e->func_id = s->current_func;
+    e->active = active;
+    e->time = halide_current_time_ns(nullptr);
+}
+
+// Threads with hardware performance counters open, found by the
+// megabyte of stack they run on. A thread can show up on more than one
+// megabyte, so it is also checked by id before opening counters.
+// Entries are appended with perf_counters_lock held, and published by
+// bumping perf_num_threads. After that, only the sampling thread
+// touches them, until they are closed with the profiler lock held.
+struct profiler_perf_thread {
+    uintptr_t stack;
+    int id;
+    // -1 if this thread's counters are in another entry, or couldn't
+    // be opened.
+    int handle;
+    uint64_t last[halide_profiler_num_perf_counters];
+};
+
+#define MAX_PROFILER_PERF_THREADS 512
+WEAK profiler_perf_thread perf_threads[MAX_PROFILER_PERF_THREADS];
+WEAK int perf_num_threads = 0;
+WEAK halide_mutex perf_counters_lock;
+// -1 until the environment variable has been checked.
+WEAK int perf_counters_enabled = -1;
+WEAK bool perf_counters_unavailable = false;
+
+WEAK void perf_counters_add_thread() {
+    uintptr_t stack = (uint32_t)stack_address_slot(32);
+    int n = __atomic_load_n(&perf_num_threads, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        if (perf_threads[i].stack == stack) {
+            return;
+        }
+    }
+
+    ScopedMutexLock lock(&perf_counters_lock);
+    n = perf_num_threads;
+    for (int i = 0; i < n; i++) {
+        if (perf_threads[i].stack == stack) {
+            return;
+        }
+    }
+    if (n == MAX_PROFILER_PERF_THREADS) {
+        return;
+    }
+    profiler_perf_thread *t = perf_threads + n;
+    t->stack = stack;
+    t->id = halide_perf_counters_thread_id();
+    t->handle = -1;
+    bool seen = false;
+    for (int i = 0; i < n && t->id >= 0; i++) {
+        seen |= perf_threads[i].id == t->id;
+    }
+    if (!seen) {
+        t->handle = halide_perf_counters_open();
+    }
+    if (t->handle < 0 || halide_perf_counters_read(t->handle, t->last) != 0) {
+        for (int i = 0; i < halide_profiler_num_perf_counters; i++) {
+            t->last[i] = 0;
+        }
+    }
+    __atomic_store_n(&perf_num_threads, n + 1, __ATOMIC_RELEASE);
+}
+
+// Close the counters of every thread seen so far. Threads open new
+// ones the next time they run with counters enabled.
+WEAK void perf_counters_close_all() {
+    ScopedMutexLock lock(&perf_counters_lock);
+    for (int i = 0; i < perf_num_threads; i++) {
+        if (perf_threads[i].handle >= 0) {
+            halide_perf_counters_close(perf_threads[i].handle);
+        }
+    }
+    perf_num_threads = 0;
+}
+
+// Bills the change in the counters of all threads since the last
+// sample to the given func. Passing a null pipeline just drops it.
+WEAK void bill_perf_counters(halide_profiler_pipeline_stats *p, int func_id) {
+    uint64_t delta[halide_profiler_num_perf_counters] = {0};
+    int n = __atomic_load_n(&perf_num_threads, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        profiler_perf_thread *t = perf_threads + i;
+        uint64_t now[halide_profiler_num_perf_counters];
+        if (t->handle < 0 || halide_perf_counters_read(t->handle, now) != 0) {
+            continue;
+        }
+        for (int j = 0; j < halide_profiler_num_perf_counters; j++) {
+            // Scaling for multiplexing can make a counter appear to go
+            // backwards briefly.
+            if (now[j] > t->last[j]) {
+                delta[j] += now[j] - t->last[j];
+                t->last[j] = now[j];
+            }
+        }
+    }
+    if (!p) {
+        return;
+    }
+    halide_profiler_func_stats *f = p->funcs + func_id - p->first_func_id;
+    for (int j = 0; j < halide_profiler_num_perf_counters; j++) {
+        f->perf_counters[j] += delta[j];
+        p->perf_counters[j] += delta[j];
+    }
+}
+
+WEAK void profiler_thread_activity(halide_profiler_state *s, int active) {
+    if (active && perf_counters_enabled > 0) {
+        perf_counters_add_thread();
+    }
+    record_thread_activity(s, active);
+}
+
+// Threads only need to tell the profiler when they start and stop
+// working if something is listening.
+WEAK void update_thread_activity_hook(halide_profiler_state *s) {
+    bool wanted = timeline_thread_events || perf_counters_enabled > 0;
+    s->thread_activity = wanted ? profiler_thread_activity : nullptr;
+}
+
+WEAK int set_perf_counters_already_locked(halide_profiler_state *s, bool enable) {
+    const bool was_enabled = perf_counters_enabled > 0;
+    perf_counters_enabled = 0;
+    if (!enable && was_enabled) {
+        perf_counters_close_all();
+    }
+    if (enable) {
+        // Check that counters can be opened at all, so that a
+        // container without perf_event_open costs nothing further.
+        ScopedMutexLock lock(&perf_counters_lock);
+        int handle = halide_perf_counters_open();
+        if (handle >= 0) {
+            halide_perf_counters_close(handle);
+            perf_counters_enabled = 1;
+        }
+        perf_counters_unavailable = handle < 0;
+    }
+    update_thread_activity_hook(s);
+    return (enable && perf_counters_enabled == 0) ? -1 : 0;
+}
+
+WEAK void free_timeline(halide_profiler_state *s) {
+    free(timeline_samples);
+    free(timeline_thread_events);
+    timeline_samples = nullptr;
+    timeline_thread_events = nullptr;
+    timeline_capacity = 0;
+    timeline_num_samples = 0;
+    timeline_num_thread_events = 0;
+    timeline_dropped_samples = 0;
+    update_thread_activity_hook(s);
 }
 
 WEAK void sampling_profiler_thread(void *) {
@@ -122,7 +350,13 @@ WEAK void sampling_profiler_thread(void *) {
             } else if (func >= 0) {
                 // Assume all time since I was last awake is due to
                 // the currently running func.
-                bill_func(s, func, t_now - t, active_threads);
+                halide_profiler_pipeline_stats *p = bill_func(s, func, t_now - t, active_threads);
+                record_timeline_sample(t, t_now, func, active_threads, p ? p->memory_current : 0);
+                if (perf_counters_enabled > 0) {
+                    bill_perf_counters(p, func);
+                }
+            } else if (perf_counters_enabled > 0) {
+                bill_perf_counters(nullptr, func);
             }
             t = t_now;
 
@@ -137,6 +371,505 @@ WEAK void sampling_profiler_thread(void *) {
     halide_mutex_unlock(&s->lock);
 }
 
+// Buffered output for halide_profiler_export.
+class ProfileWriter {
+    void *file;
+    char buf[4096];
+    size_t size;
+    bool ok;
+
+public:
+    ProfileWriter(void *file)
+        : file(file), size(0), ok(true) {
+    }
+
+    void flush() {
+        if (size && fwrite(buf, 1, size, file) != size) {
+            ok = false;
+        }
+        size = 0;
+    }
+
+    // Flushes, and returns whether everything was written.
+    bool finish() {
+        flush();
+        return ok;
+    }
+
+    void write(const void *data, size_t n) {
+        const char *src = (const char *)data;
+        while (n) {
+            if (size == sizeof(buf)) {
+                flush();
+            }
+            size_t chunk = min(n, sizeof(buf) - size);
+            memcpy(buf + size, src, chunk);
+            size += chunk;
+            src += chunk;
+            n -= chunk;
+        }
+    }
+
+    ProfileWriter &operator<<(const char *str) {
+        write(str, strlen(str));
+        return *this;
+    }
+
+    ProfileWriter &operator<<(uint64_t x) {
+        char tmp[24];
+        char *end = tmp + sizeof(tmp), *p = end;
+        do {
+            *--p = '0' + (char)(x % 10);
+            x /= 10;
+        } while (x);
+        write(p, end - p);
+        return *this;
+    }
+
+    // Writes a / b to two decimal places.
+    void ratio(uint64_t a, uint64_t b) {
+        uint64_t hundredths = b ? (a * 100 + b / 2) / b : 0;
+        *this << hundredths / 100 << ".";
+        if (hundredths % 100 < 10) {
+            *this << "0";
+        }
+        *this << hundredths % 100;
+    }
+
+    // Writes a time in nanoseconds as microseconds, the unit of Chrome
+    // trace timestamps.
+    void micros(uint64_t ns) {
+        *this << ns / 1000 << ".";
+        uint64_t frac = ns % 1000;
+        if (frac < 100) {
+            *this << "0";
+        }
+        if (frac < 10) {
+            *this << "0";
+        }
+        *this << frac;
+    }
+
+    void json_string(const char *str) {
+        *this << "\"";
+        for (const char *c = str; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                write("\\", 1);
+                write(c, 1);
+            } else if ((unsigned char)*c < 0x20) {
+                const char *hex = "0123456789abcdef";
+                char esc[6] = {'\\', 'u', '0', '0', hex[(*c >> 4) & 0xf], hex[*c & 0xf]};
+                write(esc, sizeof(esc));
+            } else {
+                write(c, 1);
+            }
+        }
+        *this << "\"";
+    }
+
+    static int varint_size(uint64_t x) {
+        int n = 1;
+        while (x >= 0x80) {
+            x >>= 7;
+            n++;
+        }
+        return n;
+    }
+
+    void varint(uint64_t x) {
+        uint8_t bytes[10];
+        int n = 0;
+        while (x >= 0x80) {
+            bytes[n++] = (uint8_t)(x | 0x80);
+            x >>= 7;
+        }
+        bytes[n++] = (uint8_t)x;
+        write(bytes, n);
+    }
+
+    // A protobuf field key. Wire type 0 is a varint and 2 is
+    // length-delimited.
+    void key(int field, int wire_type) {
+        varint((field << 3) | wire_type);
+    }
+};
+
+// What the recorded thread events say about each thread: how long it
+// spent working on each func.
+struct ProfileThreadSummary {
+    static const int max_threads = 256;
+    uintptr_t threads[max_threads];
+    int num_threads;
+    int num_events;
+    int num_funcs;
+    // Nanoseconds of work, indexed by func id * num_threads + thread.
+    uint64_t *busy;
+
+    int thread_index(uintptr_t thread) {
+        for (int i = 0; i < num_threads; i++) {
+            if (threads[i] == thread) {
+                return i;
+            }
+        }
+        if (num_threads == max_threads) {
+            // Lump any further threads in with the last one.
+            return num_threads - 1;
+        }
+        threads[num_threads] = thread;
+        return num_threads++;
+    }
+
+    bool init(halide_profiler_state *s) {
+        num_threads = 0;
+        num_events = min(timeline_num_thread_events, timeline_capacity);
+        num_funcs = s->first_free_id;
+        busy = nullptr;
+        for (int i = 0; i < num_events; i++) {
+            thread_index(timeline_thread_events[i].thread);
+        }
+        if (num_threads == 0 || num_funcs == 0) {
+            return true;
+        }
+        size_t busy_size = (size_t)num_threads * num_funcs * sizeof(uint64_t);
+        busy = (uint64_t *)malloc(busy_size);
+        if (!busy) {
+            return false;
+        }
+        memset(busy, 0, busy_size);
+        uint64_t begin[max_threads];
+        int func_id[max_threads];
+        bool working[max_threads] = {false};
+        for (int i = 0; i < num_events; i++) {
+            const profiler_thread_event &e = timeline_thread_events[i];
+            int t = thread_index(e.thread);
+            if (e.active) {
+                begin[t] = e.time;
+                func_id[t] = e.func_id;
+                working[t] = true;
+            } else if (working[t]) {
+                if (func_id[t] >= 0 && func_id[t] < num_funcs) {
+                    busy[func_id[t] * num_threads + t] += e.time - begin[t];
+                }
+                working[t] = false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t busy_time(int func_id, int thread) const {
+        return busy ? busy[func_id * num_threads + thread] : 0;
+    }
+
+    ~ProfileThreadSummary() {
+        free(busy);
+    }
+};
+
+WEAK halide_profiler_pipeline_stats *find_pipeline(halide_profiler_state *s, int func_id) {
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (func_id >= p->first_func_id && func_id < p->first_func_id + p->num_funcs) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+WEAK void write_perf_counters_json(ProfileWriter &w, const uint64_t *perf) {
+    w << ",\"cycles\":" << perf[halide_profiler_perf_cycles]
+      << ",\"instructions\":" << perf[halide_profiler_perf_instructions]
+      << ",\"cache_misses\":" << perf[halide_profiler_perf_cache_misses]
+      << ",\"branch_misses\":" << perf[halide_profiler_perf_branch_misses];
+}
+
+WEAK void write_chrome_trace(ProfileWriter &w, halide_profiler_state *s, const ProfileThreadSummary &threads) {
+    w << "{\"traceEvents\":[\n"
+      << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":0,\"args\":{\"name\":\"Halide\"}},\n"
+      << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"sampled Funcs\"}}";
+    for (int t = 0; t < threads.num_threads; t++) {
+        w << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":" << (uint64_t)(t + 1)
+          << ",\"args\":{\"name\":\"thread " << (uint64_t)(t + 1) << "\"}}";
+    }
+
+    // The sampled Funcs go on track zero, with counters for the active
+    // threads and heap usage whenever they change.
+    int last_active_threads = -1;
+    uint64_t last_memory = 0;
+    halide_profiler_pipeline_stats *last_p = nullptr;
+    for (int i = 0; i < timeline_num_samples; i++) {
+        const profiler_timeline_sample &sample = timeline_samples[i];
+        halide_profiler_pipeline_stats *p = find_pipeline(s, sample.func_id);
+        if (!p) {
+            continue;
+        }
+        w << ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":0,\"name\":";
+        w.json_string(p->funcs[sample.func_id - p->first_func_id].name);
+        w << ",\"cat\":";
+        w.json_string(p->name);
+        w << ",\"ts\":";
+        w.micros(sample.begin);
+        w << ",\"dur\":";
+        w.micros(sample.end - sample.begin);
+        w << "}";
+        if (sample.active_threads != last_active_threads) {
+            w << ",\n{\"ph\":\"C\",\"pid\":0,\"name\":\"active threads\",\"ts\":";
+            w.micros(sample.begin);
+            w << ",\"args\":{\"threads\":" << (uint64_t)sample.active_threads << "}}";
+            last_active_threads = sample.active_threads;
+        }
+        if (p != last_p || sample.memory != last_memory) {
+            w << ",\n{\"ph\":\"C\",\"pid\":0,\"name\":\"heap bytes\",\"ts\":";
+            w.micros(sample.begin);
+            w << ",\"args\":{";
+            w.json_string(p->name);
+            w << ":" << sample.memory << "}}";
+            last_p = p;
+            last_memory = sample.memory;
+        }
+    }
+
+    // Each thread gets a track showing when it was working, labelled
+    // with the Func that was running when it started.
+    uint64_t begin[ProfileThreadSummary::max_threads];
+    int func_id[ProfileThreadSummary::max_threads];
+    bool working[ProfileThreadSummary::max_threads] = {false};
+    for (int i = 0; i < threads.num_events; i++) {
+        const profiler_thread_event &e = timeline_thread_events[i];
+        int t = 0;
+        while (t < threads.num_threads - 1 && threads.threads[t] != e.thread) {
+            t++;
+        }
+        if (e.active) {
+            begin[t] = e.time;
+            func_id[t] = e.func_id;
+            working[t] = true;
+            continue;
+        } else if (!working[t]) {
+            continue;
+        }
+        working[t] = false;
+        halide_profiler_pipeline_stats *p = find_pipeline(s, func_id[t]);
+        w << ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":" << (uint64_t)(t + 1) << ",\"name\":";
+        if (p) {
+            w.json_string(p->funcs[func_id[t] - p->first_func_id].name);
+            w << ",\"cat\":";
+            w.json_string(p->name);
+        } else {
+            w << "\"working\"";
+        }
+        w << ",\"ts\":";
+        w.micros(begin[t]);
+        w << ",\"dur\":";
+        w.micros(e.time - begin[t]);
+        w << "}";
+    }
+    w << "\n],\n\"displayTimeUnit\":\"ms\",\n";
+
+    // Then the same totals as the text report, plus the time each
+    // thread spent on each Func and how uneven that was: the busiest
+    // thread's time over the mean of all threads that did any work.
+    w << "\"halide\":{\"dropped_samples\":" << timeline_dropped_samples
+      << ",\"dropped_thread_events\":"
+      << (uint64_t)(timeline_num_thread_events - threads.num_events)
+      << ",\"pipelines\":[";
+    bool first_p = true;
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (!p->runs) {
+            continue;
+        }
+        w << (first_p ? "\n" : ",\n") << "{\"name\":";
+        first_p = false;
+        w.json_string(p->name);
+        w << ",\"runs\":" << (uint64_t)p->runs
+          << ",\"time_ns\":" << p->time
+          << ",\"samples\":" << (uint64_t)p->samples
+          << ",\"average_threads\":";
+        w.ratio(p->active_threads_numerator, p->active_threads_denominator);
+        w << ",\"heap_allocs\":" << (uint64_t)p->num_allocs
+          << ",\"heap_peak\":" << p->memory_peak
+          << ",\"heap_total\":" << p->memory_total;
+        write_perf_counters_json(w, p->perf_counters);
+        w << ",\"funcs\":[";
+        for (int i = 0; i < p->num_funcs; i++) {
+            halide_profiler_func_stats *fs = p->funcs + i;
+            w << (i ? ",\n " : "\n ") << "{\"name\":";
+            w.json_string(fs->name);
+            w << ",\"time_ns\":" << fs->time
+              << ",\"average_threads\":";
+            w.ratio(fs->active_threads_numerator, fs->active_threads_denominator);
+            w << ",\"heap_allocs\":" << (uint64_t)fs->num_allocs
+              << ",\"heap_peak\":" << fs->memory_peak
+              << ",\"heap_total\":" << fs->memory_total
+              << ",\"stack_peak\":" << fs->stack_peak;
+            write_perf_counters_json(w, fs->perf_counters);
+            w << ",\"thread_busy_ns\":[";
+            uint64_t busy_max = 0, busy_total = 0, busy_threads = 0;
+            for (int t = 0; t < threads.num_threads; t++) {
+                uint64_t busy = threads.busy_time(p->first_func_id + i, t);
+                w << (t ? "," : "") << busy;
+                busy_max = max(busy_max, busy);
+                busy_total += busy;
+                busy_threads += busy ? 1 : 0;
+            }
+            w << "],\"imbalance\":";
+            w.ratio(busy_max * busy_threads, busy_total);
+            w << "}";
+        }
+        w << "]}";
+    }
+    w << "]}}\n";
+}
+
+WEAK void write_pprof_value_type(ProfileWriter &w, int type, int unit) {
+    w.key(1, 2);
+    w.varint(2 + ProfileWriter::varint_size(type) + ProfileWriter::varint_size(unit));
+    w.key(1, 0);
+    w.varint(type);
+    w.key(2, 0);
+    w.varint(unit);
+}
+
+// Writes a function and a location for it with the same id.
+WEAK void write_pprof_function(ProfileWriter &w, int id, int name) {
+    w.key(5, 2);
+    w.varint(2 + ProfileWriter::varint_size(id) + ProfileWriter::varint_size(name));
+    w.key(1, 0);
+    w.varint(id);
+    w.key(2, 0);
+    w.varint(name);
+
+    int line_size = 1 + ProfileWriter::varint_size(id);
+    w.key(4, 2);
+    w.varint(1 + ProfileWriter::varint_size(id) + 1 + ProfileWriter::varint_size(line_size) + line_size);
+    w.key(1, 0);
+    w.varint(id);
+    w.key(4, 2);
+    w.varint(line_size);
+    w.key(1, 0);
+    w.varint(id);
+}
+
+WEAK void write_pprof_string(ProfileWriter &w, const char *str) {
+    size_t len = strlen(str);
+    w.key(6, 2);
+    w.varint(len);
+    w.write(str, len);
+}
+
+const int pprof_num_values = 6 + halide_profiler_num_perf_counters;
+
+// Writes a sample with the stack leaf_location, root_location, and a
+// "thread" label if thread is positive. Threads are numbered from one,
+// as in the Chrome trace, because pprof ignores labels that are zero.
+WEAK void write_pprof_sample(ProfileWriter &w, int leaf_location, int root_location,
+                             const uint64_t *values, int thread_key, int thread) {
+    int locations_size = ProfileWriter::varint_size(leaf_location) + ProfileWriter::varint_size(root_location);
+    int values_size = 0;
+    for (int i = 0; i < pprof_num_values; i++) {
+        values_size += ProfileWriter::varint_size(values[i]);
+    }
+    int label_size = 2 + ProfileWriter::varint_size(thread_key) + ProfileWriter::varint_size(thread);
+    int size = 1 + ProfileWriter::varint_size(locations_size) + locations_size +
+               1 + ProfileWriter::varint_size(values_size) + values_size;
+    if (thread > 0) {
+        size += 1 + ProfileWriter::varint_size(label_size) + label_size;
+    }
+    w.key(2, 2);
+    w.varint(size);
+    w.key(1, 2);
+    w.varint(locations_size);
+    w.varint(leaf_location);
+    w.varint(root_location);
+    w.key(2, 2);
+    w.varint(values_size);
+    for (int i = 0; i < pprof_num_values; i++) {
+        w.varint(values[i]);
+    }
+    if (thread > 0) {
+        w.key(3, 2);
+        w.varint(label_size);
+        w.key(1, 0);
+        w.varint(thread_key);
+        w.key(3, 0);
+        w.varint(thread);
+    }
+}
+
+// Writes a pprof profile.proto message. Each Func is a location under
+// its pipeline, with a sample for its totals and one for each thread
+// that worked on it. Repeated fields may be interleaved, so strings are
+// added to the string table as they come up.
+WEAK void write_pprof(ProfileWriter &w, halide_profiler_state *s, const ProfileThreadSummary &threads) {
+    static const char *const fixed_strings[] = {
+        "", "time", "nanoseconds", "heap_allocs", "count", "heap_total", "bytes",
+        "heap_peak", "stack_peak", "thread_busy", "thread", "cycles", "instructions",
+        "cache_misses", "branch_misses"};
+    enum { time = 1,
+           nanoseconds,
+           heap_allocs,
+           count,
+           heap_total,
+           bytes,
+           heap_peak,
+           stack_peak,
+           thread_busy,
+           thread,
+           cycles,
+           instructions,
+           cache_misses,
+           branch_misses,
+           num_fixed_strings };
+    for (int i = 0; i < num_fixed_strings; i++) {
+        write_pprof_string(w, fixed_strings[i]);
+    }
+    // In the same order as the values in write_pprof_sample.
+    write_pprof_value_type(w, time, nanoseconds);
+    write_pprof_value_type(w, heap_allocs, count);
+    write_pprof_value_type(w, heap_total, bytes);
+    write_pprof_value_type(w, heap_peak, bytes);
+    write_pprof_value_type(w, stack_peak, bytes);
+    write_pprof_value_type(w, thread_busy, nanoseconds);
+    write_pprof_value_type(w, cycles, count);
+    write_pprof_value_type(w, instructions, count);
+    write_pprof_value_type(w, cache_misses, count);
+    write_pprof_value_type(w, branch_misses, count);
+    w.key(14, 0);
+    w.varint(time);
+
+    int next_string = num_fixed_strings, next_id = 1;
+    for (halide_profiler_pipeline_stats *p = s->pipelines; p;
+         p = (halide_profiler_pipeline_stats *)(p->next)) {
+        if (!p->runs) {
+            continue;
+        }
+        int p_id = next_id++;
+        write_pprof_string(w, p->name);
+        write_pprof_function(w, p_id, next_string++);
+        for (int i = 0; i < p->num_funcs; i++) {
+            halide_profiler_func_stats *fs = p->funcs + i;
+            int f_id = next_id++;
+            write_pprof_string(w, fs->name);
+            write_pprof_function(w, f_id, next_string++);
+            uint64_t values[pprof_num_values] = {fs->time, (uint64_t)fs->num_allocs, fs->memory_total,
+                                                 fs->memory_peak, fs->stack_peak, 0};
+            for (int j = 0; j < halide_profiler_num_perf_counters; j++) {
+                values[6 + j] = fs->perf_counters[j];
+            }
+            if (values[0] || values[1] || values[4]) {
+                write_pprof_sample(w, f_id, p_id, values, thread, 0);
+            }
+            for (int t = 0; t < threads.num_threads; t++) {
+                uint64_t busy = threads.busy_time(p->first_func_id + i, t);
+                if (busy) {
+                    uint64_t thread_values[pprof_num_values] = {0, 0, 0, 0, 0, busy};
+                    write_pprof_sample(w, f_id, p_id, thread_values, thread, t + 1);
+                }
+            }
+        }
+    }
+}
+
 }  // namespace Internal
 }  // namespace Runtime
 }  // namespace Halide
@@ -189,6 +922,11 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
         s->sampling_thread = halide_spawn_thread(sampling_profiler_thread, nullptr);
     }
 
+    if (perf_counters_enabled < 0) {
+        const char *str = getenv("HL_PROFILER_PERF_COUNTERS");
+        set_perf_counters_already_locked(s, str && atoi(str) != 0);
+    }
+
     halide_profiler_pipeline_stats *p =
         find_or_create_pipeline(pipeline_name, num_funcs, func_names);
     if (!p) {
@@ -314,6 +1052,20 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
         }
         sstr << " heap allocations: " << p->num_allocs
              << "  peak heap usage: " << p->memory_peak << " bytes\n";
+        const uint64_t *perf = p->perf_counters;
+        bool print_perf = perf[halide_profiler_perf_cycles] || perf[halide_profiler_perf_instructions];
+        if (print_perf) {
+            // Each cache miss moves a 64-byte line.
+            float bandwidth = perf[halide_profiler_perf_cache_misses] * 64 * 1000.0f / (p->time + 1);
+            float ipc = perf[halide_profiler_perf_instructions] / (perf[halide_profiler_perf_cycles] + 1e-10f);
+            sstr << " cycles: " << perf[halide_profiler_perf_cycles]
+                 << "  instructions: " << perf[halide_profiler_perf_instructions]
+                 << "  IPC: " << ipc;
+            sstr.erase(4);
+            sstr << "\n cache misses: " << perf[halide_profiler_perf_cache_misses]
+                 << "  branch misses: " << perf[halide_profiler_perf_branch_misses]
+                 << "  estimated memory bandwidth: " << (uint64_t)bandwidth << " MB/s\n";
+        }
         halide_print(user_context, sstr.str());
 
         bool print_f_states = p->time || p->memory_total;
@@ -396,12 +1148,36 @@ WEAK void halide_profiler_report_unlocked(void *user_context, halide_profiler_st
                 if (fs->stack_peak > 0) {
                     sstr << " stack: " << fs->stack_peak;
                 }
+                if (print_perf && fs->perf_counters[halide_profiler_perf_cycles]) {
+                    const uint64_t *fperf = fs->perf_counters;
+                    float ipc = fperf[halide_profiler_perf_instructions] / (fperf[halide_profiler_perf_cycles] + 1e-10f);
+                    sstr << " IPC: " << ipc;
+                    sstr.erase(4);
+                    sstr << " cache misses: " << fperf[halide_profiler_perf_cache_misses]
+                         << " branch misses: " << fperf[halide_profiler_perf_branch_misses];
+                }
                 sstr << "\n";
 
                 halide_print(user_context, sstr.str());
             }
         }
     }
+
+    // The host allocation pool is shared by all pipelines, so it gets
+    // a single line at the end.
+    halide_host_allocation_pool_stats pool_stats;
+    halide_host_allocation_pool_get_stats(&pool_stats);
+    if (pool_stats.hits || pool_stats.misses) {
+        sstr.clear();
+        sstr << "host allocation pool: hits: " << pool_stats.hits
+             << "  misses: " << pool_stats.misses
+             << "  cached: " << pool_stats.bytes_cached << " bytes\n";
+        halide_print(user_context, sstr.str());
+    }
+
+    if (perf_counters_unavailable) {
+        halide_print(user_context, "hardware performance counters: unavailable (perf_event_open failed)\n");
+    }
 }
 
 WEAK void halide_profiler_report(void *user_context) {
@@ -410,6 +1186,65 @@ WEAK void halide_profiler_report(void *user_context) {
     halide_profiler_report_unlocked(user_context, s);
 }
 
+WEAK int halide_profiler_set_perf_counters(void *user_context, bool enable) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    return set_perf_counters_already_locked(s, enable);
+}
+
+WEAK int halide_profiler_record_timeline(void *user_context, int max_events) {
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+    free_timeline(s);
+    if (max_events <= 0) {
+        return 0;
+    }
+    timeline_samples = (profiler_timeline_sample *)malloc(max_events * sizeof(profiler_timeline_sample));
+    timeline_thread_events = (profiler_thread_event *)malloc(max_events * sizeof(profiler_thread_event));
+    if (!timeline_samples || !timeline_thread_events) {
+        free_timeline(s);
+        return halide_error_out_of_memory(user_context);
+    }
+    timeline_capacity = max_events;
+    update_thread_activity_hook(s);
+    return 0;
+}
+
+WEAK int halide_profiler_export(void *user_context, const char *filename,
+                                halide_profiler_export_format_t format) {
+    if (format != halide_profiler_export_chrome_trace &&
+        format != halide_profiler_export_pprof) {
+        error(user_context) << "Unknown profiler export format " << (int)format << "\n";
+        return halide_error_code_generic_error;
+    }
+
+    halide_profiler_state *s = halide_profiler_get_state();
+    ScopedMutexLock lock(&s->lock);
+
+    ProfileThreadSummary threads;
+    if (!threads.init(s)) {
+        return halide_error_out_of_memory(user_context);
+    }
+
+    void *file = fopen(filename, "wb");
+    if (!file) {
+        error(user_context) << "Could not open " << filename << " to write the profile\n";
+        return halide_error_code_generic_error;
+    }
+    ProfileWriter w(file);
+    if (format == halide_profiler_export_chrome_trace) {
+        write_chrome_trace(w, s, threads);
+    } else {
+        write_pprof(w, s, threads);
+    }
+    bool ok = w.finish();
+    if (fclose(file) != 0 || !ok) {
+        error(user_context) << "Could not write the profile to " << filename << "\n";
+        return halide_error_code_generic_error;
+    }
+    return 0;
+}
+
 WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
     while (s->pipelines) {
         halide_profiler_pipeline_stats *p = s->pipelines;
@@ -418,6 +1253,10 @@ WEAK void halide_profiler_reset_unlocked(halide_profiler_state *s) {
         free(p);
     }
     s->first_free_id = 0;
+    // The timeline refers to funcs by id, so it goes too.
+    timeline_num_samples = 0;
+    timeline_num_thread_events = 0;
+    timeline_dropped_samples = 0;
 }
 
 WEAK void halide_profiler_reset() {
@@ -450,6 +1289,8 @@ halide_profiler_shutdown() {
     halide_profiler_report_unlocked(nullptr, s);
 
     halide_profiler_reset_unlocked(s);
+    free_timeline(s);
+    perf_counters_close_all();
 }
 
 namespace {
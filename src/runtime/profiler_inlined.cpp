@@ -21,6 +21,9 @@ WEAK_INLINE int halide_profiler_incr_active_threads(halide_profiler_state *state
     int ret = __sync_fetch_and_add(ptr, 1);
     asm volatile ("":::);
     // clang-format on
+    if (state->thread_activity) {
+        state->thread_activity(state, 1);
+    }
     return ret;
 }
 
@@ -31,6 +34,9 @@ WEAK_INLINE int halide_profiler_decr_active_threads(halide_profiler_state *state
     int ret = __sync_fetch_and_sub(ptr, 1);
     asm volatile ("":::);
     // clang-format on
+    if (state->thread_activity) {
+        state->thread_activity(state, 0);
+    }
     return ret;
 }
 }
@@ -135,4 +135,7 @@ struct thread_parker {
 
 #include "synchronization_common.h"
 
+// The Hexagon runtime has no clock module.
+#define THREAD_POOL_HAS_CLOCK 0
+
 #include "thread_pool_common.h"
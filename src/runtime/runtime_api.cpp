@@ -47,6 +47,7 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_device_release,
     (void *)&halide_device_sync,
     (void *)&halide_do_par_for,
+    (void *)&halide_do_par_for_with_min_grain,
     (void *)&halide_do_parallel_tasks,
     (void *)&halide_do_task,
     (void *)&halide_do_loop_task,
@@ -103,6 +104,7 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_hexagon_set_performance_mode,
     (void *)&halide_hexagon_set_thread_priority,
     (void *)&halide_hexagon_wrap_device_handle,
+    (void *)&halide_host_allocation_pool_get_stats,
     (void *)&halide_int64_to_string,
     (void *)&halide_join_thread,
     (void *)&halide_load_library,
@@ -112,6 +114,7 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_memoization_cache_evict,
     (void *)&halide_memoization_cache_lookup,
     (void *)&halide_memoization_cache_release,
+    (void *)&halide_memoization_cache_set_persistent_file,
     (void *)&halide_memoization_cache_set_size,
     (void *)&halide_memoization_cache_store,
     (void *)&halide_metal_acquire_context,
@@ -159,18 +162,22 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_openglcompute_run,
     (void *)&halide_pointer_to_string,
     (void *)&halide_print,
+    (void *)&halide_profiler_export,
     (void *)&halide_profiler_get_pipeline_state,
     (void *)&halide_profiler_get_state,
     (void *)&halide_profiler_memory_allocate,
     (void *)&halide_profiler_memory_free,
     (void *)&halide_profiler_pipeline_start,
+    (void *)&halide_profiler_record_timeline,
     (void *)&halide_profiler_report,
     (void *)&halide_profiler_reset,
+    (void *)&halide_profiler_set_perf_counters,
     (void *)&halide_profiler_stack_peak_update,
     (void *)&halide_qurt_hvx_lock,
     (void *)&halide_qurt_hvx_unlock,
     (void *)&halide_qurt_hvx_unlock_as_destructor,
     (void *)&halide_release_jit_module,
+    (void *)&halide_release_unused_host_allocations,
     (void *)&halide_semaphore_init,
     (void *)&halide_semaphore_release,
     (void *)&halide_semaphore_try_acquire,
@@ -187,8 +194,14 @@ extern "C" __attribute__((used)) void *halide_runtime_api_functions[] = {
     (void *)&halide_set_custom_trace,
     (void *)&halide_set_error_handler,
     (void *)&halide_set_gpu_device,
+    (void *)&halide_set_host_allocation_pooling,
     (void *)&halide_set_num_threads,
+    (void *)&halide_set_par_for_chunking,
+    (void *)&halide_set_semaphore_parking,
+    (void *)&halide_set_thread_affinity,
+    (void *)&halide_set_trace_compact,
     (void *)&halide_set_trace_file,
+    (void *)&halide_set_work_stealing,
     (void *)&halide_shutdown_thread_pool,
     (void *)&halide_shutdown_trace,
     (void *)&halide_sleep_ms,
@@ -158,6 +158,39 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
                                         const uint64_t *func_names);
 WEAK int halide_host_cpu_count();
 
+// Describe the NUMA topology of the host. Sets cpu_nodes[i] to the NUMA
+// node of cpu i (or -1) for the first max_cpus cpus, and returns the
+// number of cpus described, or zero if the topology is unknown.
+WEAK int halide_host_cpu_numa_nodes(int *cpu_nodes, int max_cpus);
+// Restrict the calling thread to run on the given cpu. Returns zero on success.
+WEAK int halide_pin_current_thread(int cpu);
+// The cpu the calling thread is running on, or -1 if unknown.
+WEAK int halide_current_cpu();
+
+// Map a file read/write and shared with other processes, creating it if
+// it doesn't exist and growing it to at least *size bytes. Sets *size to
+// the size of the mapping and *file to a handle for the calls below.
+// Returns nullptr on failure.
+WEAK void *halide_map_shared_file(void *user_context, const char *path, size_t *size, void **file);
+WEAK void halide_unmap_shared_file(void *user_context, void *addr, size_t size, void *file);
+// Take or drop an advisory lock on a shared file, to exclude other
+// processes. Returns zero on success.
+WEAK int halide_lock_shared_file(void *file, bool exclusive);
+WEAK int halide_unlock_shared_file(void *file);
+
+// Open the profiler's hardware performance counters for the calling
+// thread. Returns a handle, or -1 if they aren't available. Callers
+// must serialize calls to open and close.
+WEAK int halide_perf_counters_open();
+// Read the counters behind a handle into values, which has
+// halide_profiler_num_perf_counters entries, scaled up for any time they
+// were not running. Counters that aren't supported read as zero.
+// Returns zero on success.
+WEAK int halide_perf_counters_read(int handle, uint64_t *values);
+WEAK void halide_perf_counters_close(int handle);
+// A system-wide id for the calling thread, or -1 if unknown.
+WEAK int halide_perf_counters_thread_id();
+
 WEAK int halide_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
 WEAK int halide_device_and_host_free(void *user_context, struct halide_buffer_t *buf);
@@ -215,6 +248,18 @@ ALWAYS_INLINE T reinterpret(const U &x) {
     memcpy(&ret, &x, min(sizeof(T), sizeof(U)));
     return ret;
 }
+
+// Picks one of (1 << bits) slots for the calling thread by hashing
+// its stack address, for per-thread state without thread-local
+// storage. Thread stacks are at least a megabyte apart on all the
+// platforms we care about, so threads rarely share a slot, but they
+// can, so slots still need a lock. With 32 bits, the hash is a
+// bijection, so the slot identifies the megabyte of stack exactly.
+ALWAYS_INLINE int stack_address_slot(int bits) {
+    int local;
+    uint32_t h = (uint32_t)((uintptr_t)&local >> 20) * 0x9E3779B1u;
+    return (int)(h >> (32 - bits));
+}
 }  // namespace
 
 // A namespace for runtime modules to store their internal state
@@ -106,6 +106,16 @@ ALWAYS_INLINE bool cas_strong_sequentially_consistent_helper(T *addr, T *expecte
     return oldval == gotval;
 }
 
+template<typename T>
+ALWAYS_INLINE T atomic_fetch_add_sequentially_consistent(T *addr, T val) {
+    return __sync_fetch_and_add(addr, val);
+}
+
+template<typename T>
+ALWAYS_INLINE bool atomic_cas_strong_sequentially_consistent(T *addr, T *expected, T *desired) {
+    return cas_strong_sequentially_consistent_helper(addr, expected, desired);
+}
+
 ALWAYS_INLINE bool atomic_cas_strong_release_relaxed(uintptr_t *addr, uintptr_t *expected, uintptr_t *desired) {
     return cas_strong_sequentially_consistent_helper(addr, expected, desired);
 }
@@ -156,6 +166,20 @@ ALWAYS_INLINE void atomic_store_release(T *addr, T *val) {
     __sync_synchronize();
 }
 
+template<typename T>
+ALWAYS_INLINE void atomic_load_sequentially_consistent(T *addr, T *val) {
+    __sync_synchronize();
+    *val = *addr;
+    __sync_synchronize();
+}
+
+template<typename T>
+ALWAYS_INLINE void atomic_store_sequentially_consistent(T *addr, T *val) {
+    __sync_synchronize();
+    *addr = *val;
+    __sync_synchronize();
+}
+
 ALWAYS_INLINE void atomic_thread_fence_acquire() {
     __sync_synchronize();
 }
@@ -171,6 +195,16 @@ ALWAYS_INLINE T atomic_fetch_add_acquire_release(T *addr, T val) {
     return __atomic_fetch_add(addr, val, __ATOMIC_ACQ_REL);
 }
 
+template<typename T>
+ALWAYS_INLINE T atomic_fetch_add_sequentially_consistent(T *addr, T val) {
+    return __atomic_fetch_add(addr, val, __ATOMIC_SEQ_CST);
+}
+
+template<typename T>
+ALWAYS_INLINE bool atomic_cas_strong_sequentially_consistent(T *addr, T *expected, T *desired) {
+    return __atomic_compare_exchange(addr, expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
 ALWAYS_INLINE bool atomic_cas_strong_release_relaxed(uintptr_t *addr, uintptr_t *expected, uintptr_t *desired) {
     return __atomic_compare_exchange(addr, expected, desired, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
 }
@@ -219,6 +253,16 @@ ALWAYS_INLINE void atomic_store_release(T *addr, T *val) {
     __atomic_store(addr, val, __ATOMIC_RELEASE);
 }
 
+template<typename T>
+ALWAYS_INLINE void atomic_load_sequentially_consistent(T *addr, T *val) {
+    __atomic_load(addr, val, __ATOMIC_SEQ_CST);
+}
+
+template<typename T>
+ALWAYS_INLINE void atomic_store_sequentially_consistent(T *addr, T *val) {
+    __atomic_store(addr, val, __ATOMIC_SEQ_CST);
+}
+
 ALWAYS_INLINE void atomic_thread_fence_acquire() {
     __atomic_thread_fence(__ATOMIC_ACQUIRE);
 }
@@ -23,6 +23,20 @@ namespace Halide {
 namespace Runtime {
 namespace Internal {
 
+struct work;
+
+// The layout of a halide_semaphore_t in the default runtime. Must fit
+// in the space halide_semaphore_t reserves.
+struct halide_semaphore_impl_t {
+    int value;
+
+    // Jobs parked waiting for this semaphore, linked through
+    // work::next_waiter. Only modified with the work queue lock held,
+    // but read without it by halide_default_semaphore_release. See
+    // halide_set_semaphore_parking.
+    work *waiters;
+};
+
 struct work {
     halide_parallel_task_t task;
 
@@ -40,9 +54,19 @@ struct work {
     int active_workers;
     int exit_status;
     int next_semaphore;
+
+    // The running estimate of how long one iteration of a non-serial
+    // task takes. See halide_set_par_for_chunking.
+    int ns_per_iteration;
+
     // which condition variable is the owner sleeping on. nullptr if it isn't sleeping.
     bool owner_is_sleeping;
 
+    // The semaphore this job is parked on, if it is off the job stack
+    // waiting for one, and the next job parked on the same semaphore.
+    halide_semaphore_impl_t *parked_on;
+    work *next_waiter;
+
     ALWAYS_INLINE bool make_runnable() {
         for (; next_semaphore < task.num_semaphores; next_semaphore++) {
             if (!halide_default_semaphore_try_acquire(task.semaphores[next_semaphore].semaphore,
@@ -90,6 +114,98 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
+// The schedulers halide_default_do_par_for can use. See halide_set_work_stealing.
+enum par_for_scheduler {
+    // Not yet decided. HL_WORK_STEALING is consulted on first use.
+    par_for_scheduler_unset = 0,
+    // Every parallel loop goes through the shared job stack below.
+    par_for_scheduler_shared_queue,
+    // Parallel loops are split into per-thread ranges that idle threads
+    // steal from. Only used for halide_do_par_for; tasks with
+    // semaphores or min_threads requirements still use the job stack.
+    par_for_scheduler_work_stealing,
+};
+
+// How many iterations of a parallel loop a thread claims at a time.
+// See halide_set_par_for_chunking.
+enum par_for_chunking_mode {
+    // Not yet decided. HL_PAR_FOR_CHUNKING is consulted on first use.
+    par_for_chunking_unset = 0,
+    // One iteration at a time.
+    par_for_chunking_off,
+    // Guided chunks, sized by the measured cost of an iteration.
+    par_for_chunking_adaptive,
+};
+
+WEAK int default_par_for_chunking() {
+    char *str = getenv("HL_PAR_FOR_CHUNKING");
+    if (str && atoi(str) != 0) {
+        return par_for_chunking_adaptive;
+    }
+    return par_for_chunking_off;
+}
+
+// How worker threads are placed on cpus. See halide_set_thread_affinity.
+enum thread_affinity_mode {
+    // Not yet decided. HL_THREAD_AFFINITY is consulted on first use.
+    thread_affinity_unset = 0,
+    // Workers may run anywhere.
+    thread_affinity_none,
+    // Each worker is pinned to one cpu, spreading workers round-robin
+    // over the NUMA nodes.
+    thread_affinity_numa,
+};
+
+WEAK int default_thread_affinity() {
+    char *str = getenv("HL_THREAD_AFFINITY");
+    if (str && atoi(str) != 0) {
+        return thread_affinity_numa;
+    }
+    return thread_affinity_none;
+}
+
+// What a thread does with a job whose semaphores it can't acquire. See
+// halide_set_semaphore_parking.
+enum semaphore_wait_mode {
+    // Not yet decided. HL_SEMAPHORE_PARKING is consulted on first use.
+    semaphore_wait_unset = 0,
+    // The job stays on the job stack, and is retried by every thread
+    // that scans the stack until the semaphore is released.
+    semaphore_wait_scan,
+    // The thread running a serial job spins on the semaphore for a
+    // while. After that the job is taken off the job stack and parked
+    // on the semaphore, and releasing the semaphore puts it back.
+    semaphore_wait_park,
+};
+
+WEAK int default_semaphore_wait() {
+    char *str = getenv("HL_SEMAPHORE_PARKING");
+    if (str && atoi(str) != 0) {
+        return semaphore_wait_park;
+    }
+    return semaphore_wait_scan;
+}
+
+WEAK int default_par_for_scheduler(int thread_affinity) {
+    char *str = getenv("HL_WORK_STEALING");
+    if (str) {
+        return atoi(str) != 0 ? par_for_scheduler_work_stealing : par_for_scheduler_shared_queue;
+    }
+    // Only the work-stealing scheduler knows how to keep iterations on
+    // the same NUMA node from one loop to the next, so use it by
+    // default when the workers are pinned.
+    if (thread_affinity == thread_affinity_numa) {
+        return par_for_scheduler_work_stealing;
+    }
+    return par_for_scheduler_shared_queue;
+}
+
+// The largest cpu index and NUMA node index the thread pool keeps track
+// of. Cpus beyond this are never pinned to, and nodes beyond this are
+// folded onto lower ones.
+#define MAX_TOPOLOGY_CPUS 1024
+#define MAX_NUMA_NODES 16
+
 // The work queue and thread pool is weak, so one big work queue is shared by all halide functions
 struct work_queue_t {
     // all fields are protected by this mutex.
@@ -98,6 +214,27 @@ struct work_queue_t {
     // The desired number threads doing work (HL_NUM_THREADS).
     int desired_threads_working;
 
+    // Which scheduler halide_default_do_par_for uses. One of the
+    // par_for_scheduler values. Written under the mutex, but read
+    // without it on the do_par_for fast path.
+    int par_for_scheduler;
+
+    // Whether par_for_scheduler was set by halide_set_work_stealing,
+    // rather than defaulted. A defaulted one follows the affinity.
+    bool par_for_scheduler_explicit;
+
+    // One of the thread_affinity_mode values. Applies to worker threads
+    // spawned after it is set.
+    int thread_affinity;
+
+    // One of the par_for_chunking_mode values. Read without the lock
+    // when a parallel loop starts.
+    int par_for_chunking;
+
+    // One of the semaphore_wait_mode values. Written under the mutex,
+    // but read without it by running serial jobs.
+    int semaphore_wait;
+
     // All fields after this must be zero in the initial state. See assert_zeroed
     // Field serves both to mark the offset in struct and as layout padding.
     int zero_marker;
@@ -138,6 +275,20 @@ struct work_queue_t {
     // to prevent deadlock due to oversubscription of threads.
     int threads_reserved;
 
+    // The NUMA topology of the host, loaded on initialization if
+    // thread affinity is on. Zero nodes means it is unknown (or
+    // affinity is off). Read without the lock once loaded.
+    int num_numa_nodes;
+    bool topology_loaded;
+    int cpu_numa_node[MAX_TOPOLOGY_CPUS];
+
+    // The number of pinned worker threads on each NUMA node.
+    int numa_node_threads[MAX_NUMA_NODES];
+
+    // Whether the host has more than one cpu. Spinning while waiting for
+    // another thread is pointless if not. Read without the lock.
+    bool multiple_cpus;
+
     ALWAYS_INLINE bool running() const {
         return !shutdown;
     }
@@ -165,6 +316,60 @@ struct work_queue_t {
 
 WEAK work_queue_t work_queue = {};
 
+// Chunking aims for chunks that take at least this long, so that the
+// cost of claiming them is small in comparison.
+#define CHUNK_TARGET_NS 20000
+
+// Platforms without a clock module define this to 0 before including
+// this file. Chunking then falls back to purely guided chunk sizes.
+#ifndef THREAD_POOL_HAS_CLOCK
+#define THREAD_POOL_HAS_CLOCK 1
+#endif
+
+ALWAYS_INLINE int64_t chunk_clock_ns() {
+#if THREAD_POOL_HAS_CLOCK
+    return halide_current_time_ns(nullptr);
+#else
+    return 0;
+#endif
+}
+
+// Guided self-scheduling: claim a share of what's left of the loop,
+// which shrinks as the loop drains so that threads finish at about the
+// same time, but never less than CHUNK_TARGET_NS worth of iterations
+// once the cost of an iteration is known.
+ALWAYS_INLINE int adaptive_chunk_size(int remaining, int share, int ns_per_iteration) {
+    int chunk = remaining / share;
+    if (ns_per_iteration > 0) {
+        chunk = max(chunk, CHUNK_TARGET_NS / ns_per_iteration);
+    }
+    return max(chunk, 1);
+}
+
+// Reading the clock can be a system call, so once the cost of an
+// iteration is known, only time chunks that are long enough for that
+// not to matter.
+ALWAYS_INLINE bool worth_timing(int iterations, int ns_per_iteration) {
+    return ns_per_iteration == 0 ||
+           (int64_t)iterations * ns_per_iteration >= CHUNK_TARGET_NS / 4;
+}
+
+// Fold the time taken by a chunk into a running estimate of the cost
+// of one iteration. Concurrent updates may be lost, which is fine for
+// an estimate.
+ALWAYS_INLINE void record_chunk_time(int *ns_per_iteration, int iterations, int64_t ns) {
+    if (ns <= 0 || iterations <= 0) {
+        // No clock, or it didn't tick.
+        return;
+    }
+    int64_t sample = ns / iterations;
+    sample = max(min(sample, (int64_t)0x7fffffff), (int64_t)1);
+    int old;
+    Synchronization::atomic_load_relaxed(ns_per_iteration, &old);
+    int estimate = old ? (int)((3 * (int64_t)old + sample) / 4) : (int)sample;
+    Synchronization::atomic_store_release(ns_per_iteration, &estimate);
+}
+
 #if EXTENDED_DEBUG
 WEAK void print_job(work *job, const char *indent, const char *prefix = nullptr) {
     if (prefix == nullptr) {
@@ -192,6 +397,639 @@ WEAK void dump_job_state() {
 #define dump_job_state()
 #endif
 
+WEAK void load_topology_already_locked() {
+    if (work_queue.topology_loaded) {
+        return;
+    }
+    work_queue.topology_loaded = true;
+    int num_cpus = halide_host_cpu_numa_nodes(work_queue.cpu_numa_node, MAX_TOPOLOGY_CPUS);
+    work_queue.num_numa_nodes = 0;
+    for (int i = 0; i < num_cpus; i++) {
+        int node = work_queue.cpu_numa_node[i];
+        if (node >= MAX_NUMA_NODES) {
+            node %= MAX_NUMA_NODES;
+            work_queue.cpu_numa_node[i] = node;
+        }
+        if (node + 1 > work_queue.num_numa_nodes) {
+            work_queue.num_numa_nodes = node + 1;
+        }
+    }
+    log_message("Loaded topology with " << num_cpus << " cpus on " << work_queue.num_numa_nodes << " NUMA nodes");
+}
+
+// The NUMA node the calling thread is running on, or -1 if unknown.
+WEAK int current_numa_node() {
+    if (work_queue.num_numa_nodes == 0) {
+        return -1;
+    }
+    int cpu = halide_current_cpu();
+    if (cpu < 0 || cpu >= MAX_TOPOLOGY_CPUS) {
+        return -1;
+    }
+    return work_queue.cpu_numa_node[cpu];
+}
+
+// Pick the cpu for the given worker thread. Workers are dealt out
+// round-robin over the nodes that have cpus, so that a pool smaller
+// than the machine still uses the memory bandwidth of every node.
+// Returns -1 if the topology is unknown.
+WEAK int pick_worker_cpu(int worker) {
+    int cpus_on_node[MAX_NUMA_NODES] = {0};
+    for (int i = 0; i < MAX_TOPOLOGY_CPUS; i++) {
+        int node = work_queue.cpu_numa_node[i];
+        if (node >= 0) {
+            cpus_on_node[node]++;
+        }
+    }
+    int nodes[MAX_NUMA_NODES];
+    int num_nodes = 0;
+    for (int n = 0; n < work_queue.num_numa_nodes; n++) {
+        if (cpus_on_node[n] > 0) {
+            nodes[num_nodes++] = n;
+        }
+    }
+    if (num_nodes == 0) {
+        return -1;
+    }
+    int node = nodes[worker % num_nodes];
+    int k = (worker / num_nodes) % cpus_on_node[node];
+    for (int i = 0; i < MAX_TOPOLOGY_CPUS; i++) {
+        if (work_queue.cpu_numa_node[i] == node && k-- == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+WEAK void worker_thread(void *);
+
+WEAK void pinned_worker_thread(void *arg) {
+    int cpu = (int)(intptr_t)arg;
+    if (halide_pin_current_thread(cpu) != 0) {
+        log_message("Failed to pin worker to cpu " << cpu);
+    }
+    worker_thread(nullptr);
+}
+
+WEAK void spawn_worker_thread_already_locked() {
+    int index = work_queue.threads_created++;
+    work_queue.a_team_size++;
+    if (work_queue.thread_affinity == thread_affinity_numa) {
+        int cpu = pick_worker_cpu(index);
+        if (cpu >= 0) {
+            work_queue.numa_node_threads[work_queue.cpu_numa_node[cpu]]++;
+            work_queue.threads[index] = halide_spawn_thread(pinned_worker_thread, (void *)(intptr_t)cpu);
+            return;
+        }
+    }
+    work_queue.threads[index] = halide_spawn_thread(worker_thread, nullptr);
+}
+
+// The work-stealing scheduler for halide_do_par_for.
+//
+// Each parallel loop is published into one of a fixed number of
+// slots. Its iterations are divided into contiguous per-thread
+// ranges, called lanes, up front. A thread that joins the loop takes
+// a lane and claims iterations from its front. When its lane runs
+// dry it picks a random victim lane and splits off the back half of
+// it. Each lane is a single 64-bit word, so claiming and stealing are
+// a single CAS and the work queue mutex is only touched to wake up
+// sleeping threads.
+//
+// Jobs live on the stack of the thread that called
+// halide_do_par_for. To make sure no other thread is still looking
+// at a job when that stack frame goes away, threads bump a reader
+// count on the slot before loading the job pointer, and the owner
+// waits for the readers to drain after unpublishing it.
+//
+// When worker threads are pinned to NUMA nodes, the lanes are grouped
+// by node, with as many lanes per node as there are threads on it, and
+// threads take a lane on their own node and steal from their own node
+// first. Since lanes get contiguous iterations, each node works on
+// the same block of iterations in every loop with the same bounds, so
+// consumers tend to read tiles that were produced (and first-touched)
+// on the same node.
+
+#define MAX_WORK_STEALING_JOBS 64
+
+struct ws_lane {
+    // Iterations [begin, end), relative to the min of the loop, packed
+    // as begin << 32 | end.
+    uint64_t range;
+    // Whether a thread has taken this lane as its own.
+    int taken;
+    // The NUMA node this lane is meant for, or -1.
+    int numa_node;
+    // Pad lanes to a cache line so that threads working on
+    // neighbouring lanes don't contend.
+    uint64_t padding[6];
+};
+
+ALWAYS_INLINE uint64_t ws_pack_range(int begin, int end) {
+    return ((uint64_t)(uint32_t)begin << 32) | (uint64_t)(uint32_t)end;
+}
+
+ALWAYS_INLINE int ws_range_begin(uint64_t range) {
+    return (int)(uint32_t)(range >> 32);
+}
+
+ALWAYS_INLINE int ws_range_end(uint64_t range) {
+    return (int)(uint32_t)range;
+}
+
+struct ws_job {
+    halide_task_t task_fn;
+    void *user_context;
+    uint8_t *closure;
+    int min;
+
+    ws_lane *lanes;
+    int num_lanes;
+
+    // Where a thread joining the job starts looking for an untaken
+    // lane. Threads that join after every lane has been taken steal
+    // into a private range instead.
+    int next_lane;
+
+    // If non-zero, lanes are grouped by NUMA node, and node n owns
+    // lanes [numa_first_lane[n], numa_first_lane[n] + numa_num_lanes[n]).
+    int num_numa_nodes;
+    int numa_first_lane[MAX_NUMA_NODES];
+    int numa_num_lanes[MAX_NUMA_NODES];
+
+    // Whether threads claim adaptively sized chunks of their lane (see
+    // halide_set_par_for_chunking), and the running estimate of the
+    // cost of one iteration that the chunk sizes are based on.
+    int chunking;
+    int ns_per_iteration;
+
+    // The number of iterations not yet completed. The job is done when
+    // this reaches zero.
+    int remaining;
+
+    int exit_status;
+
+    // Non-zero while the owner is waiting on work_queue.wake_owners
+    // for the last iterations to finish.
+    int owner_is_sleeping;
+};
+
+// Marks a slot whose job has finished but may still have readers. It
+// can't be reused until its owner has waited for them.
+#define WS_RETIRING_JOB ((ws_job *)1)
+
+struct ws_slot {
+    ws_job *job;
+    int readers;
+};
+
+struct ws_state_t {
+    // The number of published jobs. Lets idle threads skip scanning the
+    // slots when there is no work-stealing work at all.
+    int published;
+
+    // The number of pool workers that are, or are about to be, waiting
+    // on a work queue condition variable. Publishers only take the
+    // work queue lock to wake them up when this is non-zero.
+    int waiters;
+
+    ws_slot slots[MAX_WORK_STEALING_JOBS];
+};
+
+WEAK ws_state_t ws_state = {};
+
+// How many of the available iterations at the front of a lane to claim.
+ALWAYS_INLINE int ws_chunk_size(ws_job *job, int available) {
+    if (!job->chunking) {
+        return 1;
+    }
+    // Take half of what's left in the lane. The rest stays available
+    // to thieves.
+    int ns_per_iteration;
+    Synchronization::atomic_load_relaxed(&job->ns_per_iteration, &ns_per_iteration);
+    return min(adaptive_chunk_size(available, 2, ns_per_iteration), available);
+}
+
+// Claim a chunk of iterations from the front of a lane. Returns the
+// first one and sets *count, or returns -1 if the lane is empty.
+ALWAYS_INLINE int ws_claim_chunk(ws_job *job, ws_lane *lane, int *count) {
+    using namespace Synchronization;
+    uint64_t range;
+    atomic_load_relaxed(&lane->range, &range);
+    while (ws_range_begin(range) < ws_range_end(range)) {
+        int n = ws_chunk_size(job, ws_range_end(range) - ws_range_begin(range));
+        uint64_t desired = ws_pack_range(ws_range_begin(range) + n, ws_range_end(range));
+        if (atomic_cas_weak_relacq_relaxed(&lane->range, &range, &desired)) {
+            *count = n;
+            return ws_range_begin(range);
+        }
+    }
+    return -1;
+}
+
+// Split off the back half of the victim lane and move it into the
+// thief's lane, which must be empty and not shared with any other
+// thread. Returns false if the victim had nothing left.
+WEAK bool ws_steal_range(ws_lane *victim, ws_lane *thief) {
+    using namespace Synchronization;
+    uint64_t range;
+    atomic_load_relaxed(&victim->range, &range);
+    while (true) {
+        int begin = ws_range_begin(range);
+        int end = ws_range_end(range);
+        if (begin >= end) {
+            return false;
+        }
+        int split = end - (end - begin + 1) / 2;
+        uint64_t desired = ws_pack_range(begin, split);
+        if (atomic_cas_weak_relacq_relaxed(&victim->range, &range, &desired)) {
+            uint64_t stolen = ws_pack_range(split, end);
+            atomic_store_release(&thief->range, &stolen);
+            return true;
+        }
+    }
+}
+
+// Try to steal from each of lanes [first, first + count), starting
+// at a random one.
+WEAK bool ws_steal_from_lanes(ws_job *job, int first, int count, ws_lane *thief, uint32_t *seed) {
+    if (count <= 0) {
+        return false;
+    }
+    // xorshift32 to pick where to start looking for a victim.
+    uint32_t r = *seed;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    *seed = r;
+    int start = (int)(r % (uint32_t)count);
+    for (int i = 0; i < count; i++) {
+        int v = start + i;
+        if (v >= count) {
+            v -= count;
+        }
+        ws_lane *victim = job->lanes + first + v;
+        if (victim != thief && ws_steal_range(victim, thief)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+WEAK bool ws_steal_any(ws_job *job, int numa_node, ws_lane *thief, uint32_t *seed) {
+    // Stay on our own NUMA node if there's anything left there.
+    if (numa_node >= 0 && numa_node < job->num_numa_nodes &&
+        ws_steal_from_lanes(job, job->numa_first_lane[numa_node],
+                            job->numa_num_lanes[numa_node], thief, seed)) {
+        return true;
+    }
+    return ws_steal_from_lanes(job, 0, job->num_lanes, thief, seed);
+}
+
+// Take an untaken lane, preferring ones meant for the given NUMA
+// node. Returns nullptr if all lanes are taken.
+WEAK ws_lane *ws_take_lane(ws_job *job, int numa_node) {
+    using namespace Synchronization;
+    int start;
+    if (numa_node >= 0 && numa_node < job->num_numa_nodes) {
+        start = job->numa_first_lane[numa_node];
+    } else {
+        start = atomic_fetch_add_acquire_release(&job->next_lane, 1);
+        if (start >= job->num_lanes) {
+            return nullptr;
+        }
+    }
+    for (int i = 0; i < job->num_lanes; i++) {
+        int l = start + i;
+        if (l >= job->num_lanes) {
+            l -= job->num_lanes;
+        }
+        ws_lane *lane = job->lanes + l;
+        int taken;
+        atomic_load_relaxed(&lane->taken, &taken);
+        if (taken) {
+            continue;
+        }
+        int expected = 0, desired = 1;
+        if (atomic_cas_strong_sequentially_consistent(&lane->taken, &expected, &desired)) {
+            return lane;
+        }
+    }
+    return nullptr;
+}
+
+// Work on iterations of a job until there are none left to claim or
+// steal. Returns the number of iterations this thread ran.
+WEAK int ws_work_on_job(ws_job *job) {
+    using namespace Synchronization;
+
+    int numa_node = job->num_numa_nodes ? current_numa_node() : -1;
+    ws_lane private_lane;
+    ws_lane *lane = ws_take_lane(job, numa_node);
+    if (!lane) {
+        private_lane.range = ws_pack_range(0, 0);
+        lane = &private_lane;
+    }
+    uint32_t seed = (uint32_t)(uintptr_t)lane * 2654435761U + 1;
+
+    int iterations = 0;
+    while (true) {
+        int count = 0;
+        int idx = ws_claim_chunk(job, lane, &count);
+        if (idx < 0) {
+            if (ws_steal_any(job, numa_node, lane, &seed)) {
+                continue;
+            }
+            break;
+        }
+
+        // Once one iteration has failed, the remaining ones are
+        // claimed but skipped, so that the job still completes.
+        int exit_status;
+        atomic_load_relaxed(&job->exit_status, &exit_status);
+        if (exit_status == 0) {
+            int ns_per_iteration;
+            atomic_load_relaxed(&job->ns_per_iteration, &ns_per_iteration);
+            bool timed = job->chunking && worth_timing(count, ns_per_iteration);
+            int64_t start = timed ? chunk_clock_ns() : 0;
+            int result = 0;
+            for (int i = 0; i < count && result == 0; i++) {
+                result = halide_do_task(job->user_context, job->task_fn,
+                                        job->min + idx + i, job->closure);
+            }
+            if (result != 0) {
+                int expected = 0;
+                atomic_cas_strong_sequentially_consistent(&job->exit_status, &expected, &result);
+            } else if (timed) {
+                record_chunk_time(&job->ns_per_iteration, count, chunk_clock_ns() - start);
+            }
+        }
+        iterations += count;
+
+        if (atomic_fetch_add_sequentially_consistent(&job->remaining, -count) == count) {
+            // That was the last iteration. Wake up the owner if it went to sleep.
+            int owner_is_sleeping;
+            atomic_load_sequentially_consistent(&job->owner_is_sleeping, &owner_is_sleeping);
+            if (owner_is_sleeping) {
+                halide_mutex_lock(&work_queue.mutex);
+                halide_cond_broadcast(&work_queue.wake_owners);
+                halide_mutex_unlock(&work_queue.mutex);
+            }
+        }
+    }
+    return iterations;
+}
+
+// Help with any published work-stealing job. Returns true if any
+// iterations were run.
+WEAK bool ws_help_any() {
+    using namespace Synchronization;
+    int published;
+    atomic_load_relaxed(&ws_state.published, &published);
+    if (published == 0) {
+        return false;
+    }
+    bool helped = false;
+    for (int i = 0; i < MAX_WORK_STEALING_JOBS; i++) {
+        ws_slot *slot = ws_state.slots + i;
+        ws_job *job;
+        atomic_load_relaxed(&slot->job, &job);
+        if (job == nullptr || job == WS_RETIRING_JOB) {
+            continue;
+        }
+        atomic_fetch_add_sequentially_consistent(&slot->readers, 1);
+        atomic_load_sequentially_consistent(&slot->job, &job);
+        if (job != nullptr && job != WS_RETIRING_JOB) {
+            helped |= ws_work_on_job(job) > 0;
+        }
+        atomic_fetch_add_sequentially_consistent(&slot->readers, -1);
+    }
+    return helped;
+}
+
+// Called by the shared queue scheduler when it has nothing to do. Drops
+// the lock while helping.
+WEAK bool ws_help_already_locked() {
+    int published;
+    Synchronization::atomic_load_relaxed(&ws_state.published, &published);
+    if (published == 0) {
+        return false;
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    bool helped = ws_help_any();
+    halide_mutex_lock(&work_queue.mutex);
+    return helped;
+}
+
+// Called by a pool worker, with the lock held, just before it waits on
+// a condition variable. Registers it as a waiter, so that anyone
+// publishing a job from now on will wake it, then takes one last look
+// for work published before that. Returns true if the worker should
+// go around again instead of sleeping. Otherwise the caller must call
+// ws_end_wait once it wakes up.
+WEAK bool ws_begin_wait_already_locked() {
+    using namespace Synchronization;
+    atomic_fetch_add_sequentially_consistent(&ws_state.waiters, 1);
+    int published;
+    atomic_load_sequentially_consistent(&ws_state.published, &published);
+    if (published != 0 && ws_help_already_locked()) {
+        atomic_fetch_add_sequentially_consistent(&ws_state.waiters, -1);
+        return true;
+    }
+    return false;
+}
+
+ALWAYS_INLINE void ws_end_wait() {
+    Synchronization::atomic_fetch_add_sequentially_consistent(&ws_state.waiters, -1);
+}
+
+// Returns the slot index, or -1 if all slots are taken.
+WEAK int ws_publish_job(ws_job *job) {
+    using namespace Synchronization;
+    for (int i = 0; i < MAX_WORK_STEALING_JOBS; i++) {
+        ws_job *expected = nullptr;
+        if (atomic_cas_strong_sequentially_consistent(&ws_state.slots[i].job, &expected, &job)) {
+            atomic_fetch_add_sequentially_consistent(&ws_state.published, 1);
+            return i;
+        }
+    }
+    return -1;
+}
+
+WEAK void ws_retire_job(int slot_index) {
+    using namespace Synchronization;
+    ws_slot *slot = ws_state.slots + slot_index;
+    atomic_fetch_add_sequentially_consistent(&ws_state.published, -1);
+    ws_job *retiring = WS_RETIRING_JOB;
+    atomic_store_sequentially_consistent(&slot->job, &retiring);
+    int readers;
+    atomic_load_sequentially_consistent(&slot->readers, &readers);
+    while (readers != 0) {
+        halide_thread_yield();
+        atomic_load_sequentially_consistent(&slot->readers, &readers);
+    }
+    ws_job *empty = nullptr;
+    atomic_store_release(&slot->job, &empty);
+}
+
+WEAK void ws_wake_workers() {
+    int waiters;
+    Synchronization::atomic_load_sequentially_consistent(&ws_state.waiters, &waiters);
+    if (waiters != 0) {
+        halide_mutex_lock(&work_queue.mutex);
+        work_queue.target_a_team_size = work_queue.threads_created;
+        halide_cond_broadcast(&work_queue.wake_a_team);
+        halide_cond_broadcast(&work_queue.wake_b_team);
+        halide_mutex_unlock(&work_queue.mutex);
+    }
+}
+
+// Wait for the other threads working on a job to finish their
+// iterations, helping with other jobs in the meantime.
+WEAK void ws_wait_for_job(ws_job *job) {
+    using namespace Synchronization;
+    int spin_count = 0;
+    const int max_spin_count = 40;
+    while (true) {
+        int remaining;
+        atomic_load_acquire(&job->remaining, &remaining);
+        if (remaining == 0) {
+            return;
+        }
+        if (ws_help_any()) {
+            spin_count = 0;
+        } else if (spin_count++ < max_spin_count) {
+            halide_thread_yield();
+        } else {
+            halide_mutex_lock(&work_queue.mutex);
+            int sleeping = 1;
+            atomic_store_sequentially_consistent(&job->owner_is_sleeping, &sleeping);
+            atomic_load_sequentially_consistent(&job->remaining, &remaining);
+            if (remaining != 0) {
+                work_queue.owners_sleeping++;
+                halide_cond_wait(&work_queue.wake_owners, &work_queue.mutex);
+                work_queue.owners_sleeping--;
+            }
+            sleeping = 0;
+            atomic_store_sequentially_consistent(&job->owner_is_sleeping, &sleeping);
+            halide_mutex_unlock(&work_queue.mutex);
+        }
+    }
+}
+
+// Take a job that failed to acquire its next semaphore and park it on
+// that semaphore, so that threads looking for work stop retrying it,
+// and releasing the semaphore puts it back on the job stack. The
+// caller must already have taken it off the job stack. Returns false
+// without parking it if the semaphore was released in the meantime.
+// Must be called with the lock held.
+WEAK bool park_job_already_locked(work *job) {
+    const halide_semaphore_acquire_t &acquire = job->task.semaphores[job->next_semaphore];
+    halide_semaphore_impl_t *sem = (halide_semaphore_impl_t *)acquire.semaphore;
+    job->parked_on = sem;
+    job->next_waiter = sem->waiters;
+    Synchronization::atomic_store_sequentially_consistent(&sem->waiters, &job);
+
+    // A release that came before the store above didn't see this job,
+    // so check for one. The release does the same the other way around.
+    int value;
+    Synchronization::atomic_load_sequentially_consistent(&sem->value, &value);
+    if (value >= acquire.count) {
+        Synchronization::atomic_store_sequentially_consistent(&sem->waiters, &job->next_waiter);
+        job->parked_on = nullptr;
+        return false;
+    }
+    log_message("Parked job " << job->task.name << " on semaphore " << (void *)sem);
+    return true;
+}
+
+// Take a job off the list of jobs parked on its semaphore without
+// putting it back on the job stack. Must be called with the lock held.
+WEAK void unlink_parked_job_already_locked(work *job) {
+    work **prev_ptr = &job->parked_on->waiters;
+    while (*prev_ptr != job) {
+        prev_ptr = &(*prev_ptr)->next_waiter;
+    }
+    Synchronization::atomic_store_sequentially_consistent(prev_ptr, &job->next_waiter);
+    job->parked_on = nullptr;
+}
+
+// Put every job parked on a semaphore back on the job stack, and wake
+// enough threads to run them. Must be called with the lock held.
+WEAK void unpark_jobs_already_locked(halide_semaphore_impl_t *sem) {
+    work *job = sem->waiters;
+    work *no_jobs = nullptr;
+    Synchronization::atomic_store_sequentially_consistent(&sem->waiters, &no_jobs);
+    int unparked = 0;
+    while (job) {
+        work *next = job->next_waiter;
+        log_message("Unparked job " << job->task.name << " from semaphore " << (void *)sem);
+        job->parked_on = nullptr;
+        job->next_job = work_queue.jobs;
+        work_queue.jobs = job;
+        job = next;
+        unparked++;
+    }
+    if (unparked == 0) {
+        return;
+    }
+    // Any worker can run any job on the stack, so one per job is
+    // enough. Owners can only run some of them, so wake them all.
+    if (unparked == 1) {
+        halide_cond_signal(&work_queue.wake_a_team);
+    } else {
+        halide_cond_broadcast(&work_queue.wake_a_team);
+    }
+    if (work_queue.owners_sleeping) {
+        halide_cond_broadcast(&work_queue.wake_owners);
+    }
+}
+
+// With parking on, a thread running a serial job that can't acquire
+// the semaphores for its next iteration spins for a little while
+// before giving the job up, as the producer is often only just
+// behind. It doesn't bother if there are other jobs waiting to run,
+// as the producer may well be one of them, or if there is only one
+// cpu to run the producer on. Returns true if it acquired the
+// semaphores. Called without the lock.
+WEAK bool spin_for_semaphores(work *job) {
+    int mode;
+    bool multiple_cpus;
+    Synchronization::atomic_load_relaxed(&work_queue.semaphore_wait, &mode);
+    Synchronization::atomic_load_relaxed(&work_queue.multiple_cpus, &multiple_cpus);
+    if (mode != semaphore_wait_park || !multiple_cpus) {
+        return false;
+    }
+    Synchronization::spin_control spinner;
+    while (spinner.should_spin()) {
+        work *jobs;
+        Synchronization::atomic_load_relaxed(&work_queue.jobs, &jobs);
+        if (jobs) {
+            return false;
+        }
+        halide_thread_yield();
+        if (job->make_runnable()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// How many iterations of a non-serial job to claim at once. Must be
+// called with the lock held.
+WEAK int claim_size_already_locked(const work *job) {
+    if (work_queue.par_for_chunking != par_for_chunking_adaptive ||
+        job->task.num_semaphores != 0) {
+        return 1;
+    }
+    // Guided chunks get smaller as the loop drains, so that the threads
+    // working on it finish together.
+    int chunk = adaptive_chunk_size(job->task.extent,
+                                    2 * work_queue.desired_threads_working,
+                                    job->ns_per_iteration);
+    return min(chunk, job->task.extent);
+}
+
 WEAK void worker_thread(void *);
 
 WEAK void worker_thread_already_locked(work *owned_job) {
@@ -205,11 +1043,16 @@ WEAK void worker_thread_already_locked(work *owned_job) {
         if (owned_job) {
             if (owned_job->exit_status != 0) {
                 if (owned_job->active_workers == 0) {
-                    while (job != owned_job) {
-                        prev_ptr = &job->next_job;
-                        job = job->next_job;
+                    if (owned_job->parked_on) {
+                        unlink_parked_job_already_locked(owned_job);
+                        job = owned_job;
+                    } else {
+                        while (job != owned_job) {
+                            prev_ptr = &job->next_job;
+                            job = job->next_job;
+                        }
+                        *prev_ptr = job->next_job;
                     }
-                    *prev_ptr = job->next_job;
                     job->task.extent = 0;
                     continue;  // So loop exit is always in the same place.
                 }
@@ -267,6 +1110,17 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                     break;
                 } else {
                     log_message("Cannot acquire semaphores for " << job->task.name);
+                    if (work_queue.semaphore_wait == semaphore_wait_park) {
+                        *prev_ptr = job->next_job;
+                        if (park_job_already_locked(job)) {
+                            job = *prev_ptr;
+                        } else {
+                            // It became runnable in the meantime, so
+                            // consider it again.
+                            *prev_ptr = job;
+                        }
+                        continue;
+                    }
                 }
             }
             prev_ptr = &(job->next_job);
@@ -274,6 +1128,14 @@ WEAK void worker_thread_already_locked(work *owned_job) {
         }
 
         if (!job) {
+            // Nothing on the job stack, but there may be work-stealing
+            // loops to help with. They never block, so any thread can
+            // run them.
+            if (ws_help_already_locked()) {
+                spin_count = 0;
+                continue;
+            }
+
             // There is no runnable job. Go to sleep.
             if (owned_job) {
                 if (spin_count++ < max_spin_count) {
@@ -292,16 +1154,20 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                 work_queue.workers_sleeping++;
                 if (work_queue.a_team_size > work_queue.target_a_team_size) {
                     // Transition to B team
-                    work_queue.a_team_size--;
-                    halide_cond_wait(&work_queue.wake_b_team, &work_queue.mutex);
-                    work_queue.a_team_size++;
+                    if (!ws_begin_wait_already_locked()) {
+                        work_queue.a_team_size--;
+                        halide_cond_wait(&work_queue.wake_b_team, &work_queue.mutex);
+                        work_queue.a_team_size++;
+                        ws_end_wait();
+                    }
                 } else if (spin_count++ < max_spin_count) {
                     // Spin waiting for new work
                     halide_mutex_unlock(&work_queue.mutex);
                     halide_thread_yield();
                     halide_mutex_lock(&work_queue.mutex);
-                } else {
+                } else if (!ws_begin_wait_already_locked()) {
                     halide_cond_wait(&work_queue.wake_a_team, &work_queue.mutex);
+                    ws_end_wait();
                 }
                 work_queue.workers_sleeping--;
             }
@@ -341,6 +1207,10 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                        job->make_runnable()) {
                     iters++;
                 }
+                if (iters == 0 && job->task.extent > total_iters &&
+                    spin_for_semaphores(job)) {
+                    iters = 1;
+                }
                 if (iters == 0) {
                     break;
                 }
@@ -360,15 +1230,18 @@ WEAK void worker_thread_already_locked(work *owned_job) {
             // Put it back on the job stack, if it hasn't failed.
             if (result != 0) {
                 job->task.extent = 0;  // Force job to be finished.
-            } else if (job->task.extent > 0) {
+            } else if (job->task.extent > 0 &&
+                       !(work_queue.semaphore_wait == semaphore_wait_park &&
+                         park_job_already_locked(job))) {
                 job->next_job = work_queue.jobs;
                 work_queue.jobs = job;
             }
         } else {
-            // Claim a task from it.
+            // Claim a task, or a chunk of them, from it.
             work myjob = *job;
-            job->task.min++;
-            job->task.extent--;
+            int iters = claim_size_already_locked(job);
+            job->task.min += iters;
+            job->task.extent -= iters;
 
             // If there were no more tasks pending for this job, remove it
             // from the stack.
@@ -376,17 +1249,29 @@ WEAK void worker_thread_already_locked(work *owned_job) {
                 *prev_ptr = job->next_job;
             }
 
+            // Time the chunk if it will help size the next one.
+            bool timed = work_queue.par_for_chunking == par_for_chunking_adaptive &&
+                         job->task.extent >= 2 * work_queue.desired_threads_working &&
+                         worth_timing(iters, job->ns_per_iteration);
+
             // Release the lock and do the task.
             halide_mutex_unlock(&work_queue.mutex);
+            int64_t start = timed ? chunk_clock_ns() : 0;
             if (myjob.task_fn) {
-                result = halide_do_task(myjob.user_context, myjob.task_fn,
-                                        myjob.task.min, myjob.task.closure);
+                for (int i = 0; i < iters && result == 0; i++) {
+                    result = halide_do_task(myjob.user_context, myjob.task_fn,
+                                            myjob.task.min + i, myjob.task.closure);
+                }
             } else {
                 result = halide_do_loop_task(myjob.user_context, myjob.task.fn,
-                                             myjob.task.min, 1,
+                                             myjob.task.min, iters,
                                              myjob.task.closure, job);
             }
+            int64_t end = timed ? chunk_clock_ns() : 0;
             halide_mutex_lock(&work_queue.mutex);
+            if (timed && result == 0) {
+                record_chunk_time(&job->ns_per_iteration, iters, end - start);
+            }
         }
 
         if (result != 0) {
@@ -436,7 +1321,23 @@ WEAK void worker_thread(void *arg) {
     halide_mutex_unlock(&work_queue.mutex);
 }
 
-WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_parent) {
+// Fill in any settings not yet made via the API from the environment.
+WEAK void resolve_default_settings_already_locked() {
+    if (work_queue.thread_affinity == thread_affinity_unset) {
+        work_queue.thread_affinity = default_thread_affinity();
+    }
+    if (work_queue.par_for_scheduler == par_for_scheduler_unset) {
+        work_queue.par_for_scheduler = default_par_for_scheduler(work_queue.thread_affinity);
+    }
+    if (work_queue.par_for_chunking == par_for_chunking_unset) {
+        work_queue.par_for_chunking = default_par_for_chunking();
+    }
+    if (work_queue.semaphore_wait == semaphore_wait_unset) {
+        work_queue.semaphore_wait = default_semaphore_wait();
+    }
+}
+
+WEAK void initialize_work_queue_already_locked() {
     if (!work_queue.initialized) {
         work_queue.assert_zeroed();
 
@@ -447,8 +1348,17 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
             work_queue.desired_threads_working = default_desired_num_threads();
         }
         work_queue.desired_threads_working = clamp_num_threads(work_queue.desired_threads_working);
+        resolve_default_settings_already_locked();
+        if (work_queue.thread_affinity == thread_affinity_numa) {
+            load_topology_already_locked();
+        }
+        work_queue.multiple_cpus = halide_host_cpu_count() > 1;
         work_queue.initialized = true;
     }
+}
+
+WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_parent) {
+    initialize_work_queue_already_locked();
 
     // Gather some information about the work.
 
@@ -505,9 +1415,7 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
                 (work_queue.threads_created + 1) - work_queue.threads_reserved < min_threads)) {
             // We might need to make some new threads, if work_queue.desired_threads_working has
             // increased, or if there aren't enough threads to complete this new task.
-            work_queue.a_team_size++;
-            work_queue.threads[work_queue.threads_created++] =
-                halide_spawn_thread(worker_thread, nullptr);
+            spawn_worker_thread_already_locked();
         }
         log_message("enqueue_work_already_locked top level job " << jobs[0].task.name << " with min_threads " << min_threads << " work_queue.threads_created " << work_queue.threads_created << " work_queue.threads_reserved " << work_queue.threads_reserved);
         if (job_has_acquires || job_may_block) {
@@ -564,6 +1472,132 @@ WEAK void enqueue_work_already_locked(int num_jobs, work *jobs, work *task_paren
     }
 }
 
+// halide_default_do_par_for using the work-stealing scheduler. Returns
+// false without running anything if the job could not be published,
+// in which case the caller should fall back to the shared queue.
+WEAK bool ws_do_par_for(void *user_context, halide_task_t f,
+                        int min, int size, uint8_t *closure, int *exit_status) {
+    using namespace Synchronization;
+
+    int threads_created, desired_threads_working;
+    atomic_load_relaxed(&work_queue.threads_created, &threads_created);
+    atomic_load_relaxed(&work_queue.desired_threads_working, &desired_threads_working);
+    if (threads_created < desired_threads_working - 1) {
+        // Spawn more threads if necessary. Only the first few loops
+        // (or the first after halide_set_num_threads) get here.
+        halide_mutex_lock(&work_queue.mutex);
+        while (work_queue.threads_created < MAX_THREADS &&
+               work_queue.threads_created < work_queue.desired_threads_working - 1) {
+            spawn_worker_thread_already_locked();
+        }
+        threads_created = work_queue.threads_created;
+        desired_threads_working = work_queue.desired_threads_working;
+        halide_mutex_unlock(&work_queue.mutex);
+    }
+
+    // With pinned workers, make one lane per worker, grouped by the
+    // node the worker is pinned to. The calling thread isn't pinned,
+    // so it gets no lane of its own: it takes any lane still untaken
+    // when it joins, or steals.
+    int numa_lanes[MAX_NUMA_NODES];
+    int num_numa_nodes = 0;
+    int total_numa_lanes = 0;
+    if (work_queue.thread_affinity == thread_affinity_numa && work_queue.num_numa_nodes > 1) {
+        num_numa_nodes = work_queue.num_numa_nodes;
+        for (int n = 0; n < num_numa_nodes; n++) {
+            atomic_load_relaxed(&work_queue.numa_node_threads[n], &numa_lanes[n]);
+            total_numa_lanes += numa_lanes[n];
+        }
+        if (total_numa_lanes < 2 || total_numa_lanes > size) {
+            // Too few workers pinned yet, or not enough iterations to
+            // go around. Just use plain lanes.
+            num_numa_nodes = 0;
+        }
+    }
+
+    int num_lanes = desired_threads_working < size ? desired_threads_working : size;
+    if (num_numa_nodes) {
+        num_lanes = total_numa_lanes;
+    }
+    if (num_lanes <= 1) {
+        // No point in publishing a job no one else will take.
+        *exit_status = 0;
+        for (int i = 0; i < size && *exit_status == 0; i++) {
+            *exit_status = halide_do_task(user_context, f, min + i, closure);
+        }
+        return true;
+    }
+
+    ws_job job;
+    job.task_fn = f;
+    job.user_context = user_context;
+    job.closure = closure;
+    job.min = min;
+    job.lanes = (ws_lane *)__builtin_alloca(sizeof(ws_lane) * num_lanes);
+    job.num_lanes = num_lanes;
+    job.next_lane = 0;
+    job.num_numa_nodes = num_numa_nodes;
+    // Chunking can't do much for lanes of only a few iterations.
+    atomic_load_relaxed(&work_queue.par_for_chunking, &job.chunking);
+    job.chunking = job.chunking == par_for_chunking_adaptive && size >= 4 * num_lanes;
+    job.ns_per_iteration = 0;
+    job.remaining = size;
+    job.exit_status = 0;
+    job.owner_is_sleeping = 0;
+    for (int i = 0; i < num_lanes; i++) {
+        // Give each lane a contiguous chunk, so that threads that never
+        // steal walk memory in order.
+        int64_t begin = ((int64_t)size * i) / num_lanes;
+        int64_t end = ((int64_t)size * (i + 1)) / num_lanes;
+        job.lanes[i].range = ws_pack_range((int)begin, (int)end);
+        job.lanes[i].taken = 0;
+        job.lanes[i].numa_node = -1;
+    }
+    int first_lane = 0;
+    for (int n = 0; n < num_numa_nodes; n++) {
+        job.numa_first_lane[n] = first_lane;
+        job.numa_num_lanes[n] = numa_lanes[n];
+        for (int i = 0; i < numa_lanes[n]; i++) {
+            job.lanes[first_lane + i].numa_node = n;
+        }
+        first_lane += numa_lanes[n];
+    }
+
+    int slot = ws_publish_job(&job);
+    if (slot < 0) {
+        return false;
+    }
+    ws_wake_workers();
+
+    ws_work_on_job(&job);
+    ws_wait_for_job(&job);
+    ws_retire_job(slot);
+
+    *exit_status = job.exit_status;
+    return true;
+}
+
+// A parallel loop handed to do_par_for in grains of consecutive
+// iterations. See halide_do_par_for_with_min_grain.
+struct par_for_grains {
+    halide_task_t f;
+    uint8_t *closure;
+    int min, size, grain;
+};
+
+WEAK int do_par_for_grain(void *user_context, int idx, uint8_t *closure) {
+    const par_for_grains *grains = (const par_for_grains *)closure;
+    int first = idx * grains->grain;
+    int last = min(first + grains->grain, grains->size);
+    for (int i = first; i < last; i++) {
+        int result = grains->f(user_context, grains->min + i, grains->closure);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
 WEAK halide_do_task_t custom_do_task = halide_default_do_task;
 WEAK halide_do_loop_task_t custom_do_loop_task = halide_default_do_loop_task;
 WEAK halide_do_par_for_t custom_do_par_for = halide_default_do_par_for;
@@ -603,6 +1637,23 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
         return 0;
     }
 
+    int scheduler;
+    bool initialized;
+    Halide::Runtime::Internal::Synchronization::atomic_load_relaxed(&work_queue.par_for_scheduler, &scheduler);
+    Halide::Runtime::Internal::Synchronization::atomic_load_relaxed(&work_queue.initialized, &initialized);
+    if (scheduler == par_for_scheduler_unset || !initialized) {
+        halide_mutex_lock(&work_queue.mutex);
+        initialize_work_queue_already_locked();
+        scheduler = work_queue.par_for_scheduler;
+        halide_mutex_unlock(&work_queue.mutex);
+    }
+    if (scheduler == par_for_scheduler_work_stealing) {
+        int exit_status = 0;
+        if (ws_do_par_for(user_context, f, min, size, closure, &exit_status)) {
+            return exit_status;
+        }
+    }
+
     work job;
     job.task.fn = nullptr;
     job.task.min = min;
@@ -618,7 +1669,9 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     job.exit_status = 0;
     job.active_workers = 0;
     job.next_semaphore = 0;
+    job.ns_per_iteration = 0;
     job.owner_is_sleeping = false;
+    job.parked_on = nullptr;
     job.siblings = &job;  // guarantees no other job points to the same siblings.
     job.sibling_count = 0;
     job.parent_job = nullptr;
@@ -646,7 +1699,9 @@ WEAK int halide_default_do_parallel_tasks(void *user_context, int num_tasks,
         jobs[i].exit_status = 0;
         jobs[i].active_workers = 0;
         jobs[i].next_semaphore = 0;
+        jobs[i].ns_per_iteration = 0;
         jobs[i].owner_is_sleeping = false;
+        jobs[i].parked_on = nullptr;
         jobs[i].parent_job = (work *)task_parent;
     }
 
@@ -686,6 +1741,58 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK bool halide_set_work_stealing(bool enable) {
+    halide_mutex_lock(&work_queue.mutex);
+    resolve_default_settings_already_locked();
+    bool old = work_queue.par_for_scheduler == par_for_scheduler_work_stealing;
+    work_queue.par_for_scheduler = enable ? par_for_scheduler_work_stealing : par_for_scheduler_shared_queue;
+    work_queue.par_for_scheduler_explicit = true;
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
+WEAK bool halide_set_par_for_chunking(bool enable) {
+    halide_mutex_lock(&work_queue.mutex);
+    resolve_default_settings_already_locked();
+    bool old = work_queue.par_for_chunking == par_for_chunking_adaptive;
+    work_queue.par_for_chunking = enable ? par_for_chunking_adaptive : par_for_chunking_off;
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
+WEAK bool halide_set_thread_affinity(bool enable) {
+    halide_mutex_lock(&work_queue.mutex);
+    resolve_default_settings_already_locked();
+    bool old = work_queue.thread_affinity == thread_affinity_numa;
+    work_queue.thread_affinity = enable ? thread_affinity_numa : thread_affinity_none;
+    // The default scheduler depends on the affinity.
+    if (!work_queue.par_for_scheduler_explicit) {
+        work_queue.par_for_scheduler = default_par_for_scheduler(work_queue.thread_affinity);
+    }
+    if (enable && work_queue.initialized) {
+        load_topology_already_locked();
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
+WEAK bool halide_set_semaphore_parking(bool enable) {
+    halide_mutex_lock(&work_queue.mutex);
+    resolve_default_settings_already_locked();
+    bool old = work_queue.semaphore_wait == semaphore_wait_park;
+    work_queue.semaphore_wait = enable ? semaphore_wait_park : semaphore_wait_scan;
+    if (enable && !old) {
+        // Jobs already waiting on the job stack won't be woken by a
+        // release any more, so have every thread look at them again
+        // and park them.
+        halide_cond_broadcast(&work_queue.wake_a_team);
+        halide_cond_broadcast(&work_queue.wake_b_team);
+        halide_cond_broadcast(&work_queue.wake_owners);
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
 WEAK void halide_shutdown_thread_pool() {
     if (work_queue.initialized) {
         // Wake everyone up and tell them the party's over and it's time
@@ -708,21 +1815,39 @@ WEAK void halide_shutdown_thread_pool() {
     }
 }
 
-struct halide_semaphore_impl_t {
-    int value;
-};
-
 WEAK int halide_default_semaphore_init(halide_semaphore_t *s, int n) {
     halide_semaphore_impl_t *sem = (halide_semaphore_impl_t *)s;
+    work *no_jobs = nullptr;
+    Halide::Runtime::Internal::Synchronization::atomic_store_release(&sem->waiters, &no_jobs);
     Halide::Runtime::Internal::Synchronization::atomic_store_release(&sem->value, &n);
     return n;
 }
 
 WEAK int halide_default_semaphore_release(halide_semaphore_t *s, int n) {
     halide_semaphore_impl_t *sem = (halide_semaphore_impl_t *)s;
-    int old_val = Halide::Runtime::Internal::Synchronization::atomic_fetch_add_acquire_release(&sem->value, n);
+    // Sequentially consistent, to pair with park_job_already_locked.
+    int old_val = Halide::Runtime::Internal::Synchronization::atomic_fetch_add_sequentially_consistent(&sem->value, n);
+    if (n == 0) {
+        return old_val;
+    }
+    work *waiters;
+    Halide::Runtime::Internal::Synchronization::atomic_load_sequentially_consistent(&sem->waiters, &waiters);
+    if (waiters) {
+        // Hand the parked jobs straight back to the thread pool.
+        halide_mutex_lock(&work_queue.mutex);
+        unpark_jobs_already_locked(sem);
+        halide_mutex_unlock(&work_queue.mutex);
+        return old_val + n;
+    }
+    int mode;
+    Halide::Runtime::Internal::Synchronization::atomic_load_relaxed(&work_queue.semaphore_wait, &mode);
+    if (mode == semaphore_wait_park) {
+        // Anything waiting on this semaphore would have been parked on
+        // it, so there's nobody to wake.
+        return old_val + n;
+    }
     // TODO(abadams|zvookin): Is this correct if an acquire can be for say count of 2 and the releases are 1 each?
-    if (old_val == 0 && n != 0) {  // Don't wake if nothing released.
+    if (old_val == 0) {
         // We may have just made a job runnable
         halide_mutex_lock(&work_queue.mutex);
         halide_cond_broadcast(&work_queue.wake_a_team);
@@ -794,6 +1919,17 @@ WEAK int halide_do_par_for(void *user_context, halide_task_t f,
     return (*custom_do_par_for)(user_context, f, min, size, closure);
 }
 
+WEAK int halide_do_par_for_with_min_grain(void *user_context, halide_task_t f,
+                                          int min, int size, uint8_t *closure,
+                                          int min_grain) {
+    if (min_grain <= 1) {
+        return halide_do_par_for(user_context, f, min, size, closure);
+    }
+    par_for_grains grains = {f, closure, min, size, min_grain};
+    int num_grains = (int)(((int64_t)size + min_grain - 1) / min_grain);
+    return halide_do_par_for(user_context, do_par_for_grain, 0, num_grains, (uint8_t *)&grains);
+}
+
 WEAK int halide_do_loop_task(void *user_context, halide_loop_task_t f,
                              int min, int size, uint8_t *closure, void *task_parent) {
     return custom_do_loop_task(user_context, f, min, size, closure, task_parent);
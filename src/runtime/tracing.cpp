@@ -150,6 +150,333 @@ WEAK int halide_trace_file = -1;  // -1 indicates uninitialized
 WEAK ScopedSpinLock::AtomicFlag halide_trace_file_lock = 0;
 WEAK bool halide_trace_file_initialized = false;
 WEAK void *halide_trace_file_internally_opened = nullptr;
+WEAK int32_t halide_trace_next_id = 1;
+
+// The compact format. Each thread writes packets into a chunk of its
+// own, picked by stack_address_slot, so threads don't contend on
+// anything but the occasional block of ids. Full chunks go on a list
+// of pending chunks, which is written out by whichever thread filled
+// one, unless another thread is already writing. So nobody waits on
+// the file unless the list is full.
+const static uint32_t compact_chunk_size = 64 * 1024;
+const static int compact_slot_bits = 5;
+const static int compact_max_names = 128;
+const static int compact_name_hash_size = 256;
+const static int compact_max_coords = 16;
+const static int compact_max_pending = 64;
+const static int compact_max_spare = (1 << compact_slot_bits) + 2 * compact_max_pending;
+const static int32_t compact_id_block = 256;
+// The clock is a system call on some platforms, so it's only read
+// every few packets.
+const static uint32_t compact_clock_interval = 16;
+
+struct CompactTraceSlot {
+    ScopedSpinLock::AtomicFlag lock;
+    // The chunk being written, or nullptr.
+    uint8_t *chunk;
+    uint32_t cursor, packets;
+    // The func names used by the chunk so far, and an open-addressed
+    // hash table of their indices plus one, keyed on the pointer.
+    int num_names;
+    uint32_t names_bytes;
+    const char *names[compact_max_names];
+    uint8_t name_hash[compact_name_hash_size];
+    // This slot's block of ids.
+    int32_t next_id, id_limit;
+    // State the next packet is encoded relative to.
+    int32_t prev_id, prev_parent_id;
+    uint64_t begin_ns, prev_ns;
+    int32_t prev_coords[compact_max_coords];
+};
+
+WEAK CompactTraceSlot *halide_compact_trace_slots = nullptr;
+WEAK int halide_trace_compact = -1;  // -1 indicates uninitialized
+
+WEAK ScopedSpinLock::AtomicFlag halide_compact_trace_pending_lock = 0;
+WEAK uint8_t *halide_compact_trace_pending[compact_max_pending];
+WEAK int halide_compact_trace_num_pending = 0;
+WEAK uint8_t *halide_compact_trace_spare[compact_max_spare];
+WEAK int halide_compact_trace_num_spare = 0;
+// Held by the thread writing pending chunks to the file.
+WEAK ScopedSpinLock::AtomicFlag halide_compact_trace_writing = 0;
+
+ALWAYS_INLINE uint8_t *put_varint(uint8_t *out, uint64_t x) {
+    while (x >= 0x80) {
+        *out++ = (uint8_t)(x | 0x80);
+        x >>= 7;
+    }
+    *out++ = (uint8_t)x;
+    return out;
+}
+
+ALWAYS_INLINE uint64_t zigzag(int64_t x) {
+    return ((uint64_t)x << 1) ^ (uint64_t)(x >> 63);
+}
+
+ALWAYS_INLINE bool compact_trace_enabled() {
+    if (halide_trace_compact < 0) {
+        const char *str = getenv("HL_TRACE_COMPACT");
+        halide_trace_compact = (str && atoi(str) != 0) ? 1 : 0;
+    }
+    return halide_trace_compact != 0;
+}
+
+WEAK CompactTraceSlot *compact_trace_slots(void *user_context) {
+    if (!halide_compact_trace_slots) {
+        ScopedSpinLock lock(&halide_trace_file_lock);
+        if (!halide_compact_trace_slots) {
+            size_t size = sizeof(CompactTraceSlot) << compact_slot_bits;
+            CompactTraceSlot *slots = (CompactTraceSlot *)malloc(size);
+            halide_assert(user_context, slots && "Could not allocate trace buffers");
+            memset(slots, 0, size);
+            halide_start_clock(user_context);
+            __sync_synchronize();
+            halide_compact_trace_slots = slots;
+        }
+    }
+    return halide_compact_trace_slots;
+}
+
+// Writes out all pending chunks. If another thread is already doing
+// that, waits for it if asked to, and otherwise leaves the chunks to
+// it.
+WEAK void compact_trace_write_pending(void *user_context, int fd, bool wait) {
+    while (true) {
+        if (__atomic_test_and_set(&halide_compact_trace_writing, __ATOMIC_ACQUIRE)) {
+            if (!wait) {
+                return;
+            }
+            continue;
+        }
+
+        bool success = true;
+        while (true) {
+            uint8_t *chunks[compact_max_pending];
+            int n;
+            {
+                ScopedSpinLock lock(&halide_compact_trace_pending_lock);
+                n = halide_compact_trace_num_pending;
+                memcpy(chunks, halide_compact_trace_pending, n * sizeof(uint8_t *));
+                halide_compact_trace_num_pending = 0;
+            }
+            if (n == 0) {
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                uint32_t size = ((halide_trace_chunk_t *)chunks[i])->size;
+                success = success && (size == (uint32_t)write(fd, chunks[i], size));
+            }
+            ScopedSpinLock lock(&halide_compact_trace_pending_lock);
+            for (int i = 0; i < n; i++) {
+                if (halide_compact_trace_num_spare < compact_max_spare) {
+                    halide_compact_trace_spare[halide_compact_trace_num_spare++] = chunks[i];
+                } else {
+                    free(chunks[i]);
+                }
+            }
+        }
+        __atomic_clear(&halide_compact_trace_writing, __ATOMIC_RELEASE);
+        halide_assert(user_context, success && "Could not write to trace file");
+
+        // Another thread may have handed over a chunk after we last
+        // looked, but before we stopped writing.
+        ScopedSpinLock lock(&halide_compact_trace_pending_lock);
+        if (halide_compact_trace_num_pending == 0) {
+            return;
+        }
+    }
+}
+
+// Finishes the chunk a slot is writing and hands it over to be
+// written out. The slot must be locked.
+WEAK void compact_trace_seal(void *user_context, CompactTraceSlot *slot, int fd) {
+    uint8_t *chunk = slot->chunk;
+    uint8_t *out = chunk + slot->cursor;
+    for (int i = 0; i < slot->num_names; i++) {
+        size_t len = strlen(slot->names[i]) + 1;
+        memcpy(out, slot->names[i], len);
+        out += len;
+    }
+    while ((out - chunk) & 3) {
+        *out++ = 0;
+    }
+
+    halide_trace_chunk_t *header = (halide_trace_chunk_t *)chunk;
+    header->magic = HALIDE_TRACE_CHUNK_MAGIC;
+    header->size = (uint32_t)(out - chunk);
+    header->packets = slot->packets;
+    header->names_offset = slot->cursor;
+    header->num_names = slot->num_names;
+    header->thread = (uint32_t)(slot - halide_compact_trace_slots);
+    header->begin_ns = slot->begin_ns;
+    header->end_ns = slot->prev_ns;
+    header->reserved = 0;
+    slot->chunk = nullptr;
+
+    while (true) {
+        {
+            ScopedSpinLock lock(&halide_compact_trace_pending_lock);
+            if (halide_compact_trace_num_pending < compact_max_pending) {
+                halide_compact_trace_pending[halide_compact_trace_num_pending++] = chunk;
+                break;
+            }
+        }
+        // The list is full, so the file can't keep up. Help out.
+        compact_trace_write_pending(user_context, fd, true);
+    }
+    compact_trace_write_pending(user_context, fd, false);
+}
+
+WEAK void compact_trace_start_chunk(void *user_context, CompactTraceSlot *slot) {
+    uint8_t *chunk = nullptr;
+    {
+        ScopedSpinLock lock(&halide_compact_trace_pending_lock);
+        if (halide_compact_trace_num_spare > 0) {
+            chunk = halide_compact_trace_spare[--halide_compact_trace_num_spare];
+        }
+    }
+    if (!chunk) {
+        chunk = (uint8_t *)malloc(compact_chunk_size);
+        halide_assert(user_context, chunk && "Could not allocate trace buffer");
+    }
+    slot->chunk = chunk;
+    slot->cursor = sizeof(halide_trace_chunk_t);
+    slot->packets = 0;
+    slot->num_names = 0;
+    slot->names_bytes = 0;
+    memset(slot->name_hash, 0, sizeof(slot->name_hash));
+    memset(slot->prev_coords, 0, sizeof(slot->prev_coords));
+    slot->prev_id = slot->next_id;
+    slot->prev_parent_id = 0;
+    ((halide_trace_chunk_t *)chunk)->first_id = slot->prev_id;
+    uint64_t now = (uint64_t)halide_current_time_ns(user_context);
+    slot->begin_ns = slot->prev_ns = now;
+}
+
+// Returns the index of a func name in the slot's chunk, or -1. Sets
+// *hash_slot to where it was found or should go.
+ALWAYS_INLINE int compact_trace_find_name(CompactTraceSlot *slot, const char *name, uint32_t *hash_slot) {
+    uint32_t h = ((uint32_t)((uintptr_t)name >> 3) * 0x9E3779B1u) >> 24;
+    while (slot->name_hash[h]) {
+        int idx = slot->name_hash[h] - 1;
+        if (slot->names[idx] == name) {
+            *hash_slot = h;
+            return idx;
+        }
+        h = (h + 1) & (compact_name_hash_size - 1);
+    }
+    *hash_slot = h;
+    return -1;
+}
+
+WEAK int32_t compact_trace(void *user_context, int fd, const halide_trace_event_t *e) {
+    CompactTraceSlot *slot = compact_trace_slots(user_context) + stack_address_slot(compact_slot_bits);
+    ScopedSpinLock lock(&slot->lock);
+
+    if (slot->next_id == slot->id_limit) {
+        slot->next_id = __sync_fetch_and_add(&halide_trace_next_id, compact_id_block);
+        slot->id_limit = slot->next_id + compact_id_block;
+    }
+    int32_t my_id = slot->next_id++;
+
+    uint32_t value_bytes = e->value ? (uint32_t)(e->type.lanes * e->type.bytes()) : 0;
+    const char *tag = (e->trace_tag && *e->trace_tag) ? e->trace_tag : nullptr;
+    uint32_t tag_bytes = tag ? strlen(tag) : 0;
+    // Enough for the largest possible encoding, plus padding at the
+    // end of the chunk.
+    uint32_t max_packet_bytes = 64 + e->dimensions * 10 + value_bytes + tag_bytes + 4;
+
+    uint32_t hash_slot = 0;
+    int name_index = -1;
+    if (slot->chunk) {
+        name_index = compact_trace_find_name(slot, e->func, &hash_slot);
+        uint32_t new_name_bytes = name_index < 0 ? strlen(e->func) + 1 : 0;
+        if ((name_index < 0 && slot->num_names == compact_max_names) ||
+            slot->cursor + slot->names_bytes + new_name_bytes + max_packet_bytes > compact_chunk_size) {
+            compact_trace_seal(user_context, slot, fd);
+        }
+    }
+    if (!slot->chunk) {
+        compact_trace_start_chunk(user_context, slot);
+        name_index = compact_trace_find_name(slot, e->func, &hash_slot);
+    }
+    if (name_index < 0) {
+        name_index = slot->num_names++;
+        slot->names[name_index] = e->func;
+        slot->name_hash[hash_slot] = (uint8_t)(name_index + 1);
+        slot->names_bytes += strlen(e->func) + 1;
+    }
+    halide_assert(user_context, slot->cursor + slot->names_bytes + max_packet_bytes <= compact_chunk_size && "Trace packet too large");
+
+    uint8_t *out = slot->chunk + slot->cursor;
+    *out++ = (uint8_t)(e->event | (e->value ? 0x80 : 0) | (tag ? 0x40 : 0));
+    out = put_varint(out, name_index);
+    out = put_varint(out, zigzag((int64_t)my_id - slot->prev_id));
+    out = put_varint(out, zigzag((int64_t)e->parent_id - slot->prev_parent_id));
+    out = put_varint(out, e->value_index);
+    *out++ = e->type.code;
+    *out++ = e->type.bits;
+    out = put_varint(out, e->type.lanes);
+    out = put_varint(out, e->dimensions);
+    for (int i = 0; i < e->dimensions; i++) {
+        int32_t c = e->coordinates ? e->coordinates[i] : 0;
+        if (i < compact_max_coords) {
+            out = put_varint(out, zigzag((int64_t)c - slot->prev_coords[i]));
+            slot->prev_coords[i] = c;
+        } else {
+            out = put_varint(out, zigzag(c));
+        }
+    }
+    if (e->value) {
+        memcpy(out, e->value, value_bytes);
+        out += value_bytes;
+    }
+    if (tag) {
+        out = put_varint(out, tag_bytes);
+        memcpy(out, tag, tag_bytes);
+        out += tag_bytes;
+    }
+    uint64_t now = slot->prev_ns;
+    if (slot->packets && (slot->packets % compact_clock_interval) == 0) {
+        uint64_t t = (uint64_t)halide_current_time_ns(user_context);
+        // The clock isn't necessarily monotonic.
+        now = t > now ? t : now;
+    }
+    out = put_varint(out, now - slot->prev_ns);
+
+    slot->prev_ns = now;
+    slot->prev_id = my_id;
+    slot->prev_parent_id = e->parent_id;
+    slot->packets++;
+    slot->cursor = (uint32_t)(out - slot->chunk);
+    return my_id;
+}
+
+// Hands over every partly-filled chunk, and waits for them all to be
+// written out.
+WEAK void compact_trace_flush(void *user_context, int fd) {
+    if (!halide_compact_trace_slots) {
+        return;
+    }
+    for (int i = 0; i < (1 << compact_slot_bits); i++) {
+        CompactTraceSlot *slot = halide_compact_trace_slots + i;
+        ScopedSpinLock lock(&slot->lock);
+        if (slot->chunk) {
+            compact_trace_seal(user_context, slot, fd);
+        }
+    }
+    compact_trace_write_pending(user_context, fd, true);
+}
+
+WEAK void compact_trace_free() {
+    if (halide_compact_trace_slots) {
+        free(halide_compact_trace_slots);
+        halide_compact_trace_slots = nullptr;
+    }
+    while (halide_compact_trace_num_spare > 0) {
+        free(halide_compact_trace_spare[--halide_compact_trace_num_spare]);
+    }
+}
 
 }  // namespace Internal
 }  // namespace Runtime
@@ -158,12 +485,21 @@ WEAK void *halide_trace_file_internally_opened = nullptr;
 extern "C" {
 
 WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t *e) {
-    static int32_t ids = 1;
-
-    int32_t my_id = __sync_fetch_and_add(&ids, 1);
-
     // If we're dumping to a file, use a binary format
     int fd = halide_get_trace_file(user_context);
+    if (fd > 0 && compact_trace_enabled()) {
+        int32_t my_id = compact_trace(user_context, fd, e);
+
+        // We should also flush if we hit an event that might be the
+        // end of the trace.
+        if (e->event == halide_trace_end_pipeline) {
+            compact_trace_flush(user_context, fd);
+        }
+        return my_id;
+    }
+
+    int32_t my_id = __sync_fetch_and_add(&halide_trace_next_id, 1);
+
     if (fd > 0) {
         // Compute the total packet size
         uint32_t value_bytes = (uint32_t)(e->type.lanes * e->type.bytes());
@@ -174,6 +510,16 @@ WEAK int32_t halide_default_trace(void *user_context, const halide_trace_event_t
         uint32_t total_size_without_padding = header_bytes + value_bytes + coords_bytes + name_bytes + trace_tag_bytes;
         uint32_t total_size = (total_size_without_padding + 3) & ~3;
 
+        if (!halide_trace_buffer) {
+            ScopedSpinLock lock(&halide_trace_file_lock);
+            if (!halide_trace_buffer) {
+                TraceBuffer *buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
+                buffer->init();
+                __sync_synchronize();
+                halide_trace_buffer = buffer;
+            }
+        }
+
         // Claim some space to write to in the trace buffer
         halide_trace_packet_t *packet = halide_trace_buffer->acquire_packet(user_context, fd, total_size);
 
@@ -342,6 +688,15 @@ WEAK void halide_set_trace_file(int fd) {
     halide_trace_file = fd;
 }
 
+WEAK bool halide_set_trace_compact(bool enable) {
+    bool result = compact_trace_enabled();
+    if (result && !enable && halide_trace_file > 0) {
+        compact_trace_flush(nullptr, halide_trace_file);
+    }
+    halide_trace_compact = enable ? 1 : 0;
+    return result;
+}
+
 extern int errno;
 
 WEAK int halide_get_trace_file(void *user_context) {
@@ -353,10 +708,6 @@ WEAK int halide_get_trace_file(void *user_context) {
             halide_assert(user_context, file && "Failed to open trace file\n");
             halide_set_trace_file(fileno(file));
             halide_trace_file_internally_opened = file;
-            if (!halide_trace_buffer) {
-                halide_trace_buffer = (TraceBuffer *)malloc(sizeof(TraceBuffer));
-                halide_trace_buffer->init();
-            }
         } else {
             halide_set_trace_file(0);
         }
@@ -369,6 +720,10 @@ WEAK int32_t halide_trace(void *user_context, const halide_trace_event_t *e) {
 }
 
 WEAK int halide_shutdown_trace() {
+    if (halide_trace_file > 0) {
+        compact_trace_flush(nullptr, halide_trace_file);
+    }
+    compact_trace_free();
     if (halide_trace_file_internally_opened) {
         int ret = fclose(halide_trace_file_internally_opened);
         halide_trace_file = 0;
@@ -0,0 +1,123 @@
+#include "Halide.h"
+
+#include <stdio.h>
+#include <thread>
+
+using namespace Halide;
+
+bool error_occurred = false;
+void my_error_handler(void *user_context, const char *msg) {
+    error_occurred = true;
+}
+
+int main(int argc, char **argv) {
+    ImageParam in(Float(32), 2, "in");
+    Param<float> scale("scale");
+    Param<int> offset("offset");
+    Param<int> bias("bias");
+    Var x("x"), y("y");
+    Func f("f");
+    f(x, y) = Tuple(in(x, y) * scale + offset, cast<int>(in(x, y)) + bias);
+    f.vectorize(x, 4, TailStrategy::GuardWithIf);
+
+    Buffer<float> input(32, 16);
+    input.for_each_element([&](int x, int y) { input(x, y) = (float)(x + y * 32); });
+
+    // bias is not an argument of the Callable, so it keeps the value
+    // it has when the Callable runs.
+    bias.set(3);
+    Callable c = f.compile_to_callable({in, scale, offset});
+    if (c.arguments().size() != 5) {
+        printf("Callable has %d arguments instead of 5\n", (int)c.arguments().size());
+        return -1;
+    }
+
+    auto check = [&](const Buffer<float> &in, float s, int o, int b, const Buffer<float> &a, const Buffer<int> &i) {
+        for (int yy = 0; yy < a.height(); yy++) {
+            for (int xx = 0; xx < a.width(); xx++) {
+                float correct_a = in(xx, yy) * s + o;
+                int correct_i = (int)in(xx, yy) + b;
+                if (a(xx, yy) != correct_a || i(xx, yy) != correct_i) {
+                    printf("out(%d, %d) = (%f, %d) instead of (%f, %d)\n",
+                           xx, yy, a(xx, yy), i(xx, yy), correct_a, correct_i);
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    for (int i = 0; i < 4; i++) {
+        Buffer<float> a(30 - i, 16);
+        Buffer<int> b(30 - i, 16);
+        bias.set(i);
+        int result = c(input, 0.5f * i, i * 7, a, b);
+        if (result != 0 || !check(input, 0.5f * i, i * 7, i, a, b)) {
+            return -1;
+        }
+    }
+
+    // Buffers may also be passed as halide_buffer_t pointers, and the
+    // Callable keeps working when the Pipeline is gone.
+    {
+        Callable c2;
+        {
+            Func g;
+            g(x) = in(x, 0) + offset;
+            c2 = g.compile_to_callable({offset, in});
+        }
+        Buffer<float> out(10);
+        c2(5, input.raw_buffer(), out.raw_buffer());
+        for (int xx = 0; xx < 10; xx++) {
+            if (out(xx) != input(xx, 0) + 5) {
+                printf("out(%d) = %f instead of %f\n", xx, out(xx), input(xx, 0) + 5);
+                return -1;
+            }
+        }
+    }
+
+    // Several threads may call the same Callable at once.
+    {
+        bias.set(3);
+        std::vector<std::thread> threads;
+        std::vector<char> ok(8, false);
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&, t]() {
+                Buffer<float> a(32, 16);
+                Buffer<int> b(32, 16);
+                for (int i = 0; i < 20; i++) {
+                    if (c(input, (float)t, t + i, a, b) != 0 || !check(input, (float)t, t + i, 3, a, b)) {
+                        return;
+                    }
+                }
+                ok[t] = true;
+            });
+        }
+        for (auto &t : threads) {
+            t.join();
+        }
+        for (char b : ok) {
+            if (!b) {
+                return -1;
+            }
+        }
+    }
+
+    // Errors go to the Pipeline's error handler, and with one that
+    // returns, the exit status is returned too.
+    {
+        Func g("g");
+        g(x, y) = in(x, y);
+        g.set_error_handler(my_error_handler);
+        Callable c3 = g.compile_to_callable({in});
+        Buffer<float> too_big(64, 64);
+        int result = c3(input, too_big);
+        if (!error_occurred || result == 0) {
+            printf("Reading outside the input should have failed\n");
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <cstdio>
+#include <sstream>
+
+using namespace Halide;
+
+// Keeps the passes, as well as logging them as JSON.
+class PassCollector : public Internal::JSONCompilerLogger {
+public:
+    struct Pass {
+        std::string name;
+        int64_t before, after;
+    };
+    std::vector<Pass> passes;
+
+    void record_compilation_pass(const std::string &pass_name, double duration,
+                                 int64_t ir_size_before, int64_t ir_size_after,
+                                 uint64_t peak_memory) override {
+        passes.push_back({pass_name, ir_size_before, ir_size_after});
+        JSONCompilerLogger::record_compilation_pass(pass_name, duration, ir_size_before, ir_size_after, peak_memory);
+    }
+};
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] WebAssembly does not support compiling to an object file.\n");
+        return 0;
+    }
+
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = input(x - 1, y) + input(x, y) + input(x + 1, y);
+    blur_y(x, y) = blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1);
+    blur_x.compute_at(blur_y, y).vectorize(x, 8);
+    blur_y.vectorize(x, 8).parallel(y);
+
+    PassCollector *collector = new PassCollector;
+    Internal::set_compiler_logger(std::unique_ptr<Internal::CompilerLogger>(collector));
+
+    std::string object = Internal::get_test_tmp_dir() + "compiler_log_passes.o";
+    Internal::ensure_no_file_exists(object);
+    Module m = blur_y.compile_to_module({input}, "compiler_log_passes", target);
+    m.compile({{Output::object, object}});
+    Internal::file_unlink(object);
+
+    for (const char *name : {"schedule_functions", "bounds_inference", "simplify", "vectorize_loops",
+                             "codegen_llvm", "llvm_optimize", "llvm_codegen"}) {
+        bool found = false;
+        for (const auto &p : collector->passes) {
+            found |= p.name == name;
+        }
+        if (!found) {
+            printf("No pass named %s was recorded\n", name);
+            return -1;
+        }
+    }
+
+    // Each Halide pass starts from the IR the previous one produced.
+    int64_t last = 0;
+    for (const auto &p : collector->passes) {
+        if (p.name == "codegen_llvm") {
+            break;
+        }
+        if (p.before != last) {
+            printf("%s started with %d IR nodes instead of %d\n", p.name.c_str(), (int)p.before, (int)last);
+            return -1;
+        }
+        last = p.after;
+    }
+    if (last == 0) {
+        printf("The lowered IR was empty\n");
+        return -1;
+    }
+
+    std::ostringstream json, summary;
+    collector->emit_to_stream(json);
+    collector->emit_pass_summary_to_stream(summary);
+    if (json.str().find("\"compilation_passes\"") == std::string::npos) {
+        printf("The JSON log has no passes:\n%s\n", json.str().c_str());
+        return -1;
+    }
+    if (summary.str().find("bounds_inference") == std::string::npos ||
+        summary.str().find("total") == std::string::npos) {
+        printf("Bad pass summary:\n%s\n", summary.str().c_str());
+        return -1;
+    }
+    printf("%s", summary.str().c_str());
+
+    Internal::set_compiler_logger(nullptr);
+
+    printf("Success!\n");
+    return 0;
+}
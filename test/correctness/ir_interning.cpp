@@ -0,0 +1,95 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+Buffer<float> run(bool intern) {
+    ImageParam in(Float(32), 2);
+    Var x("x"), y("y");
+    Func blur_x("blur_x"), blur_y("blur_y");
+    blur_x(x, y) = (in(x - 1, y) + in(x, y) + in(x + 1, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+    blur_y.split(y, y, x, 8).vectorize(x, 8);
+    blur_x.compute_at(blur_y, y).vectorize(x, 8);
+
+    Buffer<float> input(70, 70);
+    input.for_each_element([&](int x, int y) { input(x, y) = (float)((x * 17 + y * 31) % 64); });
+    input.set_min(-1, -1);
+    in.set(input);
+
+    // The env var is read by lowering itself, so nest a scope instead.
+    ScopedIRInterning interning(intern);
+    Buffer<float> out = blur_y.realize({64, 64});
+    return out;
+}
+
+int main(int argc, char **argv) {
+    {
+        ScopedIRInterning interning;
+        Var x("x");
+        Expr a = x + 1, b = x + 1, c = x + 2;
+        if (!a.same_as(b)) {
+            printf("Identical Exprs were not shared\n");
+            return -1;
+        }
+        if (a.same_as(c) || equal(a, c) || graph_equal(a, c)) {
+            printf("Different Exprs compared equal\n");
+            return -1;
+        }
+        if (!equal(a * 2, b * 2)) {
+            printf("Identical Exprs did not compare equal\n");
+            return -1;
+        }
+
+        // An Expr made outside the scope is not interned, and must
+        // still compare structurally.
+        Expr d;
+        {
+            ScopedIRInterning off(false);
+            d = x + 1;
+        }
+        if (!ir_interning_enabled()) {
+            printf("Disabled scope turned interning off\n");
+            return -1;
+        }
+        if (d.same_as(a) || !equal(d, a)) {
+            printf("Uninterned Expr compared wrongly\n");
+            return -1;
+        }
+
+        // Floats are interned by bit pattern.
+        Expr pz = make_const(Float(32), 0.0), nz = make_const(Float(32), -0.0);
+        if (pz.same_as(nz)) {
+            printf("0 and -0 were interned as the same node\n");
+            return -1;
+        }
+
+        IRInterningStats stats = get_ir_interning_stats();
+        if (stats.hits == 0 || stats.misses == 0 || stats.entries == 0) {
+            printf("Unexpected stats: %d hits, %d misses, %d entries\n",
+                   (int)stats.hits, (int)stats.misses, (int)stats.entries);
+            return -1;
+        }
+    }
+
+    if (ir_interning_enabled()) {
+        printf("Interning still enabled after scope ended\n");
+        return -1;
+    }
+
+    Buffer<float> plain = run(false);
+    Buffer<float> interned = run(true);
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            if (plain(x, y) != interned(x, y)) {
+                printf("plain(%d, %d) = %f, interned(%d, %d) = %f\n",
+                       x, y, plain(x, y), x, y, interned(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
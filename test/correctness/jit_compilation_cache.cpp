@@ -0,0 +1,126 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+using namespace Halide;
+
+// The cache entries in the directory, sorted by name.
+std::vector<std::string> list_entries(const std::string &dir) {
+    std::vector<std::string> result;
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return result;
+    }
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (Internal::ends_with(name, ".hjit")) {
+            result.push_back(dir + "/" + name);
+        }
+    }
+    closedir(d);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+// Compile and run a pipeline. Everything is named explicitly, and it
+// is the only thing the process compiles, so it lowers to the same
+// thing in every process.
+int run_pipeline(int scale) {
+    Var x("x"), y("y");
+    Func f("f");
+    f(x, y) = sqrt(cast<float>(x * x + y * y)) * scale;
+    f.vectorize(x, 8).parallel(y);
+    Buffer<float> out = f.realize({64, 64});
+    for (int yy = 0; yy < out.height(); yy++) {
+        for (int xx = 0; xx < out.width(); xx++) {
+            float correct = std::sqrt((float)(xx * xx + yy * yy)) * scale;
+            if (std::abs(out(xx, yy) - correct) > 1e-4f * (correct + 1)) {
+                printf("out(%d, %d) = %f instead of %f\n", xx, yy, out(xx, yy), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.os != Target::Linux && target.os != Target::OSX) {
+        printf("[SKIP] This test runs itself in child processes, which is only set up for Linux and OS X.\n");
+        return 0;
+    }
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] The JIT compilation cache is not used for WebAssembly.\n");
+        return 0;
+    }
+
+    std::string dir = Internal::get_test_tmp_dir() + "jit_compilation_cache";
+
+    if (argc == 3) {
+        // We're a child process.
+        Internal::JITSharedRuntime::set_compilation_cache(dir, atoll(argv[2]));
+        return run_pipeline(atoi(argv[1]));
+    }
+
+    for (const std::string &entry : list_entries(dir)) {
+        Internal::file_unlink(entry);
+    }
+
+    auto run_child = [&](int scale, int64_t max_size) {
+        std::string command = std::string(argv[0]) + " " + std::to_string(scale) + " " + std::to_string(max_size);
+        if (system(command.c_str()) != 0) {
+            printf("%s failed\n", command.c_str());
+            exit(-1);
+        }
+    };
+
+    // The first process compiles the pipeline and stores it, along
+    // with the shared runtime modules it uses.
+    run_child(1, 1 << 26);
+    std::vector<std::string> first = list_entries(dir);
+    if (first.size() < 2) {
+        printf("Expected entries for the pipeline and the runtime after the first run, not %d\n", (int)first.size());
+        return -1;
+    }
+
+    // Backdate the entries. A second process should load them instead
+    // of compiling again, which marks them as recently used.
+    struct utimbuf old_times = {1000000, 1000000};
+    for (const std::string &entry : first) {
+        utime(entry.c_str(), &old_times);
+    }
+    run_child(1, 1 << 26);
+    std::vector<std::string> entries = list_entries(dir);
+    if (entries != first) {
+        printf("Expected the second run to reuse the cache entries\n");
+        return -1;
+    }
+    for (const std::string &entry : entries) {
+        if (Internal::file_stat(entry).mod_time == 1000000) {
+            printf("The second run did not load the cache entry %s\n", entry.c_str());
+            return -1;
+        }
+    }
+
+    // A different pipeline gets a different entry. The runtime entries
+    // are reused, and with a tiny cache, storing the new entry evicts
+    // all the others.
+    run_child(2, 1);
+    entries = list_entries(dir);
+    if (entries.size() != 1 || std::count(first.begin(), first.end(), entries[0])) {
+        printf("Expected the new entry to replace the first ones\n");
+        return -1;
+    }
+
+    for (const std::string &entry : list_entries(dir)) {
+        Internal::file_unlink(entry);
+    }
+
+    printf("Success!\n");
+    return 0;
+}
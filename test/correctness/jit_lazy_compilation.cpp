@@ -0,0 +1,77 @@
+#include "Halide.h"
+
+#include <stdio.h>
+
+using namespace Halide;
+using Halide::Internal::JITLazyCompilationStats;
+
+int check(const Buffer<int> &out, int mode) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            int correct = (x + y * 3) * (mode + 2);
+            if (out(x, y) != correct) {
+                printf("mode %d: out(%d, %d) = %d instead of %d\n", mode, x, y, out(x, y), correct);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] WebAssembly JIT does not compile lazily.\n");
+        return 0;
+    }
+
+    // Read when the pipeline is compiled.
+    static char lazy_env[] = "HL_JIT_LAZY=1";
+    putenv(lazy_env);
+
+    // Each specialization of f gets a different loop nest, which the
+    // JIT only compiles the first time it runs.
+    Param<int> mode("mode");
+    Var x("x"), y("y");
+    Func f("f");
+    f(x, y) = (x + y * 3) * (mode + 2);
+    f.specialize(mode == 0).vectorize(x, 8);
+    f.specialize(mode == 1).parallel(y);
+    f.specialize(mode == 2).vectorize(x, 4).parallel(y, 4);
+
+    JITLazyCompilationStats before = Internal::get_jit_lazy_compilation_stats();
+    f.compile_jit(target);
+    JITLazyCompilationStats compiled = Internal::get_jit_lazy_compilation_stats();
+    if (compiled.deferred - before.deferred < 4) {
+        printf("Only %d of the specializations were compiled lazily\n",
+               (int)(compiled.deferred - before.deferred));
+        return -1;
+    }
+    if (compiled.compiled != before.compiled) {
+        printf("Specializations were compiled before they were called\n");
+        return -1;
+    }
+
+    // Run the modes a few times. Only the first run of each compiles
+    // anything.
+    bool seen[4] = {false, false, false, false};
+    for (int m : {1, 3, 1, 0, 3, 2}) {
+        JITLazyCompilationStats stats = Internal::get_jit_lazy_compilation_stats();
+        mode.set(m);
+        Buffer<int> out = f.realize({67, 33}, target);
+        if (check(out, m) != 0) {
+            return -1;
+        }
+        JITLazyCompilationStats after = Internal::get_jit_lazy_compilation_stats();
+        uint64_t expected = seen[m] ? 0 : 1;
+        seen[m] = true;
+        if (after.compiled - stats.compiled != expected) {
+            printf("Running mode %d compiled %d functions instead of %d\n",
+                   m, (int)(after.compiled - stats.compiled), (int)expected);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
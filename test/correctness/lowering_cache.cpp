@@ -0,0 +1,106 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+using namespace Halide::Internal;
+
+Buffer<int> run(bool cache) {
+    Func in("in"), f("f"), g("g"), h("h");
+    Var x("x"), y("y"), xo("xo"), xi("xi");
+    in(x, y) = x * 3 + y * 5;
+    f(x, y) = in(x - 1, y) + in(x + 1, y);
+    g(x, y) = f(x, y - 1) + f(x, y + 1) + f(x / 2, y);
+    h(x, y) = select(x < 10, g(x, y), g(x - 10, y) * 2);
+    h.split(x, xo, xi, 8, TailStrategy::GuardWithIf).parallel(y).vectorize(xi);
+    g.compute_at(h, y).vectorize(x, 4);
+    f.compute_at(h, y).store_root();
+    in.compute_root();
+
+    ScopedLoweringCache lowering_cache(cache);
+    return h.realize({37, 23});
+}
+
+int main(int argc, char **argv) {
+    Var x("x"), y("y");
+    {
+        ScopedLoweringCache cache;
+
+        // The same Expr in different scopes must get different answers.
+        Expr e = x + y;
+        Scope<Interval> s1, s2;
+        s1.push("x", Interval(0, 10));
+        s1.push("y", Interval(0, 10));
+        s2.push("x", Interval(0, 10));
+        s2.push("y", Interval(5, 20));
+        Interval a = bounds_of_expr_in_scope(e, s1);
+        Interval b = bounds_of_expr_in_scope(e, s2);
+        Interval c = bounds_of_expr_in_scope(e, s1);
+        if (!can_prove(a.max == 20) || !can_prove(b.max == 30) || !c.max.same_as(a.max)) {
+            std::cout << "Wrong bounds: " << a.max << " " << b.max << " " << c.max << "\n";
+            return -1;
+        }
+
+        // Names the Expr doesn't use don't matter.
+        s1.push("z", Interval(0, 1));
+        LoweringCacheStats before = get_lowering_cache_stats();
+        Interval d = bounds_of_expr_in_scope(e, s1);
+        LoweringCacheStats after = get_lowering_cache_stats();
+        if (!d.max.same_as(a.max) || after.bounds.hits != before.bounds.hits + 1) {
+            printf("Unrelated scope entry caused a cache miss\n");
+            return -1;
+        }
+
+        // The simplifier only uses constant bounds from the innermost
+        // scope, and so must the key.
+        Scope<Interval> outer, inner;
+        outer.push("x", Interval(0, 10));
+        inner.set_containing_scope(&outer);
+        Expr cond = x < 20;
+        if (can_prove(cond, inner)) {
+            printf("Proved something using a containing scope\n");
+            return -1;
+        }
+        inner.push("x", Interval(0, 10));
+        if (!can_prove(cond, inner)) {
+            printf("Failed to prove something using the innermost scope\n");
+            return -1;
+        }
+    }
+
+    if (lowering_cache_enabled()) {
+        printf("Cache still enabled after scope ended\n");
+        return -1;
+    }
+
+    LoweringCacheStats before = get_lowering_cache_stats();
+    Buffer<int> plain = run(false);
+    LoweringCacheStats middle = get_lowering_cache_stats();
+    Buffer<int> cached = run(true);
+    LoweringCacheStats after = get_lowering_cache_stats();
+
+    if (middle.simplify.hits + middle.simplify.misses !=
+        before.simplify.hits + before.simplify.misses) {
+        printf("Queries were cached with the cache disabled\n");
+        return -1;
+    }
+    uint64_t hits = ((after.simplify.hits - middle.simplify.hits) +
+                     (after.bounds.hits - middle.bounds.hits) +
+                     (after.boxes.hits - middle.boxes.hits));
+    if (hits == 0) {
+        printf("No queries hit the cache while lowering\n");
+        return -1;
+    }
+
+    for (int y = 0; y < plain.height(); y++) {
+        for (int x = 0; x < plain.width(); x++) {
+            if (plain(x, y) != cached(x, y)) {
+                printf("plain(%d, %d) = %d, cached(%d, %d) = %d\n",
+                       x, y, plain(x, y), x, y, cached(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "Halide.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Internal::HostMachineMeasurements m = Internal::measure_host_machine();
+    if (m.threads < 1 || m.flops.empty() || m.flops.front().first != 1 || m.flops.back().first != m.threads) {
+        printf("Expected measurements of arithmetic from 1 to %d tasks\n", m.threads);
+        return -1;
+    }
+    for (const auto &f : m.flops) {
+        if (!(f.second > 0)) {
+            printf("Measured %f flops with %d tasks\n", f.second, f.first);
+            return -1;
+        }
+    }
+    if (!(m.single_core_memory_bandwidth > 0) || !(m.total_memory_bandwidth > 0)) {
+        printf("Measured memory bandwidth of %f and %f\n", m.single_core_memory_bandwidth, m.total_memory_bandwidth);
+        return -1;
+    }
+    for (size_t i = 1; i < m.cache_sizes.size(); i++) {
+        if (m.cache_sizes[i] < m.cache_sizes[i - 1]) {
+            printf("Level %d cache is smaller than level %d cache\n", (int)i + 1, (int)i);
+            return -1;
+        }
+    }
+
+    MachineParams params = Internal::machine_params_from_measurements(m);
+    if (params.parallelism < 1 || params.parallelism > m.threads ||
+        params.last_level_cache_size == 0 || !(params.balance >= 1)) {
+        printf("Implausible machine params: %s\n", params.to_string().c_str());
+        return -1;
+    }
+    // Machine params round-trip through their string form, which is
+    // how generators and the autoschedulers receive them.
+    MachineParams parsed(params.to_string());
+    if (parsed.to_string() != params.to_string()) {
+        printf("Machine params %s parsed as %s\n", params.to_string().c_str(), parsed.to_string().c_str());
+        return -1;
+    }
+
+    // The host's params are measured once.
+    MachineParams host = MachineParams::host();
+    if (MachineParams::host().to_string() != host.to_string()) {
+        printf("MachineParams::host() changed between calls\n");
+        return -1;
+    }
+
+#ifndef _WIN32
+    setenv("HL_MACHINE_PARAMS", "host", 1);
+    if (MachineParams::generic().to_string() != host.to_string()) {
+        printf("HL_MACHINE_PARAMS=host gave %s instead of %s\n",
+               MachineParams::generic().to_string().c_str(), host.to_string().c_str());
+        return -1;
+    }
+#endif
+
+    printf("Host machine params: %s\n", host.to_string().c_str());
+    printf("Success!\n");
+    return 0;
+}
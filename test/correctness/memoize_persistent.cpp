@@ -0,0 +1,132 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+#ifdef _WIN32
+#define DLLEXPORT __declspec(dllexport)
+#else
+#define DLLEXPORT
+#endif
+
+int call_count = 0;
+
+extern "C" DLLEXPORT uint8_t count_calls_pure(uint8_t val) {
+    call_count++;
+    return val;
+}
+HalidePureExtern_1(uint8_t, count_calls_pure, uint8_t);
+
+extern "C" DLLEXPORT uint8_t count_calls_impure(uint8_t val) {
+    call_count++;
+    return val;
+}
+HalideExtern_1(uint8_t, count_calls_impure, uint8_t);
+
+// Build the pipeline from scratch, as a new process would. Everything
+// is named explicitly so that the cache keys match between builds.
+// Changing the offset changes the definition of the memoized Func, and
+// changing lut_value the contents of a Buffer it uses. Results that
+// depend on an impure extern function are never persisted.
+Func make_pipeline(Param<uint8_t> val, int offset, int lut_value, bool impure) {
+    Var x("x"), y("y");
+    Buffer<uint8_t> lut(1, "lut");
+    lut(0) = (uint8_t)lut_value;
+    Expr v = val + cast<uint8_t>(offset);
+    Func count_calls("count_calls");
+    count_calls(x, y) = (impure ? count_calls_impure(v) : count_calls_pure(v)) + lut(0);
+    count_calls.compute_root().memoize(EvictionKey(7));
+    Func f("f");
+    f(x, y) = count_calls(x, y) + cast<uint8_t>(x);
+    return f;
+}
+
+bool check(const Buffer<uint8_t> &out, int val) {
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            uint8_t correct = (uint8_t)(val + x);
+            if (out(x, y) != correct) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), correct);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.os != Target::Linux && target.os != Target::OSX) {
+        printf("[SKIP] The persistent memoization cache is only supported on Linux and OS X.\n");
+        return 0;
+    }
+
+    std::string cache_file = Internal::get_test_tmp_dir() + "memoize_persistent.cache";
+    Internal::ensure_no_file_exists(cache_file);
+    if (!Internal::JITSharedRuntime::memoization_cache_set_persistent_file(cache_file, 1 << 20)) {
+        printf("Could not use %s as a persistent cache\n", cache_file.c_str());
+        return -1;
+    }
+
+    Param<uint8_t> val;
+    struct {
+        int offset, lut_value;
+        bool impure;
+        // Whether the memoized Func is computed, or found in the file.
+        bool computed;
+    } runs[] = {
+        // The first run computes everything and stores it in the file.
+        {0, 0, false, true},
+        // The second finds everything in the file.
+        {0, 0, false, false},
+        // The third runs after an eviction, so it recomputes everything.
+        {0, 0, false, true},
+        // The fourth changes the pipeline, so nothing in the file matches.
+        {1, 0, false, true},
+        // The fifth changes the contents of the Buffer.
+        {0, 1, false, true},
+        // The last two call an impure extern function, so nothing is
+        // stored in the file by the first of them for the second.
+        {0, 0, true, true},
+        {0, 0, true, true},
+    };
+    const int num_runs = sizeof(runs) / sizeof(runs[0]);
+    for (int run = 0; run < num_runs; run++) {
+        // A fresh runtime has an empty in-memory cache.
+        Internal::JITSharedRuntime::release_all();
+        const int offset = runs[run].offset;
+        const int lut_value = runs[run].lut_value;
+        Func f = make_pipeline(val, offset, lut_value, runs[run].impure);
+
+        for (int v = 0; v < 2; v++) {
+            val.set(v + 10);
+            for (int i = 0; i < 2; i++) {
+                const int old_call_count = call_count;
+                Buffer<uint8_t> out = f.realize({100, 100});
+                if (!check(out, v + 10 + offset + lut_value)) {
+                    return -1;
+                }
+                // The second realization always finds the result in memory.
+                const bool computed = call_count != old_call_count;
+                const bool expected = i == 0 && runs[run].computed;
+                if (computed != expected) {
+                    printf("Run %d, value %d, realization %d: count_calls was %s\n",
+                           run, v, i, computed ? "computed" : "not computed");
+                    return -1;
+                }
+            }
+        }
+
+        if (run == 1) {
+            Internal::JITSharedRuntime::memoization_cache_evict(7);
+        }
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_set_persistent_file("");
+    Internal::JITSharedRuntime::release_all();
+    Internal::file_unlink(cache_file);
+
+    printf("Success!\n");
+    return 0;
+}
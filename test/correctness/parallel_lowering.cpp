@@ -0,0 +1,93 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <stdio.h>
+
+using namespace Halide;
+
+// A pipeline with several loop nests at the root, which use each of
+// the passes that run in parallel: unrolling, vectorization, loop
+// partitioning and CSE. Everything is named explicitly.
+Pipeline make_pipeline(ImageParam &input) {
+    Var x("x"), y("y"), c("c");
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func a("a"), b("b"), out("out");
+    a(x, y, c) = clamped(x - 1, y, c) + clamped(x + 1, y, c) * 3;
+    b(x, y, c) = a(x, y - 1, c) * a(x, y + 1, c) + a(x, y, c) * a(x, y, c);
+    out(x, y, c) = select(c == 0, b(x, y, c), b(x, y, c) / 2 + a(x, y, 0));
+    a.compute_root().vectorize(x, 8);
+    b.compute_root().vectorize(x, 8).unroll(x, 2);
+    out.bound(c, 0, 3).reorder(c, x, y).unroll(c).vectorize(x, 4).parallel(y);
+    return Pipeline(out);
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.os != Target::Linux && target.os != Target::OSX) {
+        printf("[SKIP] This test runs itself in child processes, which is only set up for Linux and OS X.\n");
+        return 0;
+    }
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] WebAssembly does not support system().\n");
+        return 0;
+    }
+
+    // Read by lower() each time it runs.
+    static char serial_env[] = "HL_PARALLEL_LOWERING=0";
+    static char parallel_env[] = "HL_PARALLEL_LOWERING=1";
+
+    ImageParam input(Int(32), 3, "input");
+    std::string dir = Internal::get_test_tmp_dir();
+
+    if (argc == 2) {
+        // We're a child process. Write out the lowered code.
+        putenv(parallel_env);
+        make_pipeline(input).compile_to_lowered_stmt(argv[1], {input});
+        return 0;
+    }
+
+    // The results must not depend on lowering in parallel.
+    Buffer<int> in(67, 53, 3);
+    in.for_each_element([&](int x, int y, int c) { in(x, y, c) = (x * 7 + y * 13 + c * 5) % 31; });
+    input.set(in);
+    Buffer<int> out[2];
+    for (int parallel = 0; parallel <= 1; parallel++) {
+        putenv(parallel ? parallel_env : serial_env);
+        out[parallel] = make_pipeline(input).realize({64, 48, 3});
+    }
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < 48; y++) {
+            for (int x = 0; x < 64; x++) {
+                if (out[0](x, y, c) != out[1](x, y, c)) {
+                    printf("out(%d, %d, %d) = %d serially but %d in parallel\n",
+                           x, y, c, out[0](x, y, c), out[1](x, y, c));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Two processes that lower the same pipeline in parallel must
+    // produce exactly the same code, however the threads interleave.
+    std::string stmts[2];
+    for (int i = 0; i < 2; i++) {
+        std::string file = dir + "parallel_lowering_" + std::to_string(i) + ".stmt";
+        Internal::ensure_no_file_exists(file);
+        std::string command = std::string(argv[0]) + " " + file;
+        if (system(command.c_str()) != 0) {
+            printf("%s failed\n", command.c_str());
+            return -1;
+        }
+        std::vector<char> contents = Internal::read_entire_file(file);
+        stmts[i] = std::string(contents.begin(), contents.end());
+        Internal::file_unlink(file);
+    }
+    if (stmts[0].empty() || stmts[0] != stmts[1]) {
+        printf("Lowering in parallel was not deterministic:\n%s\n\nvs\n\n%s\n",
+               stmts[0].c_str(), stmts[1].c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
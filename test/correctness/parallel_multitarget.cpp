@@ -0,0 +1,94 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <stdio.h>
+
+using namespace Halide;
+
+// A few feature levels of the host's arch-bits-os, best first.
+std::vector<Target> make_targets(const Target &host) {
+    Target base(host.os, host.arch, host.bits);
+    std::vector<Target> targets;
+    if (host.arch == Target::X86) {
+        targets.push_back(base.with_feature(Target::AVX2).with_feature(Target::FMA).with_feature(Target::F16C).with_feature(Target::AVX).with_feature(Target::SSE41));
+        targets.push_back(base.with_feature(Target::AVX).with_feature(Target::SSE41));
+        targets.push_back(base.with_feature(Target::SSE41));
+    } else if (host.arch == Target::ARM && host.bits == 64) {
+        targets.push_back(base.with_feature(Target::ARMDotProd));
+    }
+    targets.push_back(base);
+    return targets;
+}
+
+// Everything is named explicitly, and it is the only thing the
+// process compiles, so it compiles to the same thing in every process.
+void compile(const std::string &prefix, const std::vector<Target> &targets) {
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+    Func clamped("clamped"), blur_x("blur_x"), blur_y("blur_y");
+    clamped(x, y) = BoundaryConditions::repeat_edge(input)(x, y);
+    blur_x(x, y) = (clamped(x - 1, y) + clamped(x, y) + clamped(x + 1, y)) / 3;
+    blur_y(x, y) = (blur_x(x, y - 1) + blur_x(x, y) + blur_x(x, y + 1)) / 3;
+    blur_x.compute_root().vectorize(x, 8).parallel(y);
+    blur_y.vectorize(x, 8).parallel(y);
+    Pipeline(blur_y).compile_to_multitarget_static_library(prefix, {input}, targets);
+}
+
+int main(int argc, char **argv) {
+    Target host = get_host_target();
+    if (host.os != Target::Linux && host.os != Target::OSX) {
+        printf("[SKIP] This test runs itself in child processes, which is only set up for Linux and OS X.\n");
+        return 0;
+    }
+    if (host.arch == Target::WebAssembly) {
+        printf("[SKIP] WebAssembly does not support system().\n");
+        return 0;
+    }
+
+    // Read by compile_multitarget and lower() each time they run.
+    static char serial_env[] = "HL_MULTITARGET_JOBS=1";
+    static char parallel_env[] = "HL_MULTITARGET_JOBS=4";
+    static char parallel_lowering_env[] = "HL_PARALLEL_LOWERING=1";
+    std::vector<Target> targets = make_targets(host);
+
+    if (argc == 3) {
+        // We're a child process. Write out the library.
+        putenv(std::string(argv[2]) == "1" ? serial_env : parallel_env);
+        putenv(parallel_lowering_env);
+        compile(argv[1], targets);
+        return 0;
+    }
+
+    // Processes that compile the sub-targets in parallel, and lower
+    // each one in parallel too, must produce exactly the same library
+    // as each other, however the threads interleave, and as a process
+    // that compiles the sub-targets one at a time.
+    const char *jobs[] = {"4", "4", "1"};
+    std::string dir = Internal::get_test_tmp_dir();
+    std::string libs[3];
+    for (int i = 0; i < 3; i++) {
+        std::string prefix = dir + "parallel_multitarget_" + std::to_string(i);
+        std::string lib = prefix + ".a";
+        Internal::ensure_no_file_exists(lib);
+        std::string command = std::string(argv[0]) + " " + prefix + " " + jobs[i];
+        if (system(command.c_str()) != 0) {
+            printf("%s failed\n", command.c_str());
+            return -1;
+        }
+        std::vector<char> contents = Internal::read_entire_file(lib);
+        libs[i] = std::string(contents.begin(), contents.end());
+        Internal::file_unlink(lib);
+        Internal::file_unlink(prefix + ".h");
+    }
+    if (libs[0].empty() || libs[0] != libs[1]) {
+        printf("Compiling sub-targets in parallel was not deterministic\n");
+        return -1;
+    }
+    if (libs[0] != libs[2]) {
+        printf("Compiling sub-targets in parallel changed the library\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,20 @@
+#include "Halide.h"
+#include <stdio.h>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Param<float> p;
+    Func f;
+    Var x;
+    f(x) = x * p;
+
+    Callable c = f.compile_to_callable({p});
+    Buffer<float> out(10);
+
+    // p is a float, so this should fail.
+    c(3, out);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -7,6 +7,7 @@
 
 #include "HalideBuffer.h"
 #include "HalideRuntime.h"
+#include "halide_test_dirs.h"
 #include "memory_profiler_mandelbrot.h"
 
 using namespace Halide::Runtime;
@@ -68,6 +69,23 @@ int launcher_task(void *user_context, int index, uint8_t *closure) {
     return 0;
 }
 
+// Exports the profile and checks that it looks like the right format.
+void check_export(halide_profiler_export_format_t format, const char *prefix) {
+    std::string path = Halide::Internal::get_test_tmp_dir() + "memory_profiler_mandelbrot_export";
+    int result = halide_profiler_export(nullptr, path.c_str(), format);
+    assert(result == 0);
+    (void)result;
+    FILE *f = fopen(path.c_str(), "rb");
+    assert(f);
+    char buf[64] = {0};
+    size_t size = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    remove(path.c_str());
+    assert(size > strlen(prefix));
+    assert(memcmp(buf, prefix, strlen(prefix)) == 0);
+    (void)size;
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {
@@ -82,12 +100,34 @@ int main(int argc, char **argv) {
     printf("argmin expected value\n  stack peak: %d\n", argmin_stack_peak);
     printf("\n");
 
+    int result = halide_profiler_record_timeline(nullptr, 1 << 16);
+    assert(result == 0);
+    (void)result;
+
+    // Hardware counters are often unavailable, e.g. in containers, in
+    // which case the profiler should carry on without them.
+    bool perf_counters = halide_profiler_set_perf_counters(nullptr, true) == 0;
+    printf("Hardware performance counters are %savailable\n", perf_counters ? "" : "not ");
+
     halide_do_par_for(nullptr, launcher_task, 0, num_launcher_tasks, nullptr);
 
     halide_profiler_state *state = halide_profiler_get_state();
     assert(state != nullptr);
 
     validate(state);
+    if (perf_counters) {
+        for (halide_profiler_pipeline_stats *p = state->pipelines; p;
+             p = (halide_profiler_pipeline_stats *)(p->next)) {
+            assert(p->perf_counters[halide_profiler_perf_cycles] > 0);
+            assert(p->perf_counters[halide_profiler_perf_instructions] > 0);
+        }
+    }
+
+    // A Chrome trace is a JSON object, and a pprof profile starts with
+    // a string table entry (field 6, length-delimited).
+    check_export(halide_profiler_export_chrome_trace, "{\"traceEvents\":[");
+    check_export(halide_profiler_export_pprof, "\x32");
+    halide_profiler_record_timeline(nullptr, 0);
 
     printf("Success!\n");
     return 0;
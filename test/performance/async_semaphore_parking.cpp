@@ -0,0 +1,79 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // Streaming pipelines as in the async correctness test, where the
+    // producer only runs a few rows ahead of the consumer, so the
+    // consumer keeps waiting on the producer's semaphore.
+    const int W = 256, H = 1 << 14;
+    Var x, y;
+    Func producer[2], consumer[2];
+    for (int i = 0; i < 2; i++) {
+        producer[i](x, y) = sqrt(cast<float>(x * x + y + 2));
+        consumer[i](x, y) = producer[i](x, y - 1) + producer[i](x, y + 1);
+        consumer[i].compute_root().vectorize(x, 8);
+        producer[i].vectorize(x, 8);
+    }
+    // Sliding and folding over rows.
+    producer[0].store_root().fold_storage(y, 4).compute_at(consumer[0], y).async();
+    // A row-at-a-time producer computed per row of the consumer, with a
+    // double-buffered store.
+    producer[1].store_at(consumer[1], y).compute_at(consumer[1], x).async();
+    consumer[1].split(x, x, Var("xi"), 64);
+
+    Buffer<float> out(W, H);
+    for (int i = 0; i < 2; i++) {
+        double times[2];
+        for (int parking = 0; parking <= 1; parking++) {
+#ifdef _WIN32
+            _putenv_s("HL_SEMAPHORE_PARKING", parking ? "1" : "0");
+#else
+            setenv("HL_SEMAPHORE_PARKING", parking ? "1" : "0", 1);
+#endif
+            // The setting is read when the runtime is first used.
+            Pipeline p(consumer[i]);
+            p.invalidate_cache();
+            Halide::Internal::JITSharedRuntime::release_all();
+
+            p.compile_jit();
+            p.realize(out);
+            times[parking] = benchmark([&]() { p.realize(out); });
+            printf("%s, parking %s: %f ms\n",
+                   i ? "store_at" : "fold_storage",
+                   parking ? "on" : "off", times[parking] * 1e3);
+
+            for (int yy = 0; yy < H; yy++) {
+                for (int xx = 0; xx < W; xx++) {
+                    float correct = std::sqrt((float)(xx * xx + yy + 1)) +
+                                    std::sqrt((float)(xx * xx + yy + 3));
+                    if (std::abs(out(xx, yy) - correct) > 1e-3f * correct) {
+                        printf("out(%d, %d) = %f instead of %f\n",
+                               xx, yy, out(xx, yy), correct);
+                        return -1;
+                    }
+                }
+            }
+        }
+
+        if (times[1] > times[0] * 1.5) {
+            printf("Parking made async much slower: %f ms vs %f ms\n",
+                   times[1] * 1e3, times[0] * 1e3);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+void set_env(const char *name, const char *value) {
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+// Ask the shared runtime how the pool has done since it was made.
+bool get_pool_stats(const Target &target, halide_host_allocation_pool_stats *stats) {
+    for (const auto &m : Halide::Internal::JITSharedRuntime::get(nullptr, target, false)) {
+        auto f = m.exports().find("halide_host_allocation_pool_get_stats");
+        if (f != m.exports().end()) {
+            auto get_stats = (void (*)(halide_host_allocation_pool_stats *))f->second.address;
+            get_stats(stats);
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // A chain of small heap allocations inside a parallel loop, as in
+    // lots_of_small_allocations. The split factor is a Param so that
+    // the intermediates can't go on the stack.
+    Var x("x"), xo, xi, xoo;
+    Param<int> split_factor;
+    split_factor.set(200);
+    std::vector<Func> chain;
+    Func in;
+    in(x) = x;
+    chain.push_back(in);
+    for (int j = 0; j < 50; j++) {
+        Func next;
+        // Iterate the Collatz conjecture
+        Expr prev = chain.back()(x);
+        next(x) = select(prev % 2 == 0, prev / 2, 3 * prev + 1);
+        chain.push_back(next);
+    }
+    Func out_f = chain.back();
+    out_f.split(x, xo, xi, split_factor, TailStrategy::RoundUp);
+    for (size_t j = 0; j < chain.size() - 1; j++) {
+        chain[j].compute_at(out_f, xo).vectorize(x, 8, TailStrategy::RoundUp);
+    }
+    out_f.split(xo, xoo, xo, 100, TailStrategy::RoundUp).parallel(xoo);
+    out_f.vectorize(xi, 8, TailStrategy::RoundUp);
+
+    Buffer<int> out(4 * 1000 * 1000);
+    Buffer<int> reference;
+    double times[2];
+    for (int pooling = 0; pooling <= 1; pooling++) {
+        set_env("HL_HOST_ALLOCATION_POOL", pooling ? "1" : "0");
+        // The setting is read when the runtime is first used.
+        Pipeline p(out_f);
+        p.invalidate_cache();
+        Halide::Internal::JITSharedRuntime::release_all();
+
+        p.compile_jit();
+        p.realize(out);
+        times[pooling] = benchmark([&]() { p.realize(out); });
+        printf("Heap allocation with pooling %s: %f ms\n",
+               pooling ? "on" : "off", times[pooling] * 1e3);
+
+        halide_host_allocation_pool_stats stats = {0, 0, 0};
+        if (!get_pool_stats(target, &stats)) {
+            printf("Could not find halide_host_allocation_pool_get_stats in the runtime\n");
+            return -1;
+        }
+        printf("Pool hits: %llu misses: %llu\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses);
+
+        if (pooling == 0) {
+            if (stats.hits != 0) {
+                printf("Pool was used while it was turned off\n");
+                return -1;
+            }
+            reference = out.copy();
+        } else {
+            if (stats.hits == 0) {
+                printf("Pool was never used\n");
+                return -1;
+            }
+            for (int i = 0; i < out.width(); i++) {
+                if (out(i) != reference(i)) {
+                    printf("out(%d) = %d instead of %d\n", i, out(i), reference(i));
+                    return -1;
+                }
+            }
+        }
+    }
+
+    if (times[1] > times[0] * 1.5) {
+        printf("Pooling made heap allocation much slower: %f ms vs %f ms\n",
+               times[1] * 1e3, times[0] * 1e3);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
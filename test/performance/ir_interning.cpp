@@ -0,0 +1,206 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+using namespace Halide;
+
+// A chain of stages with lots of repeated index math, which is
+// what interning shares.
+Pipeline make_chain(std::vector<Argument> *args) {
+    const int stages = 32;
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+    Func prev = BoundaryConditions::repeat_edge(input);
+    for (int i = 0; i < stages; i++) {
+        Func f("stage_" + std::to_string(i));
+        f(x, y) = (prev(x - 1, y) + prev(x, y) * 2 + prev(x + 1, y + i % 3)) * 0.25f;
+        f.compute_root().vectorize(x, 8).parallel(y, 8);
+        prev = f;
+    }
+    *args = {input};
+    return Pipeline(prev);
+}
+
+// The algorithm and CPU schedule of the local_laplacian app.
+Var x("x"), y("y"), c("c"), k("k");
+
+Func downsample(Func f) {
+    Func downx, downy;
+    downx(x, y, _) = (f(2 * x - 1, y, _) + 3.0f * (f(2 * x, y, _) + f(2 * x + 1, y, _)) + f(2 * x + 2, y, _)) / 8.0f;
+    downy(x, y, _) = (downx(x, 2 * y - 1, _) + 3.0f * (downx(x, 2 * y, _) + downx(x, 2 * y + 1, _)) + downx(x, 2 * y + 2, _)) / 8.0f;
+    return downy;
+}
+
+Func upsample(Func f) {
+    Func upx, upy;
+    upx(x, y, _) = 0.25f * f((x / 2) - 1 + 2 * (x % 2), y, _) + 0.75f * f(x / 2, y, _);
+    upy(x, y, _) = 0.25f * upx(x, (y / 2) - 1 + 2 * (y % 2), _) + 0.75f * upx(x, y / 2, _);
+    return upy;
+}
+
+Pipeline make_local_laplacian(std::vector<Argument> *args) {
+    const int J = 8;
+    ImageParam input(UInt(16), 3, "input");
+    Param<int> levels("levels");
+    Param<float> alpha("alpha"), beta("beta");
+
+    Func remap;
+    Expr fx = cast<float>(x) / 256.0f;
+    remap(x) = alpha * fx * exp(-fx * fx / 2.0f);
+
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func floating;
+    floating(x, y, c) = clamped(x, y, c) / 65535.0f;
+    Func gray;
+    gray(x, y) = 0.299f * floating(x, y, 0) + 0.587f * floating(x, y, 1) + 0.114f * floating(x, y, 2);
+
+    Func gPyramid[J];
+    Expr level = k * (1.0f / (levels - 1));
+    Expr idx = gray(x, y) * cast<float>(levels - 1) * 256.0f;
+    idx = clamp(cast<int>(idx), 0, (levels - 1) * 256);
+    gPyramid[0](x, y, k) = beta * (gray(x, y) - level) + level + remap(idx - 256 * k);
+    for (int j = 1; j < J; j++) {
+        gPyramid[j](x, y, k) = downsample(gPyramid[j - 1])(x, y, k);
+    }
+
+    Func lPyramid[J];
+    lPyramid[J - 1](x, y, k) = gPyramid[J - 1](x, y, k);
+    for (int j = J - 2; j >= 0; j--) {
+        lPyramid[j](x, y, k) = gPyramid[j](x, y, k) - upsample(gPyramid[j + 1])(x, y, k);
+    }
+
+    Func inGPyramid[J];
+    inGPyramid[0](x, y) = gray(x, y);
+    for (int j = 1; j < J; j++) {
+        inGPyramid[j](x, y) = downsample(inGPyramid[j - 1])(x, y);
+    }
+
+    Func outLPyramid[J];
+    for (int j = 0; j < J; j++) {
+        Expr level = inGPyramid[j](x, y) * cast<float>(levels - 1);
+        Expr li = clamp(cast<int>(level), 0, levels - 2);
+        Expr lf = level - cast<float>(li);
+        outLPyramid[j](x, y) = (1.0f - lf) * lPyramid[j](x, y, li) + lf * lPyramid[j](x, y, li + 1);
+    }
+
+    Func outGPyramid[J];
+    outGPyramid[J - 1](x, y) = outLPyramid[J - 1](x, y);
+    for (int j = J - 2; j >= 0; j--) {
+        outGPyramid[j](x, y) = upsample(outGPyramid[j + 1])(x, y) + outLPyramid[j](x, y);
+    }
+
+    Func color;
+    float eps = 0.01f;
+    color(x, y, c) = outGPyramid[0](x, y) * (floating(x, y, c) + eps) / (gray(x, y) + eps);
+
+    Func output("output");
+    output(x, y, c) = cast<uint16_t>(clamp(color(x, y, c), 0.0f, 1.0f) * 65535.0f);
+
+    remap.compute_root();
+    Var yo;
+    output.reorder(c, x, y).split(y, yo, y, 64).parallel(yo).vectorize(x, 8);
+    gray.compute_root().parallel(y, 32).vectorize(x, 8);
+    for (int j = 1; j < 5; j++) {
+        inGPyramid[j].compute_root().parallel(y, 32).vectorize(x, 8);
+        gPyramid[j].compute_root().reorder_storage(x, k, y).reorder(k, y).parallel(y, 8).vectorize(x, 8);
+        outGPyramid[j].store_at(output, yo).compute_at(output, y).fold_storage(y, 8).vectorize(x, 8);
+    }
+    outGPyramid[0].compute_at(output, y).vectorize(x, 8);
+    for (int j = 5; j < J; j++) {
+        inGPyramid[j].compute_root();
+        gPyramid[j].compute_root().parallel(k);
+        outGPyramid[j].compute_root();
+    }
+
+    *args = {input, levels, alpha, beta};
+    return Pipeline(output);
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    const char *pipelines[] = {"chain", "local_laplacian"};
+
+    if (argc == 4) {
+        // We're a child process. Lower one pipeline with interning on
+        // or off, and write out how long it took, how much the peak
+        // memory use of the process grew, and how many nodes were
+        // shared. Peak memory only ever grows, which is why each
+        // setting needs a process of its own.
+        static char on_env[] = "HL_IR_INTERNING=1";
+        static char off_env[] = "HL_IR_INTERNING=0";
+        putenv(std::string(argv[2]) == "1" ? on_env : off_env);
+
+        std::vector<Argument> args;
+        Pipeline p = std::string(argv[1]) == pipelines[0] ? make_chain(&args) : make_local_laplacian(&args);
+
+        Internal::IRInterningStats before = Internal::get_ir_interning_stats();
+        uint64_t peak_before = Internal::get_peak_memory_usage();
+        auto start = std::chrono::high_resolution_clock::now();
+        Module m = p.compile_to_module(args, "ir_interning", target);
+        auto end = std::chrono::high_resolution_clock::now();
+        uint64_t peak_after = Internal::get_peak_memory_usage();
+        Internal::IRInterningStats after = Internal::get_ir_interning_stats();
+
+        std::ofstream out(argv[3]);
+        out << std::chrono::duration<double>(end - start).count() << " "
+            << (peak_after - peak_before) << " "
+            << (after.hits - before.hits) << " "
+            << (after.misses - before.misses) << "\n";
+        return 0;
+    }
+
+    std::string result_file = Internal::get_test_tmp_dir() + "ir_interning.txt";
+    for (const char *pipeline : pipelines) {
+        double times[2];
+        uint64_t memory[2];
+        for (int intern = 0; intern <= 1; intern++) {
+            Internal::ensure_no_file_exists(result_file);
+            std::string command = std::string(argv[0]) + " " + pipeline + " " + std::to_string(intern) + " " + result_file;
+            if (system(command.c_str()) != 0) {
+                printf("%s failed\n", command.c_str());
+                return -1;
+            }
+            std::ifstream in(result_file);
+            uint64_t hits = 0, misses = 0;
+            if (!(in >> times[intern] >> memory[intern] >> hits >> misses)) {
+                printf("%s wrote no results\n", command.c_str());
+                return -1;
+            }
+            in.close();
+            Internal::file_unlink(result_file);
+
+            printf("%s, interning %s: %f s to lower, peak memory grew by %d KB, %d nodes shared, %d made\n",
+                   pipeline, intern ? "on " : "off", times[intern], (int)(memory[intern] / 1024),
+                   (int)hits, (int)misses);
+
+            if (intern && hits == 0) {
+                printf("No nodes were shared\n");
+                return -1;
+            }
+        }
+
+        if (times[1] > times[0] * 2) {
+            printf("Lowering %s with interning was much slower: %f s vs %f s\n", pipeline, times[1], times[0]);
+            return -1;
+        }
+
+        // The growth in peak memory is zero if it can't be measured on
+        // this platform.
+        if (memory[1] > memory[0] * 1.25 + (1 << 20)) {
+            printf("Lowering %s with interning used much more memory: %d KB vs %d KB\n",
+                   pipeline, (int)(memory[1] / 1024), (int)(memory[0] / 1024));
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include "Halide.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace Halide;
+
+namespace {
+
+// A pipeline with many specializations, only one of which runs.
+Func make_pipeline(ImageParam &input, Param<int> &mode) {
+    const int specializations = 16;
+    Var x("x"), y("y");
+    Func clamped = BoundaryConditions::repeat_edge(input);
+    Func f("f");
+    f(x, y) = (clamped(x - 1, y) + clamped(x + 1, y) * 2 + clamped(x, y - 1) * 3 + clamped(x, y + 1)) / 7;
+    for (int i = 0; i < specializations; i++) {
+        f.specialize(mode == i).vectorize(x, 4 << (i % 3)).unroll(x, 2 + i % 3).parallel(y, 2 + i);
+    }
+    return f;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    Buffer<float> in(512, 512);
+    in.fill(1.0f);
+    double compile_times[2], first_run_times[2];
+    for (int lazy = 0; lazy <= 1; lazy++) {
+        // Read when the pipeline is compiled.
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "HL_JIT_LAZY=%d", lazy);
+        putenv(buf);
+
+        ImageParam input(Float(32), 2, "input");
+        Param<int> mode("mode");
+        Func f = make_pipeline(input, mode);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        f.compile_jit(target);
+        auto compiled = std::chrono::high_resolution_clock::now();
+        input.set(in);
+        mode.set(5);
+        f.realize({512, 512}, target);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        compile_times[lazy] = std::chrono::duration<double>(compiled - start).count();
+        first_run_times[lazy] = std::chrono::duration<double>(end - compiled).count();
+        printf("%s: %f s to compile, %f s for the first run\n",
+               lazy ? "lazy " : "eager", compile_times[lazy], first_run_times[lazy]);
+    }
+
+    double eager = compile_times[0] + first_run_times[0];
+    double lazy = compile_times[1] + first_run_times[1];
+    if (lazy > eager) {
+        printf("Compiling specializations lazily was slower: %f s vs %f s\n", lazy, eager);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
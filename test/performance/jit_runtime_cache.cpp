@@ -0,0 +1,100 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <dirent.h>
+
+using namespace Halide;
+
+namespace {
+
+void clear_cache(const std::string &dir) {
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return;
+    }
+    while (dirent *e = readdir(d)) {
+        std::string name = e->d_name;
+        if (Internal::ends_with(name, ".hjit")) {
+            Internal::file_unlink(dir + "/" + name);
+        }
+    }
+    closedir(d);
+}
+
+// Time from a fresh process to the end of the first realize, which
+// includes making the shared runtime.
+double first_realize(const Target &target) {
+    auto start = std::chrono::high_resolution_clock::now();
+    Var x("x"), y("y");
+    Func f("f");
+    f(x, y) = cast<float>(x + y) * 0.5f;
+    Buffer<float> out = f.realize({256, 256}, target);
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.os != Target::Linux && target.os != Target::OSX) {
+        printf("[SKIP] This test runs itself in child processes, which is only set up for Linux and OS X.\n");
+        return 0;
+    }
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    std::string dir = Internal::get_test_tmp_dir() + "jit_runtime_cache";
+
+    if (argc == 3) {
+        // We're a child process. Write the time out for the parent.
+        std::string cache = argv[1];
+        Internal::JITSharedRuntime::set_compilation_cache(cache == "none" ? "" : cache);
+        double t = first_realize(target);
+        FILE *f = fopen(argv[2], "w");
+        if (!f) {
+            return -1;
+        }
+        fprintf(f, "%.9f\n", t);
+        fclose(f);
+        return 0;
+    }
+
+    clear_cache(dir);
+    std::string times_file = Internal::get_test_tmp_dir() + "jit_runtime_cache_time.txt";
+    auto run_child = [&](const std::string &cache) {
+        std::string command = std::string(argv[0]) + " " + cache + " " + times_file;
+        if (system(command.c_str()) != 0) {
+            printf("%s failed\n", command.c_str());
+            exit(-1);
+        }
+        std::vector<char> contents = Internal::read_entire_file(times_file);
+        Internal::file_unlink(times_file);
+        return atof(std::string(contents.begin(), contents.end()).c_str());
+    };
+
+    // Without the cache, with an empty one (which is filled), and with
+    // a full one.
+    double uncached = run_child("none");
+    double cold = run_child(dir);
+    double warm = run_child(dir);
+    printf("First realize without the cache: %f s\n", uncached);
+    printf("First realize with a cold cache: %f s\n", cold);
+    printf("First realize with a warm cache: %f s\n", warm);
+    printf("Speedup: %.2fx\n", uncached / warm);
+    clear_cache(dir);
+
+    // Process start up times vary a lot on loaded machines, so only
+    // check for gross slowdowns.
+    if (warm > uncached * 1.5) {
+        printf("Loading the runtime from the cache was slower than compiling it\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
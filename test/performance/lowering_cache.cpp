@@ -0,0 +1,76 @@
+#include "Halide.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace Halide;
+using Halide::Internal::LoweringCacheStats;
+
+namespace {
+
+void print_counts(const char *name, const LoweringCacheStats::Counts &before, const LoweringCacheStats::Counts &after) {
+    uint64_t hits = after.hits - before.hits, misses = after.misses - before.misses;
+    printf("  %-24s %8d hits %8d misses (%.1f%%)\n", name, (int)hits, (int)misses,
+           hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // A pyramid of stages computed at tiles of the output, which gives
+    // bounds inference plenty of repeated work.
+    const int stages = 16;
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func prev = BoundaryConditions::repeat_edge(input);
+    std::vector<Func> chain;
+    for (int i = 0; i < stages; i++) {
+        Func f("stage_" + std::to_string(i));
+        f(x, y) = (prev(x - 1, y) + prev(x + 1, y) + prev(x, y - 1) + prev(x, y + 1 + i % 2)) * 0.25f;
+        chain.push_back(f);
+        prev = f;
+    }
+    Func out = chain.back();
+    out.tile(x, y, xo, yo, xi, yi, 64, 32).parallel(yo).vectorize(xi, 8);
+    for (int i = 0; i < stages - 1; i++) {
+        chain[i].compute_at(out, xo).vectorize(x, 8);
+    }
+    Pipeline p(out);
+
+    double times[2];
+    for (int cache = 0; cache <= 1; cache++) {
+        // Read by lower() each time it runs.
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "HL_LOWERING_CACHE=%d", cache);
+        putenv(buf);
+
+        LoweringCacheStats before = Internal::get_lowering_cache_stats();
+        auto start = std::chrono::high_resolution_clock::now();
+        Module m = p.compile_to_module({input}, "lowering_cache", target);
+        auto end = std::chrono::high_resolution_clock::now();
+        times[cache] = std::chrono::duration<double>(end - start).count();
+        LoweringCacheStats after = Internal::get_lowering_cache_stats();
+
+        printf("cache %s: %f s to lower\n", cache ? "on " : "off", times[cache]);
+        if (cache) {
+            print_counts("simplify", before.simplify, after.simplify);
+            print_counts("can_prove", before.can_prove, after.can_prove);
+            print_counts("bounds_of_expr_in_scope", before.bounds, after.bounds);
+            print_counts("boxes_touched", before.boxes, after.boxes);
+        }
+    }
+
+    if (times[1] > times[0] * 1.5) {
+        printf("Lowering with the cache was much slower: %f s vs %f s\n", times[1], times[0]);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <cstdio>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // Every row of the output looks up one of K small memoized rows,
+    // so the cost is dominated by the memoization cache itself, and the
+    // parallel version hammers it from all threads at once.
+    const int W = 64, H = 1 << 15, K = 4096;
+    Param<int> offset;
+    Var x, y;
+    Func f[2], g[2];
+    for (int i = 0; i < 2; i++) {
+        f[i](x, y) = x + y + offset;
+        g[i](x, y) = f[i](x, y % K) * 2;
+        f[i].compute_at(g[i], y).memoize();
+    }
+    g[1].parallel(y);
+
+    // Big enough to hold all K rows with room to spare.
+    Internal::JITSharedRuntime::memoization_cache_set_size(16 << 20);
+
+    Buffer<int> out(W, H);
+    double times[2][2];
+    for (int i = 0; i < 2; i++) {
+        g[i].compile_jit();
+
+        // All hits: the same K keys over and over.
+        offset.set(0);
+        g[i].realize(out);
+        times[i][0] = benchmark([&]() { g[i].realize(out); });
+
+        for (int yy = 0; yy < H; yy++) {
+            for (int xx = 0; xx < W; xx++) {
+                int correct = (xx + yy % K) * 2;
+                if (out(xx, yy) != correct) {
+                    printf("out(%d, %d) = %d instead of %d\n",
+                           xx, yy, out(xx, yy), correct);
+                    return -1;
+                }
+            }
+        }
+
+        // Mostly misses: each run asks for K keys that aren't in the
+        // cache yet, so it also stores and evicts.
+        int o = 1;
+        times[i][1] = benchmark([&]() {
+            offset.set(o++);
+            g[i].realize(out);
+        });
+
+        printf("%s: hits %f ms, misses %f ms\n",
+               i ? "parallel" : "serial",
+               times[i][0] * 1e3, times[i][1] * 1e3);
+    }
+
+    Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    for (int j = 0; j < 2; j++) {
+        if (times[1][j] > times[0][j] * 2) {
+            printf("Parallel memoization was much slower than serial: %f ms vs %f ms\n",
+                   times[1][j] * 1e3, times[0][j] * 1e3);
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
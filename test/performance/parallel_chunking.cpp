@@ -0,0 +1,80 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <cstdio>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // A parallel loop over many short rows, so that handing out one
+    // row at a time costs about as much as computing it.
+    const int W = 64, H = 1 << 16;
+    Var x, y;
+    Func f[2];
+    for (int i = 0; i < 2; i++) {
+        f[i](x, y) = sqrt(cast<float>(x * y));
+        f[i].parallel(y).vectorize(x, 8);
+    }
+    // The second one asks for at least 64 rows per task.
+    f[1].min_grain(y, 64);
+
+    Buffer<float> out(W, H);
+    Buffer<float> reference(W, H);
+    for (int yy = 0; yy < H; yy++) {
+        for (int xx = 0; xx < W; xx++) {
+            reference(xx, yy) = std::sqrt((float)(xx * yy));
+        }
+    }
+
+    for (int work_stealing = 0; work_stealing <= 1; work_stealing++) {
+        char ws_buf[32] = {0};
+        snprintf(ws_buf, sizeof(ws_buf), "HL_WORK_STEALING=%d", work_stealing);
+        putenv(ws_buf);
+
+        for (int i = 0; i < 2; i++) {
+            double times[2];
+            for (int chunking = 0; chunking <= 1; chunking++) {
+                char chunk_buf[32] = {0};
+                snprintf(chunk_buf, sizeof(chunk_buf), "HL_PAR_FOR_CHUNKING=%d", chunking);
+                putenv(chunk_buf);
+                Pipeline p(f[i]);
+                p.invalidate_cache();
+                Halide::Internal::JITSharedRuntime::release_all();
+
+                p.compile_jit();
+                p.realize(out);
+                times[chunking] = benchmark([&]() { p.realize(out); });
+
+                printf("%s, %s, chunking %s: %f ms\n",
+                       work_stealing ? "work stealing" : "shared queue",
+                       i ? "min grain 64" : "no min grain",
+                       chunking ? "on" : "off", times[chunking] * 1e3);
+
+                for (int yy = 0; yy < H; yy++) {
+                    for (int xx = 0; xx < W; xx++) {
+                        if (out(xx, yy) != reference(xx, yy)) {
+                            printf("out(%d, %d) = %f instead of %f\n",
+                                   xx, yy, out(xx, yy), reference(xx, yy));
+                            return -1;
+                        }
+                    }
+                }
+            }
+
+            if (times[1] > times[0] * 2) {
+                printf("Chunking made things much slower: %f ms vs %f ms\n",
+                       times[1] * 1e3, times[0] * 1e3);
+                return -1;
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <thread>
+
+using namespace Halide;
+
+uint32_t read_u32(const char *p, bool big_endian) {
+    const uint8_t *b = (const uint8_t *)p;
+    if (big_endian) {
+        return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    } else {
+        return ((uint32_t)b[3] << 24) | ((uint32_t)b[2] << 16) | ((uint32_t)b[1] << 8) | b[0];
+    }
+}
+
+// Read the symbol table of a GNU, BSD or COFF archive: the names of the
+// global symbols, and the offsets of the members that define them.
+bool read_archive_symbols(const std::string &path, std::set<std::string> *symbols, std::set<uint32_t> *members) {
+    std::ifstream f(path, std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    const size_t header_size = 60;
+    if (data.size() < 8 + header_size || memcmp(data.data(), "!<arch>\n", 8) != 0) {
+        return false;
+    }
+    const char *header = data.data() + 8;
+    std::string name(header, 16);
+    size_t size = std::strtoul(std::string(header + 48, 10).c_str(), nullptr, 10);
+    const char *p = header + header_size;
+    const char *end = data.data() + data.size();
+    if (name.compare(0, 3, "#1/") == 0) {
+        // A BSD long name, which precedes the contents.
+        size_t name_size = std::strtoul(name.c_str() + 3, nullptr, 10);
+        if (name_size > size || p + name_size > end) {
+            return false;
+        }
+        name = std::string(p, strnlen(p, name_size));
+        p += name_size;
+        size -= name_size;
+    }
+    if (p + size > end) {
+        return false;
+    }
+    end = p + size;
+
+    if (name.compare(0, 2, "/ ") == 0) {
+        // GNU and COFF: a big-endian count, the member offsets, then the names.
+        if (size < 4) {
+            return false;
+        }
+        uint32_t count = read_u32(p, true);
+        const char *names = p + 4 + 4 * (size_t)count;
+        if (names > end) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            members->insert(read_u32(p + 4 + 4 * i, true));
+            size_t len = strnlen(names, end - names);
+            symbols->emplace(names, len);
+            names += len + 1;
+            if (names > end) {
+                return false;
+            }
+        }
+        return true;
+    } else if (name.compare(0, 9, "__.SYMDEF") == 0) {
+        // BSD: the size of the ranlib entries, the entries themselves
+        // (a string table index and a member offset), then the strings.
+        if (size < 4) {
+            return false;
+        }
+        uint32_t ranlib_size = read_u32(p, false);
+        const char *strings = p + 8 + ranlib_size;
+        if (strings > end) {
+            return false;
+        }
+        for (uint32_t i = 0; i + 8 <= ranlib_size; i += 8) {
+            uint32_t strx = read_u32(p + 4 + i, false);
+            members->insert(read_u32(p + 8 + i, false));
+            if (strings + strx >= end) {
+                return false;
+            }
+            symbols->emplace(strings + strx, strnlen(strings + strx, end - strings - strx));
+        }
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // A long chain of stages, each with its own parallel loop, so that
+    // there are many closures for LLVM to compile.
+    const int stages = 64;
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+    std::vector<Func> chain;
+    Func prev = BoundaryConditions::repeat_edge(input);
+    for (int i = 0; i < stages; i++) {
+        Func f("stage_" + std::to_string(i));
+        f(x, y) = (prev(x - 1, y) + prev(x, y) * 2 + prev(x + 1, y + i % 3)) * 0.25f + sqrt(abs(prev(x, y - 1)));
+        f.compute_root().vectorize(x, 8).parallel(y, 8);
+        chain.push_back(f);
+        prev = f;
+    }
+    Pipeline p(chain.back());
+
+    const int max_partitions = std::max(4, (int)std::thread::hardware_concurrency());
+    std::string prefix = Internal::get_test_tmp_dir() + "parallel_codegen";
+    const char *lib_ext = target.os == Target::Windows ? ".lib" : ".a";
+
+    double baseline = 0;
+    std::set<std::string> baseline_symbols;
+    for (int partitions = 1; partitions <= max_partitions; partitions *= 2) {
+        std::string lib = prefix + lib_ext;
+        Internal::ensure_no_file_exists(lib);
+
+        // Read by Module::compile for each static library.
+        static char buf[64];
+        snprintf(buf, sizeof(buf), "HL_CODEGEN_PARTITIONS=%d", partitions);
+        putenv(buf);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        p.compile_to_static_library(prefix, {input}, "parallel_codegen", target);
+        auto end = std::chrono::high_resolution_clock::now();
+        double t = std::chrono::duration<double>(end - start).count();
+        if (partitions == 1) {
+            baseline = t;
+        }
+
+        if (!Internal::file_exists(lib)) {
+            printf("No static library was written with %d partitions\n", partitions);
+            return -1;
+        }
+        printf("%2d partitions: %f s to build (%.2fx), %d bytes\n",
+               partitions, t, baseline / t, (int)Internal::file_stat(lib).file_size);
+
+        // However the code is split, the library must define the same
+        // symbols, and the split must actually produce several objects.
+        std::set<std::string> symbols;
+        std::set<uint32_t> members;
+        if (!read_archive_symbols(lib, &symbols, &members)) {
+            printf("Could not read the symbol table of the static library built with %d partitions\n", partitions);
+            return -1;
+        }
+        if (partitions == 1) {
+            baseline_symbols = symbols;
+        } else if (symbols != baseline_symbols) {
+            printf("The static library built with %d partitions defines different symbols than with 1:\n", partitions);
+            for (const auto &sym : symbols) {
+                if (!baseline_symbols.count(sym)) {
+                    printf("  only with %d: %s\n", partitions, sym.c_str());
+                }
+            }
+            for (const auto &sym : baseline_symbols) {
+                if (!symbols.count(sym)) {
+                    printf("  only with 1: %s\n", sym.c_str());
+                }
+            }
+            return -1;
+        } else if (members.size() < 2) {
+            printf("The static library built with %d partitions has only %d object with symbols\n",
+                   partitions, (int)members.size());
+            return -1;
+        }
+        Internal::file_unlink(lib);
+        Internal::file_unlink(prefix + ".h");
+    }
+
+    printf("Success!\n");
+    return 0;
+}
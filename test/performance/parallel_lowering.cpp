@@ -0,0 +1,59 @@
+#include "Halide.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // Many stages computed at the root, each a loop nest of its own
+    // with boundary conditions to partition and loops to vectorize and
+    // unroll.
+    const int stages = 48;
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+    Func prev = BoundaryConditions::repeat_edge(input);
+    std::vector<Func> chain;
+    for (int i = 0; i < stages; i++) {
+        Func f("stage_" + std::to_string(i));
+        Func clamped = BoundaryConditions::mirror_image(prev, {{0, 1024}, {0, 1024}});
+        f(x, y) = (clamped(x - 1, y) + clamped(x + 1, y) * 2 + clamped(x, y + i % 4)) * 0.25f;
+        f.compute_root().vectorize(x, 8).unroll(x, 2).parallel(y, 4);
+        chain.push_back(f);
+        prev = f;
+    }
+    Pipeline p(chain.back());
+
+    double times[2];
+    for (int parallel = 0; parallel <= 1; parallel++) {
+        // Read by lower() each time it runs.
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "HL_PARALLEL_LOWERING=%d", parallel);
+        putenv(buf);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        Module m = p.compile_to_module({input}, "parallel_lowering", target);
+        auto end = std::chrono::high_resolution_clock::now();
+        times[parallel] = std::chrono::duration<double>(end - start).count();
+        printf("%s: %f s to lower\n", parallel ? "parallel" : "serial  ", times[parallel]);
+    }
+    printf("Speedup with %d threads: %.2fx\n",
+           (int)std::thread::hardware_concurrency(), times[0] / times[1]);
+
+    // With a single core there is nothing to gain, and splitting the
+    // Stmt up costs a little, so only check for a slowdown otherwise.
+    if (std::thread::hardware_concurrency() > 1 && times[1] > times[0] * 1.2) {
+        printf("Lowering in parallel was slower: %f s vs %f s\n", times[1], times[0]);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
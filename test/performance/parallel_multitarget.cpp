@@ -0,0 +1,64 @@
+#include "Halide.h"
+#include "halide_test_dirs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    Target host = get_host_target();
+    if (host.arch != Target::X86) {
+        printf("[SKIP] This test compiles for several x86 feature levels.\n");
+        return 0;
+    }
+
+    // Feature levels typical of a fat binary, best first.
+    Target base(host.os, host.arch, host.bits);
+    Target sse41 = base.with_feature(Target::SSE41);
+    Target avx = sse41.with_feature(Target::AVX);
+    Target avx2 = avx.with_feature(Target::AVX2).with_feature(Target::FMA).with_feature(Target::F16C);
+    Target avx512 = avx2.with_feature(Target::AVX512).with_feature(Target::AVX512_Skylake);
+    std::vector<Target> targets = {avx512, avx2, avx, sse41, base};
+
+    // A pipeline big enough for compilation to take a while.
+    const int stages = 16;
+    ImageParam input(Float(32), 2, "input");
+    Var x("x"), y("y");
+    Func prev = BoundaryConditions::repeat_edge(input);
+    for (int i = 0; i < stages; i++) {
+        Func f("stage_" + std::to_string(i));
+        f(x, y) = (prev(x - 1, y) + prev(x + 1, y) * 2 + prev(x, y + 1)) * 0.25f;
+        f.compute_root().vectorize(x, 16).unroll(x, 2).parallel(y, 4);
+        prev = f;
+    }
+    Pipeline p(prev);
+
+    std::string prefix = Internal::get_test_tmp_dir() + "parallel_multitarget";
+    double times[2];
+    for (int parallel = 0; parallel <= 1; parallel++) {
+        // Read by compile_multitarget each time it runs.
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "HL_MULTITARGET_JOBS=%d", parallel ? (int)targets.size() : 1);
+        putenv(buf);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        p.compile_to_multitarget_static_library(prefix, {input}, targets);
+        auto end = std::chrono::high_resolution_clock::now();
+        times[parallel] = std::chrono::duration<double>(end - start).count();
+        printf("%s: %f s to compile %d targets\n", parallel ? "parallel" : "serial  ", times[parallel], (int)targets.size());
+    }
+    Internal::file_unlink(prefix + ".a");
+    Internal::file_unlink(prefix + ".h");
+    printf("Speedup with %d threads: %.2fx\n",
+           (int)std::thread::hardware_concurrency(), times[0] / times[1]);
+
+    if (std::thread::hardware_concurrency() > 1 && times[1] > times[0] * 1.2) {
+        printf("Compiling targets in parallel was slower: %f s vs %f s\n", times[1], times[0]);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -47,9 +47,32 @@ int main(int argc, char **argv) {
         }
     }
 
-    printf("Times: %f %f\n", serialTime, parallelTime);
+    // Run the parallel version again with the work-stealing scheduler
+    // in the runtime. This needs a fresh runtime to pick up the
+    // environment variable.
+    char work_stealing_env[] = "HL_WORK_STEALING=1";
+    putenv(work_stealing_env);
+    Pipeline p(f);
+    p.invalidate_cache();
+    Halide::Internal::JITSharedRuntime::release_all();
+    Buffer<float> imf_ws = p.realize({W, H});
+
+    double workStealingTime = benchmark([&]() { p.realize(imf_ws); });
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            if (imf_ws(x, y) != img(x, y)) {
+                printf("imf_ws(%d, %d) = %f\n", x, y, imf_ws(x, y));
+                printf("img(%d, %d) = %f\n", x, y, img(x, y));
+                return -1;
+            }
+        }
+    }
+
+    printf("Times: %f %f %f\n", serialTime, parallelTime, workStealingTime);
     double speedup = serialTime / parallelTime;
     printf("Speedup: %f\n", speedup);
+    printf("Speedup with work stealing: %f\n", serialTime / workStealingTime);
 
     if (speedup < 1.5) {
         fprintf(stderr, "WARNING: Parallel should be faster\n");
@@ -102,6 +102,17 @@ int main(int argc, char **argv) {
         std::cout << "No argument Pipeline realize reusing Realization/Target/ParamMap with no_asserts and no_bounds_query time " << t * 1e6 << "us.\n";
     }
 
+    {
+        Func f;
+        f() = 42;
+
+        Callable c = f.compile_to_callable({});
+
+        auto buf = Buffer<int32_t>::make_scalar();
+        double t = benchmark([&]() { c(buf); });
+        std::cout << "No argument Callable call time " << t * 1e6 << "us.\n";
+    }
+
     {
         Func f;
         Param<int> in;
@@ -135,6 +146,19 @@ int main(int argc, char **argv) {
         std::cout << "One argument Pipeline realize reusing Realization/Target/ParamMap time " << t * 1e6 << "us.\n";
     }
 
+    {
+        Func f;
+        Param<int> in;
+
+        f() = in + 42;
+
+        Callable c = f.compile_to_callable({in});
+
+        auto buf = Buffer<int32_t>::make_scalar();
+        double t = benchmark([&]() { c(0, buf); });
+        std::cout << "One argument Callable call time " << t * 1e6 << "us.\n";
+    }
+
     for (int i = 10; i < 100; i += 10) {
         Func f;
         std::vector<Param<int>> params(i);
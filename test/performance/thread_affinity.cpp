@@ -0,0 +1,92 @@
+#include "Halide.h"
+#include "halide_benchmark.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+void set_env(const char *name, int value) {
+    std::string str = std::to_string(value);
+#ifdef _WIN32
+    _putenv_s(name, str.c_str());
+#else
+    setenv(name, str.c_str(), 1);
+#endif
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    // A memory-bound chain of stages, each computed root and
+    // parallelized over rows, so that each stage reads the tiles the
+    // previous stage wrote. With thread affinity on, the rows each NUMA
+    // node produces should also be the rows it consumes.
+    const int W = 2048, H = 2048;
+    Var x, y;
+    Func f[4];
+    f[0](x, y) = cast<float>(x + y);
+    for (int i = 1; i < 4; i++) {
+        f[i](x, y) = (f[i - 1](x, y) + f[i - 1](x + 1, y)) * 0.5f;
+    }
+    for (int i = 0; i < 4; i++) {
+        f[i].compute_root().parallel(y).vectorize(x, 8);
+    }
+
+    Pipeline p(f[3]);
+    Buffer<float> out(W, H);
+
+    // Powers of two, then the whole machine.
+    int max_threads = (int)std::thread::hardware_concurrency();
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) {
+        thread_counts.push_back(t);
+    }
+    thread_counts.push_back(std::max(max_threads, 1));
+
+    Buffer<float> reference;
+    for (int affinity = 0; affinity <= 1; affinity++) {
+        set_env("HL_THREAD_AFFINITY", affinity);
+
+        double serial_time = 0;
+        for (int t : thread_counts) {
+            set_env("HL_NUM_THREADS", t);
+            p.invalidate_cache();
+            Halide::Internal::JITSharedRuntime::release_all();
+
+            p.compile_jit();
+            p.realize(out);
+            double time = benchmark([&]() { p.realize(out); });
+
+            if (t == 1) {
+                serial_time = time;
+            }
+            printf("affinity %s, %d threads: %f ms (speedup %f)\n",
+                   affinity ? "on" : "off", t, time * 1e3, serial_time / time);
+
+            if (!reference.defined()) {
+                reference = out.copy();
+            } else {
+                for (int yy = 0; yy < H; yy++) {
+                    for (int xx = 0; xx < W; xx++) {
+                        if (out(xx, yy) != reference(xx, yy)) {
+                            printf("out(%d, %d) = %f instead of %f\n",
+                                   xx, yy, out(xx, yy), reference(xx, yy));
+                            return -1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
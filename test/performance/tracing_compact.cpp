@@ -0,0 +1,229 @@
+#include "Halide.h"
+#include "HalideTraceUtils.h"
+#include "halide_benchmark.h"
+#include "halide_test_dirs.h"
+
+#include <cstdio>
+#include <set>
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+// Read the trace settings from the environment the next time the
+// runtime is used.
+void set_trace_env(const std::string &trace_file, int compact) {
+    static char file_buf[1024], compact_buf[32];
+    snprintf(file_buf, sizeof(file_buf), "HL_TRACE_FILE=%s", trace_file.c_str());
+    snprintf(compact_buf, sizeof(compact_buf), "HL_TRACE_COMPACT=%d", compact);
+    putenv(file_buf);
+    putenv(compact_buf);
+    Halide::Internal::JITSharedRuntime::release_all();
+}
+
+struct Event {
+    halide_trace_event_code_t event;
+    std::string func;
+    halide_type_t type;
+    int value_index;
+    std::vector<int> coords;
+    std::vector<uint8_t> value;
+
+    bool operator==(const Event &other) const {
+        return (event == other.event &&
+                func == other.func &&
+                type == other.type &&
+                value_index == other.value_index &&
+                coords == other.coords &&
+                value == other.value);
+    }
+};
+
+// Decode a trace in either format with TraceReader.
+std::vector<Event> read_events(const std::string &trace_file) {
+    std::vector<Event> events;
+    FILE *f = fopen(trace_file.c_str(), "rb");
+    if (!f) {
+        return events;
+    }
+    Halide::Internal::TraceReader reader(f);
+    Halide::Internal::Packet p;
+    while (reader.read(p)) {
+        Event e;
+        e.event = p.event;
+        e.func = p.func();
+        e.type = p.type;
+        e.value_index = p.value_index;
+        e.coords.assign(p.coordinates(), p.coordinates() + p.dimensions);
+        // Only loads and stores are guaranteed to carry a value.
+        if (p.event == halide_trace_load || p.event == halide_trace_store) {
+            const uint8_t *value = (const uint8_t *)p.value();
+            e.value.assign(value, value + p.type.lanes * p.type.bytes());
+        }
+        events.push_back(e);
+    }
+    fclose(f);
+    return events;
+}
+
+// Trace a serial pipeline in both formats, and check that the compact
+// trace decodes to the same events as the packet one, with the right
+// values.
+bool check_round_trip() {
+    Var x("x"), y("y");
+    Func g("g"), h("h");
+    g(x, y) = x * y;
+    h(x, y) = cast<float>(g(x, y)) + 0.5f;
+    g.compute_root().trace_stores().trace_loads().trace_realizations();
+    h.trace_stores().trace_realizations();
+    Pipeline p(h);
+
+    const int W = 16, H = 16;
+    std::string trace_file = Internal::get_test_tmp_dir() + "tracing_compact_round_trip.bin";
+    std::vector<Event> events[2];
+    for (int compact = 0; compact <= 1; compact++) {
+        Internal::ensure_no_file_exists(trace_file);
+        set_trace_env(trace_file, compact);
+        p.invalidate_cache();
+        p.realize({W, H});
+        // Closes the trace file.
+        Halide::Internal::JITSharedRuntime::release_all();
+        events[compact] = read_events(trace_file);
+        Internal::file_unlink(trace_file);
+    }
+
+    if (events[0].size() != events[1].size()) {
+        printf("The compact trace has %d events instead of %d\n",
+               (int)events[1].size(), (int)events[0].size());
+        return false;
+    }
+    for (size_t i = 0; i < events[0].size(); i++) {
+        if (!(events[0][i] == events[1][i])) {
+            printf("Event %d of the compact trace (event %d of %s) doesn't match the packet trace (event %d of %s)\n",
+                   (int)i, (int)events[1][i].event, events[1][i].func.c_str(),
+                   (int)events[0][i].event, events[0][i].func.c_str());
+            return false;
+        }
+    }
+
+    std::set<std::string> funcs;
+    std::set<int> event_codes;
+    int h_stores = 0;
+    for (const Event &e : events[1]) {
+        funcs.insert(e.func);
+        event_codes.insert(e.event);
+        if (e.event == halide_trace_store && e.func == "h") {
+            const int lanes = e.type.lanes;
+            for (int lane = 0; lane < lanes; lane++) {
+                float value;
+                memcpy(&value, e.value.data() + lane * sizeof(float), sizeof(float));
+                int cx = e.coords[lane], cy = e.coords[lanes + lane];
+                float correct = cx * cy + 0.5f;
+                if (value != correct) {
+                    printf("Decoded store h(%d, %d) = %f instead of %f\n", cx, cy, value, correct);
+                    return false;
+                }
+                h_stores++;
+            }
+        }
+    }
+    if (!funcs.count("g") || !funcs.count("h")) {
+        printf("The decoded trace doesn't mention both g and h\n");
+        return false;
+    }
+    for (int code : {halide_trace_load, halide_trace_store,
+                     halide_trace_begin_realization, halide_trace_end_realization}) {
+        if (!event_codes.count(code)) {
+            printf("The decoded trace has no events with code %d\n", code);
+            return false;
+        }
+    }
+    if (h_stores != W * H) {
+        printf("Decoded %d stores to h instead of %d\n", h_stores, W * H);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Target target = get_jit_target_from_environment();
+    if (target.arch == Target::WebAssembly) {
+        printf("[SKIP] Performance tests are meaningless and/or misleading under WebAssembly interpreter.\n");
+        return 0;
+    }
+
+    if (!check_round_trip()) {
+        return -1;
+    }
+
+    // Every store in a parallel loop is traced, so the cost is
+    // dominated by writing the trace.
+    const int W = 512, H = 512, runs = 4;
+    Var x, y;
+    Func f;
+    f(x, y) = x + y;
+    f.parallel(y).trace_stores();
+
+    Buffer<int> out(W, H);
+    double times[2];
+    size_t sizes[2];
+    for (int compact = 0; compact <= 1; compact++) {
+        std::string trace_file = Internal::get_test_tmp_dir() + "tracing_compact.bin";
+        Internal::ensure_no_file_exists(trace_file);
+
+        set_trace_env(trace_file, compact);
+
+        Pipeline p(f);
+        p.invalidate_cache();
+        p.compile_jit();
+        p.realize(out);
+        times[compact] = benchmark(runs - 1, 1, [&]() { p.realize(out); });
+
+        // Closes the trace file.
+        Halide::Internal::JITSharedRuntime::release_all();
+        std::vector<char> trace = Internal::read_entire_file(trace_file);
+        sizes[compact] = trace.size();
+        Internal::file_unlink(trace_file);
+
+        printf("%s trace: %f ms per run, %d bytes\n",
+               compact ? "compact" : "packet", times[compact] * 1e3, (int)sizes[compact]);
+
+        if (compact) {
+            // Walk the chunks and count the packets.
+            size_t offset = 0, packets = 0;
+            while (offset < trace.size()) {
+                halide_trace_chunk_t header;
+                memcpy(&header, trace.data() + offset, sizeof(header));
+                if (header.magic != HALIDE_TRACE_CHUNK_MAGIC ||
+                    header.size < sizeof(header) ||
+                    header.size % 4 != 0 ||
+                    header.names_offset > header.size ||
+                    offset + header.size > trace.size()) {
+                    printf("Bad chunk at offset %d\n", (int)offset);
+                    return -1;
+                }
+                packets += header.packets;
+                offset += header.size;
+            }
+            if (packets < (size_t)(W * H * runs)) {
+                printf("Only %d packets in the trace instead of at least %d\n",
+                       (int)packets, W * H * runs);
+                return -1;
+            }
+        }
+    }
+
+    if (sizes[1] * 2 > sizes[0]) {
+        printf("Compact trace was not much smaller: %d bytes vs %d bytes\n",
+               (int)sizes[1], (int)sizes[0]);
+        return -1;
+    }
+
+    if (times[1] > times[0] * 1.5) {
+        printf("Compact tracing was much slower: %f ms vs %f ms\n",
+               times[1] * 1e3, times[0] * 1e3);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
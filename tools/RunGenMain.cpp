@@ -144,6 +144,20 @@ Flags:
         allocation during run; note that this may slow down execution, so
         benchmarks may be inaccurate if you combine --benchmark with this.
 
+    --profiler_trace=FILE:
+        Record a timeline of the run and write it to FILE as Chrome
+        trace-event JSON, for chrome://tracing or Perfetto. It shows the
+        Funcs seen by the sampling profiler, when each thread was working,
+        and the number of active threads and heap usage over time.
+        Per-Func totals, including how evenly the work was spread across
+        threads, are in the "halide" object at the end of the file. The
+        filter must be compiled with the 'profile' target feature.
+
+    --profiler_pprof=FILE:
+        Write the sampling profiler's per-Func time, heap usage and
+        per-thread busy time to FILE as a pprof profile. The filter must
+        be compiled with the 'profile' target feature.
+
     --default_input_buffers=VALUE:
         Specify the value for all otherwise-unspecified buffer inputs, in the
         same syntax in use above. If you omit =VALUE, "zero:auto" will be used.
@@ -381,6 +395,8 @@ int main(int argc, char **argv) {
     std::string default_input_buffers;
     std::string default_input_scalars;
     std::string benchmarks_flag_value;
+    std::string profiler_trace_path;
+    std::string profiler_pprof_path;
     for (int i = 1; i < argc; ++i) {
         if (argv[i][0] == '-') {
             const char *p = argv[i] + 1;  // skip -
@@ -441,6 +457,16 @@ int main(int argc, char **argv) {
                 if (!parse_scalar(flag_value, &benchmark_min_time)) {
                     fail() << "Invalid value for flag: " << flag_name;
                 }
+            } else if (flag_name == "profiler_trace") {
+                profiler_trace_path = flag_value;
+                if (profiler_trace_path.empty()) {
+                    fail() << "--profiler_trace requires a filename.";
+                }
+            } else if (flag_name == "profiler_pprof") {
+                profiler_pprof_path = flag_value;
+                if (profiler_pprof_path.empty()) {
+                    fail() << "--profiler_pprof requires a filename.";
+                }
             } else if (flag_name == "default_input_buffers") {
                 default_input_buffers = flag_value;
                 if (default_input_buffers.empty()) {
@@ -512,6 +538,14 @@ int main(int argc, char **argv) {
     // shouldn't be eagerly returning device memory.
     halide_reuse_device_allocations(nullptr, true);
 
+    if (!profiler_trace_path.empty()) {
+        // Enough for a few seconds of samples at the default rate, and
+        // for a million tasks.
+        if (halide_profiler_record_timeline(nullptr, 1 << 20) != 0) {
+            fail() << "Could not start recording a profiler timeline.";
+        }
+    }
+
     if (benchmark) {
         if (benchmarks_flag_value.empty()) {
             benchmarks_flag_value = "all";
@@ -532,6 +566,19 @@ int main(int argc, char **argv) {
                   << " bytes for output of " << r.megapixels_out() << " mpix.\n";
     }
 
+    if (!profiler_trace_path.empty() || !profiler_pprof_path.empty()) {
+        if (halide_profiler_get_state()->pipelines == nullptr) {
+            warn() << "The profiler has no data; was the filter compiled with the 'profile' target feature?";
+        }
+        // Any failure is reported through halide_error.
+        if (!profiler_trace_path.empty()) {
+            (void)halide_profiler_export(nullptr, profiler_trace_path.c_str(), halide_profiler_export_chrome_trace);
+        }
+        if (!profiler_pprof_path.empty()) {
+            (void)halide_profiler_export(nullptr, profiler_pprof_path.c_str(), halide_profiler_export_pprof);
+        }
+    }
+
     // Save the output(s), if necessary.
     r.save_outputs();
 
@@ -271,13 +271,18 @@ void finish_dump(map<string, FuncInfo> &func_info, BufferOutputOpts output_opts)
 void usage(char *const *argv) {
     const string usage =
         "Usage: " + string(argv[0]) +
-        " -i trace_file -t {png,jpg,pgm,tmp,mat}\n"
+        " -i trace_file -t {png,jpg,pgm,tmp,mat} [-f func] [-s begin_ns] [-e end_ns]\n"
         "\n"
         "This tool reads a binary trace produced by Halide, and dumps all\n"
         "Funcs into individual image files in the current directory.\n"
         "To generate a suitable binary trace, use Func::trace_stores(), or the\n"
         "target features trace_stores and trace_realizations, and run with\n"
-        "HL_TRACE_FILE=<filename>.\n";
+        "HL_TRACE_FILE=<filename>.\n"
+        "\n"
+        "-f dumps only the given Func. -s and -e only use the packets in the\n"
+        "given window of time, so -e dumps the values as of that time. They\n"
+        "need a trace written with HL_TRACE_COMPACT=1, and parts of the trace\n"
+        "that can't match are skipped without being decoded.\n";
     fprintf(stderr, "%s\n", usage.c_str());
     exit(1);
 }
@@ -285,6 +290,8 @@ void usage(char *const *argv) {
 int main(int argc, char *const *argv) {
     char *buf_filename = nullptr;
     char *buf_imagetype = nullptr;
+    char *func_filter = nullptr;
+    uint64_t begin_ns = 0, end_ns = (uint64_t)-1;
     BufferOutputOpts outputopts;
     for (int i = 1; i < argc - 1; i++) {
         string arg = argv[i];
@@ -294,6 +301,15 @@ int main(int argc, char *const *argv) {
         } else if (arg == "-i") {
             i++;
             buf_filename = argv[i];
+        } else if (arg == "-f") {
+            i++;
+            func_filter = argv[i];
+        } else if (arg == "-s") {
+            i++;
+            begin_ns = strtoull(argv[i], nullptr, 10);
+        } else if (arg == "-e") {
+            i++;
+            end_ns = strtoull(argv[i], nullptr, 10);
         }
     }
 
@@ -325,6 +341,15 @@ int main(int argc, char *const *argv) {
         exit(1);
     }
 
+    TraceReader reader(file_desc);
+    if (func_filter) {
+        reader.set_func_filter(func_filter);
+    }
+    reader.set_time_range(begin_ns, end_ns);
+    if (reader.build_index()) {
+        printf("[INFO] Indexed %d chunks of compact trace.\n", (int)reader.index().size());
+    }
+
     printf("[INFO] Starting parse of binary trace...\n");
     int packet_count = 0;
 
@@ -334,7 +359,7 @@ int main(int argc, char *const *argv) {
 
     for (;;) {
         Packet p;
-        if (!p.read_from_filedesc(file_desc)) {
+        if (!reader.read(p)) {
             printf("[INFO] Finished pass 1 after %d packets.\n", packet_count);
             break;
         }
@@ -361,6 +386,7 @@ int main(int argc, char *const *argv) {
         fprintf(stderr, "Error: couldn't seek back to beginning of trace file. Aborting.\n");
         exit(-1);
     }
+    reader.build_index();
 
     for (auto &pair : func_info) {
         pair.second.allocate();
@@ -368,7 +394,7 @@ int main(int argc, char *const *argv) {
 
     for (;;) {
         Packet p;
-        if (!p.read_from_filedesc(file_desc)) {
+        if (!reader.read(p)) {
             printf("[INFO] Finished pass 2 after %d packets.\n", packet_count);
             if (file_desc != nullptr) {
                 fclose(file_desc);
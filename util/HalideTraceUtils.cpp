@@ -1,4 +1,5 @@
 #include "HalideTraceUtils.h"
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
@@ -46,6 +47,308 @@ bool Packet::read(void *d, size_t size, FILE *fdesc) {
     return true;
 }
 
+namespace {
+
+void corrupt_trace_error() {
+    fprintf(stderr, "Corrupt chunk in trace stream\n");
+    exit(-1);
+}
+
+std::vector<std::string> parse_names(const uint8_t *begin, const uint8_t *end, uint32_t count) {
+    std::vector<std::string> result;
+    const uint8_t *p = begin;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *nul = (const uint8_t *)memchr(p, 0, end - p);
+        if (nul == nullptr) {
+            corrupt_trace_error();
+        }
+        result.emplace_back((const char *)p, nul - p);
+        p = nul + 1;
+    }
+    return result;
+}
+
+int64_t unzigzag(uint64_t x) {
+    return (int64_t)(x >> 1) ^ -(int64_t)(x & 1);
+}
+
+}  // namespace
+
+bool TraceReader::read_bytes(void *d, size_t size) {
+    if (!size) {
+        return true;
+    }
+    size_t s = fread(d, 1, size, fdesc);
+    if (s != size) {
+        if (ferror(fdesc)) {
+            perror("Failed during read");
+            exit(-1);
+        }
+        return false;  // EOF
+    }
+    return true;
+}
+
+void TraceReader::skip_bytes(size_t size) {
+    if (fseek(fdesc, (long)size, SEEK_CUR) == 0) {
+        return;
+    }
+    // Not seekable, e.g. a pipe.
+    uint8_t buf[4096];
+    while (size) {
+        size_t n = std::min(size, sizeof(buf));
+        if (!read_bytes(buf, n)) {
+            fprintf(stderr, "Unexpected EOF mid-chunk\n");
+            exit(-1);
+        }
+        size -= n;
+    }
+}
+
+bool TraceReader::wants_chunk(const halide_trace_chunk_t &header, const std::vector<std::string> &chunk_names) const {
+    if (header.end_ns < begin_ns || header.begin_ns > end_ns) {
+        return false;
+    }
+    if (func_filter.empty()) {
+        return true;
+    }
+    for (const auto &n : chunk_names) {
+        if (n == func_filter) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::next_chunk_from_index() {
+    while (next_chunk < chunk_index.size()) {
+        const ChunkInfo &info = chunk_index[next_chunk++];
+        if (wants_chunk(info.header, info.names)) {
+            if (fseek(fdesc, info.offset, SEEK_SET) != 0) {
+                perror("Failed during seek");
+                exit(-1);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::build_index() {
+    chunk_index.clear();
+    indexed = false;
+    if (fseek(fdesc, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    bool ok = true;
+    while (true) {
+        long offset = ftell(fdesc);
+        halide_trace_chunk_t header;
+        size_t n = fread(&header, 1, sizeof(header), fdesc);
+        if (n == 0) {
+            break;
+        }
+        if (n != sizeof(header) ||
+            header.magic != HALIDE_TRACE_CHUNK_MAGIC ||
+            header.names_offset < sizeof(header) ||
+            header.names_offset > header.size) {
+            ok = false;
+            break;
+        }
+        std::vector<uint8_t> name_bytes(header.size - header.names_offset);
+        if (fseek(fdesc, offset + header.names_offset, SEEK_SET) != 0 ||
+            !read_bytes(name_bytes.data(), name_bytes.size())) {
+            ok = false;
+            break;
+        }
+        ChunkInfo info;
+        info.offset = offset;
+        info.header = header;
+        info.names = parse_names(name_bytes.data(), name_bytes.data() + name_bytes.size(), header.num_names);
+        chunk_index.push_back(std::move(info));
+    }
+    clearerr(fdesc);
+    fseek(fdesc, 0, SEEK_SET);
+    if (!ok) {
+        chunk_index.clear();
+        return false;
+    }
+    indexed = true;
+    next_chunk = 0;
+    packets_left = 0;
+    return true;
+}
+
+uint64_t TraceReader::get_varint() {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (cursor >= packets_end) {
+            corrupt_trace_error();
+        }
+        uint8_t b = chunk[cursor++];
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return result;
+        }
+    }
+    corrupt_trace_error();
+    return 0;
+}
+
+void TraceReader::decode(halide_trace_packet_t *dst, size_t capacity) {
+    if (cursor >= packets_end) {
+        corrupt_trace_error();
+    }
+    uint8_t flags = chunk[cursor++];
+    uint64_t name_index = get_varint();
+    if (name_index >= names.size()) {
+        corrupt_trace_error();
+    }
+    const std::string &name = names[name_index];
+    int32_t id = (int32_t)(prev_id + unzigzag(get_varint()));
+    int32_t parent_id = (int32_t)(prev_parent_id + unzigzag(get_varint()));
+    int32_t value_index = (int32_t)get_varint();
+    if (cursor + 2 > packets_end) {
+        corrupt_trace_error();
+    }
+    halide_type_t type;
+    type.code = (halide_type_code_t)chunk[cursor++];
+    type.bits = chunk[cursor++];
+    type.lanes = (uint16_t)get_varint();
+
+    uint64_t dimensions = get_varint();
+    if (dimensions > capacity / sizeof(int32_t)) {
+        corrupt_trace_error();
+    }
+    coords.resize(dimensions);
+    for (uint64_t i = 0; i < dimensions; i++) {
+        int64_t c = unzigzag(get_varint());
+        if (i < 16) {
+            c += prev_coords[i];
+            prev_coords[i] = (int32_t)c;
+        }
+        coords[i] = (int32_t)c;
+    }
+
+    size_t value_bytes = (flags & 0x80) ? type.lanes * type.bytes() : 0;
+    if (cursor + value_bytes > packets_end) {
+        corrupt_trace_error();
+    }
+    const uint8_t *value = chunk.data() + cursor;
+    cursor += value_bytes;
+
+    size_t tag_bytes = 0;
+    const uint8_t *tag = nullptr;
+    if (flags & 0x40) {
+        tag_bytes = get_varint();
+        if (cursor + tag_bytes > packets_end) {
+            corrupt_trace_error();
+        }
+        tag = chunk.data() + cursor;
+        cursor += tag_bytes;
+    }
+    current_ns += get_varint();
+    prev_id = id;
+    prev_parent_id = parent_id;
+
+    size_t coords_bytes = dimensions * sizeof(int32_t);
+    size_t size = sizeof(halide_trace_packet_t) + coords_bytes + value_bytes + name.size() + 1 + tag_bytes + 1;
+    size = (size + 3) & ~3;
+    if (size > capacity) {
+        fprintf(stderr, "Packet larger than %d bytes in trace stream (%d)\n", (int)capacity, (int)size);
+        exit(-1);
+    }
+
+    dst->size = (uint32_t)size;
+    dst->id = id;
+    dst->type = type;
+    dst->event = (halide_trace_event_code_t)(flags & 0x3f);
+    dst->parent_id = parent_id;
+    dst->value_index = value_index;
+    dst->dimensions = (int32_t)dimensions;
+    memcpy(dst->coordinates(), coords.data(), coords_bytes);
+    memcpy(dst->value(), value, value_bytes);
+    memcpy(dst->func(), name.c_str(), name.size() + 1);
+    char *dst_tag = dst->trace_tag();
+    if (tag_bytes) {
+        memcpy(dst_tag, tag, tag_bytes);
+    }
+    dst_tag[tag_bytes] = 0;
+}
+
+bool TraceReader::read(halide_trace_packet_t *dst, size_t capacity) {
+    while (true) {
+        while (packets_left > 0) {
+            packets_left--;
+            decode(dst, capacity);
+            if (current_ns < begin_ns || current_ns > end_ns) {
+                continue;
+            }
+            if (!func_filter.empty() && func_filter != dst->func()) {
+                continue;
+            }
+            return true;
+        }
+
+        if (indexed && !next_chunk_from_index()) {
+            return false;
+        }
+
+        halide_trace_chunk_t header;
+        if (!read_bytes(&header.magic, sizeof(header.magic))) {
+            return false;  // EOF
+        }
+
+        if (header.magic != HALIDE_TRACE_CHUNK_MAGIC) {
+            // It's a halide_trace_packet_t, and that was its size.
+            uint32_t size = header.magic;
+            if (size < sizeof(halide_trace_packet_t) || size > capacity) {
+                fprintf(stderr, "Packet larger than %d bytes in trace stream (%d)\n", (int)capacity, (int)size);
+                exit(-1);
+            }
+            dst->size = size;
+            if (!read_bytes(&dst->id, size - sizeof(header.magic))) {
+                fprintf(stderr, "Unexpected EOF mid-packet\n");
+                return false;
+            }
+            current_ns = 0;
+            if (!func_filter.empty() && func_filter != dst->func()) {
+                continue;
+            }
+            return true;
+        }
+
+        if (!read_bytes(&header.size, sizeof(header) - sizeof(header.magic))) {
+            fprintf(stderr, "Unexpected EOF mid-chunk\n");
+            return false;
+        }
+        if (header.names_offset < sizeof(header) || header.names_offset > header.size) {
+            corrupt_trace_error();
+        }
+        if (header.end_ns < begin_ns || header.begin_ns > end_ns) {
+            skip_bytes(header.size - sizeof(header));
+            continue;
+        }
+        chunk.resize(header.size);
+        memcpy(chunk.data(), &header, sizeof(header));
+        if (!read_bytes(chunk.data() + sizeof(header), header.size - sizeof(header))) {
+            fprintf(stderr, "Unexpected EOF mid-chunk\n");
+            return false;
+        }
+        names = parse_names(chunk.data() + header.names_offset, chunk.data() + header.size, header.num_names);
+        if (!wants_chunk(header, names)) {
+            continue;
+        }
+        cursor = sizeof(header);
+        packets_end = header.names_offset;
+        packets_left = header.packets;
+        prev_id = header.first_id;
+        prev_parent_id = 0;
+        memset(prev_coords, 0, sizeof(prev_coords));
+        current_ns = header.begin_ns;
+    }
+}
+
 void bad_type_error(halide_type_t type) {
     fprintf(stderr, "Can't convert packet with type: %d bits: %d\n", type.code, type.bits);
     exit(-1);
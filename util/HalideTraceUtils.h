@@ -4,6 +4,8 @@
 #include "HalideRuntime.h"
 #include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 
 namespace Halide {
 namespace Internal {
@@ -94,6 +96,88 @@ private:
     bool read(void *d, size_t size, FILE *fdesc);
 };
 
+// Reads the packets of a binary trace, whether it was written as
+// halide_trace_packet_t structs, in the compact format described at
+// halide_trace_chunk_t, or a mix of the two. Packets in compact chunks
+// are decoded back into halide_trace_packet_t form.
+class TraceReader {
+public:
+    explicit TraceReader(FILE *fdesc)
+        : fdesc(fdesc) {
+    }
+
+    // Read the next packet that passes the filters into dst, which
+    // has room for capacity bytes. Returns false at the end of the
+    // trace.
+    bool read(halide_trace_packet_t *dst, size_t capacity);
+
+    bool read(Packet &p) {
+        return read(&p, sizeof(p));
+    }
+
+    // The time of the last packet read, in nanoseconds, if it came
+    // from a compact chunk. Zero otherwise.
+    uint64_t time_ns() const {
+        return current_ns;
+    }
+
+    // Only return packets for the given Func. Compact chunks that
+    // don't mention it are skipped without being decoded.
+    void set_func_filter(const std::string &func) {
+        func_filter = func;
+    }
+
+    // Only return packets from compact chunks with times in [begin,
+    // end]. Chunks entirely outside of the range are skipped without
+    // being decoded, and without being read if the file is seekable.
+    void set_time_range(uint64_t begin, uint64_t end) {
+        begin_ns = begin;
+        end_ns = end;
+    }
+
+    struct ChunkInfo {
+        long offset;
+        halide_trace_chunk_t header;
+        std::vector<std::string> names;
+    };
+
+    // Scan the chunk headers and name tables of a seekable compact
+    // trace from the start, and rewind it. Once built, reads jump
+    // straight from one chunk that passes the filters to the
+    // next. Returns false if the trace is not seekable or contains
+    // halide_trace_packet_t records.
+    bool build_index();
+
+    const std::vector<ChunkInfo> &index() const {
+        return chunk_index;
+    }
+
+private:
+    FILE *fdesc;
+    std::string func_filter;
+    uint64_t begin_ns = 0, end_ns = (uint64_t)-1;
+    uint64_t current_ns = 0;
+
+    // The compact chunk being decoded.
+    std::vector<uint8_t> chunk;
+    std::vector<std::string> names;
+    size_t cursor = 0, packets_end = 0, packets_left = 0;
+    int32_t prev_id = 0, prev_parent_id = 0;
+    int32_t prev_coords[16];
+    std::vector<int32_t> coords;
+
+    std::vector<ChunkInfo> chunk_index;
+    bool indexed = false;
+    size_t next_chunk = 0;
+
+    bool read_bytes(void *d, size_t size);
+    void skip_bytes(size_t size);
+    bool wants_chunk(const halide_trace_chunk_t &header, const std::vector<std::string> &chunk_names) const;
+    bool next_chunk_from_index();
+    uint64_t get_varint();
+    void decode(halide_trace_packet_t *dst, size_t capacity);
+};
+
 }  // namespace Internal
 }  // namespace Halide
 
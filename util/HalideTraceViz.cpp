@@ -24,6 +24,7 @@
 #endif
 
 #include "HalideRuntime.h"
+#include "HalideTraceUtils.h"
 #include "inconsolata.h"
 
 #include "halide_trace_config.h"
@@ -157,34 +158,13 @@ T get_value_as(const halide_trace_packet_t &p, int idx) {
 struct PacketAndPayload : public halide_trace_packet_t {
     uint8_t payload[4096];
 
-    static bool read_or_die(void *buf, size_t count) {
-        char *p = (char *)buf;
-        char *p_end = p + count;
-        while (p < p_end) {
-            int64_t bytes_read = ::read(STDIN_FILENO, p, p_end - p);
-            if (bytes_read == 0) {
-                return false;  // EOF
-            } else if (bytes_read < 0) {
-                fail() << "Unable to read packet";
-            }
-            p += bytes_read;
-        }
-        assert(p == p_end);
-        return true;
-    }
-
+    // Read the next packet from stdin, in either trace format. The
+    // whole trace is always read: the visualization needs every
+    // pipeline and realization event from the start, so there is no
+    // seeking by Func or time as in HalideTraceDump.
     bool read() {
-        constexpr size_t header_size = sizeof(halide_trace_packet_t);
-        if (!read_or_die(this, header_size)) {
-            return false;  // EOF
-        }
-
-        const size_t payload_size = this->size - header_size;
-        if (payload_size > sizeof(this->payload) || !read_or_die(this->payload, payload_size)) {
-            // Shouldn't ever get EOF here
-            fail() << "Unable to read packet payload of size " << payload_size;
-        }
-        return true;
+        static Halide::Internal::TraceReader reader(stdin);
+        return reader.read(this, sizeof(*this));
     }
 };
 
@@ -294,7 +274,9 @@ std::string usage() {
 HalideTraceViz accepts Halide-generated binary tracing packets from
 stdin, and outputs them as raw 8-bit rgba32 pixel values to
 stdout. You should pipe the output of HalideTraceViz into a video
-encoder or player.
+encoder or player. Traces written with HL_TRACE_COMPACT=1 work too,
+but their packets are grouped by thread rather than interleaved, so
+parallel work is drawn one thread's worth at a time.
 
 E.g. to encode a video:
  HL_TARGET=host-trace_all <command to make pipeline> && \